@@ -1,8 +1,13 @@
 // GLOBALS
 var date = new Date();
 var chart;
+// Today's log while it's displayed, polled for the records appended to it
+// and the ones not written to it yet
+var tail;
 // END GLOBALS
 
+const TAIL_INTERVAL_MILLIS = 60 * 1000;
+
 /**
  * Moves the displayed period to the previous day
  */
@@ -22,38 +27,237 @@ function later() {
 }
 
 /** 
-* Decodes a single data point and returns values as JSON 
+ * Layout of PM logs written before schema.json files were introduced.
+ * A schema lists the channels of each record in order. 
+ * The value of a channel is its raw value multiplied by 10^scale.
+ * A channel of type "presence" is a bitmap of the channels present in the record,
+ * bit i standing for channel i. Missing channels are decoded as null.
+ */
+const DEFAULT_SCHEMA = {
+  channels: [
+    { name: "pm1", type: "uint16", scale: 0 },
+    { name: "pm2_5", type: "uint16", scale: 0 },
+    { name: "pm10", type: "uint16", scale: 0 }
+  ]
+};
+
+/** Converts raw 16-bit channel values into a data point described by the schema */
+function toDataPoint(schema, timestamp, values) {
+  var point = { timestamp: timestamp };
+  var present = 0xFFFF;
+  schema.channels.forEach((channel, i) => {
+    if (channel.type == "presence" && values[i] !== undefined)
+      present = values[i];
+  });
+  schema.channels.forEach((channel, i) => {
+    var value = values[i];
+    if (value === undefined || (present & (1 << i)) == 0)
+      value = null;
+    else {
+      if (channel.type == "int16" && value >= 0x8000)
+        value -= 0x10000;
+      value = channel.scale == 0 ? value : value * Math.pow(10, channel.scale);
+    }
+    point[channel.name] = value;
+  });
+  return point;
+}
+
+/** 
+* Decodes raw channel values of a single uncompressed frame
 * @param array raw data from the backend
-* @param offset position in the stream 
+* @param offset position of the frame length in the stream 
 */
 function decodeFrame(dataView, offset) {
-  const timestamp = dataView.getUint32(offset, true);
-  const pm1 = dataView.getUint16(offset + 4, true);
-  const pm2_5 = dataView.getUint16(offset + 6, true);
-  const pm10 = dataView.getUint16(offset + 8, true);
-  return { timestamp: timestamp,               
-          pm1: pm1, pm2_5: pm2_5, pm10: pm10 };     
+  const framelen = dataView.getUint8(offset);
+  var values = [];
+  for (var pos = offset + 5; pos + 1 <= offset + framelen; pos += 2)
+    values.push(dataView.getUint16(pos, true));
+  return { timestamp: dataView.getUint32(offset + 1, true), values: values };
+}
+
+// Compressed block format, see src/LogBlock.h
+const BLOCK_MARKER = 0xB7;
+const BLOCK_HEADER_SIZE = 9;
+const BLOCK_TRAILER_SIZE = 2;
+const BLOCK_MAX_CHANNELS = 8;
+const BLOCK_MAX_SIZE = 1024;
+// Footer of a sealed day file, see src/LogSeal.h
+const SEAL_MARKER = 0xB5;
+const SEAL_HEADER_SIZE = 9;
+const SEAL_TRAILER_SIZE = 4;
+// Uncompressed frame lengths, see src/LogScanner.h
+const FRAME_MIN_LENGTH = 4 + 2;
+const FRAME_MAX_LENGTH = 4 + 2 * BLOCK_MAX_CHANNELS;
+// Uncompressed frames with an older timestamp are garbage (2019-01-01)
+const MIN_TIMESTAMP = 1546300800;
+
+/** 
+ * Computes CRC-16/CCITT-FALSE of a range of bytes. 
+ * A stored checksum of 0 means the data was written without a checksum.
+ */
+function crc16(dataView, offset, length) {
+  var crc = 0xFFFF;
+  for (var i = 0; i < length; i++) {
+    crc ^= dataView.getUint8(offset + i) << 8;
+    for (var bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+  }
+  return crc;
+}
+
+/** Checks the checksum stored in the 2 bytes after the given range */
+function checksumValid(dataView, offset, length) {
+  const crc = dataView.getUint16(offset + length, true);
+  return crc == 0 || crc == crc16(dataView, offset, length);
+}
+
+/** Reads unsigned numbers from a bit stream, most significant bit first */
+function bitReader(dataView, offset, end) {
+  var pos = offset * 8;
+  const endPos = end * 8;
+  return function(bits) {
+    if (pos + bits > endPos)
+      throw new RangeError("Unexpected end of block");
+    var value = 0;
+    for (var i = 0; i < bits; i++) {
+      const bit = (dataView.getUint8(pos >> 3) >> (7 - (pos & 7))) & 1;
+      value = value * 2 + bit;
+      pos++;
+    }
+    return value;
+  }
+}
+
+/** Reads a size code followed by a zig-zag encoded number */
+function readZigZag(read, sizes) {
+  var code = 0;
+  while (code < sizes.length - 1 && read(1) == 1)
+    code++;
+  const z = code == 0 ? 0 : read(sizes[code]);
+  return z % 2 == 0 ? z / 2 : -(z + 1) / 2;
+}
+
+/** 
+ * Decodes all records of a compressed block.
+ * Returns the block size and the list of decoded records or null if there is no valid block at offset.
+ */
+function decodeBlock(dataView, offset) {
+  if (offset + BLOCK_HEADER_SIZE + BLOCK_TRAILER_SIZE > dataView.byteLength)
+    return null;
+  const size = dataView.getUint16(offset + 1, true);
+  const count = dataView.getUint8(offset + 3);
+  const channels = dataView.getUint8(offset + 4);
+  if (size < BLOCK_HEADER_SIZE + BLOCK_TRAILER_SIZE || size > BLOCK_MAX_SIZE || 
+      offset + size > dataView.byteLength || count == 0 || channels > BLOCK_MAX_CHANNELS || 
+      !checksumValid(dataView, offset, size - BLOCK_TRAILER_SIZE))
+    return null;
+
+  const read = bitReader(dataView, offset + BLOCK_HEADER_SIZE, offset + size - BLOCK_TRAILER_SIZE);
+  var timestamp = dataView.getUint32(offset + 5, true);
+  var delta = 0;
+  var values = new Array(channels).fill(0);
+  var records = [];
+  try {
+    for (var i = 0; i < count; i++) {
+      if (i > 0) {
+        delta += readZigZag(read, [0, 7, 12, 32]);
+        timestamp += delta;
+      }
+      for (var c = 0; c < channels; c++) 
+        values[c] = (values[c] + readZigZag(read, [0, 4, 8, 16])) & 0xFFFF;
+      records.push({ timestamp: timestamp, values: values.slice() });
+    }
+  }
+  catch (e) {
+    return null;
+  }
+  return { size: size, records: records };
+}
+
+/** Checks if a byte can start a compressed block, a seal or an uncompressed frame */
+function isCandidate(b) {
+  return b == BLOCK_MARKER || b == SEAL_MARKER || 
+    (b >= FRAME_MIN_LENGTH && b <= FRAME_MAX_LENGTH && b % 2 == 0);
+}
+
+/** 
+ * Checks if there is a plausible uncompressed frame at offset. 
+ * Frames have no checksum, their last bytes hold channel values in older logs,
+ * so a frame is only trusted if the data ends or something valid may follow it.
+ */
+function frameValid(dataView, offset) {
+  const framelen = dataView.getUint8(offset);
+  const end = offset + framelen + 1;
+  if (framelen < FRAME_MIN_LENGTH || framelen > FRAME_MAX_LENGTH || framelen % 2 != 0 || end > dataView.byteLength)
+    return false;
+  return dataView.getUint32(offset + 1, true) >= MIN_TIMESTAMP && 
+    (end == dataView.byteLength || isCandidate(dataView.getUint8(end)));
 }
 
-/** Decodes a stream of measurements into an array of decoded frames */
-function decode(dataView) {
+/** Returns the size of the valid sealed file footer at offset, or 0 if there is none */
+function sealSize(dataView, offset) {
+  if (offset + SEAL_HEADER_SIZE + SEAL_TRAILER_SIZE > dataView.byteLength)
+    return 0;
+  const size = dataView.getUint16(offset + 1, true);
+  if (size < SEAL_HEADER_SIZE + SEAL_TRAILER_SIZE || offset + size > dataView.byteLength || 
+      dataView.getUint16(offset + size - 4, true) != size || 
+      dataView.getUint16(offset + size - 2, true) != crc16(dataView, offset, size - 2))
+    return 0;
+  return size;
+}
+
+/** 
+ * Decodes a stream of measurements into an array of data points with channels described by the schema.
+ * Understands both compressed blocks and the older uncompressed frames.
+ * Corrupted data is skipped up to the next valid block or frame.
+ * @param prevTimestamp time of the record preceding the data, if it continues
+ * data decoded earlier, so that a gap between them is shown too
+ */
+function decode(dataView, schema, prevTimestamp) {
   var offset = 0;
   var result = [];
-  var prevFrame;
+  var corrupt = 0;
+  var skipping = false;
+  const push = function(frame) {
+    if (prevTimestamp && frame.timestamp - prevTimestamp > 15 * 60) {
+      result.push(toDataPoint(schema, null, []));
+    }
+    result.push(toDataPoint(schema, frame.timestamp, frame.values));
+    prevTimestamp = frame.timestamp;
+  }
   while (offset < dataView.byteLength) { 
     const framelen = dataView.getUint8(offset);
-    if (framelen != 12) {
+    if (framelen == BLOCK_MARKER) {
+      const block = decodeBlock(dataView, offset);
+      if (block != null) {
+        block.records.forEach(push);
+        offset += block.size;
+        skipping = false;
+        continue;
+      }
+    }
+    if (framelen == SEAL_MARKER) {
+      const size = sealSize(dataView, offset);
+      if (size > 0) {
+        offset += size;
+        skipping = false;
+        continue;
+      }
+    }
+    if (!frameValid(dataView, offset)) {
+      if (!skipping) 
+        corrupt++;
+      skipping = true;
       offset += 1;
       continue;
     }        
-    const frame = decodeFrame(dataView, offset + 1);
-    if (prevFrame && frame.timestamp - prevFrame.timestamp > 15 * 60) {
-      result.push({ timestamp: null, pm1: null, pm2_5: null, pm10: null });
-    }
-    result.push(frame);
+    push(decodeFrame(dataView, offset));
     offset += framelen + 1;
-    prevFrame = frame;
+    skipping = false;
   }
+  if (corrupt > 0)
+    console.log("Skipped " + corrupt + " corrupted fragments of the log");
   return result;
 }
 
@@ -69,19 +273,63 @@ function displayDate(date) {
   document.getElementById("date").innerHTML = dateStr;
 }
 
-/** Fetches history of measurements from the server */
-async function fetchData(date) {  
+/** 
+ * Fetches history of measurements of a log, e.g. "env", from the server,
+ * starting at the given byte offset of the log file of the day.
+ * The server may ignore the offset and respond with the whole log (200)
+ * or have no bytes past it (416).
+ * Returns the response, or null if there is no log for the given date.
+ */
+async function fetchData(log, date, offset) {  
   const dd = String(date.getDate()).padStart(2, '0');
   const mm = String(date.getMonth() + 1).padStart(2, '0');
   const yyyy = date.getFullYear();    
   const dateStr = (yyyy + "-" + mm + "-" + dd);    
-  const response = await fetch("../log/pm/" + dateStr);
-  if (response.status == 200)
-    return new DataView(await response.arrayBuffer());
-  console.log("Failed to fetch data: " + response.status);
-  return new DataView(new ArrayBuffer(0));
+  const headers = offset > 0 ? { "Range": "bytes=" + offset + "-" } : {};
+  const response = await fetch("../log/" + log + "/" + dateStr, { headers: headers });
+  if (response.status == 200 || response.status == 206 || response.status == 416)
+    return response;
+  console.log("Failed to fetch " + log + " data: " + response.status);
+  return null;
 } 
 
+/**
+ * Fetches the records of a log in [from, to), in unix time, as data points,
+ * including the ones the server keeps in RAM until it writes them to the log file.
+ * A gap after prevTimestamp is shown like in decode.
+ * Returns null if the server can't answer now, e.g. while busy with another query.
+ */
+async function fetchRecent(log, from, to, schema, prevTimestamp) {
+  const response = await fetch("../export.ndjson?log=" + log + "&from=" + from + "&to=" + to);
+  if (response.status != 200)
+    return null;
+  const text = await response.text();
+  var result = [];
+  text.split("\n").forEach(line => {
+    if (line.length == 0)
+      return;
+    const row = JSON.parse(line);
+    if (prevTimestamp && row.time - prevTimestamp > 15 * 60)
+      result.push(toDataPoint(schema, null, []));
+    var point = { timestamp: row.time };
+    schema.channels.forEach(channel => {
+      if (channel.type != "presence")
+        point[channel.name] = row[channel.name] !== undefined ? row[channel.name] : null;
+    });
+    result.push(point);
+    prevTimestamp = row.time;
+  });
+  return result;
+}
+
+/** Fetches the description of the channels of a log, e.g. "pm" */
+async function fetchSchema(log) {
+  const response = await fetch("../log/" + log + "/schema.json");
+  if (response.status == 200)
+    return await response.json();
+  return DEFAULT_SCHEMA;
+}
+
 function toDataSet(data, valueF) {
   return data.map(d => ({ x: new Date(d.timestamp * 1000.0), y: valueF(d) }));
 }
@@ -128,6 +376,20 @@ function prepareDataSets(measurements) {
         backgroundColor: 'rgba(255, 240, 100, 1)', 
         data: dataSetPm10(measurements) }, 
         dataSetOptions),
+      Object.assign({ 
+        label: 'Temperature', 
+        borderColor: '#1060C0', 
+        backgroundColor: 'rgba(60, 130, 220, 1)', 
+        yAxisID: 'th',
+        data: dataSetTemperature(measurements) }, 
+        dataSetOptions),
+      Object.assign({ 
+        label: 'Humidity', 
+        borderColor: '#60A0A0', 
+        backgroundColor: 'rgba(120, 190, 190, 1)', 
+        yAxisID: 'th',
+        data: dataSetHumidity(measurements) }, 
+        dataSetOptions),
     ]
   }
 }
@@ -165,6 +427,7 @@ function initChart(measurements, startTime, endTime) {
           }
         }],      
         yAxes: [{                         
+          id: 'pm',
           scaleLabel: {
             display: true,
             labelString: 'μg/m³'
@@ -180,6 +443,21 @@ function initChart(measurements, startTime, endTime) {
             z: 1,
             color: "rgba(70, 70, 70, 0.08)"
           }
+        }, {
+          id: 'th',
+          position: 'right',
+          scaleLabel: {
+            display: true,
+            labelString: '°C / %'
+          },
+          ticks: {
+            fontSize: 13,
+            suggestedMin: 0,
+            suggestedMax: 100,
+          },
+          gridLines: {
+            drawOnChartArea: false
+          }
         }]
       }
     }
@@ -199,17 +477,92 @@ function updateChart(measurements, startTime, endTime) {
  * If the chart doesn't exist yet, it is initialized.
  */
 async function drawChart() {
-  var startTime = new Date(date);
+  if (tail != null) {
+    clearInterval(tail.timer);
+    tail = null;
+  }
+  const shown = new Date(date);
+  var startTime = new Date(shown);
   startTime.setHours(0,0,0,0);
   var endTime = new Date(startTime);
   endTime.setDate(startTime.getDate() + 1);        
-  const stream = await fetchData(date);
-  const measurements = decode(stream);
+  // Days logged before the combined env log have PM data only
+  var log = "env";
+  var response = await fetchData(log, shown, 0);
+  if (response == null) {
+    log = "pm";
+    response = await fetchData(log, shown, 0);
+    if (response == null)
+      log = "env";
+  }
+  const schema = await fetchSchema(log);
+  const data = response != null ? await response.arrayBuffer() : new ArrayBuffer(0);
+  const measurements = decode(new DataView(data), schema);
+  // Another day was chosen in the meantime
+  if (shown.getTime() != date.getTime())
+    return;
   
   if (chart == null) 
     initChart(measurements, startTime, endTime);
   else 
     updateChart(measurements, startTime, endTime);
+
+  // Today's log grows, but only the bytes appended to it are fetched again
+  if (startTime.getTime() == new Date().setHours(0,0,0,0)) {
+    tail = { 
+      log: log, date: shown, schema: schema, offset: data.byteLength, 
+      measurements: measurements, pending: [], startTime: startTime, endTime: endTime 
+    };
+    tail.timer = setInterval(pollTail, TAIL_INTERVAL_MILLIS);
+    pollTail();
+  }
+}
+
+/** 
+ * Adds the records appended to today's log since the last fetch to the chart,
+ * followed by the records not written to the log file yet. Those are fetched 
+ * again on every poll until they show up in the file.
+ */
+async function pollTail() {
+  const current = tail;
+  if (current == null)
+    return;
+  // The log of a past day doesn't grow, but it may be rewritten when it's sealed
+  if (current.startTime.getTime() != new Date().setHours(0,0,0,0)) {
+    clearInterval(current.timer);
+    tail = null;
+    return;
+  }
+  const response = await fetchData(current.log, current.date, current.offset);
+  if (response == null)
+    return;
+  if (response.status != 416) {
+    const data = await response.arrayBuffer();
+    if (current != tail)
+      return;
+    if (response.status == 206) {
+      const last = current.measurements[current.measurements.length - 1];
+      const added = decode(new DataView(data), current.schema, last ? last.timestamp : null);
+      current.measurements = current.measurements.concat(added);
+      current.offset += data.byteLength;
+    }
+    else {
+      current.measurements = decode(new DataView(data), current.schema);
+      current.offset = data.byteLength;
+    }
+  }
+
+  const last = current.measurements[current.measurements.length - 1];
+  const from = last ? last.timestamp + 1 : Math.floor(current.startTime.getTime() / 1000);
+  // The range is always given in full, the default end of the server may be earlier after a reboot
+  const to = Math.floor(current.endTime.getTime() / 1000);
+  const pending = from < to ?
+    await fetchRecent(current.log, from, to, current.schema, last ? last.timestamp : null) : [];
+  if (current != tail)
+    return;
+  // Without an answer, the records fetched before are shown until they are in the file
+  current.pending = pending != null ? pending : current.pending.filter(point => point.timestamp >= from);
+  updateChart(current.measurements.concat(current.pending), current.startTime, current.endTime);
 }
   
 function load() {
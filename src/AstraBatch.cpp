@@ -0,0 +1,134 @@
+#include <math.h>
+#include <string.h>
+
+#include "AstraBatch.h"
+
+
+static const char* const ERRORS = "\"errors\"";
+
+AstraBatch::AstraBatch(char* buffer, size_t size):
+    TextWriter(buffer, size),
+    rows(0),
+    firstColumn(true) {
+}
+
+void AstraBatch::begin() {
+  print("{\"query\":\"mutation{");
+}
+
+void AstraBatch::beginRow(const char* table) {
+  if (rows > 0)
+    print(' ');
+  print('r');
+  print((uint32_t) rows);
+  print(":insert");
+  print(table);
+  print("(value:{");
+  firstColumn = true;
+}
+
+void AstraBatch::beginColumn(const char* name) {
+  if (!firstColumn)
+    print(',');
+  firstColumn = false;
+  print(name);
+  print(':');
+}
+
+void AstraBatch::add(const char* name, const char* text) {
+  beginColumn(name);
+  // A GraphQL string inside a JSON string, so quotes and backslashes are escaped twice
+  print("\\\"");
+  for (const char* c = text; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      print("\\\\\\");
+      print(*c);
+    }
+    else if ((unsigned char) *c >= 0x20)
+      print(*c);
+  }
+  print("\\\"");
+}
+
+void AstraBatch::add(const char* name, int32_t value) {
+  beginColumn(name);
+  print(value);
+}
+
+void AstraBatch::add(const char* name, double value, uint8_t decimals) {
+  beginColumn(name);
+  if (isfinite(value))
+    print(value, decimals);
+  else
+    print("null");
+}
+
+void AstraBatch::endRow() {
+  print("}){applied}");
+  rows++;
+}
+
+void AstraBatch::end() {
+  print("}\"}");
+}
+
+uint8_t AstraBatch::getRowCount() const {
+  return rows;
+}
+
+void AstraBatch::writeHead(TextWriter& head, const char* host, const char* keyspace, const char* token) const {
+  head.print("POST /api/graphql/");
+  head.print(keyspace);
+  head.print(" HTTP/1.1\r\nHost: ");
+  head.print(host);
+  head.print("\r\nX-Cassandra-Token: ");
+  head.print(token);
+  head.print("\r\nContent-Type: application/json\r\nContent-Length: ");
+  head.print((uint32_t) length());
+  head.print("\r\nConnection: close\r\n\r\n");
+}
+
+
+AstraResponse::AstraResponse():
+    state(VERSION),
+    status(0),
+    matched(0),
+    errors(false) {
+}
+
+void AstraResponse::feed(const char* data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    char c = data[i];
+    switch (state) {
+      case VERSION:
+        if (c == ' ')
+          state = STATUS;
+        break;
+      case STATUS:
+        if (c >= '0' && c <= '9' && status < 1000)
+          status = status * 10 + (c - '0');
+        else
+          state = REST;
+        break;
+      case REST:
+        // Only the first character of the pattern repeats in it
+        if (c == ERRORS[matched]) {
+          if (ERRORS[++matched] == '\0') {
+            errors = true;
+            matched = 0;
+          }
+        }
+        else
+          matched = c == ERRORS[0] ? 1 : 0;
+        break;
+    }
+  }
+}
+
+uint16_t AstraResponse::getStatus() const {
+  return status;
+}
+
+bool AstraResponse::isSuccess() const {
+  return status == 200 && !errors;
+}
@@ -0,0 +1,70 @@
+#ifndef ASTRABATCH_H
+#define ASTRABATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "JsonWriter.h"
+
+/**
+ * Writes a request inserting a batch of rows into a table of an Astra database
+ * with the GraphQL API of Stargate. All rows go to a single mutation, one
+ * aliased insert per row, sent as a JSON string:
+ *
+ *   {"query":"mutation{r0:insertmeasurements(value:{day:\"2026-10-17\",temp:21.5}){applied} r1:...}"}
+ *
+ * Inserting a row with the same primary key again overwrites it,
+ * so a batch that failed part way can be sent again as a whole.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class AstraBatch: public TextWriter {
+  public:
+    AstraBatch(char* buffer, size_t size);
+
+    void begin();
+    void beginRow(const char* table);
+    // Adds a column with a string value, e.g. a date or a UUID
+    void add(const char* name, const char* text);
+    void add(const char* name, int32_t value);
+    void add(const char* name, double value, uint8_t decimals);
+    void endRow();
+    void end();
+
+    uint8_t getRowCount() const;
+
+    // Writes the head of the HTTP request sending the complete batch
+    // to the GraphQL endpoint of a keyspace, authorized by an Astra token
+    void writeHead(TextWriter& head, const char* host, const char* keyspace, const char* token) const;
+
+  private:
+    uint8_t rows;
+    bool firstColumn;
+
+    void beginColumn(const char* name);
+};
+
+/**
+ * Checks the response to an AstraBatch request as it arrives, without keeping it.
+ * GraphQL reports failed inserts with status 200 and an "errors" member,
+ * so the whole response is searched for it.
+ */
+class AstraResponse {
+  public:
+    AstraResponse();
+
+    void feed(const char* data, size_t size);
+
+    uint16_t getStatus() const;
+    // The status is 200 and no error was reported
+    bool isSuccess() const;
+
+  private:
+    enum State : uint8_t { VERSION, STATUS, REST };
+
+    State state;
+    uint16_t status;
+    uint8_t matched;
+    bool errors;
+};
+
+#endif /* ASTRABATCH_H */
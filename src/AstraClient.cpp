@@ -0,0 +1,114 @@
+#include "AstraClient.h"
+
+
+AstraClient::AstraClient(AstraSocket& socket):
+    socket(socket),
+    state(IDLE),
+    failedIn(IDLE),
+    startedAt(0),
+    body(nullptr),
+    bodyLength(0),
+    headLength(0),
+    sent(0) {
+}
+
+bool AstraClient::begin(const AstraBatch& batch, const char* host, const char* keyspace, const char* token,
+    uint32_t nowMillis) {
+  if (state == CONNECTING || state == SENDING || state == RECEIVING)
+    socket.stop();
+  state = IDLE;
+  TextWriter writer(head, sizeof(head));
+  batch.writeHead(writer, host, keyspace, token);
+  if (batch.isOverflowed() || writer.isOverflowed())
+    return false;
+  headLength = writer.length();
+  body = batch.c_str();
+  bodyLength = batch.length();
+  sent = 0;
+  response = AstraResponse();
+  startedAt = nowMillis;
+  if (!socket.connect(host, PORT)) {
+    failedIn = CONNECTING;
+    state = FAILED;
+    return false;
+  }
+  state = CONNECTING;
+  return true;
+}
+
+AstraClient::State AstraClient::poll(uint32_t nowMillis) {
+  if (state != CONNECTING && state != SENDING && state != RECEIVING)
+    return state;
+  if (nowMillis - startedAt >= TIMEOUT_MILLIS)
+    return end(FAILED);
+
+  switch (state) {
+    case CONNECTING:
+      switch (socket.poll()) {
+        case AstraSocket::CONNECTED:
+          state = SENDING;
+          break;
+        case AstraSocket::FAILED:
+          return end(FAILED);
+        default:
+          break;
+      }
+      break;
+
+    case SENDING: {
+      size_t budget = MAX_WRITE;
+      while (budget > 0 && sent < headLength + bodyLength) {
+        const char* data = sent < headLength ? head + sent : body + sent - headLength;
+        size_t size = sent < headLength ? headLength - sent : headLength + bodyLength - sent;
+        size_t space = socket.space();
+        if (size > space)
+          size = space;
+        if (size > budget)
+          size = budget;
+        size_t written = size > 0 ? socket.write((const uint8_t*) data, size) : 0;
+        if (written == 0)
+          break;
+        sent += written;
+        budget -= written;
+      }
+      if (sent == headLength + bodyLength)
+        state = RECEIVING;
+      break;
+    }
+
+    case RECEIVING: {
+      uint8_t buffer[READ_BUFFER];
+      int n = socket.read(buffer, sizeof(buffer));
+      if (n > 0)
+        response.feed((const char*) buffer, n);
+      else if (n < 0)
+        // The request asked the server to close the connection after the response
+        return end(response.isSuccess() ? STORED : FAILED);
+      break;
+    }
+
+    default:
+      break;
+  }
+  return state;
+}
+
+AstraClient::State AstraClient::end(State result) {
+  socket.stop();
+  if (result == FAILED)
+    failedIn = state;
+  state = result;
+  return state;
+}
+
+AstraClient::State AstraClient::getState() const {
+  return state;
+}
+
+AstraClient::State AstraClient::getFailedIn() const {
+  return failedIn;
+}
+
+const AstraResponse& AstraClient::getResponse() const {
+  return response;
+}
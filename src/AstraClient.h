@@ -0,0 +1,86 @@
+#ifndef ASTRACLIENT_H
+#define ASTRACLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "AstraBatch.h"
+
+/** Connection to the Astra server used by an AstraClient, e.g. over TLS */
+class AstraSocket {
+  public:
+    enum Status : uint8_t { CONNECTING, CONNECTED, FAILED };
+
+    virtual ~AstraSocket() {}
+    // Starts connecting to the host, returns false if it can't be started
+    virtual bool connect(const char* host, uint16_t port) = 0;
+    // Takes the next step of connecting, e.g. resolving the host name
+    // or the handshake, and reports how far it got
+    virtual Status poll() = 0;
+    // Number of bytes that can be written without blocking
+    virtual size_t space() = 0;
+    // Queues bytes for sending, returns the number of bytes accepted
+    virtual size_t write(const uint8_t* data, size_t size) = 0;
+    // Reads the bytes received so far, returns 0 if there are none yet
+    // and -1 once the server closed the connection and all were read
+    virtual int read(uint8_t* buffer, size_t size) = 0;
+    virtual void stop() = 0;
+};
+
+/**
+ * Sends an AstraBatch over an AstraSocket and checks the response in steps
+ * of bounded work, one per poll(), so the main loop keeps running while the
+ * request waits for the network:
+ *
+ *   CONNECTING  one step of AstraSocket::poll()
+ *   SENDING     up to MAX_WRITE bytes of the head and the body
+ *   RECEIVING   up to READ_BUFFER bytes of the response, until the server
+ *               closes the connection
+ *
+ * A request that doesn't end within TIMEOUT_MILLIS fails.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class AstraClient {
+  public:
+    enum State : uint8_t { IDLE, CONNECTING, SENDING, RECEIVING, STORED, FAILED };
+
+    static const uint16_t PORT = 443;
+    // Fits the host of a database, an Astra token and the other headers
+    static const size_t MAX_HEAD = 384;
+    static const size_t MAX_WRITE = 512;
+    static const size_t READ_BUFFER = 128;
+    static const uint32_t TIMEOUT_MILLIS = 10000;
+
+    AstraClient(AstraSocket& socket);
+
+    // Starts sending the batch to the GraphQL endpoint of a keyspace.
+    // The text of the batch must not change until the request ends.
+    // Returns false if the request can't be started.
+    bool begin(const AstraBatch& batch, const char* host, const char* keyspace, const char* token,
+      uint32_t nowMillis);
+
+    // Advances the request, returns STORED or FAILED once it ended
+    State poll(uint32_t nowMillis);
+
+    State getState() const;
+    // The state in which the last failed request failed
+    State getFailedIn() const;
+    const AstraResponse& getResponse() const;
+
+  private:
+    AstraSocket& socket;
+    State state;
+    State failedIn;
+    uint32_t startedAt;
+    const char* body;
+    size_t bodyLength;
+    size_t headLength;
+    // Bytes of the head and the body sent so far
+    size_t sent;
+    AstraResponse response;
+    char head[MAX_HEAD];
+
+    State end(State result);
+};
+
+#endif /* ASTRACLIENT_H */
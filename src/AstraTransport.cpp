@@ -0,0 +1,99 @@
+#include <lwip/dns.h>
+
+#include "AstraTransport.h"
+
+
+AstraTransport::AstraTransport():
+    state(IDLE),
+    port(0),
+    resolved(false),
+    resolveFailed(false) {
+  // The device has no CA certificates to verify the server with
+  client.setInsecure();
+  client.setSession(&session);
+  client.setTimeout(CONNECT_TIMEOUT_MILLIS);
+}
+
+bool AstraTransport::connect(const char* host, uint16_t port) {
+  stop();
+  this->port = port;
+  resolved = false;
+  resolveFailed = false;
+  ip_addr_t found;
+  switch (dns_gethostbyname(host, &found, &AstraTransport::handleDns, this)) {
+    case ERR_OK:
+      // Cached by lwIP
+      address = IPAddress(&found);
+      state = RESOLVED;
+      return true;
+    case ERR_INPROGRESS:
+      state = RESOLVING;
+      return true;
+    default:
+      state = FAILED;
+      return false;
+  }
+}
+
+// Called by lwIP with the answer, or nullptr if the name wasn't found.
+// The transport always looks up the same host, so an answer to a lookup
+// that was given up on is still right.
+void AstraTransport::handleDns(const char* name, const ip_addr_t* address, void* arg) {
+  AstraTransport* transport = (AstraTransport*) arg;
+  if (address != nullptr) {
+    transport->address = IPAddress(address);
+    transport->resolved = true;
+  }
+  else
+    transport->resolveFailed = true;
+}
+
+AstraSocket::Status AstraTransport::poll() {
+  switch (state) {
+    case RESOLVING:
+      if (resolveFailed) {
+        Serial.println("Failed to resolve the address of Astra");
+        state = FAILED;
+      }
+      else if (resolved)
+        // Connected in the next step, so resolving and connecting
+        // don't add up in a single iteration of the main loop
+        state = RESOLVED;
+      return state == FAILED ? AstraSocket::FAILED : AstraSocket::CONNECTING;
+    case RESOLVED:
+      if (!client.connect(address, port)) {
+        Serial.println("Failed to connect to Astra");
+        state = FAILED;
+        return AstraSocket::FAILED;
+      }
+      state = CONNECTED;
+      return AstraSocket::CONNECTED;
+    case CONNECTED:
+      return AstraSocket::CONNECTED;
+    default:
+      return AstraSocket::FAILED;
+  }
+}
+
+size_t AstraTransport::space() {
+  return state == CONNECTED ? client.availableForWrite() : 0;
+}
+
+size_t AstraTransport::write(const uint8_t* data, size_t size) {
+  return state == CONNECTED ? client.write(data, size) : 0;
+}
+
+int AstraTransport::read(uint8_t* buffer, size_t size) {
+  if (state != CONNECTED)
+    return -1;
+  int available = client.available();
+  if (available > 0)
+    return client.read(buffer, min(size, (size_t) available));
+  return client.connected() ? 0 : -1;
+}
+
+void AstraTransport::stop() {
+  if (state == CONNECTED)
+    client.stop();
+  state = IDLE;
+}
@@ -0,0 +1,45 @@
+#ifndef ASTRATRANSPORT_H
+#define ASTRATRANSPORT_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+
+#include "AstraClient.h"
+
+/**
+ * Connects an AstraClient to Astra with TLS, in steps taken by poll().
+ * The host name is resolved with the asynchronous DNS of lwIP, so waiting for
+ * the answer takes no time in the main loop. The TCP connection and the TLS
+ * handshake are done by BearSSL in a single blocking step, which is the only
+ * long one. The TLS session is kept and resumed by the next connection,
+ * which skips the key exchange that takes most of the time of a handshake.
+ */
+class AstraTransport: public AstraSocket {
+  public:
+    static const uint32_t CONNECT_TIMEOUT_MILLIS = 5000;
+
+    AstraTransport();
+
+    bool connect(const char* host, uint16_t port) override;
+    Status poll() override;
+    size_t space() override;
+    size_t write(const uint8_t* data, size_t size) override;
+    int read(uint8_t* buffer, size_t size) override;
+    void stop() override;
+
+  private:
+    enum State : uint8_t { IDLE, RESOLVING, RESOLVED, CONNECTED, FAILED };
+
+    BearSSL::WiFiClientSecure client;
+    BearSSL::Session session;
+    State state;
+    uint16_t port;
+    IPAddress address;
+    // Set by the DNS callback, which runs outside of the main loop
+    volatile bool resolved;
+    volatile bool resolveFailed;
+
+    static void handleDns(const char* name, const ip_addr_t* address, void* arg);
+};
+
+#endif /* ASTRATRANSPORT_H */
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "HttpCache.h"
+
+
+static uint32_t readUint32(const uint8_t* src) {
+  return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+void HttpCache::formatEtag(const uint8_t* trailer, char* etag, size_t size) {
+  snprintf(etag, size, "\"%08lx-%lx\"", (unsigned long) readUint32(trailer), (unsigned long) readUint32(trailer + 4));
+}
+
+bool HttpCache::matches(const char* ifNoneMatch, const char* etag) {
+  if (ifNoneMatch == nullptr || etag == nullptr)
+    return false;
+  if (strcmp(ifNoneMatch, "*") == 0)
+    return true;
+  // A list of ETags, possibly weak, each of which is compared as a whole
+  size_t length = strlen(etag);
+  for (const char* pos = strstr(ifNoneMatch, etag); pos != nullptr; pos = strstr(pos + 1, etag)) {
+    char after = pos[length];
+    if (after == '\0' || after == ',' || after == ' ')
+      return true;
+  }
+  return false;
+}
+
+bool HttpCache::begin(HttpRequest& request, HttpResponse& response,
+    const char* contentType, int32_t contentLength, const char* etag, bool gzip) {
+  bool current = matches(request.getHeader("If-None-Match"), etag);
+  response.begin(current ? 304 : 200, contentType, contentLength);
+  if (etag != nullptr)
+    response.addHeader("ETag", etag);
+  if (request.hasArg("v"))
+    response.addHeader("Cache-Control", "public, max-age=31536000, immutable");
+  else
+    response.addHeader("Cache-Control", "no-cache");
+  if (gzip && !current)
+    response.addHeader("Content-Encoding", "gzip");
+  return !current;
+}
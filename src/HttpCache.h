@@ -0,0 +1,38 @@
+#ifndef HTTPCACHE_H
+#define HTTPCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HttpServer.h"
+
+/**
+ * Caching rules for the static files of the UI, which the build stores
+ * gzip-compressed (see util/compress_ui.py).
+ *
+ * The strong ETag of a compressed file is made of the CRC-32 and the size of
+ * the uncompressed content, found in the gzip trailer, so it changes with every
+ * build changing the file and needs no extra storage. References between the
+ * files carry a "v" query argument with a version, which makes these URLs
+ * safe to cache for a long time. Other URLs must be revalidated on every use.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class HttpCache {
+  public:
+    static const size_t GZIP_TRAILER_SIZE = 8;
+    static const size_t MAX_ETAG = 24;
+
+    // Formats the ETag of a gzip file from its last GZIP_TRAILER_SIZE bytes
+    static void formatEtag(const uint8_t* trailer, char* etag, size_t size);
+
+    // True if an If-None-Match header value matches the ETag
+    static bool matches(const char* ifNoneMatch, const char* etag);
+
+    // Begins a response with a static file, optionally gzip-compressed and
+    // with an ETag, or sends 304 if the copy cached by the client is current.
+    // Returns true if the body should be set.
+    static bool begin(HttpRequest& request, HttpResponse& response,
+      const char* contentType, int32_t contentLength, const char* etag, bool gzip);
+};
+
+#endif /* HTTPCACHE_H */
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "HttpEvents.h"
+
+
+HttpEventSource::HttpEventSource():
+    version(0),
+    subscribers(0),
+    now(0) {
+  data[0] = '\0';
+}
+
+void HttpEventSource::subscribe(HttpResponse& response) {
+  if (subscribers >= MAX_SUBSCRIBERS) {
+    response.begin(503, "text/plain", 0);
+    response.addHeader("Retry-After", "60");
+    return;
+  }
+  response.begin(200, "text/event-stream", HttpResponse::CHUNKED);
+  response.addHeader("Cache-Control", "no-cache");
+  response.setBody<HttpEventBody>(*this);
+}
+
+void HttpEventSource::publish(const char* data) {
+  if (strcmp(this->data, data) == 0)
+    return;
+  strncpy(this->data, data, MAX_DATA - 1);
+  this->data[MAX_DATA - 1] = '\0';
+  version++;
+}
+
+void HttpEventSource::loop(uint32_t nowMillis) {
+  now = nowMillis;
+}
+
+uint8_t HttpEventSource::getSubscriberCount() const {
+  return subscribers;
+}
+
+uint32_t HttpEventSource::getEventCount() const {
+  return version;
+}
+
+
+HttpEventBody::HttpEventBody(HttpEventSource& source):
+    source(source),
+    sentVersion(0),
+    lastSent(source.now),
+    started(false) {
+  source.subscribers++;
+}
+
+HttpEventBody::~HttpEventBody() {
+  source.subscribers--;
+}
+
+size_t HttpEventBody::read(uint8_t* buffer, size_t size) {
+  int n = 0;
+  if (!started) {
+    n = snprintf((char*) buffer, size, "retry: %lu\n\n", (unsigned long) HttpEventSource::RETRY_MILLIS);
+    started = true;
+  }
+  else if (sentVersion != source.version) {
+    n = snprintf((char*) buffer, size, "data: %s\n\n", source.data);
+    sentVersion = source.version;
+  }
+  else if (source.now - lastSent >= HttpEventSource::HEARTBEAT_MILLIS)
+    n = snprintf((char*) buffer, size, ":\n\n");
+  if (n <= 0 || (size_t) n >= size)
+    return 0;
+  lastSent = source.now;
+  return n;
+}
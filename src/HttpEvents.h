@@ -0,0 +1,65 @@
+#ifndef HTTPEVENTS_H
+#define HTTPEVENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HttpServer.h"
+
+/**
+ * A Server-Sent Events stream of the latest state, e.g. sensor readings.
+ *
+ * publish() replaces the state, and every subscriber is sent the newest state
+ * as soon as its connection has room for it. Updates published while a slow
+ * client is still receiving an older one are coalesced, so a client is never
+ * behind by more than one event and no queue is needed.
+ * An idle stream gets a comment every HEARTBEAT_MILLIS, which keeps the
+ * connection from timing out and detects clients that went away.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class HttpEventSource {
+  public:
+    // Leaves connections free for other requests
+    static const uint8_t MAX_SUBSCRIBERS = 2;
+    static const size_t MAX_DATA = 160;
+    static const uint32_t HEARTBEAT_MILLIS = 15000;
+    // Reconnection delay suggested to the clients
+    static const uint32_t RETRY_MILLIS = 3000;
+
+    HttpEventSource();
+
+    // Answers a request for the stream, with 503 if there are too many subscribers
+    void subscribe(HttpResponse& response);
+
+    // Sends new data to all subscribers, unless it's the same as the last one
+    void publish(const char* data);
+
+    void loop(uint32_t nowMillis);
+
+    uint8_t getSubscriberCount() const;
+    uint32_t getEventCount() const;
+
+  private:
+    friend class HttpEventBody;
+
+    char data[MAX_DATA];
+    uint32_t version;
+    uint8_t subscribers;
+    uint32_t now;
+};
+
+/** Body of an event stream response, never complete */
+class HttpEventBody: public HttpBody {
+  public:
+    HttpEventBody(HttpEventSource& source);
+    ~HttpEventBody();
+    size_t read(uint8_t* buffer, size_t size) override;
+
+  private:
+    HttpEventSource& source;
+    uint32_t sentVersion;
+    uint32_t lastSent;
+    bool started;
+};
+
+#endif /* HTTPEVENTS_H */
@@ -0,0 +1,82 @@
+#include <math.h>
+
+#include "HttpMetrics.h"
+
+
+MetricsWriter::MetricsWriter(char* buffer, size_t size):
+    TextWriter(buffer, size) {
+}
+
+void MetricsWriter::describe(const char* name, const char* type, const char* help) {
+  print("# HELP ");
+  print(name);
+  print(' ');
+  print(help);
+  print("\n# TYPE ");
+  print(name);
+  print(' ');
+  print(type);
+  print('\n');
+}
+
+void MetricsWriter::sample(const char* name, uint32_t value, const char* label, const char* labelValue) {
+  beginSample(name, label, labelValue);
+  print(value);
+  print('\n');
+}
+
+void MetricsWriter::sample(const char* name, int32_t value, const char* label, const char* labelValue) {
+  beginSample(name, label, labelValue);
+  print(value);
+  print('\n');
+}
+
+void MetricsWriter::sample(const char* name, double value, uint8_t decimals, 
+    const char* label, const char* labelValue) {
+  beginSample(name, label, labelValue);
+  if (isfinite(value))
+    print(value, decimals);
+  else
+    print("NaN");
+  print('\n');
+}
+
+void MetricsWriter::beginSample(const char* name, const char* label, const char* labelValue) {
+  print(name);
+  if (label != nullptr) {
+    // Label values are names chosen by the firmware, which need no escaping
+    print('{');
+    print(label);
+    print("=\"");
+    print(labelValue);
+    print("\"}");
+  }
+  print(' ');
+}
+
+
+const char* HttpMetricsBody::CONTENT_TYPE = "text/plain; version=0.0.4";
+
+HttpMetricsBody::HttpMetricsBody(HttpMetricsSource& source):
+    source(source),
+    index(0) {
+}
+
+size_t HttpMetricsBody::read(uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (true) {
+    MetricsWriter writer((char*) buffer + n, size - n);
+    if (!source.writeMetrics(index, writer))
+      return n > 0 ? n : HttpBody::END;
+    if (!writer.isOverflowed()) {
+      n += writer.length();
+      index++;
+    }
+    else if (n > 0)
+      // Continue with this family in the next read
+      return n;
+    else
+      // Never fits, skip it rather than stall the response
+      index++;
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef HTTPMETRICS_H
+#define HTTPMETRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HttpServer.h"
+#include "JsonWriter.h"
+
+/** Writes metrics in the Prometheus text exposition format */
+class MetricsWriter: public TextWriter {
+  public:
+    MetricsWriter(char* buffer, size_t size);
+
+    // Writes the HELP and TYPE lines of a metric, e.g. of type "gauge" or "counter"
+    void describe(const char* name, const char* type, const char* help);
+    // Writes a sample with an optional label, e.g. label "log" with value "env".
+    // Non-finite values are written as NaN.
+    void sample(const char* name, uint32_t value, const char* label = nullptr, const char* labelValue = nullptr);
+    void sample(const char* name, int32_t value, const char* label = nullptr, const char* labelValue = nullptr);
+    void sample(const char* name, double value, uint8_t decimals, 
+      const char* label = nullptr, const char* labelValue = nullptr);
+
+  private:
+    void beginSample(const char* name, const char* label, const char* labelValue);
+};
+
+/** Provides the metrics of a /metrics response, one family at a time */
+class HttpMetricsSource {
+  public:
+    virtual ~HttpMetricsSource() {}
+    // Writes the metric family with the given index, starting at 0.
+    // Returns false if there is no such family.
+    virtual bool writeMetrics(uint8_t index, MetricsWriter& writer) = 0;
+};
+
+/**
+ * Body of a /metrics response. Families of metrics are written directly into
+ * the response buffer, as many as fit in each read, so a scrape doesn't
+ * allocate any memory and the values are read as the response is sent.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class HttpMetricsBody: public HttpBody {
+  public:
+    static const char* CONTENT_TYPE;
+
+    HttpMetricsBody(HttpMetricsSource& source);
+    size_t read(uint8_t* buffer, size_t size) override;
+
+  private:
+    HttpMetricsSource& source;
+    uint8_t index;
+};
+
+#endif /* HTTPMETRICS_H */
@@ -0,0 +1,656 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "HttpServer.h"
+
+
+// Checks if a comma-separated header value contains a token, ignoring case
+static bool hasToken(const char* value, const char* token) {
+  size_t length = strlen(token);
+  const char* pos = value;
+  while (*pos != '\0') {
+    while (*pos == ' ' || *pos == '\t' || *pos == ',')
+      pos++;
+    const char* end = pos;
+    while (*end != '\0' && *end != ',')
+      end++;
+    const char* last = end;
+    while (last > pos && (last[-1] == ' ' || last[-1] == '\t'))
+      last--;
+    if ((size_t) (last - pos) == length && strncasecmp(pos, token, length) == 0)
+      return true;
+    pos = end;
+  }
+  return false;
+}
+
+static const char* statusText(uint16_t status) {
+  switch (status) {
+    case 200: return "OK";
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 414: return "URI Too Long";
+    case 416: return "Range Not Satisfiable";
+    case 503: return "Service Unavailable";
+    default: return "Internal Server Error";
+  }
+}
+
+static int fromHex(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+
+HttpMemoryBody::HttpMemoryBody(const uint8_t* data, size_t size):
+    data(data),
+    size(size),
+    pos(0) {
+}
+
+size_t HttpMemoryBody::read(uint8_t* buffer, size_t max) {
+  if (pos == size)
+    return END;
+  size_t n = size - pos < max ? size - pos : max;
+  memcpy(buffer, data + pos, n);
+  pos += n;
+  return n;
+}
+
+
+HttpMethod HttpRequest::getMethod() const {
+  return method;
+}
+
+const char* HttpRequest::getPath() const {
+  return target;
+}
+
+bool HttpRequest::hasArg(const char* name) const {
+  return findArg(name) != nullptr;
+}
+
+bool HttpRequest::getArg(const char* name, char* value, size_t size) const {
+  const char* src = findArg(name);
+  if (src == nullptr || size == 0)
+    return false;
+  size_t n = 0;
+  while (*src != '\0' && *src != '&' && n + 1 < size) {
+    char c = *src++;
+    if (c == '+')
+      c = ' ';
+    else if (c == '%' && fromHex(src[0]) >= 0 && fromHex(src[1]) >= 0) {
+      c = (char) (fromHex(src[0]) * 16 + fromHex(src[1]));
+      src += 2;
+    }
+    value[n++] = c;
+  }
+  value[n] = '\0';
+  return true;
+}
+
+long HttpRequest::getArg(const char* name, long defaultValue) const {
+  char value[24];
+  if (!getArg(name, value, sizeof(value)) || value[0] == '\0')
+    return defaultValue;
+  return strtol(value, nullptr, 10);
+}
+
+const char* HttpRequest::getHeader(const char* name) const {
+  for (uint8_t i = 0; i < headerCount; i++) {
+    if (strcasecmp(headerNames[i], name) == 0)
+      return headers + headerValues[i];
+  }
+  return nullptr;
+}
+
+uint16_t HttpRequest::getRange(uint32_t size, uint32_t& start, uint32_t& length) const {
+  const char* range = getHeader("Range");
+  if (range == nullptr || strncmp(range, "bytes=", 6) != 0)
+    return 200;
+  // Multiple ranges would need a multipart response
+  const char* spec = range + 6;
+  if (strchr(spec, ',') != nullptr)
+    return 200;
+  char* end;
+  uint32_t first, last = size > 0 ? size - 1 : 0;
+  if (*spec == '-') {
+    // Suffix range with the number of last bytes
+    unsigned long suffix = strtoul(spec + 1, &end, 10);
+    if (end == spec + 1 || *end != '\0')
+      return 200;
+    if (suffix == 0 || size == 0)
+      return 416;
+    first = suffix < size ? size - suffix : 0;
+  }
+  else {
+    if (*spec < '0' || *spec > '9')
+      return 200;
+    first = strtoul(spec, &end, 10);
+    if (*end != '-')
+      return 200;
+    const char* lastSpec = end + 1;
+    if (*lastSpec != '\0') {
+      unsigned long value = strtoul(lastSpec, &end, 10);
+      if (*end != '\0' || value < first)
+        return 200;
+      if (value < last)
+        last = value;
+    }
+    if (first >= size)
+      return 416;
+  }
+  start = first;
+  length = last - first + 1;
+  return 206;
+}
+
+uint16_t HttpRequest::parseRequestLine(char* line) {
+  char* methodEnd = strchr(line, ' ');
+  if (methodEnd == nullptr)
+    return 400;
+  *methodEnd = '\0';
+  char* targetStart = methodEnd + 1;
+  char* targetEnd = strchr(targetStart, ' ');
+  if (targetEnd == nullptr || *targetStart != '/')
+    return 400;
+  *targetEnd = '\0';
+  const char* version = targetEnd + 1;
+
+  if (strcmp(line, "GET") == 0)
+    method = HttpMethod::GET;
+  else if (strcmp(line, "HEAD") == 0)
+    method = HttpMethod::HEAD;
+  else if (strcmp(line, "POST") == 0)
+    method = HttpMethod::POST;
+  else
+    method = HttpMethod::OTHER;
+  if (strcmp(version, "HTTP/1.1") == 0)
+    http11 = true;
+  else if (strcmp(version, "HTTP/1.0") == 0)
+    http11 = false;
+  else
+    return 400;
+  keepAlive = http11;
+
+  size_t length = targetEnd - targetStart;
+  if (length >= MAX_TARGET)
+    return 414;
+  memcpy(target, targetStart, length + 1);
+  char* queryStart = strchr(target, '?');
+  if (queryStart != nullptr) {
+    *queryStart = '\0';
+    query = queryStart + 1;
+  }
+  else
+    query = target + length;
+  return 0;
+}
+
+void HttpRequest::parseHeader(const char* name, const char* value) {
+  if (strcasecmp(name, "Connection") == 0) {
+    if (hasToken(value, "close"))
+      keepAlive = false;
+    else if (hasToken(value, "keep-alive"))
+      keepAlive = true;
+  }
+  // Request bodies aren't read, so the next request couldn't be found after one
+  else if ((strcasecmp(name, "Content-Length") == 0 && strtoul(value, nullptr, 10) > 0) ||
+      strcasecmp(name, "Transfer-Encoding") == 0)
+    hasBody = true;
+}
+
+const char* HttpRequest::findArg(const char* name) const {
+  size_t nameLength = strlen(name);
+  const char* pos = query;
+  while (*pos != '\0') {
+    const char* end = strchr(pos, '&');
+    if (end == nullptr)
+      end = pos + strlen(pos);
+    if (strncmp(pos, name, nameLength) == 0 && (pos[nameLength] == '=' || pos + nameLength == end))
+      return pos[nameLength] == '=' ? pos + nameLength + 1 : pos + nameLength;
+    pos = *end == '&' ? end + 1 : end;
+  }
+  return nullptr;
+}
+
+void HttpRequest::addHeader(const char* name, const char* value) {
+  size_t size = strlen(value) + 1;
+  if (headerCount == MAX_HEADERS || size > HEADER_STORAGE - headersLength)
+    return;
+  memcpy(headers + headersLength, value, size);
+  headerNames[headerCount] = name;
+  headerValues[headerCount] = (uint8_t) headersLength;
+  headerCount++;
+  headersLength += size;
+}
+
+
+void HttpResponse::begin(uint16_t status, const char* contentType, int32_t contentLength) {
+  char line[48];
+  length = 0;
+  sent = 0;
+  snprintf(line, sizeof(line), "HTTP/1.1 %u %s\r\n", status, statusText(status));
+  append(line);
+  addHeader("Content-Type", contentType);
+  if (status == 304)
+    withBody = false;
+  else if (contentLength >= 0) {
+    snprintf(line, sizeof(line), "%ld", (long) contentLength);
+    addHeader("Content-Length", line);
+    bodyRemaining = contentLength;
+  }
+  else if (http11) {
+    addHeader("Transfer-Encoding", "chunked");
+    chunked = true;
+  }
+  else if (withBody)
+    // The end of the body is marked by closing the connection
+    keepAlive = false;
+  started = true;
+}
+
+void HttpResponse::addHeader(const char* name, const char* value) {
+  append(name);
+  append(": ");
+  append(value);
+  append("\r\n");
+}
+
+void HttpResponse::send(uint16_t status, const char* contentType, const char* text) {
+  size_t size = strlen(text);
+  begin(status, contentType, size);
+  finishHeaders();
+  if (withBody)
+    append(text);
+  bodyRemaining = 0;
+  clearBody();
+  complete = true;
+}
+
+bool HttpResponse::isStarted() const {
+  return started;
+}
+
+void HttpResponse::reset(bool withBody, bool http11, bool keepAlive, uint8_t remainingRequests) {
+  clearBody();
+  length = 0;
+  sent = 0;
+  started = false;
+  headersDone = false;
+  chunked = false;
+  bodyRemaining = 0;
+  this->withBody = withBody;
+  this->http11 = http11;
+  this->keepAlive = keepAlive;
+  this->remainingRequests = remainingRequests;
+  complete = false;
+}
+
+void HttpResponse::clearBody() {
+  if (body != nullptr)
+    body->~HttpBody();
+  body = nullptr;
+}
+
+void HttpResponse::append(const char* text) {
+  size_t size = strlen(text);
+  if (size > BUFFER_SIZE - length)
+    size = BUFFER_SIZE - length;
+  memcpy(buffer + length, text, size);
+  length += size;
+}
+
+void HttpResponse::finishHeaders() {
+  if (keepAlive) {
+    char parameters[32];
+    snprintf(parameters, sizeof(parameters), "timeout=%u, max=%u",
+      (unsigned) (HttpServer::KEEP_ALIVE_TIMEOUT_MILLIS / 1000), remainingRequests);
+    addHeader("Connection", "keep-alive");
+    addHeader("Keep-Alive", parameters);
+    append("\r\n");
+  }
+  else
+    append("Connection: close\r\n\r\n");
+  headersDone = true;
+}
+
+bool HttpResponse::fill() {
+  length = 0;
+  sent = 0;
+  if (complete)
+    return false;
+  if (!withBody) {
+    complete = true;
+    return false;
+  }
+  if (chunked) {
+    // Room for the chunk size in hex and CRLF before the data, CRLF after it
+    const size_t head = 6;
+    size_t n = body != nullptr ? body->read(buffer + head, BUFFER_SIZE - head - 2) : HttpBody::END;
+    if (n == 0)
+      return false;
+    if (n == HttpBody::END) {
+      append("0\r\n\r\n");
+      clearBody();
+      complete = true;
+      return true;
+    }
+    char size[head + 1];
+    int sizeLength = snprintf(size, sizeof(size), "%X\r\n", (unsigned) n);
+    memcpy(buffer + head - sizeLength, size, sizeLength);
+    sent = head - sizeLength;
+    length = head + n;
+    append("\r\n");
+    return true;
+  }
+  size_t n = body != nullptr ? body->read(buffer, BUFFER_SIZE) : HttpBody::END;
+  if (n == HttpBody::END) {
+    // A body shorter than its Content-Length, e.g. after a read error, leaves the client 
+    // waiting for the rest. Only closing the connection tells it the response is truncated.
+    if (bodyRemaining > 0)
+      keepAlive = false;
+    clearBody();
+    complete = true;
+    return false;
+  }
+  bodyRemaining -= n < bodyRemaining ? n : bodyRemaining;
+  length = n;
+  return n > 0;
+}
+
+
+void HttpConnection::receive(const uint8_t* data, size_t size) {
+  size_t used = 0;
+  if (state == READING) {
+    lastActivity = server->now;
+    used = parse(data, size);
+  }
+  // Keep the following requests until the response is sent,
+  // dropping everything after the first byte that doesn't fit
+  size_t rest = size - used;
+  if (inputOverflow || rest == 0)
+    return;
+  if (rest > INPUT_BUFFER - inputLength) {
+    rest = INPUT_BUFFER - inputLength;
+    inputOverflow = true;
+  }
+  memcpy(input + inputLength, data + used, rest);
+  inputLength += rest;
+}
+
+void HttpConnection::open(HttpServer* server, HttpSocket* socket) {
+  this->server = server;
+  this->socket = socket;
+  socket->connection = this;
+  state = READING;
+  servedRequests = 0;
+  inputLength = 0;
+  inputOverflow = false;
+  response.body = nullptr;
+  startRequest();
+}
+
+void HttpConnection::release() {
+  response.clearBody();
+  if (socket != nullptr)
+    socket->connection = nullptr;
+  socket = nullptr;
+  state = FREE;
+}
+
+void HttpConnection::startRequest() {
+  lastActivity = server->now;
+  lineLength = 0;
+  lineOverflow = false;
+  requestLineDone = false;
+  errorStatus = 0;
+  request.keepAlive = false;
+  request.hasBody = false;
+  request.headerCount = 0;
+  request.headersLength = 0;
+}
+
+// Parses bytes of a request until it's complete, returns the number of bytes used
+size_t HttpConnection::parse(const uint8_t* data, size_t size) {
+  size_t i = 0;
+  while (i < size && state == READING) {
+    char c = (char) data[i++];
+    if (c == '\n') {
+      if (lineLength > 0 && line[lineLength - 1] == '\r')
+        lineLength--;
+      line[lineLength] = '\0';
+      processLine();
+      lineLength = 0;
+      lineOverflow = false;
+    }
+    else if (lineLength + 1 < MAX_LINE)
+      line[lineLength++] = c;
+    else
+      lineOverflow = true;
+  }
+  return i;
+}
+
+// Parses the pipelined bytes received while the previous response was sent
+void HttpConnection::parseInput() {
+  size_t used = parse(input, inputLength);
+  memmove(input, input + used, inputLength - used);
+  inputLength -= used;
+}
+
+void HttpConnection::processLine() {
+  if (!requestLineDone) {
+    // Empty lines before the request line are allowed
+    if (lineLength == 0 && !lineOverflow)
+      return;
+    errorStatus = lineOverflow ? 414 : request.parseRequestLine(line);
+    requestLineDone = true;
+    return;
+  }
+  if (lineLength == 0 && !lineOverflow) {
+    state = READY;
+    return;
+  }
+  char* colon = strchr(line, ':');
+  if (lineOverflow || colon == nullptr)
+    return;
+  *colon = '\0';
+  char* value = colon + 1;
+  while (*value == ' ' || *value == '\t')
+    value++;
+  char* end = value + strlen(value);
+  while (end > value && isspace((unsigned char) end[-1]))
+    *--end = '\0';
+  request.parseHeader(line, value);
+  for (uint8_t i = 0; i < server->headerCount; i++) {
+    if (strcasecmp(line, server->headerNames[i]) == 0) {
+      request.addHeader(server->headerNames[i], value);
+      break;
+    }
+  }
+}
+
+void HttpConnection::pump() {
+  if (!response.headersDone)
+    response.finishHeaders();
+  if (response.sent == response.length && !response.fill()) {
+    if (response.complete)
+      finish();
+    return;
+  }
+  size_t space = socket->space();
+  size_t pending = response.length - response.sent;
+  size_t written = socket->write(response.buffer + response.sent, space < pending ? space : pending);
+  response.sent += written;
+  if (written > 0)
+    lastActivity = server->now;
+  if (response.complete && response.sent == response.length)
+    finish();
+}
+
+// Continues with the next request after a complete response, if the connection persists
+void HttpConnection::finish() {
+  response.clearBody();
+  if (!response.keepAlive) {
+    close();
+    return;
+  }
+  startRequest();
+  state = READING;
+  parseInput();
+  // The rest of a pipelined request was dropped
+  if (state == READING && inputOverflow)
+    close();
+}
+
+void HttpConnection::close() {
+  state = CLOSING;
+  socket->close();
+}
+
+bool HttpConnection::isIdle() const {
+  return state == READING && servedRequests > 0 && !requestLineDone && lineLength == 0;
+}
+
+
+HttpServer::HttpServer():
+    routeCount(0),
+    headerCount(0),
+    now(0),
+    requests(0),
+    rejected(0) {
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    connections[i].state = HttpConnection::FREE;
+    connections[i].socket = nullptr;
+    connections[i].response.body = nullptr;
+  }
+}
+
+void HttpServer::on(const char* path, Handler handler) {
+  if (routeCount == MAX_ROUTES)
+    return;
+  routes[routeCount].path = path;
+  routes[routeCount].handler = handler;
+  routeCount++;
+}
+
+void HttpServer::onNotFound(Handler handler) {
+  notFound = handler;
+}
+
+void HttpServer::collectHeader(const char* name) {
+  if (headerCount < HttpRequest::MAX_HEADERS)
+    headerNames[headerCount++] = name;
+}
+
+HttpConnection* HttpServer::accept(HttpSocket* socket) {
+  HttpConnection* idle = nullptr;
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    HttpConnection& connection = connections[i];
+    if (connection.state == HttpConnection::FREE) {
+      connection.open(this, socket);
+      return &connection;
+    }
+    if (connection.isIdle() && (idle == nullptr || now - connection.lastActivity > now - idle->lastActivity))
+      idle = &connection;
+  }
+  if (idle == nullptr) {
+    rejected++;
+    return nullptr;
+  }
+  // The client of an idle connection retries on a new one if it needs to
+  idle->socket->close();
+  idle->release();
+  idle->open(this, socket);
+  return idle;
+}
+
+void HttpServer::release(HttpConnection* connection) {
+  connection->release();
+}
+
+void HttpServer::loop(uint32_t nowMillis) {
+  now = nowMillis;
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    HttpConnection& connection = connections[i];
+    switch (connection.state) {
+      case HttpConnection::READING:
+        if (now - connection.lastActivity >
+            (connection.isIdle() ? KEEP_ALIVE_TIMEOUT_MILLIS : REQUEST_TIMEOUT_MILLIS))
+          connection.close();
+        break;
+      case HttpConnection::READY:
+        handle(connection);
+        connection.state = HttpConnection::SENDING;
+        connection.pump();
+        break;
+      case HttpConnection::SENDING:
+        if (now - connection.lastActivity > SEND_TIMEOUT_MILLIS)
+          connection.close();
+        else
+          connection.pump();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+uint8_t HttpServer::getActiveConnections() const {
+  uint8_t active = 0;
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    if (connections[i].state != HttpConnection::FREE)
+      active++;
+  }
+  return active;
+}
+
+uint32_t HttpServer::getRequestCount() const {
+  return requests;
+}
+
+uint32_t HttpServer::getRejectedCount() const {
+  return rejected;
+}
+
+void HttpServer::handle(HttpConnection& connection) {
+  HttpRequest& request = connection.request;
+  HttpResponse& response = connection.response;
+  requests++;
+  connection.servedRequests++;
+  bool keepAlive = connection.errorStatus == 0 && request.keepAlive && !request.hasBody &&
+    connection.servedRequests < MAX_KEEP_ALIVE_REQUESTS;
+  response.reset(request.method != HttpMethod::HEAD, request.http11, keepAlive,
+    MAX_KEEP_ALIVE_REQUESTS - connection.servedRequests);
+  if (connection.errorStatus != 0) {
+    response.send(connection.errorStatus, "text/plain", statusText(connection.errorStatus));
+    return;
+  }
+  if (request.method != HttpMethod::GET && request.method != HttpMethod::HEAD) {
+    response.send(405, "text/plain", statusText(405));
+    return;
+  }
+  Handler* handler = &notFound;
+  for (uint8_t i = 0; i < routeCount; i++) {
+    if (strcmp(routes[i].path, request.target) == 0) {
+      handler = &routes[i].handler;
+      break;
+    }
+  }
+  if (*handler)
+    (*handler)(request, response);
+  if (!response.isStarted())
+    response.send(*handler ? 500 : 404, "text/plain", statusText(*handler ? 500 : 404));
+}
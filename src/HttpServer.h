@@ -0,0 +1,284 @@
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <new>
+#include <utility>
+
+class HttpConnection;
+
+/** A TCP connection accepted by the transport of HttpServer */
+class HttpSocket {
+  public:
+    HttpSocket(): connection(nullptr) {}
+    virtual ~HttpSocket() {}
+    // Number of bytes that can be written without blocking
+    virtual size_t space() = 0;
+    // Queues bytes for sending, returns the number of bytes accepted
+    virtual size_t write(const uint8_t* data, size_t size) = 0;
+    // Closes the connection after the queued bytes are sent
+    virtual void close() = 0;
+
+    // The connection slot of this socket, nullptr if it was rejected or
+    // the server closed it to give its slot to another one
+    HttpConnection* getConnection() const { return connection; }
+
+  private:
+    friend class HttpConnection;
+
+    HttpConnection* connection;
+};
+
+/** Source of a response body, pulled as the socket accepts more data */
+class HttpBody {
+  public:
+    // Returned by read() after the last byte of the body
+    static const size_t END = (size_t) -1;
+
+    virtual ~HttpBody() {}
+    // Writes up to size bytes of the body to buffer and returns their number,
+    // 0 if no data is available yet, or END if the body is complete
+    virtual size_t read(uint8_t* buffer, size_t size) = 0;
+};
+
+/** Body of a response kept in memory owned by the caller */
+class HttpMemoryBody: public HttpBody {
+  public:
+    HttpMemoryBody(const uint8_t* data, size_t size);
+    size_t read(uint8_t* buffer, size_t size) override;
+
+  private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+};
+
+enum class HttpMethod : uint8_t { GET, HEAD, POST, OTHER };
+
+class HttpRequest {
+  public:
+    static const size_t MAX_TARGET = 128;
+    static const uint8_t MAX_HEADERS = 4;
+    static const size_t HEADER_STORAGE = 160;
+
+    HttpMethod getMethod() const;
+    // Path of the request target without the query string
+    const char* getPath() const;
+    bool hasArg(const char* name) const;
+    // Copies the decoded value of a query string argument,
+    // returns false if there is no such argument
+    bool getArg(const char* name, char* value, size_t size) const;
+    // Numeric value of a query string argument, or defaultValue if it's missing
+    long getArg(const char* name, long defaultValue) const;
+    // Value of a header collected by the server, or nullptr if it's missing
+    const char* getHeader(const char* name) const;
+    // Resolves a single byte range of the Range header, which must be collected,
+    // against content of the given size. Returns 206 and the range if it's valid,
+    // 416 if it starts past the end, or 200 if there's none or it's ignored.
+    uint16_t getRange(uint32_t size, uint32_t& start, uint32_t& length) const;
+
+  private:
+    friend class HttpConnection;
+    friend class HttpServer;
+
+    HttpMethod method;
+    bool http11;
+    // The client allows the connection to stay open for the next request
+    bool keepAlive;
+    bool hasBody;
+    char target[MAX_TARGET];
+    const char* query;
+    const char* headerNames[MAX_HEADERS];
+    uint8_t headerValues[MAX_HEADERS];
+    uint8_t headerCount;
+    char headers[HEADER_STORAGE];
+    size_t headersLength;
+
+    // Returns 0 if the line is valid or the status of the error response
+    uint16_t parseRequestLine(char* line);
+    // Handles the headers the server needs for every request
+    void parseHeader(const char* name, const char* value);
+    const char* findArg(const char* name) const;
+    void addHeader(const char* name, const char* value);
+};
+
+class HttpResponse {
+  public:
+    static const size_t BUFFER_SIZE = 512;
+    static const size_t BODY_STORAGE = 192;
+    // Content length of a body of unknown length, sent in chunks
+    static const int32_t CHUNKED = -1;
+
+    // Starts a response with a body of the given length or CHUNKED.
+    // Headers may be added until the handler returns.
+    // Responses with status 304 have no body and ignore the length.
+    void begin(uint16_t status, const char* contentType, int32_t contentLength);
+    void addHeader(const char* name, const char* value);
+
+    // Sends a complete response with a short body, which is copied
+    void send(uint16_t status, const char* contentType, const char* body);
+
+    // Constructs the body of the response begun with begin() in place.
+    // It is destroyed when the response is complete or the connection closes.
+    template<typename Body, typename... Args>
+    Body* setBody(Args&&... args) {
+      static_assert(sizeof(Body) <= BODY_STORAGE, "Body doesn't fit in the response");
+      static_assert(alignof(Body) <= alignof(max_align_t), "Body is overaligned");
+      clearBody();
+      Body* created = new (bodyStorage) Body(std::forward<Args>(args)...);
+      body = created;
+      return created;
+    }
+
+    bool isStarted() const;
+
+  private:
+    friend class HttpConnection;
+    friend class HttpServer;
+
+    uint8_t buffer[BUFFER_SIZE];
+    size_t length;
+    size_t sent;
+    bool started;
+    bool headersDone;
+    bool chunked;
+    bool withBody;
+    bool http11;
+    bool keepAlive;
+    uint8_t remainingRequests;
+    bool complete;
+    // Bytes of a body of fixed length not sent yet
+    uint32_t bodyRemaining;
+    alignas(max_align_t) uint8_t bodyStorage[BODY_STORAGE];
+    HttpBody* body;
+
+    void reset(bool withBody, bool http11, bool keepAlive, uint8_t remainingRequests);
+    void clearBody();
+    void append(const char* text);
+    void finishHeaders();
+    bool fill();
+};
+
+class HttpServer;
+
+/** State of a single client connection */
+class HttpConnection {
+  public:
+    static const size_t MAX_LINE = 256;
+    // Pipelined requests received while a response is being sent
+    static const size_t INPUT_BUFFER = 256;
+
+    // Called by the transport with received bytes
+    void receive(const uint8_t* data, size_t size);
+
+  private:
+    friend class HttpServer;
+
+    enum State { FREE, READING, READY, SENDING, CLOSING };
+
+    State state;
+    HttpServer* server;
+    HttpSocket* socket;
+    uint32_t lastActivity;
+    uint8_t servedRequests;
+    char line[MAX_LINE];
+    size_t lineLength;
+    bool lineOverflow;
+    bool requestLineDone;
+    uint16_t errorStatus;
+    uint8_t input[INPUT_BUFFER];
+    size_t inputLength;
+    bool inputOverflow;
+    HttpRequest request;
+    HttpResponse response;
+
+    void open(HttpServer* server, HttpSocket* socket);
+    void release();
+    void startRequest();
+    size_t parse(const uint8_t* data, size_t size);
+    void parseInput();
+    void processLine();
+    void pump();
+    void finish();
+    void close();
+    // Waiting for the next request on a persistent connection
+    bool isIdle() const;
+};
+
+/**
+ * Asynchronous HTTP/1.1 server core, independent of the TCP stack.
+ *
+ * A transport (see HttpTransport.h) accepts connections into a fixed number of slots
+ * and feeds received bytes to them from its callbacks. Requests are parsed
+ * as the bytes arrive, keeping only the request line and the headers
+ * registered with collectHeader(). Handlers run from loop(),
+ * and responses are produced incrementally: every loop() writes at most one
+ * buffer of BUFFER_SIZE bytes to each connection, and only as much as the TCP
+ * send window allows, so a slow client never blocks the main loop.
+ * Bodies of unknown length are sent with chunked transfer encoding.
+ *
+ * Connections are persistent unless the client asks otherwise, so a page and
+ * its resources don't each pay for a TCP handshake with the device. A connection
+ * is closed after KEEP_ALIVE_TIMEOUT_MILLIS without a request or after
+ * MAX_KEEP_ALIVE_REQUESTS requests. Idle connections don't take slots away
+ * from new ones: when all slots are busy, the one idle for the longest time
+ * is closed and its slot is given to the new connection.
+ * Pipelined requests are answered in order. While a response is sent, up to
+ * HttpConnection::INPUT_BUFFER bytes of the following requests are kept.
+ * If more arrive, the connection is closed after the responses to the complete
+ * requests, and the client repeats the others on a new connection.
+ */
+class HttpServer {
+  public:
+    typedef std::function<void(HttpRequest&, HttpResponse&)> Handler;
+
+    static const uint8_t MAX_CONNECTIONS = 4;
+    static const uint8_t MAX_ROUTES = 16;
+    static const uint32_t REQUEST_TIMEOUT_MILLIS = 5000;
+    static const uint32_t SEND_TIMEOUT_MILLIS = 20000;
+    static const uint32_t KEEP_ALIVE_TIMEOUT_MILLIS = 5000;
+    static const uint8_t MAX_KEEP_ALIVE_REQUESTS = 100;
+
+    HttpServer();
+
+    void on(const char* path, Handler handler);
+    void onNotFound(Handler handler);
+    // Keeps the header with the given name in requests, other headers are skipped
+    void collectHeader(const char* name);
+
+    // Assigns a new connection to a free or idle slot, returns nullptr if there is none
+    HttpConnection* accept(HttpSocket* socket);
+    // Frees the slot of a connection closed by either side
+    void release(HttpConnection* connection);
+
+    void loop(uint32_t nowMillis);
+
+    uint8_t getActiveConnections() const;
+    uint32_t getRequestCount() const;
+    uint32_t getRejectedCount() const;
+
+  private:
+    friend class HttpConnection;
+
+    struct Route {
+      const char* path;
+      Handler handler;
+    };
+
+    HttpConnection connections[MAX_CONNECTIONS];
+    Route routes[MAX_ROUTES];
+    uint8_t routeCount;
+    const char* headerNames[HttpRequest::MAX_HEADERS];
+    uint8_t headerCount;
+    Handler notFound;
+    uint32_t now;
+    uint32_t requests;
+    uint32_t rejected;
+
+    void handle(HttpConnection& connection);
+};
+
+#endif /* HTTPSERVER_H */
@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "HttpTemplate.h"
+
+
+static bool isNameChar(uint8_t c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+HttpTemplate::HttpTemplate():
+    source(nullptr),
+    segmentCount(0) {
+}
+
+bool HttpTemplate::parse(Source& source, const char* const* names, uint8_t nameCount) {
+  this->source = nullptr;
+  segmentCount = 0;
+  uint32_t size = source.size();
+  uint32_t literalStart = 0;
+  uint32_t offset = 0;
+  uint8_t buffer[128];
+  // Name after '$' being read, nameLength > MAX_NAME if it's too long
+  char name[MAX_NAME + 1];
+  uint8_t nameLength = 0;
+  bool inName = false;
+
+  while (offset <= size) {
+    size_t n = 0;
+    if (offset < size) {
+      n = source.read(offset, buffer, sizeof(buffer));
+      if (n == 0)
+        return false;
+    }
+    // A zero byte past the end terminates a name at the end of the template
+    size_t end = offset < size ? n : 1;
+    for (size_t i = 0; i < end; i++) {
+      uint8_t c = offset < size ? buffer[i] : 0;
+      uint32_t at = offset + i;
+      if (inName && isNameChar(c)) {
+        if (nameLength < MAX_NAME)
+          name[nameLength] = (char) c;
+        if (nameLength <= MAX_NAME)
+          nameLength++;
+        continue;
+      }
+      if (inName) {
+        inName = false;
+        if (nameLength <= MAX_NAME) {
+          name[nameLength] = '\0';
+          for (uint8_t slot = 0; slot < nameCount; slot++) {
+            if (strcmp(name, names[slot]) != 0)
+              continue;
+            uint32_t dollar = at - nameLength - 1;
+            if (!addLiteral(literalStart, dollar) || segmentCount == MAX_SEGMENTS)
+              return false;
+            segments[segmentCount].offset = dollar;
+            segments[segmentCount].length = nameLength + 1;
+            segments[segmentCount].slot = slot;
+            segmentCount++;
+            literalStart = at;
+            break;
+          }
+        }
+      }
+      if (c == '$' && at < size) {
+        inName = true;
+        nameLength = 0;
+      }
+    }
+    offset += end;
+  }
+  if (!addLiteral(literalStart, size))
+    return false;
+  this->source = &source;
+  return true;
+}
+
+bool HttpTemplate::isParsed() const {
+  return source != nullptr;
+}
+
+uint8_t HttpTemplate::getSegmentCount() const {
+  return segmentCount;
+}
+
+bool HttpTemplate::addLiteral(uint32_t from, uint32_t to) {
+  while (from < to) {
+    if (segmentCount == MAX_SEGMENTS)
+      return false;
+    uint32_t length = to - from;
+    if (length > UINT16_MAX)
+      length = UINT16_MAX;
+    segments[segmentCount].offset = from;
+    segments[segmentCount].length = (uint16_t) length;
+    segments[segmentCount].slot = LITERAL;
+    segmentCount++;
+    from += length;
+  }
+  return true;
+}
+
+
+HttpTemplateBody::HttpTemplateBody(const HttpTemplate& page, HttpTemplate::Values& values):
+    page(page),
+    values(values),
+    segment(0),
+    pos(0) {
+}
+
+size_t HttpTemplateBody::read(uint8_t* buffer, size_t size) {
+  size_t filled = 0;
+  while (segment < page.segmentCount && filled < size) {
+    const HttpTemplate::Segment& current = page.segments[segment];
+    if (current.slot == HttpTemplate::LITERAL) {
+      size_t n = current.length - pos;
+      if (n > size - filled)
+        n = size - filled;
+      size_t read = page.source->read(current.offset + pos, buffer + filled, n);
+      if (read == 0)
+        return filled > 0 ? filled : HttpBody::END;
+      filled += read;
+      pos += read;
+      if (pos < current.length)
+        continue;
+    }
+    else {
+      // Values are never split, they might change between two reads
+      char value[HttpTemplate::MAX_VALUE + 1];
+      values.format(current.slot, value, sizeof(value));
+      size_t length = strlen(value);
+      if (length > size - filled) {
+        if (filled > 0)
+          break;
+        length = size;
+      }
+      memcpy(buffer + filled, value, length);
+      filled += length;
+    }
+    segment++;
+    pos = 0;
+  }
+  return filled > 0 ? filled : HttpBody::END;
+}
@@ -0,0 +1,81 @@
+#ifndef HTTPTEMPLATE_H
+#define HTTPTEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HttpServer.h"
+
+/**
+ * A page with $name placeholders, parsed once into literal segments
+ * and placeholder slots, and rendered by streaming the literal bytes
+ * from their source and formatting the values into a small buffer.
+ * Rendering allocates nothing on the heap.
+ *
+ * A placeholder is a '$' followed by the longest run of letters, digits and
+ * underscores, which must equal one of the names given to parse().
+ * Other '$' characters are kept as they are.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class HttpTemplate {
+  public:
+    static const uint8_t MAX_SEGMENTS = 32;
+    static const uint8_t MAX_NAME = 16;
+    // Maximum length of a formatted value
+    static const size_t MAX_VALUE = 24;
+
+    /** Random access to the bytes of the template, e.g. a file kept open */
+    class Source {
+      public:
+        virtual ~Source() {}
+        virtual uint32_t size() = 0;
+        virtual size_t read(uint32_t offset, uint8_t* buffer, size_t size) = 0;
+    };
+
+    /** Formats the value of the placeholder with the given index in names */
+    class Values {
+      public:
+        virtual ~Values() {}
+        // Writes at most size - 1 characters and a terminating zero
+        virtual void format(uint8_t slot, char* buffer, size_t size) = 0;
+    };
+
+    HttpTemplate();
+
+    // Splits the template into segments, returns false if it has too many
+    bool parse(Source& source, const char* const* names, uint8_t nameCount);
+    bool isParsed() const;
+    uint8_t getSegmentCount() const;
+
+  private:
+    friend class HttpTemplateBody;
+
+    static const uint8_t LITERAL = 0xFF;
+
+    struct Segment {
+      uint32_t offset;
+      uint16_t length;
+      uint8_t slot;
+    };
+
+    Source* source;
+    Segment segments[MAX_SEGMENTS];
+    uint8_t segmentCount;
+
+    bool addLiteral(uint32_t from, uint32_t to);
+};
+
+/** Body of a response rendering an HttpTemplate, sent in chunks */
+class HttpTemplateBody: public HttpBody {
+  public:
+    HttpTemplateBody(const HttpTemplate& page, HttpTemplate::Values& values);
+    size_t read(uint8_t* buffer, size_t size) override;
+
+  private:
+    const HttpTemplate& page;
+    HttpTemplate::Values& values;
+    uint8_t segment;
+    uint32_t pos;
+};
+
+#endif /* HTTPTEMPLATE_H */
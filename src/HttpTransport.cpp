@@ -0,0 +1,107 @@
+#include "HttpTransport.h"
+#include "Storage.h"
+
+
+HttpTransport::HttpTransport(uint16_t port, HttpServer& server):
+    tcpServer(port),
+    server(server) {
+}
+
+void HttpTransport::begin() {
+  tcpServer.onClient([this](void*, AsyncClient* client) { handleClient(client); }, nullptr);
+  tcpServer.setNoDelay(true);
+  tcpServer.begin();
+}
+
+void HttpTransport::handleClient(AsyncClient* client) {
+  Socket* socket = new Socket(client);
+  if (server.accept(socket) == nullptr) {
+    Serial.println("HTTP connection rejected, all slots busy");
+    delete socket;
+    client->onDisconnect([](void*, AsyncClient* client) { delete client; }, nullptr);
+    client->close();
+    return;
+  }
+  client->onData([](void* arg, AsyncClient*, void* data, size_t size) {
+    HttpConnection* connection = ((Socket*) arg)->getConnection();
+    if (connection != nullptr)
+      connection->receive((const uint8_t*) data, size);
+  }, socket);
+  client->onDisconnect([this](void* arg, AsyncClient* client) {
+    Socket* socket = (Socket*) arg;
+    // The slot of an idle connection may have been given to another one
+    if (socket->getConnection() != nullptr)
+      server.release(socket->getConnection());
+    delete socket;
+    delete client;
+  }, socket);
+}
+
+HttpTransport::Socket::Socket(AsyncClient* client):
+    client(client) {
+}
+
+size_t HttpTransport::Socket::space() {
+  return client->canSend() ? client->space() : 0;
+}
+
+size_t HttpTransport::Socket::write(const uint8_t* data, size_t size) {
+  size_t added = client->add((const char*) data, size, ASYNC_WRITE_FLAG_COPY);
+  if (added > 0)
+    client->send();
+  return added;
+}
+
+void HttpTransport::Socket::close() {
+  client->close();
+}
+
+
+HttpFileBody::HttpFileBody(File file, uint32_t offset, uint32_t length):
+    file(file),
+    remaining(length) {
+  this->file.seek(offset, SeekSet);
+}
+
+HttpFileBody::~HttpFileBody() {
+  file.close();
+}
+
+size_t HttpFileBody::read(uint8_t* buffer, size_t size) {
+  if (size > remaining)
+    size = remaining;
+  size_t n = size > 0 ? file.read(buffer, size) : 0;
+  remaining -= n;
+  return n > 0 ? n : END;
+}
+
+
+bool HttpFileSource::open(const String& fileName) {
+  file = Storage.open(fileName, "r");
+  return (bool) file;
+}
+
+uint32_t HttpFileSource::size() {
+  return file.size();
+}
+
+size_t HttpFileSource::read(uint32_t offset, uint8_t* buffer, size_t size) {
+  if (!file || !file.seek(offset, SeekSet))
+    return 0;
+  return file.read(buffer, size);
+}
+
+
+HttpStringBody::HttpStringBody(const String& content):
+    content(content),
+    pos(0) {
+}
+
+size_t HttpStringBody::read(uint8_t* buffer, size_t size) {
+  if (pos == content.length())
+    return END;
+  size_t n = min(size, content.length() - pos);
+  memcpy(buffer, content.c_str() + pos, n);
+  pos += n;
+  return n;
+}
@@ -0,0 +1,76 @@
+#ifndef HTTPTRANSPORT_H
+#define HTTPTRANSPORT_H
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+#include <FS.h>
+
+#include "HttpServer.h"
+#include "HttpTemplate.h"
+
+/**
+ * Accepts TCP connections for an HttpServer with ESPAsyncTCP.
+ * Received data is passed to the server from the TCP callbacks,
+ * responses are written from HttpServer::loop() as the send window allows.
+ */
+class HttpTransport {
+  public:
+    HttpTransport(uint16_t port, HttpServer& server);
+    void begin();
+
+  private:
+    class Socket: public HttpSocket {
+      public:
+        Socket(AsyncClient* client);
+        size_t space() override;
+        size_t write(const uint8_t* data, size_t size) override;
+        void close() override;
+
+        AsyncClient* const client;
+    };
+
+    AsyncServer tcpServer;
+    HttpServer& server;
+
+    void handleClient(AsyncClient* client);
+};
+
+/**
+ * Body of a response read from a file, starting at the given offset.
+ * At most length bytes are sent, so that a file appended to while it's being
+ * sent doesn't exceed the Content-Length announced at the start.
+ */
+class HttpFileBody: public HttpBody {
+  public:
+    HttpFileBody(File file, uint32_t offset = 0, uint32_t length = UINT32_MAX);
+    ~HttpFileBody();
+    size_t read(uint8_t* buffer, size_t size) override;
+
+  private:
+    File file;
+    uint32_t remaining;
+};
+
+/** Template source in a file, kept open to avoid allocations when rendering */
+class HttpFileSource: public HttpTemplate::Source {
+  public:
+    bool open(const String& fileName);
+    uint32_t size() override;
+    size_t read(uint32_t offset, uint8_t* buffer, size_t size) override;
+
+  private:
+    File file;
+};
+
+/** Body of a response kept in a String */
+class HttpStringBody: public HttpBody {
+  public:
+    HttpStringBody(const String& content);
+    size_t read(uint8_t* buffer, size_t size) override;
+
+  private:
+    const String content;
+    size_t pos;
+};
+
+#endif /* HTTPTRANSPORT_H */
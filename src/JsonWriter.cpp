@@ -0,0 +1,175 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "JsonWriter.h"
+
+
+TextWriter::TextWriter(char* buffer, size_t size):
+    buffer(buffer),
+    size(size),
+    pos(0),
+    overflowed(size == 0) {
+  if (size > 0)
+    buffer[0] = '\0';
+}
+
+void TextWriter::print(char c) {
+  if (pos + 1 >= size) {
+    overflowed = true;
+    return;
+  }
+  buffer[pos++] = c;
+  buffer[pos] = '\0';
+}
+
+void TextWriter::print(const char* text) {
+  size_t n = strlen(text);
+  if (pos + n >= size) {
+    overflowed = true;
+    return;
+  }
+  memcpy(buffer + pos, text, n + 1);
+  pos += n;
+}
+
+void TextWriter::print(uint32_t value) {
+  // Faster than snprintf, which matters for metrics with many counters
+  char digits[11];
+  char* start = digits + sizeof(digits) - 1;
+  *start = '\0';
+  do {
+    *--start = (char) ('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+  print(start);
+}
+
+void TextWriter::print(int32_t value) {
+  if (value < 0) {
+    print('-');
+    print((uint32_t) 0 - (uint32_t) value);
+  }
+  else
+    print((uint32_t) value);
+}
+
+void TextWriter::print(double value, uint8_t decimals) {
+  if (size <= pos) {
+    overflowed = true;
+    return;
+  }
+  int n = snprintf(buffer + pos, size - pos, "%.*f", decimals, value);
+  if (n < 0 || (size_t) n >= size - pos) {
+    overflowed = true;
+    buffer[pos] = '\0';
+    return;
+  }
+  pos += n;
+}
+
+const char* TextWriter::c_str() const {
+  return buffer;
+}
+
+size_t TextWriter::length() const {
+  return pos;
+}
+
+bool TextWriter::isOverflowed() const {
+  return overflowed;
+}
+
+
+JsonWriter::JsonWriter(char* buffer, size_t size):
+    TextWriter(buffer, size),
+    nonEmpty(0),
+    depth(0),
+    afterKey(false) {
+}
+
+void JsonWriter::beginObject() {
+  separate();
+  print('{');
+  if (depth + 1 < MAX_DEPTH)
+    depth++;
+  nonEmpty &= ~(1 << depth);
+}
+
+void JsonWriter::endObject() {
+  if (depth > 0)
+    depth--;
+  print('}');
+}
+
+void JsonWriter::beginArray() {
+  separate();
+  print('[');
+  if (depth + 1 < MAX_DEPTH)
+    depth++;
+  nonEmpty &= ~(1 << depth);
+}
+
+void JsonWriter::endArray() {
+  if (depth > 0)
+    depth--;
+  print(']');
+}
+
+void JsonWriter::key(const char* name) {
+  value(name);
+  print(':');
+  afterKey = true;
+}
+
+void JsonWriter::value(const char* text) {
+  separate();
+  print('"');
+  for (const char* c = text; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      print('\\');
+      print(*c);
+    }
+    else if ((unsigned char) *c < 0x20) {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char) *c);
+      print(escaped);
+    }
+    else
+      print(*c);
+  }
+  print('"');
+}
+
+void JsonWriter::value(uint32_t number) {
+  separate();
+  print(number);
+}
+
+void JsonWriter::value(int32_t number) {
+  separate();
+  print(number);
+}
+
+void JsonWriter::value(double number, uint8_t decimals) {
+  separate();
+  if (isfinite(number))
+    print(number, decimals);
+  else
+    print("null");
+}
+
+void JsonWriter::null() {
+  separate();
+  print("null");
+}
+
+void JsonWriter::separate() {
+  if (afterKey) {
+    afterKey = false;
+    return;
+  }
+  if (nonEmpty & (1 << depth))
+    print(',');
+  nonEmpty |= 1 << depth;
+}
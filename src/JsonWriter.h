@@ -0,0 +1,74 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Appends text to a fixed buffer supplied by the caller, e.g. on the stack
+ * or the buffer of a response body, so that no heap memory is used.
+ * The text is always null-terminated. Text that doesn't fit is dropped and
+ * the writer remembers it overflowed.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class TextWriter {
+  public:
+    TextWriter(char* buffer, size_t size);
+
+    void print(char c);
+    void print(const char* text);
+    void print(uint32_t value);
+    void print(int32_t value);
+    // Prints a finite value with the given number of decimal places
+    void print(double value, uint8_t decimals);
+
+    const char* c_str() const;
+    size_t length() const;
+    bool isOverflowed() const;
+
+  protected:
+    char* buffer;
+    size_t size;
+    size_t pos;
+    bool overflowed;
+};
+
+/**
+ * Writes JSON with a TextWriter, inserting the separators between members
+ * and elements. Non-finite numbers are written as null.
+ */
+class JsonWriter: public TextWriter {
+  public:
+    static const uint8_t MAX_DEPTH = 16;
+
+    JsonWriter(char* buffer, size_t size);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    // Name of the next member of the current object
+    void key(const char* name);
+
+    void value(const char* text);
+    void value(uint32_t number);
+    void value(int32_t number);
+    void value(double number, uint8_t decimals);
+    void null();
+
+    template<typename... Args>
+    void add(const char* name, Args... args) {
+      key(name);
+      value(args...);
+    }
+
+  private:
+    // Bit i is set if the container at depth i has a member or element already
+    uint16_t nonEmpty;
+    uint8_t depth;
+    bool afterKey;
+
+    void separate();
+};
+
+#endif /* JSONWRITER_H */
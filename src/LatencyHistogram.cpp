@@ -0,0 +1,79 @@
+#include <string.h>
+
+#include "LatencyHistogram.h"
+
+
+// Upper bounds of all buckets but the last one
+static const uint32_t BOUNDS_MICROS[] = {
+  1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 5000000
+};
+static const char* const BOUNDS_SECONDS[] = {
+  "0.001", "0.002", "0.005", "0.01", "0.02", "0.05", "0.1", "0.2", "0.5", "1", "5", "+Inf"
+};
+
+static_assert(sizeof(BOUNDS_MICROS) / sizeof(BOUNDS_MICROS[0]) == LatencyHistogram::BUCKETS - 1,
+  "a bound for every bucket but the last");
+static_assert(sizeof(BOUNDS_SECONDS) / sizeof(BOUNDS_SECONDS[0]) == LatencyHistogram::BUCKETS,
+  "a label for every bucket");
+
+
+LatencyHistogram::LatencyHistogram():
+    count(0),
+    sumMicros(0) {
+  memset(counts, 0, sizeof(counts));
+}
+
+void LatencyHistogram::record(uint32_t micros) {
+  uint8_t bucket = 0;
+  while (bucket < BUCKETS - 1 && micros > BOUNDS_MICROS[bucket])
+    bucket++;
+  counts[bucket]++;
+  count++;
+  sumMicros += micros;
+}
+
+uint32_t LatencyHistogram::getCount() const {
+  return count;
+}
+
+uint64_t LatencyHistogram::getSumMicros() const {
+  return sumMicros;
+}
+
+uint32_t LatencyHistogram::getPercentileMicros(double fraction) const {
+  if (count == 0)
+    return 0;
+  uint32_t cumulative = 0;
+  for (uint8_t bucket = 0; bucket < BUCKETS - 1; bucket++) {
+    cumulative += counts[bucket];
+    if (cumulative >= fraction * count)
+      return BOUNDS_MICROS[bucket];
+  }
+  return UINT32_MAX;
+}
+
+void LatencyHistogram::writeMetrics(MetricsWriter& out, const char* name, const char* help, uint8_t part) const {
+  char sample[64];
+  size_t nameLength = strlen(name);
+  if (nameLength + sizeof("_bucket") > sizeof(sample))
+    return;
+  memcpy(sample, name, nameLength);
+
+  if (part == 0)
+    out.describe(name, "histogram", help);
+  // Buckets are cumulative in Prometheus
+  uint32_t cumulative = 0;
+  for (uint8_t bucket = 0; bucket < BUCKETS && bucket < (part + 1) * BUCKETS_PER_PART; bucket++) {
+    cumulative += counts[bucket];
+    if (bucket >= part * BUCKETS_PER_PART) {
+      strcpy(sample + nameLength, "_bucket");
+      out.sample(sample, cumulative, "le", BOUNDS_SECONDS[bucket]);
+    }
+  }
+  if (part == PARTS - 1) {
+    strcpy(sample + nameLength, "_sum");
+    out.sample(sample, sumMicros / 1e6, 6);
+    strcpy(sample + nameLength, "_count");
+    out.sample(sample, count);
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HttpMetrics.h"
+
+/**
+ * Counts durations in buckets from 1 ms to 5 s, e.g. of iterations of the main
+ * loop, and writes them as a Prometheus histogram. Percentiles are estimated
+ * by the upper bound of the bucket they fall in, so they are never too low.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class LatencyHistogram {
+  public:
+    // Buckets including the last one, for durations longer than the longest bound
+    static const uint8_t BUCKETS = 12;
+    // Buckets written by each call of writeMetrics(), so the lines fit in a read
+    // of an HttpMetricsBody
+    static const uint8_t BUCKETS_PER_PART = 4;
+    static const uint8_t PARTS = (BUCKETS + BUCKETS_PER_PART - 1) / BUCKETS_PER_PART;
+
+    LatencyHistogram();
+
+    void record(uint32_t micros);
+
+    uint32_t getCount() const;
+    uint64_t getSumMicros() const;
+    // Upper bound of the bucket holding the given fraction of the shortest
+    // durations, e.g. 0.99, UINT32_MAX if it's the last bucket and 0 if empty
+    uint32_t getPercentileMicros(double fraction) const;
+
+    // Writes a part of the histogram, from 0 to PARTS - 1, the first one
+    // with the description and the last one with the sum and the count
+    void writeMetrics(MetricsWriter& out, const char* name, const char* help, uint8_t part) const;
+
+  private:
+    uint32_t counts[BUCKETS];
+    uint32_t count;
+    uint64_t sumMicros;
+};
+
+#endif /* LATENCYHISTOGRAM_H */
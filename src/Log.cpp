@@ -1,33 +1,404 @@
 #include <FS.h>
 #include "Log.h"
+#include "Storage.h"
 
 
 const unsigned long Log::SECONDS_IN_DAY = 24 * 3600;
+const acetime_t Log::FLUSH_AGE_SECONDS = 3600;
+const uint32_t Log::LOW_HEAP_BYTES = 8192;
+const char* Log::INDEX_SUFFIX = ".idx";
+const char* Log::SCHEMA_FILE = "schema.json";
 
 Log::Log(const String& dirName, const Clock& clock, const ace_time::TimeZone& tz): 
     fileNamePrefix(dirName),
     timeZone(tz),
     clock(clock),
-    logEndTime(0) {
+    logEndTime(0),
+    ringHead(0),
+    ringCount(0),
+    unindexedRecords(0),
+    bytesWritten(0),
+    recordsWritten(0),
+    writeErrors(0),
+    schema(nullptr),
+    schemaChannels(0),
+    logRing(nullptr),
+    staging(nullptr) {
 }
 
-void Log::write(const LogRecord& record) {
+void Log::write(const uint16_t* values, byte channels, const LogChannel* recordSchema) {
   acetime_t currentTime = clock.getNow();
-  time_t unixTime = LocalDateTime::forEpochSeconds(currentTime).toUnixSeconds();
-  String fileName = getFileName(currentTime);
-  Serial.print("Appending entry to log file: ");
-  Serial.println(fileName);  
-  File file = SPIFFS.open(fileName, "a");
-  file.write(record.pos + sizeof(currentTime) + 2);
-  file.write((char*) &unixTime, sizeof(unixTime));
-  file.write((char*) record.buffer, record.pos);
-  file.write(0);  // reserved for future use, e.g. checksum
-  file.write(0);  // reserved for future use, e.g. checksum
+  // Without the time, the record would go to a day file named after an invalid date
+  if (currentTime == Clock::kInvalidSeconds) {
+    Serial.println("Clock not set, dropping an entry of log " + fileNamePrefix);
+    return;
+  }
+  if (recordSchema != schema) {
+    writeSchema(recordSchema, channels);
+    schema = recordSchema;
+    schemaChannels = channels;
+  }
+
+  enqueue(currentTime, values, channels);
+  if (staging != nullptr) {
+    LogStaging::Record record;
+    record.time = currentTime;
+    record.channels = channels;
+    memcpy(record.values, values, channels * sizeof(uint16_t));
+    staging->stage(record);
+  }
+  updateRollups(currentTime, values, channels);
+
+  if (shouldFlush(currentTime))
+    flush();
+}
+
+void Log::enqueue(acetime_t time, const uint16_t* values, byte channels) {
+  // Records of the previous day are written before the day changes.
+  // If that fails, they stay pending and still go to their own day file later.
+  if (ringCount > 0 && getFileName(time) != getFileName(ring[ringHead].time))
+    flush();
+  if (ringCount == RING_CAPACITY) {
+    // The last flush must have failed, drop the oldest record to make room
+    Serial.println("Log buffer full, dropping the oldest entry of " + getFileName(ring[ringHead].time));
+    ringHead = (ringHead + 1) % RING_CAPACITY;
+    ringCount--;
+    if (staging != nullptr)
+      staging->release(1);
+  }
+  PendingRecord& pending = ring[(ringHead + ringCount) % RING_CAPACITY];
+  pending.time = time;
+  pending.channels = channels;
+  memcpy(pending.values, values, channels * sizeof(uint16_t));
+  ringCount++;
+  logEndTime = time;
+}
+
+void Log::useStaging(LogStaging& logStaging) {
+  staging = &logStaging;
+  LogStaging::Record records[RING_CAPACITY];
+  byte count = staging->recover(records, RING_CAPACITY);
+  if (count > 0)
+    Serial.println("Recovered " + String(count) + " staged entries of log " + fileNamePrefix);
+  for (byte i = 0; i < count; i++) 
+    enqueue(records[i].time, records[i].values, records[i].channels);
+}
+
+void Log::begin() {
+  LogEntry last;
+  if (!readLastRecord(last))
+    return;
+  acetime_t endTime = LocalDateTime::forUnixSeconds(last.timestamp).toEpochSeconds();
+  // Until the clock is set, a record from the future can't be told apart
+  acetime_t now = clock.getNow();
+  if (now != Clock::kInvalidSeconds && endTime > now) {
+    Serial.println("Last record of log " + fileNamePrefix + " is in the future, ignoring it");
+    return;
+  }
+  if (endTime > logEndTime)
+    logEndTime = endTime;
+  Serial.println("Log " + fileNamePrefix + " ends at " + String(last.timestamp));
+}
+
+void Log::loop() {
+  if (ringCount > 0 && shouldFlush(clock.getNow()))
+    flush();
+}
+
+bool Log::shouldFlush(acetime_t now) {
+  if (staging != nullptr) {
+    byte capacity = staging->getCapacity();
+    if (capacity > RING_CAPACITY)
+      capacity = RING_CAPACITY;
+    return ringCount >= capacity || ESP.getFreeHeap() < LOW_HEAP_BYTES;
+  }
+  return ringCount >= FLUSH_RECORD_COUNT 
+    || now - ring[ringHead].time >= FLUSH_AGE_SECONDS
+    || ESP.getFreeHeap() < LOW_HEAP_BYTES;
+}
+
+void Log::flush() {
+  if (logRing != nullptr) {
+    flushRing();
+    return;
+  }
+  // Pending records may span a day change if writing the previous day failed.
+  // Each day goes to its own file, the oldest first.
+  while (ringCount > 0) {
+    String fileName = getFileName(ring[ringHead].time);
+    byte count = 1;
+    while (count < ringCount && getFileName(ring[(ringHead + count) % RING_CAPACITY].time) == fileName)
+      count++;
+    if (!flushDay(fileName, count))
+      return;
+  }
+}
+
+// Encodes the oldest count pending records, so they can be appended with a single write.
+// A new block is started whenever the number of channels changes.
+size_t Log::encodePending(byte count, byte* buffer, size_t capacity) {
+  size_t size = 0;
+  byte i = 0;
+  while (i < count) {
+    byte channels = ring[(ringHead + i) % RING_CAPACITY].channels;
+    LogBlockEncoder encoder(buffer + size, capacity - size, channels);
+    for (; i < count; i++) {
+      const PendingRecord& pending = ring[(ringHead + i) % RING_CAPACITY];
+      if (pending.channels != channels)
+        break;
+      acetime_t unixTime = LocalDateTime::forEpochSeconds(pending.time).toUnixSeconds();
+      if (!encoder.add(unixTime, pending.values))
+        break;
+    }
+    if (encoder.getCount() == 0)
+      break;
+    size += encoder.finish();
+  }
+  return size;
+}
+
+// Marks the oldest count pending records as written
+void Log::releasePending(byte count) {
+  recordsWritten += count;
+  if (staging != nullptr)
+    staging->release(count);
+  ringHead = (ringHead + count) % RING_CAPACITY;
+  ringCount -= count;
+  if (ringCount == 0)
+    ringHead = 0;
+}
+
+void Log::flushRing() {
+  if (ringCount == 0)
+    return;
+  byte buffer[RING_CAPACITY * LogBlock::maxSize(1, MAX_CHANNELS)];
+  size_t size = encodePending(ringCount, buffer, sizeof(buffer));
+  uint32_t firstTime = LocalDateTime::forEpochSeconds(ring[ringHead].time).toUnixSeconds();
+  if (!logRing->append(buffer, size, firstTime)) {
+    Serial.println("Failed to append to log ring of " + fileNamePrefix);
+    writeErrors++;
+    return;
+  }
+  bytesWritten += size;
+  releasePending(ringCount);
+}
+
+bool Log::flushDay(const String& fileName, byte count) {
+  byte buffer[RING_CAPACITY * LogBlock::maxSize(1, MAX_CHANNELS)];
+  size_t size = encodePending(count, buffer, sizeof(buffer));
+
+  Serial.print("Appending ");
+  Serial.print(count);
+  Serial.print(" entries to log file: ");
+  Serial.println(fileName);
+  File file = Storage.open(fileName, "a");
+  if (!file) {
+    Serial.println("Failed to open log file " + fileName);
+    writeErrors++;
+    return false;
+  }
+  uint32_t offset = file.size();
+  size_t written = file.write(buffer, size);
   file.close();
-  logEndTime = currentTime;
+  if (written != size) {
+    Serial.println("Failed to append to log file " + fileName);
+    writeErrors++;
+    return false;
+  }
+  bytesWritten += written;
+
+  if (offset == 0) 
+    unindexedRecords = 0;
+  else if (unindexedRecords >= INDEX_INTERVAL) {
+    appendIndex(fileName, LocalDateTime::forEpochSeconds(ring[ringHead].time).toUnixSeconds(), offset);
+    unindexedRecords = 0;
+  }
+  unindexedRecords += count;
+  releasePending(count);
+  return true;
+}
+
+void Log::writeSchema(const LogChannel* channels, byte count) {
+  String descriptor = "{\"channels\":[";
+  for (byte i = 0; i < count; i++) {
+    if (i > 0)
+      descriptor += ",";
+    descriptor += String("{\"name\":\"") + channels[i].name + 
+      "\",\"type\":\"" + channels[i].typeName() + 
+      "\",\"scale\":" + String((int) channels[i].scale) + "}";
+  }
+  descriptor += "]}\n";
+
+  String fileName = fileNamePrefix + SCHEMA_FILE;
+  File file = Storage.open(fileName, "r");
+  if (file) {
+    bool unchanged = file.readString() == descriptor;
+    file.close();
+    if (unchanged)
+      return;
+  }
+  Serial.println("Writing log schema " + fileName);
+  file = Storage.open(fileName, "w");
+  if (file) {
+    bytesWritten += file.print(descriptor);
+    file.close();
+  }
+}
+
+void Log::appendIndex(const String& fileName, uint32_t unixTime, uint32_t offset) {
+  File index = Storage.open(fileName + INDEX_SUFFIX, "a");
+  if (!index) {
+    Serial.println("Failed to open index of log file " + fileName);
+    return;
+  }
+  byte entry[INDEX_ENTRY_SIZE];
+  memcpy(entry, &unixTime, sizeof(unixTime));
+  memcpy(entry + sizeof(unixTime), &offset, sizeof(offset));
+  bytesWritten += index.write(entry, sizeof(entry));
+  index.close();
 }
 
-String Log::getFileName(acetime_t currentTime) {
+uint32_t Log::findOffset(const String& fileName, uint32_t unixTime) {
+  String indexName = fileName + INDEX_SUFFIX;
+  if (!Storage.exists(indexName)) {
+    File file = Storage.open(fileName, "r");
+    if (!file)
+      return 0;
+    byte seal[LogSeal::MAX_SIZE];
+    uint32_t offset = readSeal(file, seal) > 0 ? LogSeal::findOffset(seal, unixTime) : 0;
+    file.close();
+    return offset;
+  }
+  File index = Storage.open(indexName, "r");
+  if (!index)
+    return 0;
+
+  // Binary search for the first entry not older than unixTime. 
+  // Everything before the entry preceding it is older than unixTime.
+  byte entry[INDEX_ENTRY_SIZE];
+  uint32_t entryTime;
+  size_t low = 0;
+  size_t high = index.size() / INDEX_ENTRY_SIZE;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    index.seek(mid * INDEX_ENTRY_SIZE, SeekSet);
+    if (index.read(entry, sizeof(entry)) != sizeof(entry))
+      break;
+    memcpy(&entryTime, entry, sizeof(entryTime));
+    if (entryTime < unixTime)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  uint32_t offset = 0;
+  if (low > 0) {
+    index.seek((low - 1) * INDEX_ENTRY_SIZE, SeekSet);
+    if (index.read(entry, sizeof(entry)) == sizeof(entry))
+      memcpy(&offset, entry + sizeof(entryTime), sizeof(offset));
+  }
+  index.close();
+  return offset;
+}
+
+size_t Log::readSeal(File& file, byte* seal) {
+  size_t fileSize = file.size();
+  if (fileSize < LogSeal::HEADER_SIZE + LogSeal::TRAILER_SIZE)
+    return 0;
+  byte trailer[LogSeal::TRAILER_SIZE];
+  if (!file.seek(fileSize - sizeof(trailer), SeekSet) || file.read(trailer, sizeof(trailer)) != sizeof(trailer))
+    return 0;
+  size_t size = LogSeal::getSize(trailer);
+  if (size > LogSeal::MAX_SIZE || size > fileSize || !file.seek(fileSize - size, SeekSet) || 
+      file.read(seal, size) != size)
+    return 0;
+  return LogSeal::check(seal, size);
+}
+
+void Log::updateRollups(acetime_t time, const uint16_t* values, byte channels) {
+  ZonedDateTime local = ZonedDateTime::forEpochSeconds(time, timeZone);
+  char name[8];
+
+  acetime_t hourStart = time - local.minute() * 60 - local.second();
+  snprintf(name, sizeof(name), "%d-%02d", local.year(), local.month());
+  size_t hourlyWritten = hourly.add(hourStart, fileNamePrefix + "hourly/" + name, values, channels, schema);
+  bytesWritten += hourlyWritten;
+  // Once an hour, the open day is saved too, so a reset loses at most an hour of it
+  if (hourlyWritten > 0)
+    bytesWritten += daily.save();
+
+  acetime_t dayStart = ZonedDateTime::forComponents(
+    local.year(), local.month(), local.day(), 0, 0, 0, timeZone).toEpochSeconds();
+  snprintf(name, sizeof(name), "%d", local.year());
+  bytesWritten += daily.add(dayStart, fileNamePrefix + "daily/" + name, values, channels, schema);
+}
+
+bool Log::readLastRecord(LogEntry& entry) {
+  // Blocks are at most LogBlock::MAX_SIZE bytes long, so the last one
+  // starts within that many bytes of the end of the data
+  byte buffer[LogBlock::MAX_SIZE];
+  size_t size = 0;
+  if (logRing != nullptr) {
+    uint32_t sectors = logRing->getSectorCount();
+    if (sectors == 0)
+      return false;
+    size_t dataSize = logRing->getDataSize(sectors - 1);
+    size = dataSize < sizeof(buffer) ? dataSize : sizeof(buffer);
+    size = logRing->read(sectors - 1, dataSize - size, buffer, size);
+  }
+  else {
+    String fileName = findLastFile();
+    if (fileName.length() == 0)
+      return false;
+    File file = Storage.open(fileName, "r");
+    if (!file)
+      return false;
+    // The footer of a sealed file follows the last block
+    uint32_t fileSize = file.size();
+    uint32_t indexed;
+    size_t sealSize = readSeal(file, buffer);
+    if (sealSize > 0) {
+      fileSize -= sealSize;
+      indexed = LogSeal::findOffset(buffer, UINT32_MAX);
+    }
+    else
+      indexed = findOffset(fileName, UINT32_MAX);
+    uint32_t offset = fileSize > sizeof(buffer) ? fileSize - sizeof(buffer) : 0;
+    // Starting at an indexed block is safer than resynchronizing in the middle of one
+    if (indexed > offset && indexed < fileSize)
+      offset = indexed;
+    if (file.seek(offset, SeekSet))
+      size = file.read(buffer, fileSize - offset);
+    file.close();
+  }
+
+  LogScanner scanner;
+  scanner.begin(buffer, size, true);
+  LogEntry scanned;
+  bool found = false;
+  while (scanner.next(scanned)) {
+    entry = scanned;
+    found = true;
+  }
+  return found;
+}
+
+String Log::findLastFile() {
+  String lastName;
+  Dir dir = Storage.openDir(fileNamePrefix);
+  while (dir.next()) {
+    String name = dir.fileName();
+    if (name.startsWith(fileNamePrefix))
+      name = name.substring(fileNamePrefix.length());
+    // Day files are named YYYY-MM-DD. A flat listing has the rollups too, e.g. daily/2024
+    if (dir.isFile() && dir.fileSize() > 0 && name.length() == 10 && name.indexOf('/') < 0 && 
+        name > lastName)
+      lastName = name;
+  }
+  return lastName.length() > 0 ? fileNamePrefix + lastName : lastName;
+}
+
+String Log::getFileName(acetime_t currentTime) const {
   return fileNamePrefix + getDateStr(currentTime);
 }
 
@@ -35,10 +406,88 @@ acetime_t Log::getEndTime() {
   return logEndTime; 
 }
 
-String Log::getDateStr(acetime_t epoch) {
+const String& Log::getDirectory() const {
+  return fileNamePrefix;
+}
+
+void Log::useRing(LogRing& ring) {
+  flush();
+  logRing = &ring;
+}
+
+LogRing* Log::getRing() const {
+  return logRing;
+}
+
+bool Log::getDayRange(const String& date, uint32_t& from, uint32_t& to) const {
+  int year, month, day;
+  if (date.length() != 10 || sscanf(date.c_str(), "%d-%d-%d", &year, &month, &day) != 3)
+    return false;
+  ZonedDateTime start = ZonedDateTime::forComponents(year, month, day, 0, 0, 0, timeZone);
+  if (start.isError())
+    return false;
+  ZonedDateTime end = ZonedDateTime::forEpochSeconds(start.toEpochSeconds() + SECONDS_IN_DAY + 3600, timeZone);
+  end = ZonedDateTime::forComponents(end.year(), end.month(), end.day(), 0, 0, 0, timeZone);
+  from = start.toUnixSeconds();
+  to = end.toUnixSeconds();
+  return true;
+}
+
+String Log::getDayFileName(uint32_t unixTime) {
+  return getFileName(LocalDateTime::forUnixSeconds(unixTime).toEpochSeconds());
+}
+
+byte Log::getPendingCount() const {
+  return ringCount;
+}
+
+bool Log::readPendingRecord(byte index, LogEntry& entry) const {
+  if (index >= ringCount)
+    return false;
+  const PendingRecord& pending = ring[(ringHead + index) % RING_CAPACITY];
+  entry.timestamp = LocalDateTime::forEpochSeconds(pending.time).toUnixSeconds();
+  entry.channels = pending.channels;
+  memcpy(entry.values, pending.values, pending.channels * sizeof(uint16_t));
+  return true;
+}
+
+const LogChannel* Log::getSchema() const {
+  return schema;
+}
+
+byte Log::getChannelCount() const {
+  return schemaChannels;
+}
+
+bool Log::isDayComplete(const String& fileName) const {
+  // Pending records are never older than the oldest one
+  return fileName < getCurrentFileName() && 
+    (ringCount == 0 || fileName < getFileName(ring[ringHead].time));
+}
+
+String Log::getCurrentFileName() const {
+  return getFileName(clock.getNow());
+}
+
+acetime_t Log::getCurrentTime() const {
+  return clock.getNow();
+}
+
+uint32_t Log::getBytesWritten() const {
+  return bytesWritten;
+}
+
+uint32_t Log::getRecordsWritten() const {
+  return recordsWritten;
+}
+
+uint32_t Log::getWriteErrors() const {
+  return writeErrors;
+}
+
+String Log::getDateStr(acetime_t epoch) const {
   ZonedDateTime time = ZonedDateTime::forEpochSeconds(epoch, timeZone);
   char buf[11];
   sprintf(buf, "%d-%02d-%02d", time.year(), time.month(), time.day());
   return String(buf);
 }
-
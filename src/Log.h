@@ -3,46 +3,171 @@
 
 #include <AceTime.h>
 #include <Arduino.h>
+#include <FS.h>
+
+#include "LogBlock.h"
+#include "LogRing.h"
+#include "LogRollup.h"
+#include "LogSchema.h"
+#include "LogScanner.h"
+#include "LogSeal.h"
+#include "LogStaging.h"
 
 using namespace ace_time;
 using namespace ace_time::clock;
 
 
-class LogRecord {
-  friend class Log;
-  public:
-
-    template<typename T>
-    bool write(const T& value) {
-      if (pos + sizeof(value) > MAX_SIZE)
-        return false;  
-      memcpy(buffer + pos, &value, sizeof(value));
-      pos += sizeof(value);
-      return true;
-    }
-
-  private: 
-    static const size_t MAX_SIZE = 16;
-    byte pos = 0;
-    byte buffer[MAX_SIZE];
-};
-
+/**
+ * Appends timestamped records to per-day files.
+ *
+ * Records are not written to flash immediately. They are kept in a small
+ * in-RAM ring and appended to the day file as compressed LogBlocks in a single
+ * write when FLUSH_RECORD_COUNT records are pending, the oldest pending record
+ * is older than FLUSH_AGE_SECONDS, the day changes or the free heap drops below
+ * LOW_HEAP_BYTES. Call flush() before a restart to avoid losing pending records.
+ * At boot, begin() restores the end time of the log from its last record.
+ *
+ * With useStaging(), pending records are also copied to memory surviving resets
+ * and recovered from there at boot. They are then flushed only when the staging 
+ * area is full, on the day change or on low heap. A power loss still loses them.
+ *
+ * Records are TypedLogRecords. The channels of their schema are described 
+ * in a `schema.json` file in the log directory, so readers can decode the log
+ * without hard-coding its layout.
+ *
+ * Hourly and daily LogRollups of every channel are maintained alongside
+ * the raw records in the `hourly/` and `daily/` subdirectories of the log,
+ * in one file per month and per year respectively. The open day is saved
+ * every hour and continued after a reset. The open hour is only written
+ * when it completes, so after a reset its entry covers the rest of the hour.
+ *
+ * Every INDEX_INTERVAL records a (unix timestamp, byte offset) entry pointing 
+ * at the start of a block is appended to a `.idx` sidecar file of the day file, 
+ * so readers can seek close to a given time without scanning the whole file.
+ * Completed days may be rewritten by LogCompactor into sealed files, which 
+ * end with a LogSeal footer replacing the `.idx` file.
+ *
+ * Alternatively, raw records can be appended to a pre-allocated LogRing 
+ * instead of day files (see useRing()). Rollups are kept in files either way.
+ */
 class Log {
   public:
     Log(const String& logPrefix, const Clock& clock, const TimeZone& tz);
-    void write(const LogRecord& record);
+    // Appends a record at the current time. It's dropped while the clock isn't set.
+    template<typename Schema>
+    void write(const TypedLogRecord<Schema>& record) {
+      write(record.values, TypedLogRecord<Schema>::CHANNEL_COUNT, Schema::CHANNELS);
+    }
+
+    // Restores the end time of the log from the last record in flash, so 
+    // logging continues at the same interval after a reboot.
+    // Call after useRing() and useStaging(), once the clock is set.
+    // Before that, a last record later than the current time can't be ignored.
+    void begin();
+    void loop();
+    void flush();
     acetime_t getEndTime();
+    const String& getDirectory() const;
+
+    // Stages pending records and recovers the ones staged before the reset
+    void useStaging(LogStaging& staging);
+
+    // Appends records to the ring instead of day files from now on.
+    // The ring must be started with LogRing::begin() first.
+    void useRing(LogRing& ring);
+    // Returns the ring used by this log or nullptr if the log uses day files
+    LogRing* getRing() const;
+
+    // Reads the last record written to flash, without scanning the whole 
+    // day file or ring. Returns false if the log is empty.
+    bool readLastRecord(LogEntry& entry);
+
+    // Computes the unix time range of a local day given as YYYY-MM-DD
+    bool getDayRange(const String& date, uint32_t& from, uint32_t& to) const;
+    // Name of the day file holding the records of the given unix time
+    String getDayFileName(uint32_t unixTime);
+
+    // Number of records not written to flash yet
+    byte getPendingCount() const;
+    // Reads a record not written to flash yet, the oldest has index 0
+    bool readPendingRecord(byte index, LogEntry& entry) const;
+
+    // Schema of the records written since boot, nullptr if none were written yet
+    const LogChannel* getSchema() const;
+    byte getChannelCount() const;
+
+    // Returns true if no more records will be appended to the given day file
+    bool isDayComplete(const String& fileName) const;
+    // Name of the day file of the current time
+    String getCurrentFileName() const;
+    // Current time of the clock of the log, Clock::kInvalidSeconds until it's set
+    acetime_t getCurrentTime() const;
+
+    // Total number of bytes appended to the files of this log since boot
+    uint32_t getBytesWritten() const;
+    // Number of records written to flash since boot
+    uint32_t getRecordsWritten() const;
+    // Number of failed attempts to write pending records to flash since boot
+    uint32_t getWriteErrors() const;
+
+    // Returns the offset of the first block of a day file that may contain 
+    // records not older than the given unix time. Returns 0 if there is no index.
+    static uint32_t findOffset(const String& fileName, uint32_t unixTime);
+
+    // Reads the footer of a sealed day file into seal, which must have room 
+    // for LogSeal::MAX_SIZE bytes. Returns its size, or 0 if the file isn't sealed.
+    static size_t readSeal(File& file, byte* seal);
 
   private:
     static const unsigned long SECONDS_IN_DAY;
+    static const acetime_t FLUSH_AGE_SECONDS;
+    static const uint32_t LOW_HEAP_BYTES;
+    static const byte FLUSH_RECORD_COUNT = 6;
+    static const byte RING_CAPACITY = 12;
+    static const byte INDEX_INTERVAL = 12;
+    static const size_t INDEX_ENTRY_SIZE = 2 * sizeof(uint32_t);
+    static const char* INDEX_SUFFIX;
+    static const byte MAX_CHANNELS = LogBlock::MAX_CHANNELS;
+    static const char* SCHEMA_FILE;
+
+    struct PendingRecord {
+      acetime_t time;
+      byte channels;
+      uint16_t values[MAX_CHANNELS];
+    };
 
     const String fileNamePrefix;
     const Clock& clock;
     const TimeZone& timeZone;
 
-    acetime_t logEndTime;    
-    String getFileName(acetime_t time);
-    String getDateStr(acetime_t time);  
+    acetime_t logEndTime;
+    PendingRecord ring[RING_CAPACITY];
+    byte ringHead;
+    byte ringCount;
+    byte unindexedRecords;
+    uint32_t bytesWritten;
+    uint32_t recordsWritten;
+    uint32_t writeErrors;
+    LogRollup hourly;
+    LogRollup daily;
+    const LogChannel* schema;
+    byte schemaChannels;
+    LogRing* logRing;
+    LogStaging* staging;
+
+    void write(const uint16_t* values, byte channels, const LogChannel* schema);
+    void enqueue(acetime_t time, const uint16_t* values, byte channels);
+    void writeSchema(const LogChannel* schema, byte channels);
+    bool shouldFlush(acetime_t now);
+    void updateRollups(acetime_t time, const uint16_t* values, byte channels);
+    size_t encodePending(byte count, byte* buffer, size_t capacity);
+    void releasePending(byte count);
+    void flushRing();
+    bool flushDay(const String& fileName, byte count);
+    void appendIndex(const String& fileName, uint32_t unixTime, uint32_t offset);
+    String getFileName(acetime_t time) const;
+    String findLastFile();
+    String getDateStr(acetime_t time) const;
 };
 
 
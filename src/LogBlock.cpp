@@ -0,0 +1,271 @@
+#include <string.h>
+
+#include "LogBlock.h"
+
+
+static uint32_t zigZag32(int32_t value) {
+  return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static int32_t unZigZag32(uint32_t value) {
+  return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static uint16_t zigZag16(uint16_t value) {
+  int16_t v = (int16_t) value;
+  return (uint16_t) (((uint16_t) v << 1) ^ (uint16_t) (v >> 15));
+}
+
+static uint16_t unZigZag16(uint16_t value) {
+  return (uint16_t) ((value >> 1) ^ -(value & 1));
+}
+
+static void writeUint16(uint8_t* dest, uint16_t value) {
+  dest[0] = value & 0xFF;
+  dest[1] = value >> 8;
+}
+
+static void writeUint32(uint8_t* dest, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    dest[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint16_t readUint16(const uint8_t* src) {
+  return src[0] | (src[1] << 8);
+}
+
+static uint32_t readUint32(const uint8_t* src) {
+  return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+
+uint16_t LogBlock::crc16(const uint8_t* data, size_t size) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= (uint16_t) data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+
+LogBlockEncoder::LogBlockEncoder(uint8_t* buffer, size_t capacity, uint8_t channels):
+    buffer(buffer),
+    capacity(capacity),
+    channels(channels < LogBlock::MAX_CHANNELS ? channels : LogBlock::MAX_CHANNELS),
+    count(0),
+    bitPos(LogBlock::HEADER_SIZE * 8),
+    firstTimestamp(0),
+    prevTimestamp(0),
+    prevDelta(0) {
+  memset(prevValues, 0, sizeof(prevValues));
+}
+
+bool LogBlockEncoder::add(uint32_t timestamp, const uint16_t* values) {
+  size_t worstCaseBits = 35 + channels * 19;
+  size_t limit = capacity;
+  if (limit > LogBlock::MAX_SIZE)
+    limit = LogBlock::MAX_SIZE;
+  if (count == LogBlock::MAX_RECORDS || 
+      (bitPos + worstCaseBits + 7) / 8 + LogBlock::TRAILER_SIZE > limit)
+    return false;
+
+  if (count == 0) {
+    firstTimestamp = timestamp;
+  } 
+  else {
+    int32_t delta = (int32_t) (timestamp - prevTimestamp);
+    writeTimeDelta(delta - prevDelta);
+    prevDelta = delta;
+  }
+  prevTimestamp = timestamp;
+
+  for (uint8_t i = 0; i < channels; i++) {
+    writeValueDelta(values[i] - prevValues[i]);
+    prevValues[i] = values[i];
+  }
+  count++;
+  return true;
+}
+
+size_t LogBlockEncoder::finish() {
+  size_t size = (bitPos + 7) / 8 + LogBlock::TRAILER_SIZE;
+  buffer[0] = LogBlock::MARKER;
+  writeUint16(buffer + 1, size);
+  buffer[3] = count;
+  buffer[4] = channels;
+  writeUint32(buffer + 5, firstTimestamp);
+  writeUint16(buffer + size - 2, LogBlock::crc16(buffer, size - 2));
+  return size;
+}
+
+uint8_t LogBlockEncoder::getCount() const {
+  return count;
+}
+
+void LogBlockEncoder::writeBits(uint32_t value, uint8_t bits) {
+  while (bits > 0) {
+    bits--;
+    size_t byteIndex = bitPos / 8;
+    uint8_t mask = 0x80 >> (bitPos % 8);
+    if (bitPos % 8 == 0)
+      buffer[byteIndex] = 0;
+    if ((value >> bits) & 1)
+      buffer[byteIndex] |= mask;
+    bitPos++;
+  }
+}
+
+// Size codes: '0' = no change, '10' + 7 bits, '110' + 12 bits, '111' + 32 bits
+void LogBlockEncoder::writeTimeDelta(int32_t dod) {
+  uint32_t z = zigZag32(dod);
+  if (z == 0)
+    writeBits(0, 1);
+  else if (z < (1 << 7)) {
+    writeBits(0b10, 2);
+    writeBits(z, 7);
+  } 
+  else if (z < (1 << 12)) {
+    writeBits(0b110, 3);
+    writeBits(z, 12);
+  }
+  else {
+    writeBits(0b111, 3);
+    writeBits(z, 32);
+  }
+}
+
+// Size codes: '0' = no change, '10' + 4 bits, '110' + 8 bits, '111' + 16 bits
+void LogBlockEncoder::writeValueDelta(uint16_t delta) {
+  uint16_t z = zigZag16(delta);
+  if (z == 0)
+    writeBits(0, 1);
+  else if (z < (1 << 4)) {
+    writeBits(0b10, 2);
+    writeBits(z, 4);
+  }
+  else if (z < (1 << 8)) {
+    writeBits(0b110, 3);
+    writeBits(z, 8);
+  }
+  else {
+    writeBits(0b111, 3);
+    writeBits(z, 16);
+  }
+}
+
+
+bool LogBlockDecoder::begin(const uint8_t* data, size_t available) {
+  if (available < LogBlock::HEADER_SIZE + LogBlock::TRAILER_SIZE || data[0] != LogBlock::MARKER)
+    return false;
+  size = readUint16(data + 1);
+  channels = data[4];
+  count = data[3];
+  if (size < LogBlock::HEADER_SIZE + LogBlock::TRAILER_SIZE || size > available || 
+      size > LogBlock::MAX_SIZE || channels > LogBlock::MAX_CHANNELS || count == 0)
+    return false;
+  uint16_t crc = readUint16(data + size - 2);
+  if (crc != 0 && crc != LogBlock::crc16(data, size - 2))
+    return false;
+
+  this->data = data;
+  index = 0;
+  bitPos = LogBlock::HEADER_SIZE * 8;
+  bitEnd = (size - LogBlock::TRAILER_SIZE) * 8;
+  prevTimestamp = readUint32(data + 5);
+  prevDelta = 0;
+  memset(prevValues, 0, sizeof(prevValues));
+  return true;
+}
+
+bool LogBlockDecoder::next(uint32_t& timestamp, uint16_t* values) {
+  if (index == count)
+    return false;
+  if (index > 0) {
+    int32_t dod;
+    if (!readTimeDelta(dod))
+      return false;
+    prevDelta += dod;
+    prevTimestamp += prevDelta;
+  }
+  for (uint8_t i = 0; i < channels; i++) {
+    uint16_t delta;
+    if (!readValueDelta(delta))
+      return false;
+    prevValues[i] += delta;
+    values[i] = prevValues[i];
+  }
+  timestamp = prevTimestamp;
+  index++;
+  return true;
+}
+
+size_t LogBlockDecoder::getSize() const {
+  return size;
+}
+
+uint8_t LogBlockDecoder::getCount() const {
+  return count;
+}
+
+uint8_t LogBlockDecoder::getChannels() const {
+  return channels;
+}
+
+bool LogBlockDecoder::readBits(uint8_t bits, uint32_t& value) {
+  if (bitPos + bits > bitEnd)
+    return false;
+  value = 0;
+  while (bits > 0) {
+    uint8_t bit = (data[bitPos / 8] >> (7 - bitPos % 8)) & 1;
+    value = (value << 1) | bit;
+    bitPos++;
+    bits--;
+  }
+  return true;
+}
+
+bool LogBlockDecoder::readTimeDelta(int32_t& dod) {
+  uint32_t code, z;
+  if (!readBits(1, code))
+    return false;
+  if (code == 0) {
+    dod = 0;
+    return true;
+  }
+  if (!readBits(1, code))
+    return false;
+  if (code == 0) {
+    if (!readBits(7, z))
+      return false;
+  }
+  else {
+    if (!readBits(1, code) || !readBits(code == 0 ? 12 : 32, z))
+      return false;
+  }
+  dod = unZigZag32(z);
+  return true;
+}
+
+bool LogBlockDecoder::readValueDelta(uint16_t& delta) {
+  uint32_t code, z;
+  if (!readBits(1, code))
+    return false;
+  if (code == 0) {
+    delta = 0;
+    return true;
+  }
+  if (!readBits(1, code))
+    return false;
+  if (code == 0) {
+    if (!readBits(4, z))
+      return false;
+  }
+  else {
+    if (!readBits(1, code) || !readBits(code == 0 ? 8 : 16, z))
+      return false;
+  }
+  delta = unZigZag16(z);
+  return true;
+}
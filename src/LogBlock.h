@@ -0,0 +1,106 @@
+#ifndef LOGBLOCK_H
+#define LOGBLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Compressed block of log records.
+ *
+ * A block holds a run of records with the same number of 16-bit channels and
+ * can be decoded without looking at any other part of the file.
+ * Layout (multi-byte fields are little-endian):
+ *
+ *   0     MARKER (never a valid length byte of an uncompressed frame)
+ *   1..2  total block size in bytes, including this header and the trailer
+ *   3     number of records
+ *   4     number of channels per record
+ *   5..8  unix timestamp of the first record
+ *   9..   bit stream, MSB first, padded with zeros to a full byte
+ *   n-2   CRC-16 of all the preceding bytes of the block
+ *
+ * The bit stream stores, for every record, the delta-of-delta of its timestamp
+ * (absent for the first record) followed by the delta of each channel against
+ * the same channel of the previous record (against 0 for the first record).
+ * Deltas are zig-zag encoded and prefixed with a variable-length size code,
+ * so a constant sampling interval and an unchanged value cost a single bit each.
+ */
+class LogBlock {
+  public:
+    static const uint8_t MARKER = 0xB7;
+    static const size_t HEADER_SIZE = 9;
+    static const size_t TRAILER_SIZE = 2;
+    static const uint8_t MAX_CHANNELS = 8;
+    static const uint8_t MAX_RECORDS = 255;
+    static const size_t MAX_SIZE = 1024;
+
+    // Upper bound of the encoded size of a block with given number of records
+    static constexpr size_t maxSize(size_t records, size_t channels) {
+      return HEADER_SIZE + (records * (35 + channels * 19) + 7) / 8 + TRAILER_SIZE;
+    }
+
+    // CRC-16/CCITT-FALSE. Value 0 stored in a checksum field means "not checked",
+    // so data written before checksums were introduced remains readable.
+    static uint16_t crc16(const uint8_t* data, size_t size);
+};
+
+/** Encodes records into a single LogBlock in a caller provided buffer */
+class LogBlockEncoder {
+  public:
+    LogBlockEncoder(uint8_t* buffer, size_t capacity, uint8_t channels);
+
+    // Appends a record, returns false if the block has no room left for it
+    bool add(uint32_t timestamp, const uint16_t* values);
+
+    // Writes the header and the trailer, returns the size of the block
+    size_t finish();
+
+    uint8_t getCount() const;
+
+  private:
+    uint8_t* buffer;
+    size_t capacity;
+    uint8_t channels;
+    uint8_t count;
+    size_t bitPos;
+    uint32_t firstTimestamp;
+    uint32_t prevTimestamp;
+    int32_t prevDelta;
+    uint16_t prevValues[LogBlock::MAX_CHANNELS];
+
+    void writeBits(uint32_t value, uint8_t bits);
+    void writeTimeDelta(int32_t dod);
+    void writeValueDelta(uint16_t delta);
+};
+
+/** Iterates over records stored in a single LogBlock */
+class LogBlockDecoder {
+  public:
+    // Checks the block header at data, returns false if there is no valid block
+    bool begin(const uint8_t* data, size_t available);
+
+    // Decodes the next record, returns false after the last one
+    bool next(uint32_t& timestamp, uint16_t* values);
+
+    size_t getSize() const;
+    uint8_t getCount() const;
+    uint8_t getChannels() const;
+
+  private:
+    const uint8_t* data;
+    size_t size;
+    uint8_t channels;
+    uint8_t count;
+    uint8_t index;
+    size_t bitPos;
+    size_t bitEnd;
+    uint32_t prevTimestamp;
+    int32_t prevDelta;
+    uint16_t prevValues[LogBlock::MAX_CHANNELS];
+
+    bool readBits(uint8_t bits, uint32_t& value);
+    bool readTimeDelta(int32_t& dod);
+    bool readValueDelta(uint16_t& delta);
+};
+
+#endif /* LOGBLOCK_H */
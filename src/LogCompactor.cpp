@@ -0,0 +1,279 @@
+#include <new>
+
+#include "LogCompactor.h"
+#include "Storage.h"
+
+
+const byte LogCompactor::SCAN_STEP_ENTRIES = 4;
+// The first check is an interval after boot, when the logs know their schemas
+const unsigned long LogCompactor::CHECK_INTERVAL_MILLIS = 3600000;
+const char* LogCompactor::TMP_SUFFIX = ".tmp";
+
+static const char* INDEX_SUFFIX = ".idx";
+static const size_t DAY_NAME_LENGTH = 10;  // YYYY-MM-DD
+// Free heap that must be left after allocating the buffers
+static const uint32_t MIN_FREE_HEAP = 8192;
+
+LogCompactor::LogCompactor():
+    logCount(0),
+    state(IDLE),
+    lastCheckTime(0),
+    scanIndex(0),
+    scanOpen(false),
+    passComplete(true),
+    job(nullptr),
+    sealedFiles(0),
+    savedBytes(0) {
+}
+
+void LogCompactor::add(Log& log) {
+  if (logCount == MAX_LOGS)
+    return;
+  logs[logCount].log = &log;
+  logs[logCount].sealedThrough = "";
+  logCount++;
+}
+
+void LogCompactor::loop() {
+  switch (state) {
+    case IDLE:
+      if (millis() - lastCheckTime > CHECK_INTERVAL_MILLIS) {
+        lastCheckTime = millis();
+        startScan();
+      }
+      break;
+    case SCANNING:
+      scanStep();
+      break;
+    case COMPACTING:
+      compactStep();
+      break;
+  }
+}
+
+uint32_t LogCompactor::getSealedFiles() const {
+  return sealedFiles;
+}
+
+uint32_t LogCompactor::getSavedBytes() const {
+  return savedBytes;
+}
+
+void LogCompactor::startScan() {
+  state = SCANNING;
+  scanIndex = 0;
+  scanOpen = false;
+  cursor = "";
+  passComplete = true;
+}
+
+void LogCompactor::nextLog() {
+  scanIndex++;
+  scanOpen = false;
+  cursor = "";
+  passComplete = true;
+}
+
+// Every listing of the log directory finds the oldest day after the cursor 
+// that may need sealing, so days are processed in order and each only once,
+// and files are never modified while the directory is being listed
+void LogCompactor::scanStep() {
+  if (scanIndex == logCount) {
+    state = IDLE;
+    return;
+  }
+  TrackedLog& tracked = logs[scanIndex];
+  const String& path = tracked.log->getDirectory();
+  if (!scanOpen) {
+    if (tracked.log->getRing() != nullptr) {
+      nextLog();
+      return;
+    }
+    dir = Storage.openDir(path);
+    scanOpen = true;
+    candidate = "";
+  }
+
+  for (byte i = 0; i < SCAN_STEP_ENTRIES; i++) {
+    if (!dir.next()) {
+      scanOpen = false;
+      if (candidate.length() == 0) {
+        // Skip the days checked in this pass next time, unless some failed
+        if (passComplete && cursor > tracked.sealedThrough)
+          tracked.sealedThrough = cursor;
+        nextLog();
+        return;
+      }
+      cursor = candidate;
+      checkDay(path + candidate);
+      return;
+    }
+    String name = dir.fileName();
+    if (name.startsWith(path))
+      name = name.substring(path.length());
+    if (!dir.isFile() || name.indexOf('/') >= 0)
+      continue;
+    if (name.length() == DAY_NAME_LENGTH + strlen(TMP_SUFFIX) && name.endsWith(TMP_SUFFIX)) {
+      scanOpen = false;
+      recoverTmpFile(path + name);
+      return;
+    }
+    if (name.length() == DAY_NAME_LENGTH && name > cursor && name > tracked.sealedThrough &&
+        (candidate.length() == 0 || name < candidate) && tracked.log->isDayComplete(path + name))
+      candidate = name;
+  }
+}
+
+void LogCompactor::checkDay(const String& fileName) {
+  File file = Storage.open(fileName, "r");
+  if (!file) {
+    passComplete = false;
+    return;
+  }
+  byte seal[LogSeal::MAX_SIZE];
+  bool sealed = Log::readSeal(file, seal) > 0;
+  file.close();
+  if (!sealed && !startJob(fileName))
+    passComplete = false;
+}
+
+void LogCompactor::recoverTmpFile(const String& tmpName) {
+  String fileName = tmpName.substring(0, tmpName.length() - strlen(TMP_SUFFIX));
+  if (Storage.exists(fileName)) {
+    Serial.println("Removing incomplete sealed log file " + tmpName);
+    Storage.remove(tmpName);
+  }
+  else {
+    Serial.println("Completing replacement of log file " + fileName);
+    Storage.rename(tmpName, fileName);
+  }
+}
+
+bool LogCompactor::startJob(const String& fileName) {
+  if (ESP.getFreeHeap() < sizeof(Job) + MIN_FREE_HEAP)
+    return false;
+  job = new (std::nothrow) Job();
+  if (job == nullptr)
+    return false;
+  job->fileName = fileName;
+  job->in = Storage.open(fileName, "r");
+  job->out = Storage.open(fileName + TMP_SUFFIX, "w");
+  if (!job->in || !job->out) {
+    Serial.println("Failed to open files for sealing log file " + fileName);
+    freeJob();
+    Storage.remove(fileName + TMP_SUFFIX);
+    return false;
+  }
+  job->inSize = job->in.size();
+  job->outSize = 0;
+  job->chunkSize = 0;
+  job->channels = 0;
+  job->blockTime = 0;
+  state = COMPACTING;
+  return true;
+}
+
+void LogCompactor::compactStep() {
+  size_t read = job->in.read(job->chunk + job->chunkSize, sizeof(job->chunk) - job->chunkSize);
+  job->chunkSize += read;
+  bool final = read == 0 || job->in.position() >= job->inSize;
+  job->scanner.begin(job->chunk, job->chunkSize, final);
+  LogEntry entry;
+  while (job->scanner.next(entry)) {
+    if (!addRecord(entry)) {
+      passComplete = false;
+      endJob(false);
+      return;
+    }
+  }
+  size_t consumed = job->scanner.getConsumed();
+  memmove(job->chunk, job->chunk + consumed, job->chunkSize - consumed);
+  job->chunkSize -= consumed;
+  if (!final)
+    return;
+  if (job->scanner.getCorruptFrames() > 0 || job->seal.getRecordCount() == 0) {
+    // Sealing would drop the unreadable bytes, leave the file as it is
+    Serial.println("Not sealing log file " + job->fileName + " without valid records or with corrupt data");
+    endJob(false);
+    return;
+  }
+  bool sealed = finishJob();
+  if (!sealed)
+    passComplete = false;
+  endJob(sealed);
+}
+
+bool LogCompactor::addRecord(const LogEntry& entry) {
+  bool added = job->encoder.getCount() > 0 && entry.channels == job->channels &&
+    job->encoder.add(entry.timestamp, entry.values);
+  if (!added) {
+    if (job->encoder.getCount() > 0 && !writeBlock())
+      return false;
+    job->encoder = LogBlockEncoder(job->block, sizeof(job->block), entry.channels);
+    job->channels = entry.channels;
+    job->blockTime = entry.timestamp;
+    if (!job->encoder.add(entry.timestamp, entry.values))
+      return false;
+  }
+  Log* log = logs[scanIndex].log;
+  const LogChannel* schema = log->getChannelCount() == entry.channels ? log->getSchema() : nullptr;
+  job->seal.addRecord(entry.values, entry.channels, schema);
+  return true;
+}
+
+bool LogCompactor::writeBlock() {
+  size_t size = job->encoder.finish();
+  job->seal.addBlock(job->blockTime, job->outSize);
+  if (job->out.write(job->block, size) != size)
+    return false;
+  job->outSize += size;
+  job->encoder = LogBlockEncoder(job->block, sizeof(job->block), 0);
+  return true;
+}
+
+bool LogCompactor::finishJob() {
+  if (job->encoder.getCount() > 0 && !writeBlock())
+    return false;
+  size_t sealSize = job->seal.finish(job->chunk, sizeof(job->chunk));
+  if (sealSize == 0 || job->out.write(job->chunk, sealSize) != sealSize)
+    return false;
+  job->outSize += sealSize;
+  job->in.close();
+  job->out.close();
+
+  // LogRetention may have evicted the day meanwhile
+  const String& fileName = job->fileName;
+  if (!Storage.exists(fileName)) {
+    Storage.remove(fileName + TMP_SUFFIX);
+    return false;
+  }
+  // Without the index, a crash at any point leaves a readable day file
+  Storage.remove(fileName + INDEX_SUFFIX);
+  if (!Storage.remove(fileName))
+    return false;
+  if (!Storage.rename(fileName + TMP_SUFFIX, fileName))
+    Serial.println("Failed to rename sealed log file " + fileName + ", will retry");
+  Serial.println("Sealed log file " + fileName + ": " + String(job->inSize) + " -> " + 
+    String(job->outSize) + " bytes");
+  sealedFiles++;
+  if (job->outSize < job->inSize)
+    savedBytes += job->inSize - job->outSize;
+  return true;
+}
+
+void LogCompactor::endJob(bool sealed) {
+  // A failed rewrite leaves the day file untouched, unless it was removed meanwhile
+  if (!sealed && Storage.exists(job->fileName)) {
+    job->out.close();
+    Storage.remove(job->fileName + TMP_SUFFIX);
+  }
+  freeJob();
+  state = SCANNING;
+}
+
+void LogCompactor::freeJob() {
+  job->in.close();
+  job->out.close();
+  delete job;
+  job = nullptr;
+}
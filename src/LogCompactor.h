@@ -0,0 +1,104 @@
+#ifndef LOGCOMPACTOR_H
+#define LOGCOMPACTOR_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "Log.h"
+#include "LogBlock.h"
+#include "LogScanner.h"
+#include "LogSeal.h"
+
+/**
+ * Rewrites completed day files of the registered logs into sealed files.
+ *
+ * A day file is appended in small blocks of a few records each, with a separate
+ * `.idx` file. Once the day is over, its records are re-encoded into as few 
+ * LogBlocks as possible, followed by a LogSeal footer with a block index 
+ * and a summary of the day, which makes the file smaller and self-contained.
+ *
+ * The sealed file is written next to the day file with a `.tmp` suffix and 
+ * replaces it only when complete: the `.idx` file is removed first, then the day
+ * file, then the `.tmp` file is renamed. A `.tmp` file found next to its day file 
+ * is an interrupted rewrite and is removed, a `.tmp` file without its day file 
+ * is a complete one and is renamed.
+ *
+ * All the work is split into small steps performed by loop(), reading at most 
+ * one chunk of a file per step, so it never blocks the main loop for long.
+ * Buffers are allocated only while a file is being rewritten.
+ */
+class LogCompactor {
+  public:
+    static const byte MAX_LOGS = 4;
+
+    LogCompactor();
+    void add(Log& log);
+    void loop();
+
+    uint32_t getSealedFiles() const;
+    // Number of bytes freed by sealing files since boot
+    uint32_t getSavedBytes() const;
+
+  private:
+    static const byte SCAN_STEP_ENTRIES;
+    static const unsigned long CHECK_INTERVAL_MILLIS;
+    static const char* TMP_SUFFIX;
+
+    enum State { IDLE, SCANNING, COMPACTING };
+
+    struct TrackedLog {
+      Log* log;
+      // Newest day known to be sealed, older days are not checked again
+      String sealedThrough;
+    };
+
+    struct Job {
+      String fileName;
+      File in;
+      File out;
+      uint32_t inSize;
+      uint32_t outSize;
+      LogScanner scanner;
+      LogSealEncoder seal;
+      byte chunk[LogBlock::MAX_SIZE];
+      size_t chunkSize;
+      byte block[LogBlock::MAX_SIZE];
+      LogBlockEncoder encoder;
+      uint8_t channels;
+      uint32_t blockTime;
+
+      Job(): encoder(block, sizeof(block), 0) {}
+    };
+
+    TrackedLog logs[MAX_LOGS];
+    byte logCount;
+
+    State state;
+    unsigned long lastCheckTime;
+    Dir dir;
+    byte scanIndex;
+    bool scanOpen;
+    // The newest day checked in the current pass over a log
+    String cursor;
+    String candidate;
+    bool passComplete;
+    Job* job;
+
+    uint32_t sealedFiles;
+    uint32_t savedBytes;
+
+    void startScan();
+    void nextLog();
+    void scanStep();
+    void checkDay(const String& fileName);
+    void recoverTmpFile(const String& fileName);
+    bool startJob(const String& fileName);
+    void compactStep();
+    bool addRecord(const LogEntry& entry);
+    bool writeBlock();
+    bool finishJob();
+    void endJob(bool sealed);
+    void freeJob();
+};
+
+#endif /* LOGCOMPACTOR_H */
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "LogExport.h"
+
+
+// Scales beyond this are clamped, no channel uses more than a few decimals
+static const int8_t MAX_SCALE = 9;
+
+LogExport::LogExport():
+    format(Format::CSV),
+    from(0),
+    to(0),
+    channelCount(0),
+    presence(NO_PRESENCE),
+    hasEntry(false),
+    rows(0) {
+}
+
+void LogExport::begin(Format format, uint32_t from, uint32_t to,
+    const Channel* channels, uint8_t channelCount, uint8_t presence) {
+  this->format = format;
+  this->from = from;
+  this->to = to;
+  if (channelCount > MAX_CHANNELS)
+    channelCount = MAX_CHANNELS;
+  memcpy(this->channels, channels, channelCount * sizeof(Channel));
+  this->channelCount = channelCount;
+  this->presence = presence;
+  hasEntry = false;
+  rows = 0;
+}
+
+bool LogExport::add(const LogEntry& entry) {
+  if (entry.timestamp < from || entry.timestamp >= to)
+    return true;
+  if (hasEntry)
+    return false;
+  this->entry = entry;
+  hasEntry = true;
+  return true;
+}
+
+void LogExport::finish() {
+}
+
+bool LogExport::hasRow() const {
+  return hasEntry;
+}
+
+size_t LogExport::getMaxRowSize() const {
+  // Timestamp and delimiters, then a quoted name and a value of up to
+  // 11 digits, a sign and a decimal point for each channel
+  size_t channelSize = format == Format::NDJSON ? MAX_NAME + 4 + 14 : 14;
+  return 24 + channelCount * channelSize;
+}
+
+size_t LogExport::formatHeader(char* buffer, size_t size) const {
+  if (format == Format::NDJSON || size == 0)
+    return 0;
+  size_t n = snprintf(buffer, size, "time");
+  for (uint8_t i = 0; i < channelCount && n < size; i++)
+    n += snprintf(buffer + n, size - n, ",%s", channels[i].name);
+  if (n < size)
+    n += snprintf(buffer + n, size - n, "\n");
+  return n < size ? n : size - 1;
+}
+
+size_t LogExport::formatRow(char* buffer, size_t size) {
+  if (!hasEntry || size == 0)
+    return 0;
+  bool json = format == Format::NDJSON;
+  size_t n = snprintf(buffer, size, json ? "{\"time\":%lu" : "%lu", (unsigned long) entry.timestamp);
+  uint16_t present = presence < entry.channels ? entry.values[presence] : 0xFFFF;
+  for (uint8_t i = 0; i < channelCount && n < size; i++) {
+    if (json)
+      n += snprintf(buffer + n, size - n, ",\"%s\":", channels[i].name);
+    else
+      n += snprintf(buffer + n, size - n, ",");
+    if (n >= size)
+      break;
+    uint8_t index = channels[i].index;
+    if (index >= entry.channels || !(present & (1 << index))) {
+      if (json)
+        n += snprintf(buffer + n, size - n, "null");
+      continue;
+    }
+    int32_t value = channels[i].type == LogChannelType::INT16 ? 
+      (int32_t) (int16_t) entry.values[index] : (int32_t) entry.values[index];
+    n += formatValue(value, channels[i].scale, buffer + n, size - n);
+  }
+  if (n < size)
+    n += snprintf(buffer + n, size - n, json ? "}\n" : "\n");
+  hasEntry = false;
+  rows++;
+  return n < size ? n : size - 1;
+}
+
+size_t LogExport::formatFooter(char* buffer, size_t size) const {
+  return 0;
+}
+
+uint32_t LogExport::getRowCount() const {
+  return rows;
+}
+
+size_t LogExport::formatValue(int32_t value, int8_t scale, char* buffer, size_t size) {
+  if (scale > MAX_SCALE)
+    scale = MAX_SCALE;
+  if (scale < -MAX_SCALE)
+    scale = -MAX_SCALE;
+  int n;
+  if (scale >= 0)
+    n = snprintf(buffer, size, "%ld%.*s", (long) value, scale, "000000000");
+  else {
+    // Split into the integer part and the decimals, e.g. 215 and -1 into 21.5
+    uint32_t divisor = 1;
+    for (int8_t i = 0; i < -scale; i++)
+      divisor *= 10;
+    uint32_t magnitude = value < 0 ? (uint32_t) 0 - (uint32_t) value : (uint32_t) value;
+    n = snprintf(buffer, size, "%s%lu.%0*lu", value < 0 ? "-" : "", 
+      (unsigned long) (magnitude / divisor), -scale, (unsigned long) (magnitude % divisor));
+  }
+  if (n < 0)
+    return 0;
+  return (size_t) n < size ? n : (size > 0 ? size - 1 : 0);
+}
@@ -0,0 +1,58 @@
+#ifndef LOGEXPORT_H
+#define LOGEXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LogRows.h"
+
+/**
+ * Formats every log record in a time range as a row of CSV or NDJSON,
+ * holding only the record being formatted:
+ *
+ *   time,pm10,pm2_5,temperature          {"time":1700000000,"pm10":12,"pm2_5":8,"temperature":21.5}
+ *   1700000000,12,8,21.5
+ *
+ * Times are unix seconds. Values are scaled by 10^scale of their channel 
+ * and written with exactly as many decimals as the scale gives, so no precision
+ * is lost or made up. Values missing according to the presence channel
+ * are empty in CSV and null in NDJSON.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class LogExport: public LogRows {
+  public:
+    enum class Format : uint8_t { CSV, NDJSON };
+
+    LogExport();
+
+    // Starts an export of the records in [from, to).
+    // presence is the index of the presence channel of the records or NO_PRESENCE.
+    void begin(Format format, uint32_t from, uint32_t to,
+      const Channel* channels, uint8_t channelCount, uint8_t presence);
+
+    bool add(const LogEntry& entry) override;
+    void finish() override;
+    bool hasRow() const override;
+    size_t getMaxRowSize() const override;
+    size_t formatHeader(char* buffer, size_t size) const override;
+    size_t formatRow(char* buffer, size_t size) override;
+    size_t formatFooter(char* buffer, size_t size) const override;
+
+    uint32_t getRowCount() const;
+
+    // Writes a raw value multiplied by 10^scale, returns the number of characters
+    static size_t formatValue(int32_t value, int8_t scale, char* buffer, size_t size);
+
+  private:
+    Format format;
+    uint32_t from;
+    uint32_t to;
+    Channel channels[MAX_CHANNELS];
+    uint8_t channelCount;
+    uint8_t presence;
+    LogEntry entry;
+    bool hasEntry;
+    uint32_t rows;
+};
+
+#endif /* LOGEXPORT_H */
@@ -0,0 +1,325 @@
+#include "LogQuery.h"
+#include "Storage.h"
+
+
+/** Body of a series response, produced by the running query */
+class LogQueryBody: public HttpBody {
+  public:
+    LogQueryBody(LogQuery& query): query(query) {}
+
+    ~LogQueryBody() {
+      query.end();
+    }
+
+    size_t read(uint8_t* buffer, size_t size) override {
+      return query.read(buffer, size);
+    }
+
+  private:
+    LogQuery& query;
+};
+
+
+LogQuery::LogQuery():
+    job(nullptr),
+    corruptFrames(0) {
+}
+
+void LogQuery::handle(Format format, Log** logs, byte logCount, HttpRequest& request, HttpResponse& response) {
+  if (job != nullptr) {
+    response.begin(503, "text/plain", 0);
+    response.addHeader("Retry-After", "5");
+    return;
+  }
+
+  // Find the log and the requested channels
+  char logName[16] = "";
+  char names[96] = "";
+  request.getArg("log", logName, sizeof(logName));
+  request.getArg("channels", names, sizeof(names));
+  LogRows::Channel all[LogRows::MAX_CHANNELS];
+  LogRows::Channel selected[LogRows::MAX_CHANNELS];
+  uint8_t allCount = 0, selectedCount = 0, presence = LogRows::NO_PRESENCE;
+  Log* log = nullptr;
+  for (byte i = 0; i < logCount && log == nullptr; i++) {
+    if (logName[0] != '\0' && logs[i]->getDirectory() != String("/log/") + logName + "/")
+      continue;
+    if (!loadChannels(*logs[i], all, allCount, presence))
+      continue;
+    selectedCount = 0;
+    bool found = true;
+    if (names[0] == '\0') {
+      for (uint8_t c = 0; c < allCount; c++) {
+        if (c != presence)
+          selected[selectedCount++] = all[c];
+      }
+    }
+    else {
+      char* context;
+      for (char* name = strtok_r(names, ",", &context); name != nullptr && found; name = strtok_r(nullptr, ",", &context)) {
+        found = false;
+        for (uint8_t c = 0; c < allCount && !found; c++) {
+          if (strcmp(all[c].name, name) == 0 && selectedCount < LogRows::MAX_CHANNELS) {
+            selected[selectedCount++] = all[c];
+            found = true;
+          }
+        }
+      }
+      // The names were split in place, restore them for the next log
+      request.getArg("channels", names, sizeof(names));
+    }
+    if (found && selectedCount > 0)
+      log = logs[i];
+  }
+  if (log == nullptr) {
+    response.send(404, "text/plain", "No log with the requested channels");
+    return;
+  }
+
+  // Time range and step
+  long end = defaultEnd(*log);
+  long to = request.getArg("to", end);
+  long from = request.getArg("from", to - 86400L);
+  if (from < (long) LogScanner::MIN_TIMESTAMP)
+    from = LogScanner::MIN_TIMESTAMP;
+  long defaultStep = (to - from) / (long) MAX_DEFAULT_ROWS;
+  if (defaultStep < (long) MIN_STEP)
+    defaultStep = MIN_STEP;
+  long step = request.getArg("step", defaultStep);
+  if (to <= from || (format == Format::SERIES && (step < (long) MIN_STEP || (to - from) / step >= (long) MAX_ROWS))) {
+    response.send(400, "text/plain", "Invalid time range or step");
+    return;
+  }
+
+  job = new (std::nothrow) Job();
+  if (job == nullptr) {
+    response.begin(503, "text/plain", 0);
+    response.addHeader("Retry-After", "5");
+    return;
+  }
+  job->log = log;
+  const char* contentType;
+  if (format == Format::SERIES) {
+    Serial.printf("Querying %u channels of %s from %ld to %ld by %ld s\n", 
+      selectedCount, log->getDirectory().c_str(), from, to, step);
+    job->series.begin(from, to, step, selected, selectedCount, presence);
+    job->rows = &job->series;
+    contentType = "application/json";
+  }
+  else {
+    Serial.printf("Exporting %u channels of %s from %ld to %ld\n", 
+      selectedCount, log->getDirectory().c_str(), from, to);
+    bool csv = format == Format::CSV;
+    job->exporter.begin(csv ? LogExport::Format::CSV : LogExport::Format::NDJSON, 
+      from, to, selected, selectedCount, presence);
+    job->rows = &job->exporter;
+    contentType = csv ? "text/csv" : "application/x-ndjson";
+  }
+  job->from = from;
+  job->to = to;
+  job->nextDay = from;
+  job->scanning = false;
+  job->finalChunk = false;
+  job->sourceDone = false;
+  job->hasEntry = false;
+  job->pending = 0;
+  job->stage = HEADER;
+  job->chunkSize = 0;
+  LogRing* ring = log->getRing();
+  if (ring != nullptr) {
+    job->sector = ring->findSector(from);
+    job->sectorOffset = 0;
+  }
+  response.begin(200, contentType, HttpResponse::CHUNKED);
+  response.setBody<LogQueryBody>(*this);
+}
+
+// Channels of the log, from the schema of its records or its schema file
+// End of the default range: just after the last record of the log. Until a record 
+// is written after a reboot, it's read from flash, or the current time if there is none.
+long LogQuery::defaultEnd(Log& log) {
+  LogEntry last;
+  if (log.getEndTime() != 0)
+    return LocalDateTime::forEpochSeconds(log.getEndTime()).toUnixSeconds() + 1;
+  if (log.readLastRecord(last))
+    return last.timestamp + 1;
+  if (log.getCurrentTime() != Clock::kInvalidSeconds)
+    return LocalDateTime::forEpochSeconds(log.getCurrentTime()).toUnixSeconds() + 1;
+  // Nothing logged and no time yet, the range is empty but valid
+  return LogScanner::MIN_TIMESTAMP + 86400L;
+}
+
+bool LogQuery::loadChannels(Log& log, LogRows::Channel* channels, uint8_t& count, uint8_t& presence) {
+  count = 0;
+  presence = LogRows::NO_PRESENCE;
+  const LogChannel* schema = log.getSchema();
+  if (schema != nullptr) {
+    for (byte i = 0; i < log.getChannelCount() && count < LogRows::MAX_CHANNELS; i++, count++) {
+      strncpy(channels[count].name, schema[i].name, LogRows::MAX_NAME - 1);
+      channels[count].name[LogRows::MAX_NAME - 1] = '\0';
+      channels[count].index = i;
+      channels[count].type = schema[i].type;
+      channels[count].scale = schema[i].scale;
+    }
+  }
+  else {
+    File file = Storage.open(log.getDirectory() + "schema.json", "r");
+    if (!file)
+      return false;
+    String descriptor = file.readString();
+    file.close();
+    for (int pos = descriptor.indexOf("\"name\":\""); pos >= 0 && count < LogRows::MAX_CHANNELS;
+        pos = descriptor.indexOf("\"name\":\"", pos + 1)) {
+      int start = pos + 8;
+      int end = descriptor.indexOf('"', start);
+      int type = descriptor.indexOf("\"type\":\"", start);
+      int scale = descriptor.indexOf("\"scale\":", start);
+      if (end < 0 || type < 0 || scale < 0)
+        break;
+      String name = descriptor.substring(start, end);
+      strncpy(channels[count].name, name.c_str(), LogRows::MAX_NAME - 1);
+      channels[count].name[LogRows::MAX_NAME - 1] = '\0';
+      channels[count].index = count;
+      channels[count].type = descriptor.startsWith("int16", type + 8) ? LogChannelType::INT16 :
+        descriptor.startsWith("presence", type + 8) ? LogChannelType::PRESENCE : LogChannelType::UINT16;
+      channels[count].scale = (int8_t) descriptor.substring(scale + 8).toInt();
+      count++;
+    }
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    if (channels[i].type == LogChannelType::PRESENCE)
+      presence = channels[i].index;
+  }
+  return count > 0;
+}
+
+// Produces as many rows as fit in the buffer, reading at most one chunk of the log
+size_t LogQuery::read(uint8_t* buffer, size_t size) {
+  if (job == nullptr || job->stage == DONE)
+    return HttpBody::END;
+  char* text = (char*) buffer;
+  size_t filled = 0;
+  bool chunkRead = false;
+  if (job->stage == HEADER) {
+    filled += job->rows->formatHeader(text, size);
+    job->stage = ROWS;
+  }
+  while (job->stage != DONE && filled + job->rows->getMaxRowSize() < size) {
+    if (job->rows->hasRow()) {
+      filled += job->rows->formatRow(text + filled, size - filled);
+      continue;
+    }
+    if (job->hasEntry) {
+      if (job->rows->add(job->entry))
+        job->hasEntry = false;
+      continue;
+    }
+    if (job->stage == FOOTER) {
+      filled += job->rows->formatFooter(text + filled, size - filled);
+      job->stage = DONE;
+      break;
+    }
+    if (job->stage == PENDING) {
+      // Records not written to flash yet come last
+      if (job->log->readPendingRecord(job->pending++, job->entry))
+        job->hasEntry = true;
+      else {
+        job->rows->finish();
+        if (!job->rows->hasRow())
+          job->stage = FOOTER;
+      }
+      continue;
+    }
+    if (job->scanning) {
+      if (job->scanner.next(job->entry)) {
+        job->hasEntry = true;
+        continue;
+      }
+      size_t consumed = job->scanner.getConsumed();
+      memmove(job->chunk, job->chunk + consumed, job->chunkSize - consumed);
+      job->chunkSize -= consumed;
+      job->scanning = false;
+    }
+    if (chunkRead)
+      break;
+    if (!readChunk())
+      job->stage = PENDING;
+    chunkRead = true;
+  }
+  return filled;
+}
+
+// Reads the next chunk of the day files or the ring, returns false after the last one
+bool LogQuery::readChunk() {
+  LogRing* ring = job->log->getRing();
+  size_t free = sizeof(job->chunk) - job->chunkSize;
+  size_t read = 0;
+  if (ring != nullptr) {
+    while (read == 0 && job->sector < ring->getSectorCount() && ring->getSectorTime(job->sector) < job->to) {
+      size_t dataSize = ring->getDataSize(job->sector);
+      if (job->sectorOffset < dataSize) {
+        size_t n = dataSize - job->sectorOffset < free ? dataSize - job->sectorOffset : free;
+        read = ring->read(job->sector, job->sectorOffset, job->chunk + job->chunkSize, n);
+        job->sectorOffset += read;
+      }
+      if (read == 0) {
+        job->sector++;
+        job->sectorOffset = 0;
+      }
+    }
+    job->finalChunk = read == 0;
+  }
+  else {
+    if (job->finalChunk || !job->file) {
+      if (!openNextFile())
+        return false;
+    }
+    read = job->file.read(job->chunk + job->chunkSize, free);
+    job->finalChunk = read == 0 || job->file.position() >= job->file.size();
+  }
+  if (read == 0 && job->chunkSize == 0)
+    return ring == nullptr;
+  job->chunkSize += read;
+  job->scanner.begin(job->chunk, job->chunkSize, job->finalChunk);
+  job->scanning = true;
+  if (job->finalChunk && ring == nullptr)
+    job->file.close();
+  return true;
+}
+
+// Opens the next existing day file of the range
+bool LogQuery::openNextFile() {
+  job->chunkSize = 0;
+  job->finalChunk = false;
+  while (job->nextDay < job->to) {
+    String fileName = job->log->getDayFileName(job->nextDay);
+    uint32_t dayStart, dayEnd;
+    if (!job->log->getDayRange(fileName.substring(job->log->getDirectory().length()), dayStart, dayEnd) ||
+        dayEnd <= job->nextDay)
+      return false;
+    job->nextDay = dayEnd;
+    if (!Storage.exists(fileName))
+      continue;
+    job->file = Storage.open(fileName, "r");
+    if (!job->file)
+      continue;
+    if (dayStart < job->from)
+      job->file.seek(Log::findOffset(fileName, job->from), SeekSet);
+    return true;
+  }
+  return false;
+}
+
+uint32_t LogQuery::getCorruptFrames() const {
+  return corruptFrames;
+}
+
+void LogQuery::end() {
+  if (job == nullptr)
+    return;
+  corruptFrames += job->scanner.getCorruptFrames();
+  if (job->file)
+    job->file.close();
+  delete job;
+  job = nullptr;
+}
@@ -0,0 +1,87 @@
+#ifndef LOGQUERY_H
+#define LOGQUERY_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "HttpServer.h"
+#include "Log.h"
+#include "LogExport.h"
+#include "LogSeries.h"
+
+/**
+ * Answers requests for downsampled time series of log channels
+ * and for exports of their records:
+ *
+ *   /api/series?channels=pm2_5,temperature&from=<unix>&to=<unix>&step=<seconds>&log=env
+ *   /export.csv?channels=pm2_5,temperature&from=<unix>&to=<unix>&log=env
+ *   /export.ndjson?channels=pm2_5,temperature&from=<unix>&to=<unix>&log=env
+ *
+ * All arguments are optional. The channels default to all channels of the log,
+ * the range to the last day of records, the step to about MAX_DEFAULT_ROWS
+ * buckets. Without the log argument, the first log having all the channels is used.
+ * The result is the JSON of LogSeries or the rows of LogExport, streamed while 
+ * the day files (or the ring) of the range and the records not yet written 
+ * to flash are read in one pass. Every read of the response reads at most
+ * one chunk of the log, so exports of any length don't hold up the main loop.
+ *
+ * A query takes a fixed amount of memory, allocated when it starts and freed 
+ * when its response is complete. Only one query runs at a time.
+ */
+class LogQuery {
+  public:
+    static const uint32_t MIN_STEP = 60;
+    static const uint32_t MAX_DEFAULT_ROWS = 300;
+    static const uint32_t MAX_ROWS = 10000;
+
+    enum class Format : uint8_t { SERIES, CSV, NDJSON };
+
+    LogQuery();
+
+    void handle(Format format, Log** logs, byte logCount, HttpRequest& request, HttpResponse& response);
+
+    // Number of corrupt fragments of the log skipped by the queries since boot
+    uint32_t getCorruptFrames() const;
+
+  private:
+    friend class LogQueryBody;
+
+    enum Stage { HEADER, ROWS, PENDING, FOOTER, DONE };
+
+    struct Job {
+      Log* log;
+      LogSeries series;
+      LogExport exporter;
+      // The one of the above answering the query
+      LogRows* rows;
+      LogScanner scanner;
+      File file;
+      uint32_t from;
+      uint32_t to;
+      // Start of the next day file to read, or the next ring sector
+      uint32_t nextDay;
+      uint32_t sector;
+      uint32_t sectorOffset;
+      bool scanning;
+      bool finalChunk;
+      bool sourceDone;
+      bool hasEntry;
+      LogEntry entry;
+      byte pending;
+      Stage stage;
+      size_t chunkSize;
+      byte chunk[LogBlock::MAX_SIZE];
+    };
+
+    Job* job;
+    uint32_t corruptFrames;
+
+    static long defaultEnd(Log& log);
+    static bool loadChannels(Log& log, LogRows::Channel* channels, uint8_t& count, uint8_t& presence);
+    size_t read(uint8_t* buffer, size_t size);
+    bool readChunk();
+    bool openNextFile();
+    void end();
+};
+
+#endif /* LOGQUERY_H */
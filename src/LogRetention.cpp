@@ -0,0 +1,190 @@
+#include "LogRetention.h"
+#include "Storage.h"
+
+
+const byte LogRetention::SCAN_STEP_ENTRIES = 4;
+const unsigned long LogRetention::CHECK_INTERVAL_MILLIS = 10000;
+
+static const char* INDEX_SUFFIX = ".idx";
+static const char* HOURLY_DIR = "hourly/";
+static const char* SUBDIRS[] = { "", HOURLY_DIR, "daily/" };
+static const byte SUBDIR_COUNT = sizeof(SUBDIRS) / sizeof(SUBDIRS[0]);
+static const size_t DAY_NAME_LENGTH = 10;  // YYYY-MM-DD
+
+LogRetention::LogRetention(byte highWaterPercent):
+    highWaterPercent(highWaterPercent),
+    logCount(0),
+    state(IDLE),
+    lastCheckTime(0),
+    scanIndex(0),
+    scanOpen(false),
+    evictIndex(0),
+    evictedFiles(0),
+    evictedBytes(0),
+    blocked(false) {
+}
+
+void LogRetention::add(const Log& log) {
+  if (logCount == MAX_LOGS)
+    return;
+  TrackedLog& tracked = logs[logCount++];
+  tracked.log = &log;
+  tracked.scannedBytes = 0;
+  tracked.writtenAtScan = log.getBytesWritten();
+  tracked.evictedBytes = 0;
+}
+
+void LogRetention::begin() {
+  // The first scan only establishes how much space the logs take
+  startScan();
+}
+
+void LogRetention::loop() {
+  switch (state) {
+    case IDLE:
+      if (millis() - lastCheckTime > CHECK_INTERVAL_MILLIS) {
+        lastCheckTime = millis();
+        if (isOverHighWater())
+          startScan();
+        else
+          blocked = false;
+      }
+      break;
+    case SCANNING:
+      scanStep();
+      break;
+    case EVICTING:
+      evictStep();
+      break;
+  }
+}
+
+byte LogRetention::getLogCount() const {
+  return logCount;
+}
+
+const Log& LogRetention::getLog(byte i) const {
+  return *logs[i].log;
+}
+
+uint32_t LogRetention::getUsedBytes(byte i) const {
+  const TrackedLog& tracked = logs[i];
+  uint32_t used = tracked.scannedBytes + (tracked.log->getBytesWritten() - tracked.writtenAtScan);
+  return used > tracked.evictedBytes ? used - tracked.evictedBytes : 0;
+}
+
+uint32_t LogRetention::getEvictedFiles() const {
+  return evictedFiles;
+}
+
+uint32_t LogRetention::getEvictedBytes() const {
+  return evictedBytes;
+}
+
+bool LogRetention::isBlocked() const {
+  return blocked;
+}
+
+bool LogRetention::isOverHighWater() {
+  FSInfo info;
+  if (!Storage.info(info) || info.totalBytes == 0)
+    return false;
+  return info.usedBytes * 100 / info.totalBytes > highWaterPercent;
+}
+
+void LogRetention::startScan() {
+  state = SCANNING;
+  scanIndex = 0;
+  scanOpen = false;
+  oldestDay = "";
+  oldestRollup = "";
+}
+
+void LogRetention::scanStep() {
+  if (scanIndex == logCount * SUBDIR_COUNT) {
+    bool over = isOverHighWater();
+    bool evict = over && (oldestDay.length() > 0 || oldestRollup.length() > 0);
+    if (over && !evict && !blocked)
+      Serial.println("Filesystem over the high-water mark, but only log files still being written are left");
+    blocked = over && !evict;
+    state = evict ? EVICTING : IDLE;
+    evictIndex = 0;
+    lastCheckTime = millis();
+    return;
+  }
+
+  // Subdirectories are listed separately, because SPIFFS lists them 
+  // together with their parent directory and LittleFS doesn't
+  TrackedLog& tracked = logs[scanIndex / SUBDIR_COUNT];
+  const char* subdir = SUBDIRS[scanIndex % SUBDIR_COUNT];
+  String path = tracked.log->getDirectory() + subdir;
+  if (!scanOpen) {
+    dir = Storage.openDir(path);
+    if (scanIndex % SUBDIR_COUNT == 0) {
+      tracked.scannedBytes = 0;
+      tracked.writtenAtScan = tracked.log->getBytesWritten();
+      tracked.evictedBytes = 0;
+    }
+    scanOpen = true;
+  }
+
+  for (byte i = 0; i < SCAN_STEP_ENTRIES; i++) {
+    if (!dir.next()) {
+      scanOpen = false;
+      scanIndex++;
+      return;
+    }
+    String name = dir.fileName();
+    if (name.startsWith(path))
+      name = name.substring(path.length());
+    if (!dir.isFile() || name.indexOf('/') >= 0)
+      continue;
+    tracked.scannedBytes += dir.fileSize();
+    // Files still being written are never candidates
+    if (subdir == SUBDIRS[0] && name.length() == DAY_NAME_LENGTH && 
+        (oldestDay.length() == 0 || name < oldestDay) && tracked.log->isDayComplete(path + name)) 
+      oldestDay = name;
+    else if (subdir == HOURLY_DIR && (oldestRollup.length() == 0 || name < oldestRollup) && 
+        name < getCurrentMonth(*tracked.log))
+      oldestRollup = name;
+  }
+}
+
+void LogRetention::evictStep() {
+  if (evictIndex == logCount) {
+    state = IDLE;
+    return;
+  }
+  const Log& log = *logs[evictIndex].log;
+  const String& prefix = log.getDirectory();
+  if (oldestDay.length() > 0) {
+    // The day may be complete in the log where it was found, but not in this one
+    if (log.isDayComplete(prefix + oldestDay)) {
+      evictFile(evictIndex, prefix + oldestDay);
+      evictFile(evictIndex, prefix + oldestDay + INDEX_SUFFIX);
+    }
+  }
+  else if (oldestRollup < getCurrentMonth(log)) {
+    evictFile(evictIndex, prefix + HOURLY_DIR + oldestRollup);
+  }
+  evictIndex++;
+}
+
+// Name of the hourly rollup file written now, YYYY-MM
+String LogRetention::getCurrentMonth(const Log& log) {
+  return log.getCurrentFileName().substring(log.getDirectory().length(), log.getDirectory().length() + 7);
+}
+
+void LogRetention::evictFile(byte logIndex, const String& fileName) {
+  if (!Storage.exists(fileName))
+    return;
+  File file = Storage.open(fileName, "r");
+  size_t size = file ? file.size() : 0;
+  file.close();
+  if (!Storage.remove(fileName))
+    return;
+  Serial.println("Evicted old log file " + fileName);
+  logs[logIndex].evictedBytes += size;
+  evictedFiles++;
+  evictedBytes += size;
+}
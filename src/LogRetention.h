@@ -0,0 +1,82 @@
+#ifndef LOGRETENTION_H
+#define LOGRETENTION_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "Log.h"
+
+/**
+ * Keeps the filesystem below a high-water mark by deleting the oldest day 
+ * files of the registered logs.
+ * 
+ * Bytes used by each log are counted once by a directory scan and then kept
+ * up to date from the number of bytes the log reports as written, so checking
+ * the usage is O(1). When the filesystem gets over the high-water mark, the 
+ * oldest day is found by another scan and its raw files and indexes are removed 
+ * from all logs. Hourly rollups are removed only when no raw day files are left,
+ * daily rollups are never removed. Files still being written, i.e. the day
+ * files of today or of records not written yet and the hourly rollups of 
+ * the current month, are never removed. If nothing else is left, eviction
+ * stops and isBlocked() reports it until the usage drops.
+ * All the work is split into small steps performed by loop(), so it never 
+ * blocks the main loop for long.
+ */
+class LogRetention {
+  public:
+    static const byte MAX_LOGS = 4;
+
+    LogRetention(byte highWaterPercent);
+    void add(const Log& log);
+    void begin();
+    void loop();
+
+    byte getLogCount() const;
+    const Log& getLog(byte i) const;
+    // Number of bytes used by the files of the i-th registered log
+    uint32_t getUsedBytes(byte i) const;
+    uint32_t getEvictedFiles() const;
+    uint32_t getEvictedBytes() const;
+    // Returns true if the filesystem is over the high-water mark
+    // and only files still being written are left to evict
+    bool isBlocked() const;
+
+  private:
+    static const byte SCAN_STEP_ENTRIES;
+    static const unsigned long CHECK_INTERVAL_MILLIS;
+
+    enum State { IDLE, SCANNING, EVICTING };
+
+    struct TrackedLog {
+      const Log* log;
+      uint32_t scannedBytes;
+      uint32_t writtenAtScan;
+      uint32_t evictedBytes;
+    };
+
+    byte highWaterPercent;
+    TrackedLog logs[MAX_LOGS];
+    byte logCount;
+
+    State state;
+    unsigned long lastCheckTime;
+    Dir dir;
+    byte scanIndex;
+    bool scanOpen;
+    String oldestDay;
+    String oldestRollup;
+    byte evictIndex;
+
+    uint32_t evictedFiles;
+    uint32_t evictedBytes;
+    bool blocked;
+
+    bool isOverHighWater();
+    void startScan();
+    void scanStep();
+    void evictStep();
+    void evictFile(byte logIndex, const String& fileName);
+    static String getCurrentMonth(const Log& log);
+};
+
+#endif /* LOGRETENTION_H */
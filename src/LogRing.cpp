@@ -0,0 +1,162 @@
+#include "LogRing.h"
+
+
+static void writeUint32(uint8_t* dest, uint32_t value) {
+  for (uint8_t i = 0; i < 4; i++)
+    dest[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint32_t readUint32(const uint8_t* src) {
+  return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+LogRing::LogRing(LogRingMedium& medium):
+    medium(medium),
+    sectors(0),
+    used(0),
+    head(0),
+    headSequence(0),
+    headSize(0) {
+}
+
+bool LogRing::begin() {
+  if (!medium.begin())
+    return false;
+  sectors = medium.getSectorCount();
+  used = 0;
+  headSize = 0;
+
+  // The head is the sector with the highest sequence number
+  Header header;
+  bool found = false;
+  for (uint32_t sector = 0; sector < sectors; sector++) {
+    if (readHeader(sector, header) && (!found || header.sequence > headSequence)) {
+      head = sector;
+      headSequence = header.sequence;
+      found = true;
+    }
+  }
+  if (!found)
+    return true;
+
+  // Count the run of consecutive sequence numbers ending at the head.
+  // Anything before a gap (e.g. a sector erased just before a power loss) is lost.
+  used = 1;
+  while (used < sectors) {
+    uint32_t sector = (head + sectors - used) % sectors;
+    if (!readHeader(sector, header) || header.sequence != headSequence - used)
+      break;
+    used++;
+  }
+  headSize = findEnd(head);
+  return true;
+}
+
+bool LogRing::append(const uint8_t* blocks, size_t size, uint32_t firstTimestamp) {
+  if (sectors == 0 || size > CAPACITY)
+    return false;
+  if ((used == 0 || headSize + size > CAPACITY) && !startSector(firstTimestamp))
+    return false;
+  if (!medium.write(head * SECTOR_SIZE + HEADER_SIZE + headSize, blocks, size))
+    return false;
+  headSize += size;
+  return true;
+}
+
+bool LogRing::startSector(uint32_t firstTimestamp) {
+  uint32_t sector = used == 0 ? 0 : (head + 1) % sectors;
+  uint32_t sequence = used == 0 ? 0 : headSequence + 1;
+  if (!medium.erase(sector))
+    return false;
+
+  uint8_t header[HEADER_SIZE];
+  header[0] = (uint8_t) MAGIC;
+  header[1] = (uint8_t) (MAGIC >> 8);
+  writeUint32(header + 2, sequence);
+  writeUint32(header + 6, firstTimestamp);
+  uint16_t crc = LogBlock::crc16(header, HEADER_SIZE - 2);
+  header[10] = (uint8_t) crc;
+  header[11] = (uint8_t) (crc >> 8);
+  if (!medium.write(sector * SECTOR_SIZE, header, HEADER_SIZE))
+    return false;
+
+  head = sector;
+  headSequence = sequence;
+  headSize = 0;
+  if (used < sectors)
+    used++;
+  return true;
+}
+
+bool LogRing::readHeader(uint32_t sector, Header& header) {
+  uint8_t data[HEADER_SIZE];
+  if (!medium.read(sector * SECTOR_SIZE, data, HEADER_SIZE))
+    return false;
+  if (data[0] != (uint8_t) MAGIC || data[1] != (uint8_t) (MAGIC >> 8))
+    return false;
+  if (LogBlock::crc16(data, HEADER_SIZE - 2) != (uint16_t) (data[10] | (data[11] << 8)))
+    return false;
+  header.sequence = readUint32(data + 2);
+  header.firstTimestamp = readUint32(data + 6);
+  return true;
+}
+
+size_t LogRing::findEnd(uint32_t sector) {
+  // Walk the chain of block sizes until the erased area
+  size_t pos = 0;
+  uint8_t start[3];
+  while (pos + LogBlock::HEADER_SIZE <= CAPACITY) {
+    if (!medium.read(sector * SECTOR_SIZE + HEADER_SIZE + pos, start, sizeof(start)))
+      break;
+    size_t size = start[1] | (start[2] << 8);
+    if (start[0] != LogBlock::MARKER || size < LogBlock::HEADER_SIZE || pos + size > CAPACITY)
+      break;
+    pos += size;
+  }
+  return pos;
+}
+
+uint32_t LogRing::toPhysical(uint32_t index) const {
+  return (head + sectors - used + 1 + index) % sectors;
+}
+
+uint32_t LogRing::getSectorCount() const {
+  return used;
+}
+
+uint32_t LogRing::findSector(uint32_t unixTime) {
+  uint32_t low = 0;
+  uint32_t high = used;
+  while (low < high) {
+    uint32_t mid = (low + high) / 2;
+    if (getSectorTime(mid) < unixTime)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low > 0 ? low - 1 : 0;
+}
+
+uint32_t LogRing::getSectorTime(uint32_t index) {
+  Header header;
+  if (index >= used || !readHeader(toPhysical(index), header))
+    return 0;
+  return header.firstTimestamp;
+}
+
+size_t LogRing::getDataSize(uint32_t index) {
+  if (index >= used)
+    return 0;
+  uint32_t sector = toPhysical(index);
+  return sector == head ? headSize : findEnd(sector);
+}
+
+size_t LogRing::read(uint32_t index, uint32_t offset, uint8_t* buffer, size_t size) {
+  if (index >= used || offset >= CAPACITY)
+    return 0;
+  if (size > CAPACITY - offset)
+    size = CAPACITY - offset;
+  if (!medium.read(toPhysical(index) * SECTOR_SIZE + HEADER_SIZE + offset, buffer, size))
+    return 0;
+  return size;
+}
@@ -0,0 +1,93 @@
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LogBlock.h"
+
+/**
+ * A fixed region of LogRing::SECTOR_SIZE sectors, e.g. a pre-sized file
+ * or a raw flash partition. Offsets are relative to the start of the region.
+ */
+class LogRingMedium {
+  public:
+    virtual ~LogRingMedium() {}
+    virtual bool begin() = 0;
+    virtual uint32_t getSectorCount() const = 0;
+    virtual bool read(uint32_t offset, uint8_t* data, size_t size) = 0;
+    // Writes only ever go to bytes erased since they were last written
+    virtual bool write(uint32_t offset, const uint8_t* data, size_t size) = 0;
+    // Sets all bytes of the sector to 0xFF
+    virtual bool erase(uint32_t sector) = 0;
+};
+
+/**
+ * Circular log storage in a pre-allocated LogRingMedium.
+ *
+ * LogBlocks are appended sequentially. When the current sector is full,
+ * writing continues in the next one, wrapping around to overwrite the oldest
+ * sector, so every sector is erased equally often and no file system metadata
+ * is updated on append. Each sector starts with a header:
+ *
+ *   0..1   MAGIC
+ *   2..5   sequence number, increasing by one with every new sector
+ *   6..9   unix timestamp of the first record in the sector
+ *   10..11 CRC-16 of the preceding bytes of the header
+ *
+ * followed by LogBlocks and erased bytes (0xFF) up to the end of the sector.
+ * Sectors are addressed by their index counting from the oldest one.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class LogRing {
+  public:
+    static const uint32_t SECTOR_SIZE = 4096;
+    static const uint16_t MAGIC = 0x52A7;
+    static const size_t HEADER_SIZE = 12;
+    // Maximum number of bytes appended at once
+    static const size_t CAPACITY = SECTOR_SIZE - HEADER_SIZE;
+
+    LogRing(LogRingMedium& medium);
+
+    // Finds the end of the log. Must be called before any other method.
+    bool begin();
+
+    // Appends one or more complete LogBlocks. The first timestamp is the
+    // timestamp of the first record of the first block.
+    bool append(const uint8_t* blocks, size_t size, uint32_t firstTimestamp);
+
+    // Number of sectors holding records
+    uint32_t getSectorCount() const;
+
+    // Index of the last sector starting with a record older than unixTime,
+    // so it is the first sector that can hold records not older than unixTime
+    uint32_t findSector(uint32_t unixTime);
+
+    uint32_t getSectorTime(uint32_t index);
+
+    // Number of bytes of LogBlocks in a sector
+    size_t getDataSize(uint32_t index);
+
+    // Reads LogBlock bytes of a sector, starting at a given offset past its header
+    size_t read(uint32_t index, uint32_t offset, uint8_t* buffer, size_t size);
+
+  private:
+    struct Header {
+      uint32_t sequence;
+      uint32_t firstTimestamp;
+    };
+
+    LogRingMedium& medium;
+    uint32_t sectors;
+    uint32_t used;
+    uint32_t head;
+    uint32_t headSequence;
+    size_t headSize;
+
+    uint32_t toPhysical(uint32_t index) const;
+    bool readHeader(uint32_t sector, Header& header);
+    bool startSector(uint32_t firstTimestamp);
+    size_t findEnd(uint32_t sector);
+};
+
+#endif /* LOGRING_H */
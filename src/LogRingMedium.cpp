@@ -0,0 +1,102 @@
+#include <flash_hal.h>
+
+#include "LogRingMedium.h"
+#include "Storage.h"
+
+
+LogRingFile::LogRingFile(const String& fileName, uint32_t sectors):
+    fileName(fileName),
+    sectors(sectors) {
+}
+
+bool LogRingFile::begin() {
+  const uint32_t size = sectors * LogRing::SECTOR_SIZE;
+  file = Storage.open(fileName, "r+");
+  if (file && file.size() == size)
+    return true;
+  if (file)
+    file.close();
+
+  Serial.println("Allocating log ring file " + fileName);
+  file = Storage.open(fileName, "w+");
+  if (!file) {
+    Serial.println("Failed to create log ring file " + fileName);
+    return false;
+  }
+  uint8_t erased[256];
+  memset(erased, 0xFF, sizeof(erased));
+  for (uint32_t written = 0; written < size; written += sizeof(erased)) {
+    if (file.write(erased, sizeof(erased)) != sizeof(erased)) {
+      Serial.println("Not enough space for log ring file " + fileName);
+      file.close();
+      Storage.remove(fileName);
+      return false;
+    }
+  }
+  file.flush();
+  return true;
+}
+
+uint32_t LogRingFile::getSectorCount() const {
+  return sectors;
+}
+
+bool LogRingFile::read(uint32_t offset, uint8_t* data, size_t size) {
+  return file.seek(offset, SeekSet) && file.read(data, size) == size;
+}
+
+bool LogRingFile::write(uint32_t offset, const uint8_t* data, size_t size) {
+  if (!file.seek(offset, SeekSet) || file.write(data, size) != size)
+    return false;
+  file.flush();
+  return true;
+}
+
+bool LogRingFile::erase(uint32_t sector) {
+  uint8_t erased[256];
+  memset(erased, 0xFF, sizeof(erased));
+  if (!file.seek(sector * LogRing::SECTOR_SIZE, SeekSet))
+    return false;
+  for (uint32_t written = 0; written < LogRing::SECTOR_SIZE; written += sizeof(erased)) {
+    if (file.write(erased, sizeof(erased)) != sizeof(erased))
+      return false;
+  }
+  return true;
+}
+
+
+LogRingFlash::LogRingFlash(uint32_t startAddress, uint32_t sectors):
+    startAddress(startAddress),
+    sectors(sectors) {
+}
+
+bool LogRingFlash::begin() {
+  // The sectors must lie between the end of the sketch and the start of the filesystem,
+  // the flash after the filesystem holds EEPROM emulation and the SDK settings
+  const uint32_t sketchEnd = (ESP.getSketchSize() + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+  const uint32_t fsStart = FS_PHYS_ADDR;
+  const uint32_t end = startAddress + sectors * LogRing::SECTOR_SIZE;
+  if (startAddress % LogRing::SECTOR_SIZE != 0 || startAddress < sketchEnd || end > fsStart ||
+      end > ESP.getFlashChipRealSize()) {
+    Serial.printf("Log ring 0x%06x-0x%06x is outside of the free flash 0x%06x-0x%06x\n", 
+      (unsigned) startAddress, (unsigned) end, (unsigned) sketchEnd, (unsigned) fsStart);
+    return false;
+  }
+  return true;
+}
+
+uint32_t LogRingFlash::getSectorCount() const {
+  return sectors;
+}
+
+bool LogRingFlash::read(uint32_t offset, uint8_t* data, size_t size) {
+  return ESP.flashRead(startAddress + offset, data, size);
+}
+
+bool LogRingFlash::write(uint32_t offset, const uint8_t* data, size_t size) {
+  return ESP.flashWrite(startAddress + offset, data, size);
+}
+
+bool LogRingFlash::erase(uint32_t sector) {
+  return ESP.flashEraseSector((startAddress + sector * LogRing::SECTOR_SIZE) / FLASH_SECTOR_SIZE);
+}
@@ -0,0 +1,54 @@
+#ifndef LOGRINGMEDIUM_H
+#define LOGRINGMEDIUM_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "LogRing.h"
+
+/**
+ * LogRing storage in a file of the Storage filesystem, pre-allocated
+ * at its full size on the first start and never resized afterwards.
+ * It bounds the space taken by the log, but the filesystem still copies every
+ * overwritten page, so it doesn't reduce flash wear (see util/logtool/ringsim).
+ */
+class LogRingFile: public LogRingMedium {
+  public:
+    LogRingFile(const String& fileName, uint32_t sectors);
+
+    bool begin() override;
+    uint32_t getSectorCount() const override;
+    bool read(uint32_t offset, uint8_t* data, size_t size) override;
+    bool write(uint32_t offset, const uint8_t* data, size_t size) override;
+    bool erase(uint32_t sector) override;
+
+  private:
+    const String fileName;
+    const uint32_t sectors;
+    File file;
+};
+
+/**
+ * LogRing storage in raw flash sectors outside of the filesystem,
+ * e.g. a region freed by a linker script with a smaller filesystem.
+ * This avoids all filesystem overhead: an append programs only the appended bytes.
+ * begin() fails unless the sectors lie between the end of the sketch and the start
+ * of the filesystem. An OTA update would stage the new sketch over them.
+ */
+class LogRingFlash: public LogRingMedium {
+  public:
+    // The start address is a flash offset aligned to LogRing::SECTOR_SIZE
+    LogRingFlash(uint32_t startAddress, uint32_t sectors);
+
+    bool begin() override;
+    uint32_t getSectorCount() const override;
+    bool read(uint32_t offset, uint8_t* data, size_t size) override;
+    bool write(uint32_t offset, const uint8_t* data, size_t size) override;
+    bool erase(uint32_t sector) override;
+
+  private:
+    const uint32_t startAddress;
+    const uint32_t sectors;
+};
+
+#endif /* LOGRINGMEDIUM_H */
@@ -0,0 +1,160 @@
+#include <FS.h>
+
+#include "LogRollup.h"
+#include "Storage.h"
+
+using namespace ace_time;
+
+
+LogRollup::LogRollup(): 
+    bucketStart(0),
+    channels(0),
+    count(0),
+    saved(false),
+    restored(false) {
+}
+
+size_t LogRollup::add(acetime_t start, const String& name, 
+                      const uint16_t* values, byte n, const LogChannel* schema) {
+  size_t appended = 0;
+  if (count > 0 && (start != bucketStart || n != channels)) {
+    appended = append();
+    count = 0;
+    saved = false;
+  }
+  if (n > MAX_CHANNELS)
+    n = MAX_CHANNELS;
+  if (count == 0) {
+    bucketStart = start;
+    fileName = name;
+    channels = n;
+    for (byte i = 0; i < n; i++) {
+      min[i] = INT32_MAX;
+      max[i] = INT32_MIN;
+      sum[i] = 0;
+      samples[i] = 0;
+    }
+    if (!restored) {
+      restored = true;
+      restore(schema);
+    }
+  }
+  uint16_t present = UINT16_MAX;
+  for (byte i = 0; i < n; i++) {
+    if (schema[i].type == LogChannelType::PRESENCE) 
+      present = values[i];
+  }
+  for (byte i = 0; i < n; i++) {
+    if (schema[i].type == LogChannelType::PRESENCE) {
+      min[i] = count == 0 ? values[i] : min[i] & values[i];
+      max[i] = count == 0 ? values[i] : max[i] | values[i];
+      sum[i] = max[i];
+      samples[i] = 1;
+      continue;
+    }
+    if (!(present & (1 << i)))
+      continue;
+    int32_t value = schema[i].type == LogChannelType::INT16 ? (int16_t) values[i] : values[i];
+    if (value < min[i])
+      min[i] = value;
+    if (value > max[i])
+      max[i] = value;
+    sum[i] += value;
+    samples[i]++;
+  }
+  if (count < UINT16_MAX)
+    count++;
+  return appended;
+}
+
+size_t LogRollup::append() {
+  byte entry[entrySize(MAX_CHANNELS)];
+  size_t size = 0;
+  uint32_t unixTime = LocalDateTime::forEpochSeconds(bucketStart).toUnixSeconds();
+  entry[size++] = channels;
+  memcpy(entry + size, &unixTime, sizeof(unixTime));
+  size += sizeof(unixTime);
+  memcpy(entry + size, &count, sizeof(count));
+  size += sizeof(count);
+  for (byte i = 0; i < channels; i++) {
+    int32_t n = samples[i];
+    uint16_t stats[3] = { 0, 0, 0 };
+    if (n > 0) {
+      stats[0] = (uint16_t) min[i];
+      stats[1] = (uint16_t) max[i];
+      stats[2] = (uint16_t) ((sum[i] + (sum[i] >= 0 ? n / 2 : -(n / 2))) / n);
+    }
+    memcpy(entry + size, stats, sizeof(stats));
+    size += 3 * sizeof(int16_t);
+  }
+
+  // A saved entry of the bucket is overwritten
+  File file = Storage.open(fileName, saved ? "r+" : "a");
+  if (!file) {
+    Serial.println("Failed to open rollup file " + fileName);
+    return 0;
+  }
+  if (saved && (file.size() < size || !file.seek(file.size() - size, SeekSet))) {
+    file.close();
+    return 0;
+  }
+  size_t written = file.write(entry, size);
+  file.close();
+  return written;
+}
+
+size_t LogRollup::save() {
+  if (count == 0)
+    return 0;
+  size_t written = append();
+  if (written > 0)
+    saved = true;
+  return written;
+}
+
+// Continues the bucket from its entry saved before a reset, if it is the last one of the file.
+// The means are restored as sums of equal values, which may be off by the rounding of the mean.
+void LogRollup::restore(const LogChannel* schema) {
+  File file = Storage.open(fileName, "r");
+  if (!file)
+    return;
+  byte entry[entrySize(MAX_CHANNELS)];
+  size_t size = entrySize(channels);
+  bool found = file.size() >= size && file.seek(file.size() - size, SeekSet) && 
+    file.read(entry, size) == size;
+  file.close();
+  uint32_t unixTime;
+  memcpy(&unixTime, entry + 1, sizeof(unixTime));
+  if (!found || entry[0] != channels || 
+      unixTime != (uint32_t) LocalDateTime::forEpochSeconds(bucketStart).toUnixSeconds())
+    return;
+
+  uint16_t stats[MAX_CHANNELS][3];
+  memcpy(&count, entry + 1 + sizeof(unixTime), sizeof(count));
+  memcpy(stats, entry + 1 + sizeof(unixTime) + sizeof(count), channels * sizeof(stats[0]));
+  // Channels present in any record, if there is a presence channel
+  uint16_t present = UINT16_MAX;
+  for (byte i = 0; i < channels; i++) {
+    if (schema[i].type == LogChannelType::PRESENCE) 
+      present = stats[i][1];
+  }
+  for (byte i = 0; i < channels; i++) {
+    if (schema[i].type == LogChannelType::PRESENCE) {
+      min[i] = stats[i][0];
+      max[i] = stats[i][1];
+      sum[i] = max[i];
+      samples[i] = 1;
+      continue;
+    }
+    if (!(present & (1 << i)))
+      continue;
+    bool isSigned = schema[i].type == LogChannelType::INT16;
+    min[i] = isSigned ? (int16_t) stats[i][0] : stats[i][0];
+    max[i] = isSigned ? (int16_t) stats[i][1] : stats[i][1];
+    int32_t mean = isSigned ? (int16_t) stats[i][2] : stats[i][2];
+    samples[i] = count;
+    sum[i] = mean * count;
+  }
+  saved = true;
+  Serial.println("Continuing rollup of " + fileName + " from " + String(count) + " saved records");
+}
@@ -0,0 +1,70 @@
+#ifndef LOGROLLUP_H
+#define LOGROLLUP_H
+
+#include <AceTime.h>
+#include <Arduino.h>
+
+#include "LogSchema.h"
+
+/**
+ * Keeps min, max, mean and count of each channel over consecutive time buckets
+ * (e.g. hours or days). The running aggregate is updated with every record and 
+ * appended to a rollup file once its bucket is complete, so raw log files 
+ * never need to be read back.
+ *
+ * Each rollup file entry has the following layout (little-endian):
+ *
+ *   0     number of channels n
+ *   1..4  unix timestamp of the start of the bucket
+ *   5..6  number of records in the bucket
+ *   7..   n times: min, max, mean
+ *
+ * Min, max and mean are 16-bit numbers of the type of their channel.
+ * If the records have a presence channel, values missing from a record are 
+ * skipped and the presence channel stores the channels present in all records 
+ * of the bucket as min and the channels present in any record as max and mean.
+ *
+ * The open bucket can be saved before it is complete with save(). It is then
+ * the last entry of its file and is overwritten in place when saved again or
+ * completed. After a reset, a saved entry of the bucket of the first record 
+ * is loaded and updated, so the file never holds two entries of a bucket.
+ * Records added after the last save before a reset are missing from it.
+ */
+class LogRollup {
+  public:
+    static const byte MAX_CHANNELS = 8;
+
+    LogRollup();
+
+    // Adds values to the bucket starting at bucketStart. 
+    // If a different bucket was open, it is appended to its file first.
+    // Returns the number of bytes appended to the rollup file.
+    size_t add(acetime_t bucketStart, const String& fileName, 
+               const uint16_t* values, byte channels, const LogChannel* schema);
+
+    // Writes the open bucket to its file, returns the number of bytes written
+    size_t save();
+
+    static constexpr size_t entrySize(byte channels) {
+      return 1 + sizeof(uint32_t) + sizeof(uint16_t) + channels * 3 * sizeof(int16_t);
+    }
+
+  private:
+    acetime_t bucketStart;
+    String fileName;
+    byte channels;
+    uint16_t count;
+    int32_t min[MAX_CHANNELS];
+    int32_t max[MAX_CHANNELS];
+    int32_t sum[MAX_CHANNELS];
+    uint16_t samples[MAX_CHANNELS];
+    // The open bucket is the last entry of its file
+    bool saved;
+    // A saved entry was looked for since boot
+    bool restored;
+
+    size_t append();
+    void restore(const LogChannel* schema);
+};
+
+#endif /* LOGROLLUP_H */
@@ -0,0 +1,54 @@
+#ifndef LOGROWS_H
+#define LOGROWS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LogScanner.h"
+#include "LogSchema.h"
+
+/**
+ * Formats the response to a query of log records, fed with the records
+ * in time order as they are read. Implementations keep a fixed amount of
+ * state, so responses of any length are produced in constant memory.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class LogRows {
+  public:
+    static const uint8_t MAX_CHANNELS = LogBlock::MAX_CHANNELS;
+    static const size_t MAX_NAME = 16;
+    // Longest formatted row, header or footer
+    static const size_t MAX_ROW = 64 + MAX_CHANNELS * 48;
+    static const uint8_t NO_PRESENCE = 0xFF;
+
+    /** A channel of the records selected for the response */
+    struct Channel {
+      char name[MAX_NAME];
+      // Index of the channel in the records
+      uint8_t index;
+      LogChannelType type;
+      int8_t scale;
+    };
+
+    virtual ~LogRows() {}
+
+    // Adds a record. Records must come in time order, those out of range are skipped.
+    // Returns false if a completed row must be formatted first.
+    virtual bool add(const LogEntry& entry) = 0;
+
+    // Completes the last row after all records were added
+    virtual void finish() = 0;
+
+    // True if a completed row is ready to be formatted
+    virtual bool hasRow() const = 0;
+
+    // Longest row formatted for the selected channels
+    virtual size_t getMaxRowSize() const = 0;
+
+    // Each of these writes at most MAX_ROW characters and returns their number
+    virtual size_t formatHeader(char* buffer, size_t size) const = 0;
+    virtual size_t formatRow(char* buffer, size_t size) = 0;
+    virtual size_t formatFooter(char* buffer, size_t size) const = 0;
+};
+
+#endif /* LOGROWS_H */
@@ -0,0 +1,131 @@
+#include <string.h>
+
+#include "LogScanner.h"
+#include "LogSeal.h"
+
+
+static uint32_t readUint32(const uint8_t* src) {
+  return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+LogScanner::LogScanner():
+    data(nullptr),
+    size(0),
+    pos(0),
+    final(false),
+    inBlock(false),
+    skipping(false),
+    blockChannels(0),
+    corruptFrames(0),
+    records(0) {
+}
+
+void LogScanner::begin(const uint8_t* data, size_t size, bool final) {
+  this->data = data;
+  this->size = size;
+  this->final = final;
+  pos = 0;
+  inBlock = false;
+}
+
+bool LogScanner::next(LogEntry& entry) {
+  while (true) {
+    if (inBlock) {
+      if (decoder.next(entry.timestamp, entry.values)) {
+        entry.channels = blockChannels;
+        records++;
+        return true;
+      }
+      inBlock = false;
+    }
+
+    // Jump to the next byte that can start a block or a frame
+    while (pos < size && !isCandidate(data[pos]))
+      skip();
+    if (pos == size)
+      return false;
+
+    size_t available = size - pos;
+    const uint8_t* start = data + pos;
+    if (start[0] == LogBlock::MARKER) {
+      if (decoder.begin(start, available)) {
+        inBlock = true;
+        blockChannels = decoder.getChannels();
+        accept(decoder.getSize());
+        continue;
+      }
+      // A block that doesn't fit in the chunk yet may still be valid
+      size_t declared = available >= 3 ? start[1] | (start[2] << 8) : 0;
+      if (!final && (available < 3 || (declared <= LogBlock::MAX_SIZE && declared > available)))
+        return false;
+      skip();
+      continue;
+    }
+
+    if (start[0] == LogSeal::MARKER) {
+      // The footer of a sealed file holds no records
+      size_t sealSize = LogSeal::check(start, available);
+      if (sealSize > 0) {
+        accept(sealSize);
+        continue;
+      }
+      size_t declared = available >= 3 ? start[1] | (start[2] << 8) : 0;
+      if (!final && (available < 3 || (declared <= LogSeal::MAX_SIZE && declared > available)))
+        return false;
+      skip();
+      continue;
+    }
+
+    size_t length = 1 + start[0];
+    if (length > available) {
+      if (!final)
+        return false;
+      skip();
+      continue;
+    }
+    // Without a checksum, a frame is only trusted if something valid may follow it
+    if (length == available && !final)
+      return false;
+    uint32_t timestamp = readUint32(start + 1);
+    if (timestamp < MIN_TIMESTAMP || (length < available && !isCandidate(start[length]))) {
+      skip();
+      continue;
+    }
+    entry.timestamp = timestamp;
+    entry.channels = (start[0] - 4) / 2;
+    memset(entry.values, 0, sizeof(entry.values));
+    memcpy(entry.values, start + 5, entry.channels * sizeof(uint16_t));
+    accept(length);
+    records++;
+    return true;
+  }
+}
+
+size_t LogScanner::getConsumed() const {
+  return pos;
+}
+
+uint32_t LogScanner::getCorruptFrames() const {
+  return corruptFrames;
+}
+
+uint32_t LogScanner::getRecords() const {
+  return records;
+}
+
+bool LogScanner::isCandidate(uint8_t b) const {
+  return b == LogBlock::MARKER || b == LogSeal::MARKER || 
+    (b >= MIN_FRAME_LENGTH && b <= MAX_FRAME_LENGTH && b % 2 == 0);
+}
+
+void LogScanner::skip() {
+  if (!skipping) 
+    corruptFrames++;
+  skipping = true;
+  pos++;
+}
+
+void LogScanner::accept(size_t length) {
+  skipping = false;
+  pos += length;
+}
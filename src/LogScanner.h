@@ -0,0 +1,80 @@
+#ifndef LOGSCANNER_H
+#define LOGSCANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LogBlock.h"
+
+/** A single decoded log record */
+struct LogEntry {
+  uint32_t timestamp;
+  uint8_t channels;
+  uint16_t values[LogBlock::MAX_CHANNELS];
+};
+
+/**
+ * Extracts records from the contents of a log file, which may contain 
+ * compressed LogBlocks as well as older uncompressed frames:
+ *
+ *   0     frame length n (number of bytes that follow)
+ *   1..4  unix timestamp
+ *   5..   n - 4 bytes of 16-bit channel values
+ *
+ * Only LogBlocks, which start with their MARKER, carry a checksum. 
+ * Frames have none: the last two bytes, which the firmware once wrote as zeros,
+ * hold channel values in older files. A frame is accepted if its length fits 
+ * whole channels, its timestamp is plausible and it is followed by the end 
+ * of the data or by a byte that can start a block or a frame.
+ *
+ * Blocks failing their checksum and malformed frames are skipped and the scanner 
+ * resynchronizes on the next byte that can start a block or a frame. Each run 
+ * of skipped bytes counts as one corrupt frame. The LogSeal footer of a sealed 
+ * file is skipped.
+ *
+ * Files can be scanned in chunks. Feed each chunk with begin(), call next() 
+ * until it returns false, then keep the bytes past getConsumed() and prepend
+ * them to the next chunk. The buffer must fit at least LogBlock::MAX_SIZE bytes.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class LogScanner {
+  public:
+    static const uint8_t MIN_FRAME_LENGTH = 4 + 2;
+    static const uint8_t MAX_FRAME_LENGTH = 4 + 2 * LogBlock::MAX_CHANNELS;
+    // Frames with older timestamps are considered garbage (2019-01-01)
+    static const uint32_t MIN_TIMESTAMP = 1546300800;
+
+    LogScanner();
+
+    // Sets the next chunk of data to scan. 
+    // If final is true, there is no more data after this chunk.
+    void begin(const uint8_t* data, size_t size, bool final);
+
+    // Returns the next valid record from the current chunk. 
+    // Returns false if the chunk has no more complete records.
+    bool next(LogEntry& entry);
+
+    // Number of bytes of the current chunk that were processed
+    size_t getConsumed() const;
+
+    uint32_t getCorruptFrames() const;
+    uint32_t getRecords() const;
+
+  private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    bool final;
+    bool inBlock;
+    bool skipping;
+    LogBlockDecoder decoder;
+    uint8_t blockChannels;
+    uint32_t corruptFrames;
+    uint32_t records;
+
+    bool isCandidate(uint8_t b) const;
+    void skip();
+    void accept(size_t length);
+};
+
+#endif /* LOGSCANNER_H */
@@ -0,0 +1,82 @@
+#ifndef LOGSCHEMA_H
+#define LOGSCHEMA_H
+
+#include <stdint.h>
+#include <utility>
+
+#include "LogBlock.h"
+
+enum class LogChannelType : uint8_t { 
+  INT16, 
+  UINT16,
+  PRESENCE
+};
+
+/** Describes a single channel of a log record */
+struct LogChannel {
+  const char* name;
+  LogChannelType type;
+  // Decimal exponent of the unit, e.g. -1 if the raw value is in tenths
+  int8_t scale;
+
+  const char* typeName() const {
+    switch (type) {
+      case LogChannelType::INT16: return "int16";
+      case LogChannelType::PRESENCE: return "presence";
+      default: return "uint16";
+    }
+  }
+};
+
+/** 
+ * Bitmap of the channels of a record that hold a valid value. 
+ * Bit i stands for channel i of the record, including the presence channel itself.
+ * Values of channels with a cleared bit are meaningless and should be skipped by readers.
+ */
+struct LogPresence {
+  uint16_t bits;
+  explicit operator uint16_t() const { return bits; }
+};
+
+template<typename T> struct LogChannelTypeOf;
+template<> struct LogChannelTypeOf<int16_t> { static constexpr LogChannelType value = LogChannelType::INT16; };
+template<> struct LogChannelTypeOf<uint16_t> { static constexpr LogChannelType value = LogChannelType::UINT16; };
+template<> struct LogChannelTypeOf<LogPresence> { static constexpr LogChannelType value = LogChannelType::PRESENCE; };
+
+/**
+ * A log record with channels declared by the Schema type. 
+ * Schema must define a `static constexpr LogChannel CHANNELS[]` array.
+ * The record is constructed from one value per channel, in the schema order, 
+ * and the types of the values are checked against the schema at compile time:
+ *
+ *   struct ThSchema {
+ *     static constexpr LogChannel CHANNELS[] = {
+ *       { "temperature", LogChannelType::INT16, -1 },
+ *       { "humidity", LogChannelType::INT16, -1 },
+ *     };
+ *   };
+ *   TypedLogRecord<ThSchema> record(t, h);
+ */
+template<typename Schema>
+class TypedLogRecord {
+  public:
+    static constexpr uint8_t CHANNEL_COUNT = sizeof(Schema::CHANNELS) / sizeof(LogChannel);
+    static_assert(CHANNEL_COUNT <= LogBlock::MAX_CHANNELS, "Too many channels in a log record");
+
+    template<typename... Values>
+    TypedLogRecord(Values... v): values { (uint16_t) v... } {
+      static_assert(sizeof...(Values) == CHANNEL_COUNT, "Number of values must match the schema");
+      static_assert(typesMatch<Values...>(std::index_sequence_for<Values...>()), 
+        "Value types must match the channel types of the schema");
+    }
+
+    uint16_t values[CHANNEL_COUNT];
+
+  private:
+    template<typename... Values, size_t... I>
+    static constexpr bool typesMatch(std::index_sequence<I...>) {
+      return ((LogChannelTypeOf<Values>::value == Schema::CHANNELS[I].type) && ...);
+    }
+};
+
+#endif /* LOGSCHEMA_H */
@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include "LogSeal.h"
+
+
+static void writeUint32(uint8_t* dest, uint32_t value) {
+  for (uint8_t i = 0; i < 4; i++)
+    dest[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint32_t readUint32(const uint8_t* src) {
+  return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+static void writeUint16(uint8_t* dest, uint16_t value) {
+  dest[0] = (uint8_t) value;
+  dest[1] = (uint8_t) (value >> 8);
+}
+
+static uint16_t readUint16(const uint8_t* src) {
+  return (uint16_t) (src[0] | (src[1] << 8));
+}
+
+size_t LogSeal::check(const uint8_t* data, size_t available) {
+  if (available < HEADER_SIZE + TRAILER_SIZE || data[0] != MARKER)
+    return 0;
+  size_t size = readUint16(data + 1);
+  if (size > MAX_SIZE || size > available || data[3] > LogBlock::MAX_CHANNELS || data[4] > MAX_BLOCKS ||
+      size != HEADER_SIZE + data[4] * INDEX_ENTRY_SIZE + data[3] * STATS_SIZE + TRAILER_SIZE ||
+      readUint16(data + size - 4) != size ||
+      readUint16(data + size - 2) != LogBlock::crc16(data, size - 2))
+    return 0;
+  return size;
+}
+
+size_t LogSeal::getSize(const uint8_t* trailer) {
+  return readUint16(trailer);
+}
+
+uint32_t LogSeal::findOffset(const uint8_t* seal, uint32_t unixTime) {
+  uint32_t offset = 0;
+  for (uint8_t i = 0; i < seal[4]; i++) {
+    const uint8_t* entry = seal + HEADER_SIZE + i * INDEX_ENTRY_SIZE;
+    if (readUint32(entry) >= unixTime)
+      break;
+    offset = readUint32(entry + 4);
+  }
+  return offset;
+}
+
+uint32_t LogSeal::getRecordCount(const uint8_t* seal) {
+  return readUint32(seal + 5);
+}
+
+
+LogSealEncoder::LogSealEncoder():
+    records(0),
+    blocks(0),
+    channels(0) {
+}
+
+void LogSealEncoder::addBlock(uint32_t firstTimestamp, uint32_t offset) {
+  if (blocks == LogSeal::MAX_BLOCKS)
+    return;
+  blockTimes[blocks] = firstTimestamp;
+  blockOffsets[blocks] = offset;
+  blocks++;
+}
+
+void LogSealEncoder::addRecord(const uint16_t* values, uint8_t n, const LogChannel* schema) {
+  if (records == 0) {
+    channels = n;
+    if (channels > LogBlock::MAX_CHANNELS)
+      channels = LogBlock::MAX_CHANNELS;
+    for (uint8_t i = 0; i < channels; i++) {
+      min[i] = INT32_MAX;
+      max[i] = INT32_MIN;
+      sum[i] = 0;
+      samples[i] = 0;
+    }
+  }
+  records++;
+  if (n != channels)
+    return;
+
+  // Same rules as in LogRollup
+  uint16_t present = UINT16_MAX;
+  for (uint8_t i = 0; schema != nullptr && i < n; i++) {
+    if (schema[i].type == LogChannelType::PRESENCE)
+      present = values[i];
+  }
+  for (uint8_t i = 0; i < n; i++) {
+    LogChannelType type = schema != nullptr ? schema[i].type : LogChannelType::UINT16;
+    if (type == LogChannelType::PRESENCE) {
+      min[i] = samples[i] == 0 ? values[i] : min[i] & values[i];
+      max[i] = samples[i] == 0 ? values[i] : max[i] | values[i];
+      sum[i] = max[i];
+      samples[i] = 1;
+      continue;
+    }
+    if (!(present & (1 << i)))
+      continue;
+    int32_t value = type == LogChannelType::INT16 ? (int16_t) values[i] : values[i];
+    if (value < min[i])
+      min[i] = value;
+    if (value > max[i])
+      max[i] = value;
+    sum[i] += value;
+    samples[i]++;
+  }
+}
+
+size_t LogSealEncoder::finish(uint8_t* buffer, size_t capacity) {
+  size_t size = LogSeal::HEADER_SIZE + blocks * LogSeal::INDEX_ENTRY_SIZE + 
+    channels * LogSeal::STATS_SIZE + LogSeal::TRAILER_SIZE;
+  if (size > capacity)
+    return 0;
+  buffer[0] = LogSeal::MARKER;
+  writeUint16(buffer + 1, (uint16_t) size);
+  buffer[3] = channels;
+  buffer[4] = blocks;
+  writeUint32(buffer + 5, records);
+  uint8_t* pos = buffer + LogSeal::HEADER_SIZE;
+  for (uint8_t i = 0; i < blocks; i++) {
+    writeUint32(pos, blockTimes[i]);
+    writeUint32(pos + 4, blockOffsets[i]);
+    pos += LogSeal::INDEX_ENTRY_SIZE;
+  }
+  for (uint8_t i = 0; i < channels; i++) {
+    int32_t n = (int32_t) samples[i];
+    uint16_t stats[3] = { 0, 0, 0 };
+    if (n > 0) {
+      stats[0] = (uint16_t) min[i];
+      stats[1] = (uint16_t) max[i];
+      stats[2] = (uint16_t) ((sum[i] + (sum[i] >= 0 ? n / 2 : -(n / 2))) / n);
+    }
+    for (uint8_t j = 0; j < 3; j++)
+      writeUint16(pos + 2 * j, stats[j]);
+    pos += LogSeal::STATS_SIZE;
+  }
+  writeUint16(pos, (uint16_t) size);
+  writeUint16(pos + 2, LogBlock::crc16(buffer, size - 2));
+  return size;
+}
+
+uint32_t LogSealEncoder::getRecordCount() const {
+  return records;
+}
@@ -0,0 +1,82 @@
+#ifndef LOGSEAL_H
+#define LOGSEAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LogBlock.h"
+#include "LogSchema.h"
+
+/**
+ * Footer of a sealed day file.
+ *
+ * A completed day can be rewritten into as few LogBlocks as possible followed 
+ * by a footer indexing the blocks and summarizing the whole day. 
+ * Layout (multi-byte fields are little-endian):
+ *
+ *   0     MARKER (never a valid block marker or length byte of a frame)
+ *   1..2  total footer size n in bytes
+ *   3     number of channels c of the summary
+ *   4     number of index entries b
+ *   5..8  number of records in the file
+ *   9..   b times: unix timestamp of the first record of a block, offset of the block
+ *   ..    c times: min, max and mean of the channel, as in LogRollup
+ *   n-4   total footer size n, so the footer can be found from the end of the file
+ *   n-2   CRC-16 of all the preceding bytes of the footer
+ *
+ * Readers scanning the whole file skip the footer like any other block.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class LogSeal {
+  public:
+    static const uint8_t MARKER = 0xB5;
+    static const size_t HEADER_SIZE = 9;
+    static const size_t INDEX_ENTRY_SIZE = 8;
+    static const size_t STATS_SIZE = 6;
+    static const size_t TRAILER_SIZE = 4;
+    static const uint8_t MAX_BLOCKS = 32;
+    static const size_t MAX_SIZE = HEADER_SIZE + MAX_BLOCKS * INDEX_ENTRY_SIZE + 
+      LogBlock::MAX_CHANNELS * STATS_SIZE + TRAILER_SIZE;
+
+    // Returns the size of the valid footer at data, or 0 if there is none
+    static size_t check(const uint8_t* data, size_t available);
+
+    // Reads the footer size from the last TRAILER_SIZE bytes of a file
+    static size_t getSize(const uint8_t* trailer);
+
+    // Offset of the last indexed block starting before unixTime, 0 if there is none
+    static uint32_t findOffset(const uint8_t* seal, uint32_t unixTime);
+
+    static uint32_t getRecordCount(const uint8_t* seal);
+};
+
+/** Collects the index and the summary of a file being sealed */
+class LogSealEncoder {
+  public:
+    LogSealEncoder();
+
+    // Blocks beyond MAX_BLOCKS are not indexed
+    void addBlock(uint32_t firstTimestamp, uint32_t offset);
+
+    // Adds a record to the summary. Only records with the same number of channels 
+    // as the first one are summarized. The schema may be nullptr if unknown.
+    void addRecord(const uint16_t* values, uint8_t channels, const LogChannel* schema);
+
+    // Writes the footer, returns its size or 0 if it doesn't fit in the buffer
+    size_t finish(uint8_t* buffer, size_t capacity);
+
+    uint32_t getRecordCount() const;
+
+  private:
+    uint32_t records;
+    uint8_t blocks;
+    uint8_t channels;
+    uint32_t blockTimes[LogSeal::MAX_BLOCKS];
+    uint32_t blockOffsets[LogSeal::MAX_BLOCKS];
+    int32_t min[LogBlock::MAX_CHANNELS];
+    int32_t max[LogBlock::MAX_CHANNELS];
+    int32_t sum[LogBlock::MAX_CHANNELS];
+    uint32_t samples[LogBlock::MAX_CHANNELS];
+};
+
+#endif /* LOGSEAL_H */
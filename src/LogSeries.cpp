@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "LogSeries.h"
+
+
+LogSeries::LogSeries():
+    from(0),
+    to(0),
+    step(1),
+    channelCount(0),
+    presence(NO_PRESENCE),
+    hasCompleted(false),
+    rows(0) {
+  reset(current, 0);
+}
+
+void LogSeries::begin(uint32_t from, uint32_t to, uint32_t step,
+    const Channel* channels, uint8_t channelCount, uint8_t presence) {
+  this->from = from;
+  this->to = to;
+  this->step = step > 0 ? step : 1;
+  if (channelCount > MAX_CHANNELS)
+    channelCount = MAX_CHANNELS;
+  memcpy(this->channels, channels, channelCount * sizeof(Channel));
+  this->channelCount = channelCount;
+  this->presence = presence;
+  hasCompleted = false;
+  rows = 0;
+  reset(current, from);
+}
+
+bool LogSeries::add(const LogEntry& entry) {
+  if (entry.timestamp < from || entry.timestamp >= to)
+    return true;
+  uint32_t start = from + (entry.timestamp - from) / step * step;
+  if (start > current.start) {
+    if (current.records > 0) {
+      if (hasCompleted)
+        return false;
+      completed = current;
+      hasCompleted = true;
+    }
+    reset(current, start);
+  }
+  uint16_t present = presence < entry.channels ? entry.values[presence] : 0xFFFF;
+  current.records++;
+  for (uint8_t i = 0; i < channelCount; i++) {
+    uint8_t index = channels[i].index;
+    if (index >= entry.channels || !(present & (1 << index)))
+      continue;
+    int32_t value = channels[i].type == LogChannelType::INT16 ? 
+      (int32_t) (int16_t) entry.values[index] : (int32_t) entry.values[index];
+    if (current.count[i] == 0 || value < current.min[i])
+      current.min[i] = value;
+    if (current.count[i] == 0 || value > current.max[i])
+      current.max[i] = value;
+    current.sum[i] += value;
+    current.count[i]++;
+  }
+  return true;
+}
+
+void LogSeries::finish() {
+  if (current.records > 0 && !hasCompleted) {
+    completed = current;
+    hasCompleted = true;
+    reset(current, to);
+  }
+}
+
+bool LogSeries::hasRow() const {
+  return hasCompleted;
+}
+
+size_t LogSeries::getMaxRowSize() const {
+  // Separator, timestamp and brackets, then up to 3 numbers of 11 characters and commas
+  return 16 + channelCount * 36;
+}
+
+size_t LogSeries::formatHeader(char* buffer, size_t size) const {
+  size_t n = snprintf(buffer, size, "{\"from\":%lu,\"to\":%lu,\"step\":%lu,\"channels\":[",
+    (unsigned long) from, (unsigned long) to, (unsigned long) step);
+  for (uint8_t i = 0; i < channelCount && n < size; i++)
+    n += snprintf(buffer + n, size - n, "%s{\"name\":\"%s\",\"scale\":%d}",
+      i > 0 ? "," : "", channels[i].name, channels[i].scale);
+  if (n < size)
+    n += snprintf(buffer + n, size - n, "],\"rows\":[");
+  return n < size ? n : size - 1;
+}
+
+size_t LogSeries::formatRow(char* buffer, size_t size) {
+  if (!hasCompleted)
+    return 0;
+  size_t n = snprintf(buffer, size, "%s\n[%lu", rows > 0 ? "," : "", (unsigned long) completed.start);
+  for (uint8_t i = 0; i < channelCount && n < size; i++) {
+    if (completed.count[i] == 0) {
+      n += snprintf(buffer + n, size - n, ",null,null,null");
+      continue;
+    }
+    // Mean rounded half away from zero
+    int64_t sum = completed.sum[i];
+    int64_t half = completed.count[i] / 2;
+    long mean = (long) ((sum >= 0 ? sum + half : sum - half) / (int64_t) completed.count[i]);
+    n += snprintf(buffer + n, size - n, ",%ld,%ld,%ld", (long) completed.min[i], (long) completed.max[i], mean);
+  }
+  if (n < size)
+    n += snprintf(buffer + n, size - n, "]");
+  hasCompleted = false;
+  rows++;
+  return n < size ? n : size - 1;
+}
+
+size_t LogSeries::formatFooter(char* buffer, size_t size) const {
+  int n = snprintf(buffer, size, "]}\n");
+  return n > 0 && (size_t) n < size ? n : 0;
+}
+
+uint32_t LogSeries::getRowCount() const {
+  return rows;
+}
+
+void LogSeries::reset(Bucket& bucket, uint32_t start) {
+  bucket.start = start;
+  bucket.records = 0;
+  for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+    bucket.min[i] = 0;
+    bucket.max[i] = 0;
+    bucket.sum[i] = 0;
+    bucket.count[i] = 0;
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef LOGSERIES_H
+#define LOGSERIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LogRows.h"
+
+/**
+ * Downsamples log records into consecutive time buckets of a fixed length,
+ * keeping min, max and mean of the selected channels, and formats them as JSON.
+ * Records are aggregated in a single pass as they are read, and only the bucket
+ * being filled and the last completed one are kept in memory:
+ *
+ *   {"from":F,"to":T,"step":S,"channels":[{"name":"pm2_5","scale":0},...],
+ *    "rows":[[start,min,max,mean,...],...]}
+ *
+ * Every row holds the unix time of the start of a bucket followed by min, max 
+ * and mean of each channel, as raw values to be multiplied by 10^scale. 
+ * A channel without values in a bucket has nulls, buckets without records
+ * are left out. As in LogRollup, values missing according to the presence 
+ * channel of a record are skipped.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class LogSeries: public LogRows {
+  public:
+    LogSeries();
+
+    // Starts a series of buckets of step seconds covering [from, to).
+    // presence is the index of the presence channel of the records or NO_PRESENCE.
+    void begin(uint32_t from, uint32_t to, uint32_t step, 
+      const Channel* channels, uint8_t channelCount, uint8_t presence);
+
+    bool add(const LogEntry& entry) override;
+    void finish() override;
+    bool hasRow() const override;
+    size_t getMaxRowSize() const override;
+    size_t formatHeader(char* buffer, size_t size) const override;
+    size_t formatRow(char* buffer, size_t size) override;
+    size_t formatFooter(char* buffer, size_t size) const override;
+
+    uint32_t getRowCount() const;
+
+  private:
+    struct Bucket {
+      uint32_t start;
+      uint32_t records;
+      int32_t min[MAX_CHANNELS];
+      int32_t max[MAX_CHANNELS];
+      int64_t sum[MAX_CHANNELS];
+      uint32_t count[MAX_CHANNELS];
+    };
+
+    uint32_t from;
+    uint32_t to;
+    uint32_t step;
+    Channel channels[MAX_CHANNELS];
+    uint8_t channelCount;
+    uint8_t presence;
+    Bucket current;
+    Bucket completed;
+    bool hasCompleted;
+    uint32_t rows;
+
+    void reset(Bucket& bucket, uint32_t start);
+};
+
+#endif /* LOGSERIES_H */
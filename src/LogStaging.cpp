@@ -0,0 +1,144 @@
+#include <string.h>
+
+#include "LogStaging.h"
+
+
+static void writeUint32(uint8_t* dest, uint32_t value) {
+  for (uint8_t i = 0; i < 4; i++)
+    dest[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint32_t readUint32(const uint8_t* src) {
+  return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+static void writeUint16(uint8_t* dest, uint16_t value) {
+  dest[0] = (uint8_t) value;
+  dest[1] = (uint8_t) (value >> 8);
+}
+
+static uint16_t readUint16(const uint8_t* src) {
+  return (uint16_t) (src[0] | (src[1] << 8));
+}
+
+static uint8_t slotCount(size_t size) {
+  if (size < LogStaging::HEADER_SIZE)
+    return 0;
+  size_t slots = (size - LogStaging::HEADER_SIZE) / LogStaging::SLOT_SIZE;
+  if (slots > LogStaging::MAX_SLOTS)
+    slots = LogStaging::MAX_SLOTS;
+  return (uint8_t) slots;
+}
+
+LogStaging::LogStaging(RtcMemory& memory, uint32_t offset, size_t size):
+    memory(memory),
+    offset(offset),
+    capacity(slotCount(size)),
+    committed(0),
+    nextSequence(1) {
+}
+
+uint8_t LogStaging::getCapacity() const {
+  return capacity;
+}
+
+uint8_t LogStaging::recover(Record* records, uint8_t maxRecords) {
+  uint32_t words[HEADER_SIZE / 4];
+  uint8_t* header = (uint8_t*) words;
+  if (!memory.read(offset, words, HEADER_SIZE) ||
+      readUint16(header + 4) != MAGIC ||
+      readUint16(header + 6) != LogBlock::crc16(header, 6)) {
+    // Power-on, nothing to recover
+    committed = 0;
+    nextSequence = 1;
+    writeHeader();
+    return 0;
+  }
+  committed = readUint32(header);
+  nextSequence = committed + 1;
+
+  // Collect the uncommitted records ordered by their sequence numbers
+  uint32_t sequences[MAX_SLOTS];
+  uint8_t count = 0;
+  Record record;
+  for (uint8_t slot = 0; slot < capacity; slot++) {
+    uint32_t sequence;
+    if (!readSlot(slot, sequence, record) || sequence <= committed || sequence - committed > capacity)
+      continue;
+    if (sequence >= nextSequence)
+      nextSequence = sequence + 1;
+    uint8_t i = count;
+    if (count == maxRecords) {
+      // Keep the newest records
+      if (maxRecords == 0 || sequence < sequences[0])
+        continue;
+      memmove(sequences, sequences + 1, (count - 1) * sizeof(uint32_t));
+      memmove(records, records + 1, (count - 1) * sizeof(Record));
+      i--;
+    }
+    else
+      count++;
+    for (; i > 0 && sequences[i - 1] > sequence; i--) {
+      sequences[i] = sequences[i - 1];
+      records[i] = records[i - 1];
+    }
+    sequences[i] = sequence;
+    records[i] = record;
+  }
+  // Records older than the oldest one returned are lost
+  if (count > 0 && committed != sequences[0] - 1) {
+    committed = sequences[0] - 1;
+    writeHeader();
+  }
+  return count;
+}
+
+bool LogStaging::stage(const Record& record) {
+  if (capacity == 0)
+    return false;
+  uint32_t words[SLOT_SIZE / 4];
+  uint8_t* slot = (uint8_t*) words;
+  uint32_t sequence = nextSequence++;
+  memset(slot, 0, SLOT_SIZE);
+  writeUint32(slot, sequence);
+  writeUint32(slot + 4, record.time);
+  slot[8] = record.channels;
+  if (slot[8] > MAX_CHANNELS)
+    slot[8] = MAX_CHANNELS;
+  for (uint8_t i = 0; i < slot[8]; i++)
+    writeUint16(slot + 10 + 2 * i, record.values[i]);
+  writeUint16(slot + SLOT_SIZE - 2, LogBlock::crc16(slot, SLOT_SIZE - 2));
+  return memory.write(offset + HEADER_SIZE + (sequence % capacity) * SLOT_SIZE, words, SLOT_SIZE);
+}
+
+bool LogStaging::release(uint8_t count) {
+  uint32_t last = nextSequence - 1;
+  if (count == 0 || committed == last)
+    return true;
+  committed = last - committed < count ? last : committed + count;
+  return writeHeader();
+}
+
+bool LogStaging::writeHeader() {
+  uint32_t words[HEADER_SIZE / 4];
+  uint8_t* header = (uint8_t*) words;
+  writeUint32(header, committed);
+  writeUint16(header + 4, MAGIC);
+  writeUint16(header + 6, LogBlock::crc16(header, 6));
+  return memory.write(offset, words, HEADER_SIZE);
+}
+
+bool LogStaging::readSlot(uint8_t slot, uint32_t& sequence, Record& record) {
+  uint32_t words[SLOT_SIZE / 4];
+  uint8_t* data = (uint8_t*) words;
+  if (!memory.read(offset + HEADER_SIZE + slot * SLOT_SIZE, words, SLOT_SIZE))
+    return false;
+  if (readUint16(data + SLOT_SIZE - 2) != LogBlock::crc16(data, SLOT_SIZE - 2) || data[8] > MAX_CHANNELS)
+    return false;
+  sequence = readUint32(data);
+  record.time = readUint32(data + 4);
+  record.channels = data[8];
+  for (uint8_t i = 0; i < record.channels; i++)
+    record.values[i] = readUint16(data + 10 + 2 * i);
+  return true;
+}
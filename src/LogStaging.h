@@ -0,0 +1,66 @@
+#ifndef LOGSTAGING_H
+#define LOGSTAGING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LogBlock.h"
+#include "RtcMemory.h"
+
+/**
+ * Keeps copies of log records not yet written to flash in a region of
+ * RtcMemory, so they can be recovered after a reset.
+ *
+ * The region holds a header with the sequence number of the last record
+ * committed to flash, followed by a ring of fixed-size slots:
+ *
+ *   header: 0..3 committed sequence number, 4..5 MAGIC, 6..7 CRC-16 of bytes 0..5
+ *   slot:   0..3 sequence number, 4..7 time, 8 number of channels, 9 unused,
+ *           10..25 values, 26..27 CRC-16 of bytes 0..25
+ *
+ * Record n goes to slot n % capacity and every slot has its own checksum,
+ * so a reset in the middle of a write loses at most the record being written.
+ * After a power-on the memory holds garbage, which fails the header checksum.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class LogStaging {
+  public:
+    static const uint8_t MAX_CHANNELS = LogBlock::MAX_CHANNELS;
+    static const uint16_t MAGIC = 0x5347;
+    static const size_t HEADER_SIZE = 8;
+    static const size_t SLOT_SIZE = 28;
+    // The RTC user memory of the ESP8266 has room for 18 slots at most
+    static const uint8_t MAX_SLOTS = 16;
+
+    struct Record {
+      uint32_t time;
+      uint8_t channels;
+      uint16_t values[MAX_CHANNELS];
+    };
+
+    LogStaging(RtcMemory& memory, uint32_t offset, size_t size);
+
+    // Reads the staged records not committed before the reset, oldest first,
+    // and returns their number. Must be called once before staging any records.
+    uint8_t recover(Record* records, uint8_t maxRecords);
+
+    // Maximum number of uncommitted records
+    uint8_t getCapacity() const;
+
+    bool stage(const Record& record);
+
+    // Marks the oldest staged records as written to flash (or dropped)
+    bool release(uint8_t count);
+
+  private:
+    RtcMemory& memory;
+    const uint32_t offset;
+    const uint8_t capacity;
+    uint32_t committed;
+    uint32_t nextSequence;
+
+    bool writeHeader();
+    bool readSlot(uint8_t slot, uint32_t& sequence, Record& record);
+};
+
+#endif /* LOGSTAGING_H */
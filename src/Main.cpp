@@ -2,7 +2,6 @@
 
 #include <AceTime.h>
 #include <Arduino.h>
-#include <Astra.h>
 #include <ESP8266WiFi.h>
 #include <FS.h>
 #include <Wire.h>
@@ -14,9 +13,15 @@
 #include "Pins.h"
 #include "Lcd.h"
 #include "Log.h"
+#include "LogCompactor.h"
+#include "LogRetention.h"
+#include "LogRingMedium.h"
 #include "ThSensor.h"
 #include "PmSensor.h"
+#include "PublishQueue.h"
 #include "Publisher.h"
+#include "RtcUserMemory.h"
+#include "Storage.h"
 #include "WebServer.h"
 
 using namespace ace_time;
@@ -25,6 +30,8 @@ using namespace ace_time::clock;
 static BasicZoneProcessor tzProcessor;
 
 const time_t LOG_INTERVAL_SECONDS = 60 * 10;
+const time_t PM_WAIT_SECONDS = 60;
+const byte LOG_HIGH_WATER_PERCENT = 75;
 
 TimeZone timeZone = TimeZone::forZoneInfo(&zonedb::kZoneEurope_Warsaw, &tzProcessor);
 NtpClock ntpClock("2.pl.pool.ntp.org");
@@ -32,11 +39,40 @@ SystemClockLoop systemClock(&ntpClock, nullptr);
 
 Log thLog("/log/th/", systemClock, timeZone);
 Log pmLog("/log/pm/", systemClock, timeZone);
+Log envLog("/log/env/", systemClock, timeZone);
+LogRetention logRetention(LOG_HIGH_WATER_PERCENT);
+LogCompactor logCompactor;
+#ifdef USE_LOG_RING
+#ifndef LOG_RING_SECTORS
+#define LOG_RING_SECTORS 64
+#endif
+#ifdef LOG_RING_FLASH_START
+LogRingFlash envRingMedium(LOG_RING_FLASH_START, LOG_RING_SECTORS);
+#else
+LogRingFile envRingMedium("/log/env/ring.dat", LOG_RING_SECTORS);
+#endif
+LogRing envRing(envRingMedium);
+#endif
+// The publisher schedule and pending log records survive resets in RTC user memory
+RtcUserMemory rtcMemory;
+const uint32_t PUBLISHER_STATE_OFFSET = RtcUserMemory::START;
+const uint32_t STAGING_OFFSET = PUBLISHER_STATE_OFFSET + Publisher::STATE_SIZE;
+#ifdef SEPARATE_LOGS
+const size_t STAGING_SIZE = (RtcUserMemory::SIZE - STAGING_OFFSET) / 2;
+LogStaging thStaging(rtcMemory, STAGING_OFFSET, STAGING_SIZE);
+LogStaging pmStaging(rtcMemory, STAGING_OFFSET + STAGING_SIZE, STAGING_SIZE);
+#else
+LogStaging envStaging(rtcMemory, STAGING_OFFSET, RtcUserMemory::SIZE - STAGING_OFFSET);
+#endif
 ThSensor thSensor(PIN_D7);
 PmSensor pmSensor(PIN_D5, PIN_D6);
 WebServer server(80, thSensor, pmSensor);
 Lcd lcd(0x27, PIN_D3);
-Publisher publisher(thSensor, pmSensor, systemClock);
+// Readouts not yet published to Astra, about a day of them at one per minute
+const uint32_t PUBLISH_QUEUE_SECTORS = 10;
+LogRingFile publishQueueMedium("/publish/queue.dat", PUBLISH_QUEUE_SECTORS);
+PublishQueue publishQueue(publishQueueMedium);
+Publisher publisher(thSensor, pmSensor, systemClock, publishQueue);
 
 RH_ASK receiver(2000, PIN_D8);
 char buf[RH_ASK_MAX_MESSAGE_LEN];
@@ -45,8 +81,8 @@ uint8_t buflen = sizeof(buf);
 
 
 void setupWiFi() {
-  Serial.println("Reading network credentials SPIFFS...");    
-  fs::File secret = SPIFFS.open("/secret/wifi.txt", "r");
+  Serial.println("Reading network credentials from flash...");    
+  fs::File secret = Storage.open("/secret/wifi.txt", "r");
   String ssid = secret.readStringUntil('\n');
   String password = secret.readStringUntil('\n');  
   secret.close();  
@@ -63,7 +99,58 @@ void setupWiFi() {
   Serial.println("Connected successfully. Local IP is " + WiFi.localIP().toString());
 }
 
+/** Channels of the combined temperature, humidity and PM log */
+struct EnvSchema {
+  static constexpr LogChannel CHANNELS[] = {
+    { "present", LogChannelType::PRESENCE, 0 },
+    { "temperature", LogChannelType::INT16, -1 },
+    { "humidity", LogChannelType::INT16, -1 },
+    { "pm1", LogChannelType::UINT16, 0 },
+    { "pm2_5", LogChannelType::UINT16, 0 },
+    { "pm10", LogChannelType::UINT16, 0 },
+  };
+};
+
+const uint16_t ENV_PRESENT_ALWAYS = 0b000001;
+const uint16_t ENV_PRESENT_TH = 0b000110;
+const uint16_t ENV_PRESENT_PM = 0b111000;
+
+/** 
+ * Appends a single record with all ready sensors once per LOG_INTERVAL_SECONDS. 
+ * The PM sensor is woken up in advance, and if it isn't ready in time, 
+ * the record is delayed by up to PM_WAIT_SECONDS before it is written without PM.
+ */
+void maybeAppendEnvLog() {
+  // Until NTP syncs, the time is invalid and so is the elapsed time
+  if (!systemClock.isInit())
+    return;
+  time_t elapsed = systemClock.getNow() - envLog.getEndTime();
+  if (elapsed > LOG_INTERVAL_SECONDS - pmSensor.WARM_UP_DELAY_MILLIS / 1000) 
+    pmSensor.wakeUp();
+  if (elapsed <= LOG_INTERVAL_SECONDS)
+    return;
+  if (!pmSensor.isReady() && elapsed <= LOG_INTERVAL_SECONDS + PM_WAIT_SECONDS)
+    return;
+
+  bool th = thSensor.isReady();
+  bool pm = pmSensor.isReady();
+  if (!th && !pm)
+    return;
+  uint16_t present = ENV_PRESENT_ALWAYS | (th ? ENV_PRESENT_TH : 0) | (pm ? ENV_PRESENT_PM : 0);
+  envLog.write(TypedLogRecord<EnvSchema>(
+    LogPresence { present },
+    // Rounded like the publisher does, so the log and Astra agree
+    (int16_t) (th ? lround(thSensor.getTemperature() * 10) : 0),
+    (int16_t) (th ? lround(thSensor.getHumidity() * 10) : 0),
+    (uint16_t) (pm ? pmSensor.getPm1() : 0),
+    (uint16_t) (pm ? pmSensor.getPm2_5() : 0),
+    (uint16_t) (pm ? pmSensor.getPm10() : 0)));
+  Serial.println(String("Appended environment log") + (th ? "" : " without temperature/humidity") + (pm ? "" : " without PM"));
+}
+
 void maybeAppendPmLog() {
+  if (!systemClock.isInit())
+    return;
   if (systemClock.getNow() - pmLog.getEndTime() > LOG_INTERVAL_SECONDS - pmSensor.WARM_UP_DELAY_MILLIS / 1000) {    
     pmSensor.wakeUp();
   }
@@ -75,6 +162,8 @@ void maybeAppendPmLog() {
 }
 
 void maybeAppendThLog() {
+  if (!systemClock.isInit())
+    return;
   if (systemClock.getNow() - thLog.getEndTime() > LOG_INTERVAL_SECONDS) {
     if (thSensor.save(thLog)) {
       Serial.println("Appended temperature/humidity log");    
@@ -88,28 +177,81 @@ void setup() {
   pinMode(PIN_D8, INPUT);
   Serial.begin(115200);  
   lcd.begin();
-  SPIFFS.begin();
+  beginStorage();
+  logRetention.add(thLog);
+  logRetention.add(pmLog);
+  logRetention.add(envLog);
+  logRetention.begin();
+  logCompactor.add(thLog);
+  logCompactor.add(pmLog);
+  logCompactor.add(envLog);
+#ifdef USE_LOG_RING
+  if (envRing.begin())
+    envLog.useRing(envRing);
+  else
+    Serial.println("Failed to start the log ring, logging to day files");
+#endif
+#ifdef SEPARATE_LOGS
+  thLog.useStaging(thStaging);
+  pmLog.useStaging(pmStaging);
+#else
+  envLog.useStaging(envStaging);
+#endif
   thSensor.begin();
   pmSensor.begin();
   setupWiFi();
   ntpClock.setup();  
   systemClock.setup();
+  server.addLog(envLog);
+#ifdef SEPARATE_LOGS
+  server.addLog(thLog);
+  server.addLog(pmLog);
+#endif
+  server.setRetention(logRetention);
   server.begin();
   if (receiver.init()) 
     Serial.println("RF433 receiver initialized ok");
+  if (!publishQueue.begin())
+    Serial.println("Failed to open the publish queue, readouts won't be published");
+  publisher.useStateMemory(rtcMemory, PUBLISHER_STATE_OFFSET);
   publisher.init();
 }
 
 
+// Restores the end times of the logs, once the clock is synced to check them against
+void maybeBeginLogs() {
+  static bool logsBegun = false;
+  if (logsBegun || !systemClock.isInit())
+    return;
+#ifdef SEPARATE_LOGS
+  thLog.begin();
+  pmLog.begin();
+#else
+  envLog.begin();
+#endif
+  logsBegun = true;
+}
+
 void loop() {
   systemClock.loop();
+  maybeBeginLogs();
   lcd.loop();
   server.loop();
   thSensor.loop();
   pmSensor.loop();  
+#ifdef SEPARATE_LOGS
   maybeAppendThLog();
   maybeAppendPmLog();  
+#else
+  maybeAppendEnvLog();
+#endif
+  thLog.loop();
+  pmLog.loop();
+  envLog.loop();
+  logRetention.loop();
+  logCompactor.loop();
   publisher.loop();
+  server.setPublishing(publisher.isSending());
 
   if (receiver.recv((uint8_t*) buf, &buflen)) 
     Serial.printf("Received temperature: %d.%d\n", buf[0] - 100, buf[1]);
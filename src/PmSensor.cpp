@@ -73,11 +73,8 @@ bool PmSensor::isReady() const {
 bool PmSensor::save(Log& log) {
   if (!isReady()) 
     return false;    
-  LogRecord record;
-  record.write(pmsData.PM_AE_UG_1_0);
-  record.write(pmsData.PM_AE_UG_2_5);
-  record.write(pmsData.PM_AE_UG_10_0);
-  log.write(record);
+  log.write(TypedLogRecord<PmSchema>(
+    pmsData.PM_AE_UG_1_0, pmsData.PM_AE_UG_2_5, pmsData.PM_AE_UG_10_0));
   return true;
 }
 
@@ -6,6 +6,15 @@
 
 #include "Log.h"
 
+/** Channels of the particulate matter log, in μg/m³ */
+struct PmSchema {
+  static constexpr LogChannel CHANNELS[] = {
+    { "pm1", LogChannelType::UINT16, 0 },
+    { "pm2_5", LogChannelType::UINT16, 0 },
+    { "pm10", LogChannelType::UINT16, 0 },
+  };
+};
+
 class PmSensor {
 public:
   PmSensor(uint8_t rxPin, uint8_t txPin);
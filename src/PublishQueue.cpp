@@ -0,0 +1,261 @@
+#include <string.h>
+
+#include "PublishQueue.h"
+
+
+static void writeUint32(uint8_t* dest, uint32_t value) {
+  for (uint8_t i = 0; i < 4; i++)
+    dest[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint32_t readUint32(const uint8_t* src) {
+  return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+static void writeUint16(uint8_t* dest, uint16_t value) {
+  dest[0] = (uint8_t) value;
+  dest[1] = (uint8_t) (value >> 8);
+}
+
+static uint16_t readUint16(const uint8_t* src) {
+  return (uint16_t) (src[0] | (src[1] << 8));
+}
+
+static bool isErased(const uint8_t* entry) {
+  for (size_t i = 0; i < PublishQueue::ENTRY_SIZE; i++)
+    if (entry[i] != 0xFF)
+      return false;
+  return true;
+}
+
+// Returns false if the entry is erased or damaged, e.g. by a reset during its write
+static bool decodeEntry(const uint8_t* entry, uint32_t& sequence, uint8_t& type, PublishQueue::Record& record) {
+  const size_t end = PublishQueue::ENTRY_SIZE - 2;
+  if (readUint16(entry + end) != LogBlock::crc16(entry, end) || entry[8] > PublishQueue::MAX_CHANNELS)
+    return false;
+  sequence = readUint32(entry);
+  type = entry[9];
+  record.time = readUint32(entry + 4);
+  record.channels = entry[8];
+  for (uint8_t i = 0; i < record.channels; i++)
+    record.values[i] = readUint16(entry + 10 + 2 * i);
+  return type == PublishQueue::RECORD || type == PublishQueue::ACK;
+}
+
+PublishQueue::PublishQueue(LogRingMedium& medium):
+    medium(medium),
+    sectors(0),
+    used(0),
+    head(0),
+    headSequence(0),
+    headEntries(0),
+    firstRecord(1),
+    nextRecord(1),
+    acknowledged(0),
+    peeked(0),
+    dropped(0) {
+}
+
+bool PublishQueue::begin() {
+  if (!medium.begin())
+    return false;
+  sectors = medium.getSectorCount();
+  used = 0;
+  headEntries = 0;
+  firstRecord = 1;
+  nextRecord = 1;
+  acknowledged = 0;
+  peeked = 0;
+  dropped = 0;
+
+  // The head is the sector with the highest sequence number
+  Header header;
+  bool found = false;
+  for (uint32_t sector = 0; sector < sectors; sector++) {
+    if (readHeader(sector, header) && (!found || header.sequence > headSequence)) {
+      head = sector;
+      headSequence = header.sequence;
+      found = true;
+    }
+  }
+  if (!found)
+    return true;
+
+  // Count the run of consecutive sequence numbers ending at the head,
+  // anything before a gap is lost
+  used = 1;
+  while (used < sectors) {
+    uint32_t sector = (head + sectors - used) % sectors;
+    if (!readHeader(sector, header) || header.sequence != headSequence - used)
+      break;
+    used++;
+  }
+  if (readHeader(toPhysical(0), header))
+    firstRecord = header.firstRecord;
+  if (readHeader(head, header))
+    nextRecord = header.firstRecord;
+  headEntries = getEntryCount(head);
+
+  // The last acknowledgement is in the newest sector holding one,
+  // the last record in the head unless it has none
+  bool acknowledgementFound = false;
+  for (uint32_t i = used; i > 0 && !acknowledgementFound; i--) {
+    uint32_t sector = toPhysical(i - 1);
+    uint32_t entries = sector == head ? headEntries : ENTRIES_PER_SECTOR;
+    uint8_t entry[ENTRY_SIZE];
+    uint32_t sequence;
+    uint8_t type;
+    Record record;
+    for (uint32_t index = 0; index < entries; index++) {
+      if (!readEntry(sector, index, entry) || !decodeEntry(entry, sequence, type, record))
+        continue;
+      if (type == ACK && sequence > acknowledged) {
+        acknowledged = sequence;
+        acknowledgementFound = true;
+      }
+      else if (type == RECORD && sector == head && sequence >= nextRecord)
+        nextRecord = sequence + 1;
+    }
+  }
+  if (acknowledged < firstRecord - 1)
+    acknowledged = firstRecord - 1;
+  if (acknowledged > nextRecord - 1)
+    acknowledged = nextRecord - 1;
+  return true;
+}
+
+bool PublishQueue::push(const Record& record) {
+  if (!append(nextRecord, RECORD, &record))
+    return false;
+  nextRecord++;
+  return true;
+}
+
+uint32_t PublishQueue::getPending() const {
+  return nextRecord - 1 - acknowledged;
+}
+
+uint32_t PublishQueue::getDropped() const {
+  return dropped;
+}
+
+uint8_t PublishQueue::peek(Record* records, uint8_t maxRecords) {
+  uint8_t count = 0;
+  uint32_t wanted = acknowledged + 1;
+  for (uint32_t i = 0; i < used && count < maxRecords && wanted < nextRecord; i++) {
+    // Skip the sectors where all records are older than the wanted one
+    Header next;
+    if (i + 1 < used && readHeader(toPhysical(i + 1), next) && next.firstRecord <= wanted)
+      continue;
+    uint32_t sector = toPhysical(i);
+    uint32_t entries = sector == head ? headEntries : ENTRIES_PER_SECTOR;
+    uint8_t entry[ENTRY_SIZE];
+    uint32_t sequence;
+    uint8_t type;
+    for (uint32_t index = 0; index < entries && count < maxRecords; index++) {
+      if (!readEntry(sector, index, entry) || !decodeEntry(entry, sequence, type, records[count]) ||
+          type != RECORD || sequence < wanted)
+        continue;
+      count++;
+      wanted = sequence + 1;
+      peeked = sequence;
+    }
+  }
+  if (count == 0 && maxRecords > 0 && getPending() > 0) {
+    // The pending records can't be read
+    dropped += getPending();
+    acknowledged = nextRecord - 1;
+  }
+  return count;
+}
+
+bool PublishQueue::acknowledge() {
+  if (peeked <= acknowledged)
+    return true;
+  acknowledged = peeked;
+  return append(peeked, ACK, nullptr);
+}
+
+bool PublishQueue::append(uint32_t sequence, uint8_t type, const Record* record) {
+  if (sectors == 0)
+    return false;
+  if ((used == 0 || headEntries == ENTRIES_PER_SECTOR) && !startSector())
+    return false;
+
+  uint8_t entry[ENTRY_SIZE];
+  memset(entry, 0, ENTRY_SIZE);
+  writeUint32(entry, sequence);
+  entry[9] = type;
+  if (record != nullptr) {
+    writeUint32(entry + 4, record->time);
+    entry[8] = record->channels > MAX_CHANNELS ? MAX_CHANNELS : record->channels;
+    for (uint8_t i = 0; i < entry[8]; i++)
+      writeUint16(entry + 10 + 2 * i, record->values[i]);
+  }
+  writeUint16(entry + ENTRY_SIZE - 2, LogBlock::crc16(entry, ENTRY_SIZE - 2));
+  // A failed write may have programmed some of the bytes, so the entry is skipped
+  uint32_t index = headEntries++;
+  return medium.write(head * SECTOR_SIZE + HEADER_SIZE + index * ENTRY_SIZE, entry, ENTRY_SIZE);
+}
+
+bool PublishQueue::startSector() {
+  uint32_t sector = used == 0 ? 0 : (head + 1) % sectors;
+  uint32_t sequence = used == 0 ? 0 : headSequence + 1;
+  if (used == sectors) {
+    // The oldest sector is overwritten, the next one becomes the oldest
+    Header next;
+    uint32_t oldest = sectors > 1 && readHeader((sector + 1) % sectors, next) ? next.firstRecord : nextRecord;
+    if (oldest - 1 > acknowledged) {
+      dropped += oldest - 1 - acknowledged;
+      acknowledged = oldest - 1;
+    }
+    firstRecord = oldest;
+    used--;
+  }
+  if (!medium.erase(sector))
+    return false;
+
+  uint8_t header[HEADER_SIZE];
+  writeUint16(header, MAGIC);
+  writeUint32(header + 2, sequence);
+  writeUint32(header + 6, nextRecord);
+  writeUint16(header + 10, LogBlock::crc16(header, HEADER_SIZE - 2));
+  if (!medium.write(sector * SECTOR_SIZE, header, HEADER_SIZE))
+    return false;
+
+  if (used == 0)
+    firstRecord = nextRecord;
+  head = sector;
+  headSequence = sequence;
+  headEntries = 0;
+  used++;
+  return true;
+}
+
+bool PublishQueue::readHeader(uint32_t sector, Header& header) {
+  uint8_t data[HEADER_SIZE];
+  if (!medium.read(sector * SECTOR_SIZE, data, HEADER_SIZE))
+    return false;
+  if (readUint16(data) != MAGIC || readUint16(data + 10) != LogBlock::crc16(data, HEADER_SIZE - 2))
+    return false;
+  header.sequence = readUint32(data + 2);
+  header.firstRecord = readUint32(data + 6);
+  return true;
+}
+
+bool PublishQueue::readEntry(uint32_t sector, uint32_t index, uint8_t* entry) {
+  return medium.read(sector * SECTOR_SIZE + HEADER_SIZE + index * ENTRY_SIZE, entry, ENTRY_SIZE);
+}
+
+uint32_t PublishQueue::getEntryCount(uint32_t sector) {
+  // Entries are written in order, so the first erased one is the end
+  uint8_t entry[ENTRY_SIZE];
+  uint32_t index = 0;
+  while (index < ENTRIES_PER_SECTOR && readEntry(sector, index, entry) && !isErased(entry))
+    index++;
+  return index;
+}
+
+uint32_t PublishQueue::toPhysical(uint32_t index) const {
+  return (head + sectors - used + 1 + index) % sectors;
+}
@@ -0,0 +1,98 @@
+#ifndef PUBLISHQUEUE_H
+#define PUBLISHQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LogRing.h"
+
+/**
+ * Persistent queue of sensor readouts waiting to be published, so they
+ * survive outages of Wi-Fi or the database as well as resets.
+ *
+ * Entries are appended to the sectors of a pre-allocated LogRingMedium
+ * like LogBlocks to a LogRing. Each sector starts with a header:
+ *
+ *   0..1   MAGIC
+ *   2..5   sequence number, increasing by one with every new sector
+ *   6..9   sequence number of the first record appended to the sector
+ *   10..11 CRC-16 of the preceding bytes of the header
+ *
+ * followed by entries of ENTRY_SIZE bytes, in the layout of LogStaging slots:
+ *
+ *   0..3 sequence number, 4..7 time, 8 number of channels, 9 type,
+ *   10..25 values, 26..27 CRC-16 of bytes 0..25
+ *
+ * A RECORD entry holds a readout, numbered consecutively from 1.
+ * An ACK entry marks all records up to its sequence number as published,
+ * so the position of the oldest unpublished record survives a reset
+ * without ever rewriting flash. When the medium is full, the oldest sector
+ * is erased, dropping the unpublished records in it.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class PublishQueue {
+  public:
+    static const uint32_t SECTOR_SIZE = LogRing::SECTOR_SIZE;
+    static const uint16_t MAGIC = 0x5051;
+    static const size_t HEADER_SIZE = 12;
+    static const size_t ENTRY_SIZE = 28;
+    static const uint32_t ENTRIES_PER_SECTOR = (SECTOR_SIZE - HEADER_SIZE) / ENTRY_SIZE;
+    static const uint8_t MAX_CHANNELS = 8;
+    static const uint8_t RECORD = 1;
+    static const uint8_t ACK = 2;
+
+    struct Record {
+      uint32_t time;
+      uint8_t channels;
+      uint16_t values[MAX_CHANNELS];
+    };
+
+    PublishQueue(LogRingMedium& medium);
+
+    // Finds the end of the queue and the oldest unpublished record.
+    // Must be called before any other method.
+    bool begin();
+
+    bool push(const Record& record);
+
+    // Number of records not published yet
+    uint32_t getPending() const;
+
+    // Reads up to maxRecords of the oldest unpublished records, returns their number
+    uint8_t peek(Record* records, uint8_t maxRecords);
+
+    // Marks the records returned by the last peek() as published
+    bool acknowledge();
+
+    // Number of unpublished records erased to make room since begin()
+    uint32_t getDropped() const;
+
+  private:
+    struct Header {
+      uint32_t sequence;
+      uint32_t firstRecord;
+    };
+
+    LogRingMedium& medium;
+    uint32_t sectors;
+    uint32_t used;
+    uint32_t head;
+    uint32_t headSequence;
+    uint32_t headEntries;
+    // Sequence number of the oldest record still in the medium
+    uint32_t firstRecord;
+    uint32_t nextRecord;
+    uint32_t acknowledged;
+    // Sequence number of the last record returned by peek()
+    uint32_t peeked;
+    uint32_t dropped;
+
+    bool append(uint32_t sequence, uint8_t type, const Record* record);
+    bool startSector();
+    bool readHeader(uint32_t sector, Header& header);
+    bool readEntry(uint32_t sector, uint32_t index, uint8_t* entry);
+    uint32_t getEntryCount(uint32_t sector);
+    uint32_t toPhysical(uint32_t index) const;
+};
+
+#endif /* PUBLISHQUEUE_H */
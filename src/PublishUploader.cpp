@@ -0,0 +1,86 @@
+#include "PublishUploader.h"
+
+
+PublishUploader::PublishUploader(PublishQueue& queue, PublishSender& sender):
+    queue(queue),
+    sender(sender),
+    waiting(false),
+    sending(false),
+    sendingCount(0),
+    waitingSince(0),
+    retryAt(0),
+    consecutiveFailures(0),
+    sentRecords(0),
+    failures(0) {
+}
+
+void PublishUploader::loop(uint32_t nowMillis) {
+  if (sending) {
+    PublishSender::Status status = sender.poll(nowMillis);
+    if (status == PublishSender::IN_PROGRESS)
+      return;
+    sending = false;
+    if (status == PublishSender::FAILED) {
+      fail(nowMillis);
+      return;
+    }
+    queue.acknowledge();
+    sentRecords += sendingCount;
+    consecutiveFailures = 0;
+    // The remaining records wait for a full batch again, unless they already waited
+    if (queue.getPending() == 0)
+      waiting = false;
+    return;
+  }
+
+  uint32_t pending = queue.getPending();
+  if (pending == 0) {
+    waiting = false;
+    return;
+  }
+  if (!waiting) {
+    waiting = true;
+    waitingSince = nowMillis;
+  }
+  if (consecutiveFailures > 0 && (int32_t) (nowMillis - retryAt) < 0)
+    return;
+  if (pending < MAX_BATCH && nowMillis - waitingSince < MAX_DELAY_MILLIS && consecutiveFailures == 0)
+    return;
+
+  PublishQueue::Record records[MAX_BATCH];
+  uint8_t count = queue.peek(records, MAX_BATCH);
+  if (count == 0)
+    return;
+  if (!sender.begin(records, count)) {
+    fail(nowMillis);
+    return;
+  }
+  sending = true;
+  sendingCount = count;
+}
+
+void PublishUploader::fail(uint32_t nowMillis) {
+  failures++;
+  if (consecutiveFailures < 255)
+    consecutiveFailures++;
+  uint32_t backoff = MIN_BACKOFF_MILLIS;
+  for (uint8_t i = 1; i < consecutiveFailures && backoff < MAX_BACKOFF_MILLIS; i++)
+    backoff *= 2;
+  retryAt = nowMillis + (backoff < MAX_BACKOFF_MILLIS ? backoff : MAX_BACKOFF_MILLIS);
+}
+
+bool PublishUploader::isSending() const {
+  return sending;
+}
+
+uint32_t PublishUploader::getSentRecords() const {
+  return sentRecords;
+}
+
+uint32_t PublishUploader::getFailures() const {
+  return failures;
+}
+
+uint8_t PublishUploader::getConsecutiveFailures() const {
+  return consecutiveFailures;
+}
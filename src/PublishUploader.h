@@ -0,0 +1,74 @@
+#ifndef PUBLISHUPLOADER_H
+#define PUBLISHUPLOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PublishQueue.h"
+
+/**
+ * Stores batches of records in a database, e.g. Astra over HTTPS.
+ * A request is started by begin() and advanced by poll() until it ends,
+ * so a slow request doesn't hold up the main loop.
+ */
+class PublishSender {
+  public:
+    enum Status : uint8_t { IN_PROGRESS, STORED, FAILED };
+
+    virtual ~PublishSender() {}
+    // Starts storing the records with a single request, returns false if
+    // it can't be started. The records are not used after begin() returns.
+    virtual bool begin(const PublishQueue::Record* records, uint8_t count) = 0;
+    // Takes a bounded step of the request, returns FAILED if any of the
+    // records may not be stored. Records of a failed batch are sent again,
+    // so storing a record twice must be harmless.
+    virtual Status poll(uint32_t nowMillis) = 0;
+};
+
+/**
+ * Drains a PublishQueue in batches, oldest records first.
+ *
+ * A batch is sent when MAX_BATCH records are pending or the oldest pending
+ * record has waited MAX_DELAY_MILLIS, so a readout every minute costs one
+ * connection to the database every few minutes instead of every minute.
+ * A backlog left after an outage is sent in full batches, one at a time.
+ * After a failure the batch is retried after MIN_BACKOFF_MILLIS, doubling
+ * with every further failure up to MAX_BACKOFF_MILLIS.
+ * This class doesn't depend on Arduino, so it can be used on the host too.
+ */
+class PublishUploader {
+  public:
+    static const uint8_t MAX_BATCH = 10;
+    static const uint32_t MAX_DELAY_MILLIS = 5 * 60 * 1000UL;
+    static const uint32_t MIN_BACKOFF_MILLIS = 10 * 1000UL;
+    static const uint32_t MAX_BACKOFF_MILLIS = 30 * 60 * 1000UL;
+
+    PublishUploader(PublishQueue& queue, PublishSender& sender);
+
+    // Starts sending a batch if one is due, or advances the one being sent
+    void loop(uint32_t nowMillis);
+
+    // A batch is being sent
+    bool isSending() const;
+
+    uint32_t getSentRecords() const;
+    uint32_t getFailures() const;
+    // Number of failures since the last successful batch
+    uint8_t getConsecutiveFailures() const;
+
+  private:
+    PublishQueue& queue;
+    PublishSender& sender;
+    bool waiting;
+    bool sending;
+    uint8_t sendingCount;
+    uint32_t waitingSince;
+    uint32_t retryAt;
+    uint8_t consecutiveFailures;
+    uint32_t sentRecords;
+    uint32_t failures;
+
+    void fail(uint32_t nowMillis);
+};
+
+#endif /* PUBLISHUPLOADER_H */
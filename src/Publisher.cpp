@@ -1,7 +1,10 @@
-
 #include <AceTime.h>
+#include <ESP8266WiFi.h>
+#include <FS.h>
 
+#include "AstraBatch.h"
 #include "Publisher.h"
+#include "Storage.h"
 
 
 const char* KEYSPACE = "public";
@@ -10,73 +13,130 @@ const char* SENSOR_ID = "81fc94c8-dc84-49bf-9d82-df629b8555c2";
 
 const acetime_t PUBLISH_INTERVAL_SECONDS = 60;
 
-    
-Publisher::Publisher(ThSensor& th, PmSensor& pm, Clock& clock)
-        : client(AstraClient()), th(th), pm(pm), clock(clock), lastPublishTime(0) {
+// Channels of a queued record, temperature and humidity in tenths
+enum Channel { TEMPERATURE, HUMIDITY, PM1, PM2_5, PM10, CHANNELS };
+
+
+Publisher::Publisher(ThSensor& th, PmSensor& pm, Clock& clock, PublishQueue& queue)
+        : th(th), pm(pm), clock(clock), queue(queue), uploader(queue, *this), client(transport),
+          lastPublishTime(0), stateMemory(nullptr), stateOffset(0), sending(false) {
 }
 
 void Publisher::init() {
-    fs::File secret = SPIFFS.open("/secret/astra.txt", "r");
+    fs::File secret = Storage.open("/secret/astra.txt", "r");
     String dbId = secret.readStringUntil('\n');
     String dbRegion = secret.readStringUntil('\n');
     String dbUser = secret.readStringUntil('\n');
     String dbPassword = secret.readStringUntil('\n');
     secret.close();
+    dbId.trim();
+    dbRegion.trim();
+    dbPassword.trim();
 
+    // The GraphQL API accepts the Astra token directly, no login is needed
+    host = dbId + "-" + dbRegion + ".apps.astra.datastax.com";
+    token = dbPassword;
+    Serial.println("Publishing to Astra at " + host + ", " + String(queue.getPending()) + " readouts queued");
+}
 
-    Serial.println("Connecting to Astra...");    
-    client.logger->setLevel(LEVEL_DEBUG);
-    int status = client.connect(
-        // client.connect() stores string references in the client object, so we must duplicate them.
-        // strdup memory leak here, but we do it only once for the lifetime of the program, so nobody cares ;)
-        strdup(dbId.c_str()),                
-        strdup(dbRegion.c_str()), 
-        strdup(dbUser.c_str()), 
-        strdup(dbPassword.c_str()));
-    if (status == 0) 
-        Serial.println("Connected to Astra!");    
-    else 
-        Serial.println("Failed to connect, return code = " + status);
+void Publisher::useStateMemory(RtcMemory& memory, uint32_t offset) {
+    stateMemory = &memory;
+    stateOffset = offset;
+    // The time is followed by its complement, which garbage left
+    // after a power-on is unlikely to match
+    uint32_t state[STATE_SIZE / 4];
+    if (memory.read(offset, state, STATE_SIZE) && state[1] == ~state[0]) {
+        lastPublishTime = (acetime_t) state[0];
+        Serial.println("Restored the time of the last publication");
+    }
 }
 
 void Publisher::loop() {
     if ((clock.getNow() - lastPublishTime > PUBLISH_INTERVAL_SECONDS) && pm.isReady() && th.isReady()) {
         publish();
     }
+    bool wasSending = uploader.isSending();
+    uploader.loop(millis());
+    sending = wasSending || uploader.isSending();
 }
 
-void Publisher::read(Measurement& meas) {
-    acetime_t time = clock.getNow();
-    LocalDateTime ldt = LocalDateTime::forEpochSeconds(time);
-    snprintf(meas.day, sizeof(meas.day), "%04d-%02d-%02d", 
-        ldt.year(), ldt.month(), ldt.day());
-    snprintf(meas.timestamp, sizeof(meas.timestamp), "%04d-%02d-%02dT%02d:%02d:%02dZ", 
-        ldt.year(), ldt.month(), ldt.day(), ldt.hour(), ldt.minute(), ldt.second());
-    snprintf(meas.temperature, sizeof(meas.temperature), "%3.1f", th.getTemperature());
-    snprintf(meas.humidity, sizeof(meas.humidity), "%3.1f", th.getHumidity());
-    snprintf(meas.pm1, sizeof(meas.pm1), "%d", pm.getPm1());
-    snprintf(meas.pm2_5, sizeof(meas.pm2_5), "%d", pm.getPm2_5());
-    snprintf(meas.pm10, sizeof(meas.pm10), "%d", pm.getPm10());
+bool Publisher::isSending() const {
+    return sending;
 }
 
 void Publisher::publish() {
     lastPublishTime = clock.getNow();
-    Serial.println("Publishing sensor readouts to Astra...");
-
-    Measurement meas;
-    read(meas);
-    
-    struct AstraClient::KeyVal columns[10] = { 
-        { "sensor_id", SENSOR_ID }, 
-        { "day", meas.day }, 
-        { "ts", meas.timestamp }, 
-        { "temp", meas.temperature }, 
-        { "humidity", meas.humidity }, 
-        { "pm01", meas.pm1 }, 
-        { "pm02", meas.pm2_5 }, 
-        { "pm10", meas.pm10 },
-        { "latitude", "52.237049" },
-        { "longitude", "21.017532" } 
-    };
-    client.addRow(KEYSPACE, TABLE, 10, columns);
-}
\ No newline at end of file
+    if (stateMemory != nullptr) {
+        uint32_t state[STATE_SIZE / 4] = { (uint32_t) lastPublishTime, ~(uint32_t) lastPublishTime };
+        stateMemory->write(stateOffset, state, STATE_SIZE);
+    }
+
+    PublishQueue::Record record;
+    record.time = (uint32_t) lastPublishTime;
+    record.channels = CHANNELS;
+    record.values[TEMPERATURE] = (uint16_t) (int16_t) lround(th.getTemperature() * 10);
+    record.values[HUMIDITY] = (uint16_t) lround(th.getHumidity() * 10);
+    record.values[PM1] = pm.getPm1();
+    record.values[PM2_5] = pm.getPm2_5();
+    record.values[PM10] = pm.getPm10();
+    uint32_t dropped = queue.getDropped();
+    if (!queue.push(record))
+        Serial.println("Failed to queue sensor readouts for publishing");
+    if (queue.getDropped() > dropped)
+        Serial.printf("Publish queue full, dropped %u oldest readouts\n", queue.getDropped() - dropped);
+}
+
+bool Publisher::begin(const PublishQueue::Record* records, uint8_t count) {
+    if (WiFi.status() != WL_CONNECTED || host.length() == 0)
+        return false;
+    Serial.printf("Publishing %u sensor readouts to Astra...\n", count);
+
+    // Columns of the measurements table: uuid sensor_id, date day, timestamp ts,
+    // float temp, humidity, latitude and longitude, int pm01, pm02 and pm10
+    AstraBatch batch(body, sizeof(body));
+    batch.begin();
+    for (uint8_t i = 0; i < count; i++) {
+        const PublishQueue::Record& record = records[i];
+        LocalDateTime ldt = LocalDateTime::forEpochSeconds((acetime_t) record.time);
+        char day[12];
+        char timestamp[24];
+        snprintf(day, sizeof(day), "%04d-%02d-%02d", ldt.year(), ldt.month(), ldt.day());
+        snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02dT%02d:%02d:%02dZ",
+            ldt.year(), ldt.month(), ldt.day(), ldt.hour(), ldt.minute(), ldt.second());
+        batch.beginRow(TABLE);
+        batch.add("sensor_id", SENSOR_ID);
+        batch.add("day", day);
+        batch.add("ts", timestamp);
+        batch.add("temp", (int16_t) record.values[TEMPERATURE] / 10.0, 1);
+        batch.add("humidity", record.values[HUMIDITY] / 10.0, 1);
+        batch.add("pm01", (int32_t) record.values[PM1]);
+        batch.add("pm02", (int32_t) record.values[PM2_5]);
+        batch.add("pm10", (int32_t) record.values[PM10]);
+        batch.add("latitude", 52.237049, 6);
+        batch.add("longitude", 21.017532, 6);
+        batch.endRow();
+    }
+    batch.end();
+    if (batch.isOverflowed() ||
+            !client.begin(batch, host.c_str(), KEYSPACE, token.c_str(), millis())) {
+        Serial.println("Failed to start a request to Astra");
+        return false;
+    }
+    return true;
+}
+
+PublishSender::Status Publisher::poll(uint32_t nowMillis) {
+    switch (client.poll(nowMillis)) {
+        case AstraClient::STORED:
+            Serial.println("Published to Astra");
+            return PublishSender::STORED;
+        case AstraClient::FAILED:
+            if (client.getFailedIn() == AstraClient::RECEIVING)
+                Serial.printf("Astra failed to store the readouts, status %u\n", client.getResponse().getStatus());
+            else if (client.getFailedIn() != AstraClient::CONNECTING)
+                Serial.println("Astra request timed out");
+            return PublishSender::FAILED;
+        default:
+            return PublishSender::IN_PROGRESS;
+    }
+}
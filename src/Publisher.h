@@ -1,60 +1,75 @@
-#include <Astra.h>
+#include <Arduino.h>
 
+#include "AstraClient.h"
+#include "AstraTransport.h"
 #include "PmSensor.h"
+#include "PublishQueue.h"
+#include "PublishUploader.h"
+#include "RtcMemory.h"
 #include "ThSensor.h"
 
-// A structure storing text data to be send to Astra.
-// Astra REST API accepts only textual data (even numbers must be converted to text).
-struct Measurement {
-    char day[12];
-    char timestamp[32];
-    char temperature[7];
-    char humidity[7];
-    char pm10[5];
-    char pm2_5[5];
-    char pm1[5];
-};
-
 
-// Publishes sensor readouts to Astra database
-class Publisher {
+// Publishes sensor readouts to Astra database.
+// Readouts are kept in a PublishQueue in flash until Astra stores them,
+// so none are lost while Wi-Fi or Astra is down or after a reset.
+// A batch is sent by an AstraClient in small steps, one per loop(),
+// so the sensors and the web server keep running during the request.
+class Publisher: private PublishSender {
 public:
+    // Number of bytes of RtcMemory used by `useStateMemory()`
+    static const size_t STATE_SIZE = 8;
+    // Longest body of a batch of PublishUploader::MAX_BATCH rows
+    static const size_t MAX_BODY = 3072;
+
     // Creates a new publisher that will read the temperature and humidity
     // from the `th` object, air pollution information from the `pm` sensor object,
     // and current NTP-synchronized timestamp from `clock`.
-    Publisher(ThSensor& th, PmSensor& pm, Clock& clock);
-    
-    // Connects to Astra.
-    // The credentials needs to be placed in the SPIFFS filesystem in 
+    // Readouts wait in `queue` until they are published.
+    Publisher(ThSensor& th, PmSensor& pm, Clock& clock, PublishQueue& queue);
+
+    // Reads the Astra credentials.
+    // The credentials needs to be placed in the Storage filesystem in
     // file /data/secret/astra.txt. The file should consist of 4 lines:
     // 1. database uuid
-    // 2. region 
+    // 2. region
     // 3. username (accound identifier)
     // 4. password (Astra token)
     void init();
 
-    // Must be called in the main loop of the program, 
-    // will publish sensor readouts, every 10-minutes.
+    // Keeps the time of the last publication in `memory` at `offset`
+    // and restores it, so the publishing schedule continues after a reset.
+    void useStateMemory(RtcMemory& memory, uint32_t offset);
+
+    // Must be called in the main loop of the program,
+    // will queue sensor readouts every minute and send them in batches.
     // It checks if the sensors are ready by calling `isReady()` on them
     // before fetching the data.
     void loop();
 
-    // Reads sensor values and sends them to Astra database.
+    // A batch was being sent during the last loop()
+    bool isSending() const;
+
+    // Reads sensor values and queues them for sending to Astra database.
     void publish();
 
 
 private:
-    AstraClient client;
     ThSensor& th;
     PmSensor& pm;
     Clock& clock;
+    PublishQueue& queue;
+    PublishUploader uploader;
+    AstraTransport transport;
+    AstraClient client;
+    String host;
+    String token;
     acetime_t lastPublishTime;
+    RtcMemory* stateMemory;
+    uint32_t stateOffset;
+    bool sending;
+    char body[MAX_BODY];
 
-    // Reads clock and sensor values into meas struct
-    void read(Measurement& meas);
+    // Starts sending a batch of readouts in a single HTTPS request
+    bool begin(const PublishQueue::Record* records, uint8_t count) override;
+    Status poll(uint32_t nowMillis) override;
 };
-
-
-
-
-
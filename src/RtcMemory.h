@@ -0,0 +1,18 @@
+#ifndef RTCMEMORY_H
+#define RTCMEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Memory that survives resets, e.g. the RTC user memory of the ESP8266.
+ * Offsets and sizes are in bytes and must be multiples of 4.
+ */
+class RtcMemory {
+  public:
+    virtual ~RtcMemory() {}
+    virtual bool read(uint32_t offset, uint32_t* data, size_t size) = 0;
+    virtual bool write(uint32_t offset, const uint32_t* data, size_t size) = 0;
+};
+
+#endif /* RTCMEMORY_H */
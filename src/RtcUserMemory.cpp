@@ -0,0 +1,14 @@
+#include "RtcUserMemory.h"
+
+
+bool RtcUserMemory::read(uint32_t offset, uint32_t* data, size_t size) {
+  if (offset < START || offset + size > SIZE)
+    return false;
+  return ESP.rtcUserMemoryRead(offset / 4, data, size);
+}
+
+bool RtcUserMemory::write(uint32_t offset, const uint32_t* data, size_t size) {
+  if (offset < START || offset + size > SIZE)
+    return false;
+  return ESP.rtcUserMemoryWrite(offset / 4, (uint32_t*) data, size);
+}
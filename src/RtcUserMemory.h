@@ -0,0 +1,21 @@
+#ifndef RTCUSERMEMORY_H
+#define RTCUSERMEMORY_H
+
+#include <Arduino.h>
+
+#include "RtcMemory.h"
+
+/**
+ * The 512 B of ESP8266 RTC user memory, which survive resets and deep sleep,
+ * but not a power loss. The first 128 B are used by OTA updates.
+ */
+class RtcUserMemory: public RtcMemory {
+  public:
+    static const uint32_t START = 128;
+    static const uint32_t SIZE = 512;
+
+    bool read(uint32_t offset, uint32_t* data, size_t size) override;
+    bool write(uint32_t offset, const uint32_t* data, size_t size) override;
+};
+
+#endif /* RTCUSERMEMORY_H */
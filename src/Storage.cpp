@@ -0,0 +1,113 @@
+#include "Storage.h"
+
+#ifdef USE_LITTLEFS
+
+#include <LittleFS.h>
+
+// LittleFS, or SPIFFS if its files couldn't be migrated yet. 
+// Set by beginStorage(), copies share the filesystem they were copied from.
+static fs::FS selectedStorage { fs::FSImplPtr() };
+fs::FS& Storage = selectedStorage;
+
+// Free heap left untouched while buffering files during migration
+static const uint32_t MIGRATION_HEAP_RESERVE = 16384;
+// Heap used by a buffered file besides its name and data
+static const uint32_t MIGRATION_FILE_OVERHEAD = 48;
+
+struct MigratedFile {
+  String name;
+  uint8_t* data;
+  size_t size;
+  MigratedFile* next;
+};
+
+static void freeMigratedFiles(MigratedFile* files) {
+  while (files != nullptr) {
+    MigratedFile* f = files;
+    files = f->next;
+    free(f->data);
+    delete f;
+  }
+}
+
+// SPIFFS and LittleFS share the same flash partition, so files can't be copied
+// directly from one to another. They are read into RAM, the partition is formatted 
+// and they are written back. The partition is formatted only if all files fit in 
+// the free heap. Otherwise nothing is lost, SPIFFS stays in use and false is returned.
+// Such a filesystem can be migrated by downloading it with `pio run -t downloadfs` 
+// and uploading it as a LittleFS image.
+static bool migrateFromSpiffs() {
+  Serial.println("Migrating SPIFFS to LittleFS...");
+  uint32_t needed = MIGRATION_HEAP_RESERVE;
+  Dir dir = SPIFFS.openDir("/");
+  while (dir.next()) 
+    needed += dir.fileSize() + dir.fileName().length() + MIGRATION_FILE_OVERHEAD;
+  if (ESP.getFreeHeap() < needed) {
+    Serial.println("Not enough memory to migrate all files, keeping SPIFFS");
+    return false;
+  }
+
+  MigratedFile* files = nullptr;
+  dir = SPIFFS.openDir("/");
+  while (dir.next()) {
+    String name = dir.fileName();
+    size_t size = dir.fileSize();
+    uint8_t* data = (uint8_t*) malloc(size > 0 ? size : 1);
+    File file = data != nullptr ? dir.openFile("r") : File();
+    size_t read = file ? file.read(data, size) : 0;
+    file.close();
+    if (data == nullptr || read != size) {
+      Serial.println("Failed to read " + name + ", keeping SPIFFS");
+      free(data);
+      freeMigratedFiles(files);
+      return false;
+    }
+    files = new MigratedFile { name, data, read, files };
+  }
+  SPIFFS.end();
+
+  LittleFS.format();
+  LittleFS.begin();
+  for (MigratedFile* f = files; f != nullptr; f = f->next) {
+    File file = LittleFS.open(f->name, "w");
+    if (file && file.write(f->data, f->size) == f->size)
+      Serial.println("Migrated " + f->name);
+    else
+      Serial.println("Failed to migrate " + f->name);
+    file.close();
+  }
+  freeMigratedFiles(files);
+  return true;
+}
+
+bool beginStorage() {
+  selectedStorage = LittleFS;
+  LittleFSConfig config;
+  config.setAutoFormat(false);
+  LittleFS.setConfig(config);
+  if (LittleFS.begin())
+    return true;
+
+  SPIFFSConfig spiffsConfig;
+  spiffsConfig.setAutoFormat(false);
+  SPIFFS.setConfig(spiffsConfig);
+  if (SPIFFS.begin()) {
+    if (!migrateFromSpiffs()) {
+      selectedStorage = SPIFFS;
+      return true;
+    }
+  }
+  else 
+    LittleFS.format();
+  return LittleFS.begin();
+}
+
+#else
+
+fs::FS& Storage = SPIFFS;
+
+bool beginStorage() {
+  return SPIFFS.begin();
+}
+
+#endif
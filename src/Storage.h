@@ -0,0 +1,16 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <FS.h>
+
+// Filesystem holding the UI files, credentials and logs.
+// It is SPIFFS by default. Build with -D USE_LITTLEFS to use LittleFS instead.
+extern fs::FS& Storage;
+
+// Mounts the Storage filesystem. 
+// In a LittleFS build, a flash that still holds a SPIFFS image is migrated to LittleFS
+// on the first boot. If its files don't all fit in RAM, nothing is formatted and
+// Storage stays on SPIFFS. Returns false if the filesystem couldn't be mounted.
+bool beginStorage();
+
+#endif /* STORAGE_H */
@@ -50,11 +50,8 @@ void ThSensor::loop() {
 bool ThSensor::save(Log& log) {
   if (!isReady())
     return false;
-  int16_t t = (int16_t) (temperature * 10);
-  int16_t h = (int16_t) (humidity * 10);
-  LogRecord record;
-  record.write(t);
-  record.write(h);
-  log.write(record);
+  int16_t t = (int16_t) lround(temperature * 10);
+  int16_t h = (int16_t) lround(humidity * 10);
+  log.write(TypedLogRecord<ThSchema>(t, h));
   return true;    
 }
@@ -5,6 +5,14 @@
 
 #include "Log.h"
 
+/** Channels of the temperature and humidity log */
+struct ThSchema {
+  static constexpr LogChannel CHANNELS[] = {
+    { "temperature", LogChannelType::INT16, -1 },
+    { "humidity", LogChannelType::INT16, -1 },
+  };
+};
+
 /** Temperature and humidity sensor */
 class ThSensor {
 public:
@@ -1,77 +1,420 @@
+#include <ESP8266WiFi.h>
 #include <FS.h>
 
+#include "HttpCache.h"
+#include "JsonWriter.h"
+#include "Storage.h"
 #include "WebServer.h"
 
 
+/** Streams the sectors of a log ring from the sector holding the given time */
+class LogRingBody: public HttpBody {
+  public:
+    LogRingBody(LogRing* ring, uint32_t from, uint32_t to):
+        ring(ring),
+        sector(ring->findSector(from)),
+        offset(0),
+        to(to) {
+    }
+
+    size_t read(uint8_t* buffer, size_t size) override {
+      for (; sector < ring->getSectorCount() && ring->getSectorTime(sector) < to; sector++, offset = 0) {
+        size_t dataSize = ring->getDataSize(sector);
+        if (offset >= dataSize)
+          continue;
+        size_t read = ring->read(sector, offset, buffer, min(size, dataSize - offset));
+        if (read == 0)
+          continue;
+        offset += read;
+        return read;
+      }
+      return END;
+    }
+
+  private:
+    LogRing* ring;
+    uint32_t sector;
+    size_t offset;
+    uint32_t to;
+};
+
+
+// Returns true if the path has a ".." segment, also with percent-encoded dots.
+// The filesystem resolves them, so such a path could reach /secret.
+static bool isTraversal(const String& uri) {
+  String path = uri;
+  path.replace("%2e", ".");
+  path.replace("%2E", ".");
+  return path == ".." || path.startsWith("../") || path.endsWith("/..") || path.indexOf("/../") >= 0;
+}
+
+// Placeholders of index.html, in the order of the slots passed to format()
+static const char* const INDEX_VALUES[] = { "temperature", "humidity", "pm10", "pm2_5", "pm1", "pmready" };
+
+
 WebServer::WebServer(
       uint16_t port, 
       ThSensor& thSensor, 
       PmSensor& pmSensor): 
+      transport(port, server),
       thSensor(thSensor), 
       pmSensor(pmSensor), 
-      server(port) { }
+      lastWakeUp(0),
+      lastLoopMicros(0),
+      loopMaxMicros(0),
+      publishing(false),
+      logCount(0),
+      retention(nullptr) { 
+  memset(&lastReadings, 0xFF, sizeof(lastReadings));
+}
 
 void WebServer::begin() {
     Serial.println("Starting server..."); 
-  server.on("/", std::bind(&WebServer::handleIndex, this));
-  server.on("/sensor", std::bind(&WebServer::handleSensor, this));
-  server.serveStatic("/graphs.html", SPIFFS, "/ui/graphs.html");  
-  server.serveStatic("/thermometer.svg", SPIFFS, "/ui/thermometer.svg");
-  server.serveStatic("/droplet.svg", SPIFFS, "/ui/droplet.svg"); 
-  server.serveStatic("/gas-mask.svg", SPIFFS, "/ui/gas-mask.svg");
-  server.onNotFound(std::bind(&WebServer::handleFileRead, this));
-  server.begin();
+  using namespace std::placeholders;
+  if (!indexSource.open("/ui/index.html") || 
+      !indexPage.parse(indexSource, INDEX_VALUES, sizeof(INDEX_VALUES) / sizeof(INDEX_VALUES[0])))
+    Serial.println("Failed to parse /ui/index.html");
+  server.collectHeader("If-None-Match");
+  server.collectHeader("Range");
+  server.on("/", std::bind(&WebServer::handleIndex, this, _1, _2));
+  server.on("/sensor", std::bind(&WebServer::handleSensor, this, _1, _2));
+  // Scraped every few seconds, so not logged
+  server.on("/metrics", [this](HttpRequest& request, HttpResponse& response) { 
+    response.begin(200, HttpMetricsBody::CONTENT_TYPE, HttpResponse::CHUNKED);
+    response.setBody<HttpMetricsBody>(static_cast<HttpMetricsSource&>(*this));
+  });
+  server.on("/api/series", [this](HttpRequest& request, HttpResponse& response) { 
+    Serial.println("Received a request for /api/series");
+    logQuery.handle(LogQuery::Format::SERIES, logs, logCount, request, response);
+  });
+  server.on("/export.csv", [this](HttpRequest& request, HttpResponse& response) { 
+    Serial.println("Received a request for /export.csv");
+    logQuery.handle(LogQuery::Format::CSV, logs, logCount, request, response);
+  });
+  server.on("/export.ndjson", [this](HttpRequest& request, HttpResponse& response) { 
+    Serial.println("Received a request for /export.ndjson");
+    logQuery.handle(LogQuery::Format::NDJSON, logs, logCount, request, response);
+  });
+  server.on("/events", [this](HttpRequest& request, HttpResponse& response) { 
+    Serial.println("Received a request for /events");
+    events.subscribe(response);
+  });
+  server.onNotFound(std::bind(&WebServer::handleFileRead, this, _1, _2));
+  transport.begin();
   Serial.println("Server started");
 }
 
+void WebServer::addLog(Log& log) {
+  if (logCount < MAX_LOGS)
+    logs[logCount++] = &log;
+}
+
+void WebServer::setRetention(const LogRetention& retention) {
+  this->retention = &retention;
+}
+
+void WebServer::setPublishing(bool publishing) {
+  this->publishing = publishing;
+}
+
 void WebServer::loop() {
-  server.handleClient();
+  // Time between two calls is the duration of an iteration of the main loop
+  uint32_t nowMicros = micros();
+  if (lastLoopMicros != 0) {
+    uint32_t duration = nowMicros - lastLoopMicros;
+    loopDurations.record(duration);
+    if (publishing)
+      publishingLoopDurations.record(duration);
+    loopMaxMicros = max(loopMaxMicros, duration);
+  }
+  lastLoopMicros = nowMicros;
+  publishing = false;
+
+  uint32_t now = millis();
+  publishReadings();
+  if (events.getSubscriberCount() > 0 && now - lastWakeUp >= WAKE_UP_INTERVAL_MILLIS) {
+    // Someone is watching the live feed
+    pmSensor.wakeUp();
+    lastWakeUp = now;
+  }
+  events.loop(now);
+  server.loop(now);
+}
+
+// Publishes the current readings to the live feed if they changed
+void WebServer::publishReadings() {
+  Readings readings;
+  readReadings(readings);
+  if (memcmp(&readings, &lastReadings, sizeof(readings)) == 0)
+    return;
+  memcpy(&lastReadings, &readings, sizeof(readings));
+
+  char data[HttpEventSource::MAX_DATA];
+  formatReadings(readings, data, sizeof(data));
+  events.publish(data);
+}
+
+void WebServer::readReadings(Readings& readings) {
+  memset(&readings, 0, sizeof(readings));
+  readings.temperature = thSensor.getTemperature();
+  readings.humidity = thSensor.getHumidity();
+  readings.pm10 = pmSensor.getPm10();
+  readings.pm2_5 = pmSensor.getPm2_5();
+  readings.pm1 = pmSensor.getPm1();
+  readings.pmReady = pmSensor.isReady();
+}
+
+// Formats readings as JSON, with null for missing temperature and humidity
+void WebServer::formatReadings(const Readings& readings, char* buffer, size_t size) {
+  JsonWriter json(buffer, size);
+  json.beginObject();
+  json.add("temperature", readings.temperature, 2);
+  json.add("humidity", readings.humidity, 2);
+  json.add("pm10", (uint32_t) readings.pm10);
+  json.add("pm2_5", (uint32_t) readings.pm2_5);
+  json.add("pm1", (uint32_t) readings.pm1);
+  json.add("pmready", (int32_t) readings.pmReady);
+  json.endObject();
 }
 
-void WebServer::handleIndex() {
+void WebServer::format(uint8_t slot, char* buffer, size_t size) {
+  switch (slot) {
+    case 0: snprintf(buffer, size, "%.2f", thSensor.getTemperature()); break;
+    case 1: snprintf(buffer, size, "%.2f", thSensor.getHumidity()); break;
+    case 2: snprintf(buffer, size, "%u", pmSensor.getPm10()); break;
+    case 3: snprintf(buffer, size, "%u", pmSensor.getPm2_5()); break;
+    case 4: snprintf(buffer, size, "%u", pmSensor.getPm1()); break;
+    default: snprintf(buffer, size, "%d", pmSensor.isReady()); break;
+  }
+}
+
+void WebServer::handleIndex(HttpRequest& request, HttpResponse& response) {
   Serial.println("Received a request for /");
-  File index = SPIFFS.open("/ui/index.html", "r");
-  String content = index.readString();
-  index.close();
-  content.replace("$temperature", String(thSensor.getTemperature()));
-  content.replace("$humidity", String(thSensor.getHumidity()));
-  content.replace("$pm10", String(pmSensor.getPm10()));
-  content.replace("$pm2_5", String(pmSensor.getPm2_5()));
-  content.replace("$pm1", String(pmSensor.getPm1()));
-  content.replace("$pmready", String(pmSensor.isReady()));
-  server.send(200, "text/html", content);    
-}
-
-void WebServer::handleSensor() {
+  if (!indexPage.isParsed()) {
+    response.send(500, "text/plain", "Missing /ui/index.html");
+    return;
+  }
+  response.begin(200, "text/html", HttpResponse::CHUNKED);
+  response.setBody<HttpTemplateBody>(indexPage, static_cast<HttpTemplate::Values&>(*this));
+}
+
+void WebServer::handleSensor(HttpRequest& request, HttpResponse& response) {
   Serial.println("Received a request for /sensor");
   pmSensor.wakeUp();
 
-  server.send(200, "application/json", 
-  String("{ \"temperature\":") + thSensor.getTemperature() + 
-         ", \"humidity\":" + thSensor.getHumidity() + 
-         ", \"pm10\":" + pmSensor.getPm10() + 
-         ", \"pm2_5\":" + pmSensor.getPm2_5() + 
-         ", \"pm1\":" + pmSensor.getPm1() +  
-         ", \"pmready\":" + pmSensor.isReady() + 
-         " }\n");     
-}
-
-void WebServer::handleFileRead() {
-  String uri = server.uri();
-  if (SPIFFS.exists(uri) && (uri.startsWith("/ui/") || uri.startsWith("/log/"))) {
-    String contentType = "application/octet-stream";
-    if (uri.endsWith(".html"))
-      contentType = "text/html";
-    else if (uri.endsWith(".js"))
-      contentType = "text/javascript";          
-    else if (uri.endsWith(".svg"))
-      contentType = "image/svg+xml";
-
-    File file = SPIFFS.open(uri, "r");
-    server.streamFile(file, contentType);
+  Readings readings;
+  readReadings(readings);
+  char json[HttpEventSource::MAX_DATA];
+  formatReadings(readings, json, sizeof(json));
+  response.send(200, "application/json", json);
+}
+
+// Each histogram takes PARTS families
+static_assert(LatencyHistogram::PARTS == 3, "loop histograms are families 10 to 15");
+
+bool WebServer::writeMetrics(uint8_t index, MetricsWriter& out) {
+  switch (index) {
+    case 0:
+      out.describe("air_temperature_celsius", "gauge", "Air temperature");
+      out.sample("air_temperature_celsius", thSensor.getTemperature(), 2);
+      return true;
+    case 1:
+      out.describe("air_humidity_percent", "gauge", "Relative humidity");
+      out.sample("air_humidity_percent", thSensor.getHumidity(), 2);
+      return true;
+    case 2:
+      out.describe("air_pm_micrograms_per_cubic_meter", "gauge", "Concentration of particulate matter by size");
+      out.sample("air_pm_micrograms_per_cubic_meter", (uint32_t) pmSensor.getPm10(), "size", "10");
+      out.sample("air_pm_micrograms_per_cubic_meter", (uint32_t) pmSensor.getPm2_5(), "size", "2.5");
+      out.sample("air_pm_micrograms_per_cubic_meter", (uint32_t) pmSensor.getPm1(), "size", "1");
+      return true;
+    case 3:
+      out.describe("air_pm_sensor_ready", "gauge", "1 if the PM sensor has settled after waking up");
+      out.sample("air_pm_sensor_ready", (uint32_t) pmSensor.isReady());
+      return true;
+    case 4:
+      out.describe("air_log_records_written_total", "counter", "Records written to flash since boot");
+      for (byte i = 0; i < logCount; i++)
+        out.sample("air_log_records_written_total", logs[i]->getRecordsWritten(), "log", logs[i]->getDirectory().c_str());
+      return true;
+    case 5:
+      out.describe("air_log_bytes_written_total", "counter", "Bytes appended to log files since boot");
+      for (byte i = 0; i < logCount; i++)
+        out.sample("air_log_bytes_written_total", logs[i]->getBytesWritten(), "log", logs[i]->getDirectory().c_str());
+      return true;
+    case 6:
+      out.describe("air_log_write_errors_total", "counter", "Failed writes of records to flash since boot");
+      for (byte i = 0; i < logCount; i++)
+        out.sample("air_log_write_errors_total", logs[i]->getWriteErrors(), "log", logs[i]->getDirectory().c_str());
+      return true;
+    case 7:
+      out.describe("air_log_pending_records", "gauge", "Records waiting in RAM to be written to flash");
+      for (byte i = 0; i < logCount; i++)
+        out.sample("air_log_pending_records", (uint32_t) logs[i]->getPendingCount(), "log", logs[i]->getDirectory().c_str());
+      return true;
+    case 8:
+      out.describe("air_heap_free_bytes", "gauge", "Free heap memory");
+      out.sample("air_heap_free_bytes", ESP.getFreeHeap());
+      out.describe("air_heap_max_free_block_bytes", "gauge", "Largest block of heap memory that can be allocated");
+      out.sample("air_heap_max_free_block_bytes", ESP.getMaxFreeBlockSize());
+      return true;
+    case 9:
+      out.describe("air_heap_fragmentation_percent", "gauge", "Fragmentation of free heap memory");
+      out.sample("air_heap_fragmentation_percent", (uint32_t) ESP.getHeapFragmentation());
+      return true;
+    case 10:
+    case 11:
+    case 12:
+      loopDurations.writeMetrics(out, "air_loop_duration_seconds",
+        "Duration of iterations of the main loop", index - 10);
+      return true;
+    case 13:
+    case 14:
+    case 15:
+      publishingLoopDurations.writeMetrics(out, "air_loop_publishing_duration_seconds",
+        "Duration of iterations of the main loop while readouts were sent to Astra", index - 13);
+      return true;
+    case 16:
+      // Reset by every scrape, so it covers the time since the previous one
+      out.describe("air_loop_duration_max_seconds", "gauge", "Longest iteration of the main loop since the previous scrape");
+      out.sample("air_loop_duration_max_seconds", loopMaxMicros / 1e6, 6);
+      if (!out.isOverflowed())
+        loopMaxMicros = 0;
+      return true;
+    case 17:
+      out.describe("air_wifi_rssi_dbm", "gauge", "Signal strength of the Wi-Fi network");
+      out.sample("air_wifi_rssi_dbm", (int32_t) WiFi.RSSI());
+      return true;
+    case 18:
+      out.describe("air_http_requests_total", "counter", "HTTP requests handled since boot");
+      out.sample("air_http_requests_total", server.getRequestCount());
+      out.describe("air_http_rejected_total", "counter", "HTTP connections rejected because all slots were busy");
+      out.sample("air_http_rejected_total", server.getRejectedCount());
+      return true;
+    case 19:
+      out.describe("air_uptime_seconds", "gauge", "Time since boot");
+      out.sample("air_uptime_seconds", (uint32_t) (millis() / 1000));
+      return true;
+    case 20:
+      out.describe("air_log_corrupt_frames_total", "counter", "Corrupt fragments of the logs skipped by queries since boot");
+      out.sample("air_log_corrupt_frames_total", logQuery.getCorruptFrames());
+      return true;
+    case 21:
+      if (retention == nullptr)
+        return true;
+      out.describe("air_log_used_bytes", "gauge", "Bytes used by the files of the log");
+      for (byte i = 0; i < retention->getLogCount(); i++)
+        out.sample("air_log_used_bytes", retention->getUsedBytes(i), "log", retention->getLog(i).getDirectory().c_str());
+      return true;
+    case 22:
+      if (retention == nullptr)
+        return true;
+      out.describe("air_log_evicted_files_total", "counter", "Old log files removed to stay below the high-water mark since boot");
+      out.sample("air_log_evicted_files_total", retention->getEvictedFiles());
+      out.describe("air_log_evicted_bytes_total", "counter", "Bytes of old log files removed since boot");
+      out.sample("air_log_evicted_bytes_total", retention->getEvictedBytes());
+      out.describe("air_log_eviction_blocked", "gauge", "1 if over the high-water mark with only live log files left");
+      out.sample("air_log_eviction_blocked", (uint32_t) retention->isBlocked());
+      return true;
+    default:
+      return false;
+  }
+}
+
+void WebServer::handleFileRead(HttpRequest& request, HttpResponse& response) {
+  String uri = request.getPath();
+  if (isTraversal(uri)) {
+    response.send(400, "text/plain", "Bad request");
+    return;
+  }
+  if (handleRingRead(uri, request, response))
+    return;
+  // Other pages of the UI are served from the root too
+  if (!uri.startsWith("/ui/") && !uri.startsWith("/log/"))
+    uri = "/ui" + uri;
+  String contentType = "application/octet-stream";
+  if (uri.endsWith(".html"))
+    contentType = "text/html";
+  else if (uri.endsWith(".js"))
+    contentType = "text/javascript";          
+  else if (uri.endsWith(".css"))
+    contentType = "text/css";
+  else if (uri.endsWith(".svg"))
+    contentType = "image/svg+xml";
+  else if (uri.endsWith(".json"))
+    contentType = "application/json";
+
+  if (uri.startsWith("/ui/") && Storage.exists(uri + ".gz")) {
+    handleCompressedRead(uri + ".gz", contentType, request, response);
+    return;
+  }
+  if (!Storage.exists(uri)) {
+    response.send(404, "text/plain", "Not found");
+    return;
+  }
+  File file = Storage.open(uri, "r");
+  uint32_t size = file.size();
+  if (uri.startsWith("/ui/")) {
+    if (HttpCache::begin(request, response, contentType.c_str(), size, nullptr, false))
+      response.setBody<HttpFileBody>(file, 0, size);
+    return;
+  }
+  // Log files are only appended to, so a client polling today's log
+  // asks for the bytes after the ones it already has
+  uint32_t offset = 0, length = size;
+  uint16_t status = request.getRange(size, offset, length);
+  if (status == 416) {
     file.close();
+    response.begin(416, "text/plain", 0);
+    response.addHeader("Content-Range", ("bytes */" + String(size)).c_str());
+    return;
+  }
+  if (status == 200 && request.hasArg("from")) {
+    // Skip the blocks older than the requested time using the log index
+    offset = Log::findOffset(uri, request.getArg("from", 0L));
+    length = size - offset;
+  }
+  response.begin(status, contentType.c_str(), length);
+  response.addHeader("Accept-Ranges", "bytes");
+  if (status == 206) {
+    String range = "bytes " + String(offset) + "-" + String(offset + length - 1) + "/" + String(size);
+    response.addHeader("Content-Range", range.c_str());
   }
-  else {
-    server.send(404, "text/plain", "Not found: " + uri);
+  response.setBody<HttpFileBody>(file, offset, length);
+}
+
+// Serves a UI file compressed by the build, without decompressing it.
+// Clients not accepting gzip are not supported.
+void WebServer::handleCompressedRead(const String& fileName, const String& contentType, 
+    HttpRequest& request, HttpResponse& response) {
+  File file = Storage.open(fileName, "r");
+  uint8_t trailer[HttpCache::GZIP_TRAILER_SIZE];
+  char etag[HttpCache::MAX_ETAG];
+  if (file.size() < sizeof(trailer) || !file.seek(file.size() - sizeof(trailer), SeekSet) ||
+      file.read(trailer, sizeof(trailer)) != sizeof(trailer)) {
+    response.send(500, "text/plain", "Corrupt file");
+    return;
+  }
+  HttpCache::formatEtag(trailer, etag, sizeof(etag));
+  if (HttpCache::begin(request, response, contentType.c_str(), file.size(), etag, true))
+    response.setBody<HttpFileBody>(file);
+}
+
+// Streams the sectors of a log ring holding the records of the requested day
+bool WebServer::handleRingRead(const String& uri, HttpRequest& request, HttpResponse& response) {
+  for (byte i = 0; i < logCount; i++) {
+    LogRing* ring = logs[i]->getRing();
+    const String& dir = logs[i]->getDirectory();
+    uint32_t from, to;
+    if (ring == nullptr || !uri.startsWith(dir) || 
+        !logs[i]->getDayRange(uri.substring(dir.length()), from, to))
+      continue;
+    if (request.hasArg("from"))
+      from = max(from, (uint32_t) request.getArg("from", 0L));
+
+    response.begin(200, "application/octet-stream", HttpResponse::CHUNKED);
+    response.setBody<LogRingBody>(ring, from, to);
+    return true;
   }
+  return false;
 }
@@ -2,12 +2,20 @@
 #define WEBSERVER_H
 
 #include <Arduino.h>
-#include <ESP8266WebServer.h>
 
+#include "HttpEvents.h"
+#include "HttpMetrics.h"
+#include "HttpServer.h"
+#include "HttpTemplate.h"
+#include "HttpTransport.h"
+#include "LatencyHistogram.h"
+#include "Log.h"
+#include "LogQuery.h"
+#include "LogRetention.h"
 #include "ThSensor.h"
 #include "PmSensor.h"
 
-class WebServer {
+class WebServer: private HttpTemplate::Values, private HttpMetricsSource {
   public:
     WebServer(
       uint16_t port, 
@@ -17,13 +25,61 @@ class WebServer {
     void begin();
     void loop();
 
+    // Serves the records of a log kept in a LogRing at the URLs of its day files
+    // and makes its channels available to /api/series and the exports
+    void addLog(Log& log);
+
+    // Reports the usage and evictions of the retention manager on /metrics
+    void setRetention(const LogRetention& retention);
+
+    // Tells whether the publisher was sending readouts during this iteration
+    // of the main loop, which is then counted in a histogram of its own
+    void setPublishing(bool publishing);
+
   private:
-    ESP8266WebServer server;
+    static const byte MAX_LOGS = 4;
+    // How often the PM sensor is kept awake while the live feed has subscribers
+    static const uint32_t WAKE_UP_INTERVAL_MILLIS = 5000;
+
+    /** Readings sent to the live feed, compared bitwise to detect changes */
+    struct Readings {
+      float temperature;
+      float humidity;
+      uint16_t pm10;
+      uint16_t pm2_5;
+      uint16_t pm1;
+      bool pmReady;
+    };
+
+    HttpServer server;
+    HttpTransport transport;
     ThSensor& thSensor;
     PmSensor& pmSensor;
+    HttpFileSource indexSource;
+    HttpTemplate indexPage;
+    HttpEventSource events;
+    LogQuery logQuery;
+    Readings lastReadings;
+    uint32_t lastWakeUp;
+    uint32_t lastLoopMicros;
+    LatencyHistogram loopDurations;
+    LatencyHistogram publishingLoopDurations;
+    uint32_t loopMaxMicros;
+    bool publishing;
+    Log* logs[MAX_LOGS];
+    byte logCount;
+    const LogRetention* retention;
 
-    void handleIndex();
-    void handleSensor();
-    void handleFileRead();
+    void format(uint8_t slot, char* buffer, size_t size) override;
+    void handleIndex(HttpRequest& request, HttpResponse& response);
+    void handleSensor(HttpRequest& request, HttpResponse& response);
+    bool writeMetrics(uint8_t index, MetricsWriter& out) override;
+    void publishReadings();
+    void readReadings(Readings& readings);
+    void formatReadings(const Readings& readings, char* buffer, size_t size);
+    void handleFileRead(HttpRequest& request, HttpResponse& response);
+    void handleCompressedRead(const String& fileName, const String& contentType, 
+      HttpRequest& request, HttpResponse& response);
+    bool handleRingRead(const String& uri, HttpRequest& request, HttpResponse& response);
 };
 #endif /* WEBSERVER_H */
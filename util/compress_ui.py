@@ -0,0 +1,86 @@
+# Prepares the UI files for the filesystem image:
+# - local references in HTML files get a "v" argument with the CRC-32 of the
+#   referenced file, so the browser may cache them until they change,
+# - every UI file except index.html, whose placeholders are filled in by the
+#   firmware, is replaced by its gzip-compressed copy <name>.gz, which
+#   the firmware serves as it is.
+# Other files of the data directory are copied unchanged.
+#
+# As a PlatformIO pre: extra script it prepares a copy of the data directory
+# in the build directory and builds the filesystem image from that copy.
+# It can also be run directly: python3 util/compress_ui.py data out_dir
+import gzip
+import os
+import re
+import shutil
+import sys
+import zlib
+
+UNCOMPRESSED = {"index.html"}
+# SPIFFS keeps at most 31 characters of a path
+MAX_PATH = 31
+REFERENCE = re.compile(r'((?:src|href)=")([^"?#:]+)(")')
+
+
+def file_version(path):
+    with open(path, "rb") as f:
+        return "%08x" % (zlib.crc32(f.read()) & 0xFFFFFFFF)
+
+
+def add_versions(html, versions):
+    def replace(match):
+        name = match.group(2)
+        if name.startswith("ui/"):
+            name = name[3:]
+        if name not in versions:
+            return match.group(0)
+        return match.group(1) + match.group(2) + "?v=" + versions[name] + match.group(3)
+    return REFERENCE.sub(replace, html)
+
+
+def compress_ui(data_dir, out_dir):
+    if os.path.exists(out_dir):
+        shutil.rmtree(out_dir)
+    shutil.copytree(data_dir, out_dir)
+    ui_dir = os.path.join(out_dir, "ui")
+    if not os.path.isdir(ui_dir):
+        return
+    names = sorted(n for n in os.listdir(ui_dir) if os.path.isfile(os.path.join(ui_dir, n)))
+    versions = {n: file_version(os.path.join(ui_dir, n)) for n in names}
+    original_size = compressed_size = 0
+    for name in names:
+        path = os.path.join(ui_dir, name)
+        with open(path, "rb") as f:
+            content = f.read()
+        if name.endswith(".html"):
+            content = add_versions(content.decode("utf-8"), versions).encode("utf-8")
+        original_size += len(content)
+        if name in UNCOMPRESSED:
+            with open(path, "wb") as f:
+                f.write(content)
+            compressed_size += len(content)
+            continue
+        fs_path = "/ui/" + name + ".gz"
+        if len(fs_path) > MAX_PATH:
+            print("Warning: %s is longer than %d characters" % (fs_path, MAX_PATH))
+        with open(path + ".gz", "wb") as f:
+            f.write(gzip.compress(content, compresslevel=9, mtime=0))
+        compressed_size += os.path.getsize(path + ".gz")
+        os.remove(path)
+    print("UI files: %d B, %d B after compression" % (original_size, compressed_size))
+
+
+try:
+    Import("env")
+except NameError:
+    env = None
+
+if env is not None:
+    prepared_dir = os.path.join(env.subst("$BUILD_DIR"), "data")
+    compress_ui(env.subst("$PROJECT_DATA_DIR"), prepared_dir)
+    env.Replace(PROJECT_DATA_DIR=prepared_dir)
+elif __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print("Usage: python3 %s <data dir> <output dir>" % sys.argv[0])
+        sys.exit(1)
+    compress_ui(sys.argv[1], sys.argv[2])
@@ -0,0 +1,633 @@
+/**
+ * Checks persistent connections and pipelining of HttpServer and measures
+ * what they save on a load of the graphs page.
+ *
+ * The checks feed requests to the real server on simulated sockets: one after
+ * another on the same connection, pipelined in a single packet and split at
+ * every byte, with more pipelined bytes than the server keeps, with clients
+ * asking to close, with a body shorter than its Content-Length, and with all
+ * slots taken by idle or busy connections.
+ * Responses are split by their Content-Length or chunked encoding, like a
+ * browser does, and must arrive complete and in order.
+ *
+ * The page load runs over the simulated Wi-Fi link of pageload, where every
+ * new connection costs a TCP handshake of one round trip. The browser loads
+ * graphs.html, then main.js, then the log and schema of every chart one after
+ * another, like data/ui/main.js, and later switches to the previous day.
+ * It keeps up to 6 connections and reuses idle ones if the server allows it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "HttpServer.h"
+
+
+static const uint32_t RTT_MILLIS = 30;
+static const size_t BYTES_PER_MILLI = 100;
+static const size_t WINDOW = 2920;
+static const size_t MAX_BROWSER_CONNECTIONS = 6;
+
+static const char* const BIG_PATTERN = "0123456789abcdef";
+static const size_t BIG_SIZE = 3000;
+
+struct Response {
+  int status = 0;
+  std::string headers;
+  std::string body;
+
+  bool closes() const {
+    return headers.find("\r\nConnection: close\r\n") != std::string::npos;
+  }
+};
+
+// Splits the complete responses at pos of data, returns the position after them
+static size_t splitResponses(const std::string& data, size_t pos, std::vector<Response>& responses) {
+  while (true) {
+    size_t end = data.find("\r\n\r\n", pos);
+    if (end == std::string::npos)
+      return pos;
+    Response response;
+    sscanf(data.c_str() + pos, "HTTP/1.%*d %d", &response.status);
+    response.headers = data.substr(pos, end + 2 - pos);
+    size_t next = end + 4;
+    size_t lengthHeader = response.headers.find("\r\nContent-Length: ");
+    if (lengthHeader != std::string::npos) {
+      size_t length = strtoul(response.headers.c_str() + lengthHeader + 18, nullptr, 10);
+      if (data.size() < next + length)
+        return pos;
+      response.body = data.substr(next, length);
+      next += length;
+    }
+    else if (response.headers.find("\r\nTransfer-Encoding: chunked\r\n") != std::string::npos) {
+      while (true) {
+        size_t lineEnd = data.find("\r\n", next);
+        if (lineEnd == std::string::npos)
+          return pos;
+        size_t size = strtoul(data.c_str() + next, nullptr, 16);
+        if (data.size() < lineEnd + 2 + size + 2)
+          return pos;
+        response.body.append(data, lineEnd + 2, size);
+        next = lineEnd + 2 + size + 2;
+        if (size == 0)
+          break;
+      }
+    }
+    responses.push_back(response);
+    pos = next;
+  }
+}
+
+/** Socket of a client reading as fast as possible */
+class FastSocket: public HttpSocket {
+  public:
+    size_t space() override {
+      return WINDOW;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      received.append((const char*) data, size);
+      return size;
+    }
+
+    void close() override {
+      closed = true;
+    }
+
+    std::vector<Response> responses() const {
+      std::vector<Response> result;
+      splitResponses(received, 0, result);
+      return result;
+    }
+
+    bool closed = false;
+    std::string received;
+};
+
+static void serveChecks(HttpServer& server, const std::string& big) {
+  server.on("/a", [](HttpRequest& request, HttpResponse& response) {
+    response.send(200, "text/plain", "alpha");
+  });
+  server.on("/b", [](HttpRequest& request, HttpResponse& response) {
+    response.send(200, "text/plain", "bravo");
+  });
+  server.on("/big", [&big](HttpRequest& request, HttpResponse& response) {
+    response.begin(200, "text/plain", big.size());
+    response.setBody<HttpMemoryBody>((const uint8_t*) big.data(), big.size());
+  });
+  server.on("/short", [&big](HttpRequest& request, HttpResponse& response) {
+    // The body ends before its Content-Length, like a file that fails to read
+    response.begin(200, "text/plain", big.size());
+    response.setBody<HttpMemoryBody>((const uint8_t*) big.data(), big.size() / 2);
+  });
+  server.on("/chunked", [](HttpRequest& request, HttpResponse& response) {
+    static const char* const content = "chunked";
+    response.begin(200, "text/plain", HttpResponse::CHUNKED);
+    response.setBody<HttpMemoryBody>((const uint8_t*) content, strlen(content));
+  });
+}
+
+static std::string get(const char* path, const char* headers = "") {
+  return std::string("GET ") + path + " HTTP/1.1\r\nHost: sensor\r\n" + headers + "\r\n";
+}
+
+static void send(HttpConnection* connection, const std::string& data) {
+  connection->receive((const uint8_t*) data.data(), data.size());
+}
+
+static void run(HttpServer& server, uint32_t& now, int loops = 20) {
+  for (int i = 0; i < loops; i++)
+    server.loop(++now);
+}
+
+static std::string bodyOf(const char* path, const std::string& big) {
+  if (strcmp(path, "/big") == 0)
+    return big;
+  if (strcmp(path, "/chunked") == 0)
+    return "chunked";
+  return strcmp(path, "/a") == 0 ? "alpha" : "bravo";
+}
+
+static bool expect(bool condition, const char* description) {
+  printf("  %-64s %s\n", description, condition ? "ok" : "FAILED");
+  return condition;
+}
+
+static bool check(const std::string& big) {
+  bool ok = true;
+  printf("checks\n");
+
+  {
+    // Requests sent one after another reuse the connection
+    HttpServer server;
+    serveChecks(server, big);
+    uint32_t now = 0;
+    FastSocket socket;
+    HttpConnection* connection = server.accept(&socket);
+    const char* paths[] = { "/a", "/big", "/chunked", "/b" };
+    for (int i = 0; i < 20; i++) {
+      send(connection, get(paths[i % 4]));
+      run(server, now);
+    }
+    std::vector<Response> responses = socket.responses();
+    bool correct = responses.size() == 20 && !socket.closed;
+    for (size_t i = 0; correct && i < responses.size(); i++)
+      correct = responses[i].status == 200 && responses[i].body == bodyOf(paths[i % 4], big) &&
+        responses[i].headers.find("\r\nConnection: keep-alive\r\n") != std::string::npos;
+    ok &= expect(correct, "20 sequential requests on one connection");
+    ok &= expect(responses.size() > 0 && responses[0].headers.find("\r\nKeep-Alive: timeout=5, max=99\r\n") != std::string::npos,
+      "Keep-Alive header announces the timeout and the remaining requests");
+    run(server, now, HttpServer::KEEP_ALIVE_TIMEOUT_MILLIS - 100);
+    bool openBefore = !socket.closed;
+    run(server, now, 200);
+    ok &= expect(openBefore && socket.closed, "idle connection closed after the keep-alive timeout");
+    server.release(socket.getConnection());
+  }
+
+  {
+    // Pipelined requests, in one packet and split at every byte
+    const char* paths[] = { "/a", "/big", "/chunked", "/b" };
+    std::string pipelined;
+    for (const char* path : paths)
+      pipelined += get(path);
+    bool correct = true;
+    for (size_t piece = 1; piece <= pipelined.size(); piece++) {
+      HttpServer server;
+      serveChecks(server, big);
+      uint32_t now = 0;
+      FastSocket socket;
+      HttpConnection* connection = server.accept(&socket);
+      for (size_t pos = 0; pos < pipelined.size(); pos += piece) {
+        send(connection, pipelined.substr(pos, piece));
+        server.loop(++now);
+      }
+      run(server, now);
+      std::vector<Response> responses = socket.responses();
+      correct = correct && responses.size() == 4 && !socket.closed;
+      for (size_t i = 0; correct && i < responses.size(); i++)
+        correct = responses[i].body == bodyOf(paths[i], big);
+      server.release(socket.getConnection());
+    }
+    ok &= expect(correct, "4 pipelined requests split at every possible size");
+  }
+
+  {
+    // More pipelined bytes than the server keeps
+    HttpServer server;
+    serveChecks(server, big);
+    uint32_t now = 0;
+    FastSocket socket;
+    HttpConnection* connection = server.accept(&socket);
+    std::string pipelined = get("/big");
+    for (int i = 0; i < 11; i++)
+      pipelined += get(i % 2 == 0 ? "/a" : "/b");
+    // The first request is parsed at once, the complete ones that fit are kept
+    size_t kept = HttpConnection::INPUT_BUFFER / get("/a").size();
+    send(connection, pipelined);
+    run(server, now, 50);
+    std::vector<Response> responses = socket.responses();
+    bool correct = responses.size() == 1 + kept && socket.closed;
+    for (size_t i = 1; correct && i < responses.size(); i++)
+      correct = responses[i].body == ((i - 1) % 2 == 0 ? "alpha" : "bravo");
+    char description[80];
+    snprintf(description, sizeof(description), "%zu B pipelined: %zu responses, then closed", pipelined.size(), responses.size());
+    ok &= expect(correct, description);
+    server.release(socket.getConnection());
+  }
+
+  {
+    // Clients that don't allow a persistent connection
+    struct Case {
+      const char* description;
+      std::string request;
+      bool persists;
+    };
+    const Case cases[] = {
+      { "HTTP/1.1 with Connection: close", get("/a", "Connection: close\r\n"), false },
+      { "HTTP/1.1 with Connection: Keep-Alive, TE", get("/a", "Connection: Keep-Alive, TE\r\n"), true },
+      { "HTTP/1.0", "GET /a HTTP/1.0\r\n\r\n", false },
+      { "HTTP/1.0 with Connection: keep-alive", "GET /a HTTP/1.0\r\nConnection: keep-alive\r\n\r\n", true },
+      { "HTTP/1.0 with Connection: keep-alive, chunked response", "GET /chunked HTTP/1.0\r\nConnection: keep-alive\r\n\r\n", false },
+      { "POST with a body", "POST /a HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc", false },
+      { "malformed request", "GET /a\r\n\r\n", false },
+    };
+    for (const Case& c : cases) {
+      HttpServer server;
+      serveChecks(server, big);
+      uint32_t now = 0;
+      FastSocket socket;
+      HttpConnection* connection = server.accept(&socket);
+      send(connection, c.request);
+      run(server, now);
+      std::vector<Response> responses = socket.responses();
+      bool correct = socket.closed != c.persists && responses.size() == 1 && responses[0].closes() != c.persists;
+      char description[80];
+      snprintf(description, sizeof(description), "%s %s", c.description, c.persists ? "persists" : "closes");
+      ok &= expect(correct, description);
+      server.release(socket.getConnection());
+    }
+  }
+
+  {
+    // The last request allowed on a connection closes it
+    HttpServer server;
+    serveChecks(server, big);
+    uint32_t now = 0;
+    FastSocket socket;
+    HttpConnection* connection = server.accept(&socket);
+    for (int i = 0; i < HttpServer::MAX_KEEP_ALIVE_REQUESTS; i++) {
+      send(connection, get("/a"));
+      run(server, now, 2);
+    }
+    std::vector<Response> responses = socket.responses();
+    bool correct = responses.size() == HttpServer::MAX_KEEP_ALIVE_REQUESTS && socket.closed &&
+      responses.back().closes() && !responses[responses.size() - 2].closes();
+    ok &= expect(correct, "connection closed after MAX_KEEP_ALIVE_REQUESTS");
+    server.release(socket.getConnection());
+  }
+
+  {
+    // A body shorter than its Content-Length closes the connection,
+    // otherwise the client would take the next response for the rest of it
+    HttpServer server;
+    serveChecks(server, big);
+    uint32_t now = 0;
+    FastSocket socket;
+    HttpConnection* connection = server.accept(&socket);
+    send(connection, get("/short") + get("/a"));
+    run(server, now);
+    bool correct = socket.closed && socket.responses().empty() &&
+      socket.received.find("alpha") == std::string::npos;
+    ok &= expect(correct, "body shorter than its Content-Length closes the connection");
+    server.release(socket.getConnection());
+  }
+
+  {
+    // Idle connections give their slots to new ones, the longest idle first
+    HttpServer server;
+    serveChecks(server, big);
+    uint32_t now = 0;
+    FastSocket idle[HttpServer::MAX_CONNECTIONS];
+    for (FastSocket& socket : idle) {
+      send(server.accept(&socket), get("/a"));
+      run(server, now);
+    }
+    FastSocket late;
+    HttpConnection* connection = server.accept(&late);
+    bool correct = connection != nullptr && idle[0].closed && idle[0].getConnection() == nullptr;
+    for (int i = 1; i < HttpServer::MAX_CONNECTIONS; i++)
+      correct = correct && !idle[i].closed;
+    if (connection != nullptr) {
+      send(connection, get("/b"));
+      run(server, now);
+      correct = correct && late.responses().size() == 1;
+    }
+    ok &= expect(correct, "new connection takes the slot of the longest idle one");
+
+    // Connections receiving a request are never closed for a new one
+    for (int i = 1; i < HttpServer::MAX_CONNECTIONS; i++)
+      idle[i].getConnection()->receive((const uint8_t*) "GET /a HTTP/1.1\r\n", 17);
+    send(connection, "GET ");
+    FastSocket rejected;
+    correct = server.accept(&rejected) == nullptr && rejected.getConnection() == nullptr;
+    ok &= expect(correct, "new connection rejected while all slots are busy");
+    for (FastSocket& socket : idle)
+      if (socket.getConnection() != nullptr)
+        server.release(socket.getConnection());
+    server.release(connection);
+  }
+  return ok;
+}
+
+/** Socket sending through the shared link, acknowledged one RTT after sending */
+class LinkSocket: public HttpSocket {
+  public:
+    size_t space() override {
+      return WINDOW - queued - unacked;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      size_t n = size < space() ? size : space();
+      received.append((const char*) data, n);
+      queued += n;
+      return n;
+    }
+
+    void close() override {
+      closed = true;
+    }
+
+    size_t queued = 0;
+    size_t unacked = 0;
+    std::deque<std::pair<uint32_t, size_t>> acks;
+    uint32_t lastDelivery = 0;
+    bool closed = false;
+    std::string received;
+};
+
+/** A connection of the browser, usable after the handshake */
+struct BrowserConnection {
+  LinkSocket socket;
+  uint32_t openAt = 0;
+  // Current request, empty if the connection is idle
+  std::string url;
+  int chain = -1;
+  uint32_t requestAt = 0;
+  bool sent = false;
+  size_t parsed = 0;
+  bool closing = false;
+};
+
+class Browser {
+  public:
+    Browser(HttpServer& server, bool keepAlive): server(server), keepAlive(keepAlive) {}
+
+    struct Load {
+      uint32_t millis;
+      int requests;
+      int connections;
+      size_t bytes;
+    };
+
+    // Loads chains of requests in parallel, the requests of a chain one after another
+    Load load(const std::vector<std::vector<std::string>>& chains) {
+      Load result = { 0, 0, 0, 0 };
+      uint32_t start = now;
+      std::vector<size_t> next(chains.size(), 0);
+      std::vector<bool> waiting(chains.size(), false);
+      size_t done = 0;
+      size_t bytes = received();
+      while (done < chains.size()) {
+        for (size_t chain = 0; chain < chains.size(); chain++) {
+          if (waiting[chain] || next[chain] == chains[chain].size())
+            continue;
+          BrowserConnection* connection = idleConnection();
+          if (connection == nullptr) {
+            if (connections.size() == MAX_BROWSER_CONNECTIONS)
+              break;
+            connections.emplace_back();
+            connection = &connections.back();
+            connection->openAt = now + RTT_MILLIS;
+            result.connections++;
+          }
+          connection->url = chains[chain][next[chain]++];
+          connection->chain = chain;
+          connection->sent = false;
+          connection->requestAt = (connection->openAt > now ? connection->openAt : now) + RTT_MILLIS / 2;
+          waiting[chain] = true;
+          result.requests++;
+        }
+        now++;
+        for (BrowserConnection& connection : connections) {
+          if (connection.url.empty() || connection.sent || now < connection.requestAt)
+            continue;
+          if (connection.socket.getConnection() == nullptr && !server.accept(&connection.socket)) {
+            fprintf(stderr, "Connection rejected\n");
+            exit(1);
+          }
+          std::string request = "GET " + connection.url + " HTTP/1.1\r\nHost: sensor\r\n";
+          if (!keepAlive)
+            request += "Connection: close\r\n";
+          request += "\r\n";
+          connection.socket.getConnection()->receive((const uint8_t*) request.data(), request.size());
+          connection.sent = true;
+        }
+        server.loop(now);
+        transmit();
+
+        for (auto i = connections.begin(); i != connections.end(); ) {
+          LinkSocket& socket = i->socket;
+          if (!i->url.empty() && socket.queued == 0 && socket.lastDelivery <= now) {
+            std::vector<Response> responses;
+            i->parsed = splitResponses(socket.received, i->parsed, responses);
+            if (!responses.empty()) {
+              waiting[i->chain] = false;
+              if (next[i->chain] == chains[i->chain].size())
+                done++;
+              i->url.clear();
+              i->closing = responses.back().closes();
+              end = now;
+            }
+          }
+          // Forget connections closed by the server
+          if (i->url.empty() && (i->closing || socket.closed) && socket.queued == 0 && socket.lastDelivery <= now) {
+            if (socket.getConnection() != nullptr)
+              server.release(socket.getConnection());
+            totalReceived += socket.received.size();
+            i = connections.erase(i);
+          }
+          else
+            i++;
+        }
+      }
+      result.millis = end - start;
+      result.bytes = received() - bytes;
+      return result;
+    }
+
+    void wait(uint32_t millis) {
+      for (uint32_t i = 0; i < millis; i++) {
+        server.loop(++now);
+        transmit();
+      }
+    }
+
+  private:
+    HttpServer& server;
+    const bool keepAlive;
+    std::list<BrowserConnection> connections;
+    uint32_t now = 0;
+    uint32_t end = 0;
+    size_t totalReceived = 0;
+
+    size_t received() const {
+      size_t bytes = totalReceived;
+      for (const BrowserConnection& connection : connections)
+        bytes += connection.socket.received.size();
+      return bytes;
+    }
+
+    BrowserConnection* idleConnection() {
+      for (BrowserConnection& connection : connections)
+        if (connection.url.empty() && !connection.closing && !connection.socket.closed)
+          return &connection;
+      return nullptr;
+    }
+
+    // Sends the queued bytes of all sockets over the link, sharing its bandwidth
+    void transmit() {
+      for (BrowserConnection& connection : connections) {
+        LinkSocket& socket = connection.socket;
+        while (!socket.acks.empty() && socket.acks.front().first <= now) {
+          socket.unacked -= socket.acks.front().second;
+          socket.acks.pop_front();
+        }
+      }
+      size_t budget = BYTES_PER_MILLI;
+      bool progress = true;
+      while (budget > 0 && progress) {
+        progress = false;
+        for (BrowserConnection& connection : connections) {
+          LinkSocket& socket = connection.socket;
+          if (socket.queued == 0 || budget == 0)
+            continue;
+          size_t n = socket.queued < 100 ? socket.queued : 100;
+          if (n > budget)
+            n = budget;
+          socket.queued -= n;
+          socket.unacked += n;
+          socket.acks.emplace_back(now + RTT_MILLIS, n);
+          socket.lastDelivery = now + RTT_MILLIS / 2;
+          budget -= n;
+          progress = true;
+        }
+      }
+    }
+};
+
+static std::string readFile(const std::string& name) {
+  std::string content;
+  FILE* file = fopen(name.c_str(), "rb");
+  if (file == nullptr)
+    return content;
+  char buffer[4096];
+  for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0; )
+    content.append(buffer, n);
+  fclose(file);
+  return content;
+}
+
+static void serveFiles(HttpServer& server, const std::map<std::string, std::string>& files) {
+  server.onNotFound([&files](HttpRequest& request, HttpResponse& response) {
+    auto file = files.find(request.getPath());
+    if (file == files.end())
+      return;
+    response.begin(200, "application/octet-stream", file->second.size());
+    response.setBody<HttpMemoryBody>((const uint8_t*) file->second.data(), file->second.size());
+  });
+}
+
+static void measureLoads(const std::string& dataDir) {
+  std::map<std::string, std::string> files;
+  files["/graphs.html"] = readFile(dataDir + "/ui/graphs.html");
+  files["/ui/main.js"] = readFile(dataDir + "/ui/main.js");
+  const char* const logs[] = { "env", "pm" };
+  for (const char* log : logs) {
+    // A day of records with every channel changing, about the size of the real logs
+    files[std::string("/log/") + log + "/2026-10-16"] = std::string(6000, 'x');
+    files[std::string("/log/") + log + "/2026-10-17"] = std::string(4000, 'x');
+    files[std::string("/log/") + log + "/schema.json"] = std::string(180, 'x');
+  }
+  auto day = [&logs](const char* date) {
+    std::vector<std::vector<std::string>> chains;
+    for (const char* log : logs)
+      chains.push_back({ std::string("/log/") + log + "/" + date, std::string("/log/") + log + "/schema.json" });
+    return chains;
+  };
+
+  printf("graphs page over a link of %u ms RTT and %zu kB/s\n", RTT_MILLIS, BYTES_PER_MILLI);
+  for (bool keepAlive : { false, true }) {
+    HttpServer server;
+    serveFiles(server, files);
+    Browser browser(server, keepAlive);
+    Browser::Load page = browser.load({ { "/graphs.html" } });
+    Browser::Load script = browser.load({ { "/ui/main.js" } });
+    Browser::Load charts = browser.load(day("2026-10-17"));
+    browser.wait(2000);
+    Browser::Load previous = browser.load(day("2026-10-16"));
+    printf("  %-10s load: %2d requests on %d new connections, %4u ms; previous day: %d requests on %d new connections, %4u ms\n",
+      keepAlive ? "keep-alive" : "close",
+      page.requests + script.requests + charts.requests, page.connections + script.connections + charts.connections,
+      page.millis + script.millis + charts.millis, previous.requests, previous.connections, previous.millis);
+  }
+}
+
+// Host time of the server per request, without the TCP stack of the device
+static double measureCpu(bool keepAlive, int requests) {
+  HttpServer server;
+  serveChecks(server, std::string());
+  std::string request = get("/a", keepAlive ? "" : "Connection: close\r\n");
+  uint32_t now = 0;
+  FastSocket* socket = nullptr;
+  HttpConnection* connection = nullptr;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < requests; i++) {
+    if (socket == nullptr || socket->closed) {
+      if (connection != nullptr)
+        server.release(connection);
+      delete socket;
+      socket = new FastSocket();
+      connection = server.accept(socket);
+    }
+    send(connection, request);
+    server.loop(++now);
+    socket->received.clear();
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  server.release(connection);
+  delete socket;
+  return std::chrono::duration<double, std::micro>(t1 - t0).count() / requests;
+}
+
+int main(int argc, char** argv) {
+  const char* dataDir = argc > 1 ? argv[1] : "../../data";
+  const int requests = argc > 2 ? atoi(argv[2]) : 1000000;
+  std::string big;
+  while (big.size() < BIG_SIZE)
+    big += BIG_PATTERN;
+  big.resize(BIG_SIZE);
+
+  bool ok = check(big);
+  measureLoads(dataDir);
+  printf("server time on the host: close %.2f us/request, keep-alive %.2f us/request\n",
+    measureCpu(false, requests), measureCpu(true, requests));
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
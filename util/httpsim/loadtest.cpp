@@ -0,0 +1,305 @@
+/**
+ * Load test of the HTTP server core with slow clients.
+ *
+ * Runs the real HttpServer code against simulated sockets with a small send
+ * window, like the one of lwIP on the ESP8266. Clients arrive at random and
+ * differ in how fast they send their requests and acknowledge the response:
+ * some read at full speed, some trickle, some stop sending their request
+ * halfway or stop reading the response, and must be timed out.
+ * Time advances by 1 ms per loop().
+ *
+ * Every complete response is parsed and its body compared with the expected
+ * one, including bodies sent in chunks. The test reports how much work a single
+ * loop() or receive() call did, which bounds how long it blocks the main loop.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <list>
+#include <random>
+#include <string>
+
+#include "HttpServer.h"
+
+
+static uint8_t byteAt(size_t i) {
+  return (uint8_t) (i * 31 + i / 7);
+}
+
+static std::string expectedBody(size_t size) {
+  std::string body(size, '\0');
+  for (size_t i = 0; i < size; i++)
+    body[i] = (char) byteAt(i);
+  return body;
+}
+
+/** Generated body of unknown length, which is sometimes not ready yet */
+class GeneratedBody: public HttpBody {
+  public:
+    GeneratedBody(size_t size): size(size), pos(0), calls(0) {}
+
+    size_t read(uint8_t* buffer, size_t max) override {
+      if (pos == size)
+        return END;
+      if (++calls % 3 == 0)
+        return 0;
+      size_t n = size - pos < max ? size - pos : max;
+      // Produce less than asked for sometimes
+      if (calls % 5 == 0 && n > 100)
+        n = 100;
+      for (size_t i = 0; i < n; i++)
+        buffer[i] = byteAt(pos + i);
+      pos += n;
+      return n;
+    }
+
+  private:
+    const size_t size;
+    size_t pos;
+    uint32_t calls;
+};
+
+/** Socket with a send window emptied as the client acknowledges data */
+class SimulatedSocket: public HttpSocket {
+  public:
+    SimulatedSocket(size_t window): window(window) {}
+
+    size_t space() override {
+      return window - inFlight;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      size_t n = size < space() ? size : space();
+      received.append((const char*) data, n);
+      inFlight += n;
+      written += n;
+      return n;
+    }
+
+    void close() override {
+      closed = true;
+    }
+
+    void ack(size_t n) {
+      inFlight -= n < inFlight ? n : inFlight;
+    }
+
+    const size_t window;
+    size_t inFlight = 0;
+    size_t written = 0;
+    bool closed = false;
+    std::string received;
+};
+
+enum class Behavior { FAST, SLOW, STALLED_REQUEST, STALLED_READ };
+
+struct Client {
+  Client(size_t window): socket(window) {}
+
+  SimulatedSocket socket;
+  HttpConnection* connection = nullptr;
+  Behavior behavior;
+  std::string request;
+  size_t requestPos = 0;
+  size_t requestBytesPerTick;
+  size_t ackBytesPerTick;
+  bool head = false;
+  int expectedStatus;
+  std::string expected;
+};
+
+struct Response {
+  int status = 0;
+  bool chunked = false;
+  long contentLength = -1;
+  std::string body;
+  bool valid = false;
+};
+
+static Response parse(const std::string& data, bool head) {
+  Response response;
+  size_t headerEnd = data.find("\r\n\r\n");
+  if (headerEnd == std::string::npos || sscanf(data.c_str(), "HTTP/1.1 %d", &response.status) != 1)
+    return response;
+  std::string headers = data.substr(0, headerEnd + 2);
+  response.chunked = headers.find("\r\nTransfer-Encoding: chunked\r\n") != std::string::npos;
+  size_t lengthPos = headers.find("\r\nContent-Length: ");
+  if (lengthPos != std::string::npos)
+    response.contentLength = atol(headers.c_str() + lengthPos + 18);
+  std::string body = data.substr(headerEnd + 4);
+  if (head) {
+    response.valid = body.empty();
+    return response;
+  }
+  if (!response.chunked) {
+    response.body = body;
+    response.valid = response.contentLength == (long) body.size();
+    return response;
+  }
+  size_t pos = 0;
+  while (true) {
+    size_t lineEnd = body.find("\r\n", pos);
+    if (lineEnd == std::string::npos)
+      return response;
+    size_t size = strtoul(body.c_str() + pos, nullptr, 16);
+    pos = lineEnd + 2;
+    if (size == 0) {
+      response.valid = body.compare(pos, std::string::npos, "\r\n") == 0;
+      return response;
+    }
+    if (pos + size + 2 > body.size() || body.compare(pos + size, 2, "\r\n") != 0)
+      return response;
+    response.body.append(body, pos, size);
+    pos += size + 2;
+  }
+}
+
+int main(int argc, char** argv) {
+  const int requests = argc > 1 ? atoi(argv[1]) : 2000;
+  // The ESP8266 core sends at most 2 segments of 1460 B without an ack
+  const size_t window = argc > 2 ? atoi(argv[2]) : 2920;
+  const size_t bigSize = 64 * 1024;
+  const size_t chunkedSize = 20000;
+  const std::string big = expectedBody(bigSize);
+
+  HttpServer server;
+  server.on("/small", [](HttpRequest& request, HttpResponse& response) {
+    response.send(200, "text/plain", "small\n");
+  });
+  server.on("/big", [&big](HttpRequest& request, HttpResponse& response) {
+    response.begin(200, "application/octet-stream", big.size());
+    response.setBody<HttpMemoryBody>((const uint8_t*) big.data(), big.size());
+  });
+  server.on("/chunked", [chunkedSize](HttpRequest& request, HttpResponse& response) {
+    response.begin(200, "application/octet-stream", HttpResponse::CHUNKED);
+    response.setBody<GeneratedBody>(request.getArg("size", (long) chunkedSize));
+  });
+
+  std::mt19937 random(1);
+  std::list<Client> clients;
+  int started = 0, rejected = 0, completed = 0, failed = 0, timedOut = 0;
+  uint64_t bodyBytes = 0;
+  size_t maxLoopBytes = 0;
+  double maxLoopMicros = 0, maxReceiveMicros = 0, totalLoopMicros = 0;
+  uint32_t now = 0;
+
+  while (started < requests || !clients.empty()) {
+    now++;
+    // A new client every 100 ms on average
+    if (started < requests && random() % 100 == 0) {
+      started++;
+      clients.emplace_back(window);
+      Client& client = clients.back();
+      client.connection = server.accept(&client.socket);
+      if (client.connection == nullptr) {
+        rejected++;
+        clients.pop_back();
+      }
+      else {
+        uint32_t kind = random() % 50;
+        client.behavior = kind < 25 ? Behavior::FAST : kind < 48 ? Behavior::SLOW :
+          kind == 48 ? Behavior::STALLED_REQUEST : Behavior::STALLED_READ;
+        client.requestBytesPerTick = client.behavior == Behavior::FAST ? 1000 : 3;
+        client.ackBytesPerTick = client.behavior == Behavior::FAST ? window :
+          client.behavior == Behavior::SLOW ? 20 + random() % 200 : 0;
+        uint32_t target = random() % 6;
+        const char* method = target == 5 ? "HEAD" : "GET";
+        std::string path;
+        switch (target) {
+          case 0: path = "/small"; client.expectedStatus = 200; client.expected = "small\n"; break;
+          case 1: case 5: path = "/big"; client.expectedStatus = 200; client.expected = big; break;
+          case 2: path = "/chunked"; client.expectedStatus = 200; client.expected = expectedBody(chunkedSize); break;
+          case 3: {
+            size_t size = random() % 3000;
+            path = "/chunked?x=1&size=" + std::to_string(size);
+            client.expectedStatus = 200;
+            client.expected = expectedBody(size);
+            break;
+          }
+          default: path = "/missing%20file"; client.expectedStatus = 404; client.expected = "Not Found"; break;
+        }
+        client.head = target == 5;
+        client.request = std::string(method) + " " + path + " HTTP/1.1\r\nHost: sensor\r\nAccept: */*\r\nConnection: close\r\n\r\n";
+        if (client.behavior == Behavior::STALLED_REQUEST)
+          client.request.resize(client.request.size() / 2);
+      }
+    }
+
+    // Deliver request bytes and acks from the TCP callbacks
+    for (Client& client : clients) {
+      if (client.requestPos < client.request.size()) {
+        size_t n = client.request.size() - client.requestPos;
+        if (n > client.requestBytesPerTick)
+          n = client.requestBytesPerTick;
+        auto t0 = std::chrono::steady_clock::now();
+        client.connection->receive((const uint8_t*) client.request.data() + client.requestPos, n);
+        auto t1 = std::chrono::steady_clock::now();
+        double micros = std::chrono::duration<double, std::micro>(t1 - t0).count();
+        if (micros > maxReceiveMicros)
+          maxReceiveMicros = micros;
+        client.requestPos += n;
+      }
+      client.socket.ack(client.ackBytesPerTick);
+    }
+
+    size_t written = 0;
+    for (Client& client : clients)
+      written -= client.socket.written;
+    auto t0 = std::chrono::steady_clock::now();
+    server.loop(now);
+    auto t1 = std::chrono::steady_clock::now();
+    for (Client& client : clients)
+      written += client.socket.written;
+    double micros = std::chrono::duration<double, std::micro>(t1 - t0).count();
+    totalLoopMicros += micros;
+    if (micros > maxLoopMicros)
+      maxLoopMicros = micros;
+    if (written > maxLoopBytes)
+      maxLoopBytes = written;
+
+    // Connections closed by the server disconnect once their data is acknowledged
+    for (auto i = clients.begin(); i != clients.end(); ) {
+      Client& client = *i;
+      if (!client.socket.closed || (client.socket.inFlight > 0 && client.ackBytesPerTick > 0)) {
+        i++;
+        continue;
+      }
+      if (client.behavior == Behavior::STALLED_REQUEST || client.behavior == Behavior::STALLED_READ) {
+        bool silent = client.behavior == Behavior::STALLED_REQUEST ? client.socket.received.empty() : true;
+        if (silent)
+          timedOut++;
+        else
+          failed++;
+      }
+      else {
+        Response response = parse(client.socket.received, client.head);
+        bool ok = response.valid && response.status == client.expectedStatus &&
+          (client.head ? response.contentLength == (long) client.expected.size() : response.body == client.expected);
+        if (ok) {
+          completed++;
+          bodyBytes += response.body.size();
+        }
+        else {
+          failed++;
+          fprintf(stderr, "Invalid response to %s", client.request.c_str());
+        }
+      }
+      server.release(client.connection);
+      i = clients.erase(i);
+    }
+  }
+
+  printf("%d requests, %zu B send window, %lu simulated seconds\n", requests, window, (unsigned long) now / 1000);
+  printf("%d rejected (all %u connections busy), %d timed out, %d completed, %d failed\n",
+    rejected, HttpServer::MAX_CONNECTIONS, timedOut, completed, failed);
+  printf("%.1f MB of verified response bodies\n", bodyBytes / 1e6);
+  printf("loop(): at most %zu B written per call (%zu B buffer per connection), %.1f us max, %.2f us mean\n",
+    maxLoopBytes, HttpResponse::BUFFER_SIZE, maxLoopMicros, totalLoopMicros / now);
+  printf("receive(): %.1f us max\n", maxReceiveMicros);
+  bool ok = failed == 0 && completed > 0 && server.getActiveConnections() == 0 &&
+    maxLoopBytes <= HttpServer::MAX_CONNECTIONS * HttpResponse::BUFFER_SIZE;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
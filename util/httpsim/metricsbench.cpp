@@ -0,0 +1,278 @@
+/**
+ * Benchmarks the /sensor and /metrics responses.
+ *
+ * /sensor is rendered by JsonWriter into a stack buffer and compared with the
+ * previous approach of concatenating strings. /metrics is written by
+ * HttpMetricsBody from a source with the same families as the firmware,
+ * and every line must be valid in the Prometheus text format.
+ * Both are served by HttpServer to a client reading as fast as possible.
+ * Heap use is measured by counting the allocations of operator new.
+ */
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <new>
+#include <string>
+
+#include "HttpMetrics.h"
+#include "HttpServer.h"
+#include "JsonWriter.h"
+
+
+static size_t allocations = 0;
+static size_t heapUsed = 0;
+
+void* operator new(size_t size) {
+  void* p = malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  allocations++;
+  heapUsed += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  if (p == nullptr)
+    return;
+  heapUsed -= malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  operator delete(p);
+}
+
+static const char* const LOGS[] = { "/log/env/", "/log/th/", "/log/pm/" };
+static const uint8_t LOG_COUNT = sizeof(LOGS) / sizeof(LOGS[0]);
+
+/** Fixed values in the families written by WebServer */
+class FixedMetrics: public HttpMetricsSource {
+  public:
+    bool writeMetrics(uint8_t index, MetricsWriter& out) override {
+      switch (index) {
+        case 0:
+          out.describe("air_temperature_celsius", "gauge", "Air temperature");
+          out.sample("air_temperature_celsius", 21.5, 2);
+          return true;
+        case 1:
+          out.describe("air_humidity_percent", "gauge", "Relative humidity");
+          out.sample("air_humidity_percent", NAN, 2);
+          return true;
+        case 2:
+          out.describe("air_pm_micrograms_per_cubic_meter", "gauge", "Concentration of particulate matter by size");
+          out.sample("air_pm_micrograms_per_cubic_meter", (uint32_t) 12, "size", "10");
+          out.sample("air_pm_micrograms_per_cubic_meter", (uint32_t) 8, "size", "2.5");
+          out.sample("air_pm_micrograms_per_cubic_meter", (uint32_t) 5, "size", "1");
+          return true;
+        case 3:
+          out.describe("air_pm_sensor_ready", "gauge", "1 if the PM sensor has settled after waking up");
+          out.sample("air_pm_sensor_ready", (uint32_t) 1);
+          return true;
+        case 4: case 5: case 6: case 7: {
+          static const char* const NAMES[] = { 
+            "air_log_records_written_total", "air_log_bytes_written_total", 
+            "air_log_write_errors_total", "air_log_pending_records" };
+          const char* name = NAMES[index - 4];
+          out.describe(name, index < 7 ? "counter" : "gauge", "Log counter");
+          for (uint8_t i = 0; i < LOG_COUNT; i++)
+            out.sample(name, (uint32_t) 4000000000u - i, "log", LOGS[i]);
+          return true;
+        }
+        case 8:
+          out.describe("air_heap_free_bytes", "gauge", "Free heap memory");
+          out.sample("air_heap_free_bytes", (uint32_t) 24512);
+          out.describe("air_heap_max_free_block_bytes", "gauge", "Largest block of heap memory that can be allocated");
+          out.sample("air_heap_max_free_block_bytes", (uint32_t) 16384);
+          return true;
+        case 9:
+          out.describe("air_heap_fragmentation_percent", "gauge", "Fragmentation of free heap memory");
+          out.sample("air_heap_fragmentation_percent", (uint32_t) 17);
+          return true;
+        case 10:
+          out.describe("air_loop_duration_seconds", "summary", "Duration of iterations of the main loop");
+          out.sample("air_loop_duration_seconds_sum", 123456789 / 1e6, 6);
+          out.sample("air_loop_duration_seconds_count", (uint32_t) 98765432);
+          return true;
+        case 11:
+          out.describe("air_loop_duration_max_seconds", "gauge", "Longest iteration of the main loop since the previous scrape");
+          out.sample("air_loop_duration_max_seconds", 0.042, 6);
+          return true;
+        case 12:
+          out.describe("air_wifi_rssi_dbm", "gauge", "Signal strength of the Wi-Fi network");
+          out.sample("air_wifi_rssi_dbm", (int32_t) -67);
+          return true;
+        case 13:
+          out.describe("air_http_requests_total", "counter", "HTTP requests handled since boot");
+          out.sample("air_http_requests_total", (uint32_t) 1234567);
+          out.describe("air_http_rejected_total", "counter", "HTTP connections rejected because all slots were busy");
+          out.sample("air_http_rejected_total", (uint32_t) 3);
+          return true;
+        case 14:
+          out.describe("air_uptime_seconds", "gauge", "Time since boot");
+          out.sample("air_uptime_seconds", (uint32_t) 864000);
+          return true;
+        default:
+          return false;
+      }
+    }
+};
+
+/** Socket of a client reading as fast as possible */
+class FastSocket: public HttpSocket {
+  public:
+    size_t space() override {
+      return 2920;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      if (keep)
+        received.append((const char*) data, size);
+      bytes += size;
+      return size;
+    }
+
+    void close() override {
+      closed = true;
+    }
+
+    bool keep = false;
+    bool closed = false;
+    size_t bytes = 0;
+    std::string received;
+};
+
+static std::string decodeChunked(const std::string& response) {
+  size_t pos = response.find("\r\n\r\n") + 4;
+  std::string body;
+  while (true) {
+    size_t size = strtoul(response.c_str() + pos, nullptr, 16);
+    pos = response.find("\r\n", pos) + 2;
+    if (size == 0)
+      return body;
+    body.append(response, pos, size);
+    pos += size + 2;
+  }
+}
+
+// Serves one request and returns the number of bytes sent
+static size_t serve(HttpServer& server, const char* path, FastSocket& socket, uint32_t& now) {
+  char request[64];
+  int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: sensor\r\nConnection: close\r\n\r\n", path);
+  HttpConnection* connection = server.accept(&socket);
+  connection->receive((const uint8_t*) request, length);
+  while (!socket.closed)
+    server.loop(++now);
+  server.release(connection);
+  return socket.bytes;
+}
+
+// Checks the lines of the text format, returns the number of samples or -1
+static int countSamples(const std::string& text) {
+  int samples = 0;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    if (end == std::string::npos)
+      return -1;
+    std::string line = text.substr(pos, end - pos);
+    pos = end + 1;
+    if (line.compare(0, 7, "# HELP ") == 0 || line.compare(0, 7, "# TYPE ") == 0)
+      continue;
+    size_t space = line.rfind(' ');
+    if (space == std::string::npos || line.find('{') != line.rfind('{'))
+      return -1;
+    std::string value = line.substr(space + 1);
+    char* valueEnd;
+    strtod(value.c_str(), &valueEnd);
+    if (value.empty() || *valueEnd != '\0')
+      return -1;
+    samples++;
+  }
+  return samples;
+}
+
+int main(int argc, char** argv) {
+  const int requests = argc > 1 ? atoi(argv[1]) : 100000;
+  const float temperature = 21.5f, humidity = 45.25f;
+  const uint16_t pm10 = 12, pm2_5 = 8, pm1 = 5;
+  const bool ready = true;
+
+  FixedMetrics metrics;
+  HttpServer* server = new HttpServer();
+  server->on("/sensor", [&](HttpRequest& request, HttpResponse& response) {
+    char json[160];
+    JsonWriter writer(json, sizeof(json));
+    writer.beginObject();
+    writer.add("temperature", temperature, 2);
+    writer.add("humidity", humidity, 2);
+    writer.add("pm10", (uint32_t) pm10);
+    writer.add("pm2_5", (uint32_t) pm2_5);
+    writer.add("pm1", (uint32_t) pm1);
+    writer.add("pmready", (int32_t) ready);
+    writer.endObject();
+    response.send(200, "application/json", json);
+  });
+  server->on("/concat", [&](HttpRequest& request, HttpResponse& response) {
+    char number[16];
+    snprintf(number, sizeof(number), "%.2f", temperature);
+    std::string json = std::string("{\"temperature\":") + number;
+    snprintf(number, sizeof(number), "%.2f", humidity);
+    json = json + ",\"humidity\":" + number + 
+      ",\"pm10\":" + std::to_string(pm10) + 
+      ",\"pm2_5\":" + std::to_string(pm2_5) + 
+      ",\"pm1\":" + std::to_string(pm1) + 
+      ",\"pmready\":" + std::to_string(ready) + "}";
+    response.send(200, "application/json", json.c_str());
+  });
+  server->on("/metrics", [&metrics](HttpRequest& request, HttpResponse& response) {
+    response.begin(200, HttpMetricsBody::CONTENT_TYPE, HttpResponse::CHUNKED);
+    response.setBody<HttpMetricsBody>(metrics);
+  });
+  uint32_t now = 0;
+
+  FastSocket sensorCheck;
+  sensorCheck.keep = true;
+  serve(*server, "/sensor", sensorCheck, now);
+  FastSocket concatCheck;
+  concatCheck.keep = true;
+  serve(*server, "/concat", concatCheck, now);
+  std::string sensorBody = sensorCheck.received.substr(sensorCheck.received.find("\r\n\r\n") + 4);
+  bool same = sensorBody == concatCheck.received.substr(concatCheck.received.find("\r\n\r\n") + 4);
+
+  FastSocket metricsCheck;
+  metricsCheck.keep = true;
+  serve(*server, "/metrics", metricsCheck, now);
+  std::string exposition = decodeChunked(metricsCheck.received);
+  int samples = countSamples(exposition);
+
+  const char* paths[] = { "/sensor", "/concat", "/metrics" };
+  size_t counts[3];
+  double seconds[3];
+  size_t bytes[3];
+  for (int p = 0; p < 3; p++) {
+    size_t before = allocations;
+    bytes[p] = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; i++) {
+      FastSocket socket;
+      bytes[p] += serve(*server, paths[p], socket, now);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    seconds[p] = std::chrono::duration<double>(t1 - t0).count();
+    counts[p] = allocations - before;
+  }
+
+  printf("/sensor: %s, %s\n", sensorBody.c_str(), same ? "same as concatenated" : "DIFFERENT");
+  printf("/metrics: %zu B in %d samples, %s\n", exposition.size(), samples, samples > 0 ? "valid" : "INVALID");
+  for (int p = 0; p < 3; p++)
+    printf("%-8s %8.0f requests/s, %5.2f us/request, %.2f allocations/request, %zu B per response\n",
+      paths[p], requests / seconds[p], seconds[p] * 1e6 / requests, (double) counts[p] / requests, bytes[p] / requests);
+  delete server;
+  bool ok = same && samples > 0 && counts[0] == 0 && counts[2] == 0;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,348 @@
+/**
+ * Measures page loads of the UI before and after compression and caching.
+ *
+ * Serves the files of a data directory with the real HttpServer over a
+ * simulated Wi-Fi link with limited bandwidth and a round-trip time.
+ * A browser loads a page, parses it for local references, loads them over
+ * up to 4 new connections and keeps a cache of the responses. Every page is
+ * loaded twice: a first visit with an empty cache and a repeat visit.
+ *
+ * The "before" server sends the plain files of the data directory without any
+ * caching headers, like the firmware used to. The "after" server sends the files
+ * prepared by util/compress_ui.py with the rules of HttpCache, like WebServer.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "HttpCache.h"
+#include "HttpServer.h"
+
+
+static const uint32_t RTT_MILLIS = 30;
+static const size_t BYTES_PER_MILLI = 100;
+static const size_t WINDOW = 2920;
+static const size_t MAX_BROWSER_CONNECTIONS = 4;
+
+static std::map<std::string, std::string> readDirectory(const std::string& dirName) {
+  std::map<std::string, std::string> files;
+  DIR* dir = opendir(dirName.c_str());
+  if (dir == nullptr)
+    return files;
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.')
+      continue;
+    FILE* file = fopen((dirName + "/" + entry->d_name).c_str(), "rb");
+    if (file == nullptr)
+      continue;
+    std::string content;
+    char buffer[4096];
+    for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0; )
+      content.append(buffer, n);
+    fclose(file);
+    files[std::string("/ui/") + entry->d_name] = content;
+  }
+  closedir(dir);
+  return files;
+}
+
+static std::string gunzip(const std::string& data) {
+  z_stream stream = {};
+  std::string result;
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+    return result;
+  stream.next_in = (Bytef*) data.data();
+  stream.avail_in = data.size();
+  char buffer[4096];
+  int status;
+  do {
+    stream.next_out = (Bytef*) buffer;
+    stream.avail_out = sizeof(buffer);
+    status = inflate(&stream, Z_NO_FLUSH);
+    result.append(buffer, sizeof(buffer) - stream.avail_out);
+  } while (status == Z_OK);
+  inflateEnd(&stream);
+  return result;
+}
+
+/** Socket sending through the shared link, acknowledged one RTT after sending */
+class LinkSocket: public HttpSocket {
+  public:
+    size_t space() override {
+      return WINDOW - queued - unacked;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      size_t n = size < space() ? size : space();
+      received.append((const char*) data, n);
+      queued += n;
+      return n;
+    }
+
+    void close() override {
+      closed = true;
+    }
+
+    size_t queued = 0;
+    size_t unacked = 0;
+    std::deque<std::pair<uint32_t, size_t>> acks;
+    uint32_t lastDelivery = 0;
+    bool closed = false;
+    std::string received;
+};
+
+struct Fetch {
+  std::string url;
+  uint32_t requestAt;
+  LinkSocket socket;
+  HttpConnection* connection = nullptr;
+  bool sent = false;
+};
+
+struct CacheEntry {
+  std::string etag;
+  bool immutable;
+};
+
+struct Response {
+  int status = 0;
+  std::string headers;
+  std::string body;
+
+  std::string header(const char* name) const {
+    size_t pos = headers.find(std::string("\r\n") + name + ": ");
+    if (pos == std::string::npos)
+      return "";
+    pos += strlen(name) + 4;
+    return headers.substr(pos, headers.find("\r\n", pos) - pos);
+  }
+};
+
+static Response parse(const std::string& data) {
+  Response response;
+  size_t end = data.find("\r\n\r\n");
+  sscanf(data.c_str(), "HTTP/1.1 %d", &response.status);
+  response.headers = data.substr(0, end + 2);
+  response.body = data.substr(end + 4);
+  if (response.header("Content-Encoding") == "gzip")
+    response.body = gunzip(response.body);
+  return response;
+}
+
+// Local references of a page, resolved against the root
+static std::vector<std::string> findReferences(const std::string& page) {
+  std::vector<std::string> references;
+  for (const char* attribute : { "src=\"", "href=\"" }) {
+    for (size_t pos = page.find(attribute); pos != std::string::npos; pos = page.find(attribute, pos + 1)) {
+      size_t start = pos + strlen(attribute);
+      std::string reference = page.substr(start, page.find('"', start) - start);
+      if (reference.find(':') != std::string::npos)
+        continue;
+      references.push_back("/" + reference);
+    }
+  }
+  return references;
+}
+
+class Browser {
+  public:
+    Browser(HttpServer& server): server(server) {}
+
+    struct Visit {
+      uint32_t millis;
+      int requests;
+      int notModified;
+      size_t bytes;
+    };
+
+    Visit load(const std::string& url) {
+      Visit visit = { 0, 0, 0, 0 };
+      uint32_t start = now;
+      std::deque<std::string> pending = { url };
+      std::list<Fetch> active;
+      std::map<std::string, bool> seen;
+      uint32_t end = start;
+      while (!pending.empty() || !active.empty()) {
+        // Open new connections, the request arrives after the handshake and half an RTT
+        while (!pending.empty() && active.size() < MAX_BROWSER_CONNECTIONS) {
+          std::string next = pending.front();
+          pending.pop_front();
+          auto cached = cache.find(next);
+          if (cached != cache.end() && cached->second.immutable)
+            continue;
+          active.emplace_back();
+          active.back().url = next;
+          active.back().requestAt = now + RTT_MILLIS + RTT_MILLIS / 2;
+          visit.requests++;
+        }
+        now++;
+        for (Fetch& fetch : active) {
+          if (!fetch.sent && now >= fetch.requestAt) {
+            fetch.connection = server.accept(&fetch.socket);
+            std::string request = "GET " + fetch.url + " HTTP/1.1\r\nHost: sensor\r\nConnection: close\r\n";
+            auto cached = cache.find(fetch.url);
+            if (cached != cache.end() && !cached->second.etag.empty())
+              request += "If-None-Match: " + cached->second.etag + "\r\n";
+            request += "\r\n";
+            fetch.connection->receive((const uint8_t*) request.data(), request.size());
+            fetch.sent = true;
+          }
+        }
+        server.loop(now);
+        transmit(active);
+
+        for (auto i = active.begin(); i != active.end(); ) {
+          LinkSocket& socket = i->socket;
+          if (!socket.closed || socket.queued > 0 || socket.lastDelivery > now) {
+            i++;
+            continue;
+          }
+          Response response = parse(socket.received);
+          visit.bytes += socket.received.size();
+          visit.notModified += response.status == 304;
+          if (response.status == 200 && !response.header("ETag").empty())
+            cache[i->url] = { response.header("ETag"), response.header("Cache-Control").find("immutable") != std::string::npos };
+          if (response.status == 200 && response.header("Content-Type") == "text/html") {
+            for (const std::string& reference : findReferences(response.body)) {
+              if (!seen[reference])
+                pending.push_back(reference);
+              seen[reference] = true;
+            }
+          }
+          end = now;
+          server.release(i->connection);
+          i = active.erase(i);
+        }
+      }
+      visit.millis = end - start;
+      return visit;
+    }
+
+  private:
+    HttpServer& server;
+    std::map<std::string, CacheEntry> cache;
+    uint32_t now = 0;
+
+    // Sends the queued bytes of all sockets over the link, sharing its bandwidth
+    void transmit(std::list<Fetch>& active) {
+      for (Fetch& fetch : active) {
+        LinkSocket& socket = fetch.socket;
+        while (!socket.acks.empty() && socket.acks.front().first <= now) {
+          socket.unacked -= socket.acks.front().second;
+          socket.acks.pop_front();
+        }
+      }
+      size_t budget = BYTES_PER_MILLI;
+      bool progress = true;
+      while (budget > 0 && progress) {
+        progress = false;
+        for (Fetch& fetch : active) {
+          LinkSocket& socket = fetch.socket;
+          if (socket.queued == 0 || budget == 0)
+            continue;
+          size_t n = socket.queued < 100 ? socket.queued : 100;
+          if (n > budget)
+            n = budget;
+          socket.queued -= n;
+          socket.unacked += n;
+          socket.acks.emplace_back(now + RTT_MILLIS, n);
+          socket.lastDelivery = now + RTT_MILLIS / 2;
+          budget -= n;
+          progress = true;
+        }
+      }
+    }
+};
+
+/** Serves the files like the firmware did before compression and caching */
+static void serveBefore(HttpServer& server, const std::map<std::string, std::string>& files) {
+  server.on("/", [&files](HttpRequest& request, HttpResponse& response) {
+    const std::string& page = files.at("/ui/index.html");
+    response.begin(200, "text/html", page.size());
+    response.setBody<HttpMemoryBody>((const uint8_t*) page.data(), page.size());
+  });
+  server.onNotFound([&files](HttpRequest& request, HttpResponse& response) {
+    std::string path = request.getPath();
+    if (path.compare(0, 4, "/ui/") != 0)
+      path = "/ui" + path;
+    auto file = files.find(path);
+    if (file == files.end())
+      return;
+    const char* type = path.find(".html") != std::string::npos ? "text/html" : "application/octet-stream";
+    response.begin(200, type, file->second.size());
+    response.setBody<HttpMemoryBody>((const uint8_t*) file->second.data(), file->second.size());
+  });
+}
+
+/** Serves the prepared files like WebServer */
+static void serveAfter(HttpServer& server, const std::map<std::string, std::string>& files) {
+  server.collectHeader("If-None-Match");
+  server.on("/", [&files](HttpRequest& request, HttpResponse& response) {
+    const std::string& page = files.at("/ui/index.html");
+    response.begin(200, "text/html", page.size());
+    response.setBody<HttpMemoryBody>((const uint8_t*) page.data(), page.size());
+  });
+  server.onNotFound([&files](HttpRequest& request, HttpResponse& response) {
+    std::string path = request.getPath();
+    if (path.compare(0, 4, "/ui/") != 0)
+      path = "/ui" + path;
+    const char* type = path.find(".html") != std::string::npos ? "text/html" : "application/octet-stream";
+    auto compressed = files.find(path + ".gz");
+    if (compressed != files.end()) {
+      const std::string& data = compressed->second;
+      char etag[HttpCache::MAX_ETAG];
+      HttpCache::formatEtag((const uint8_t*) data.data() + data.size() - HttpCache::GZIP_TRAILER_SIZE, etag, sizeof(etag));
+      if (HttpCache::begin(request, response, type, data.size(), etag, true))
+        response.setBody<HttpMemoryBody>((const uint8_t*) data.data(), data.size());
+      return;
+    }
+    auto file = files.find(path);
+    if (file == files.end())
+      return;
+    if (HttpCache::begin(request, response, type, file->second.size(), nullptr, false))
+      response.setBody<HttpMemoryBody>((const uint8_t*) file->second.data(), file->second.size());
+  });
+}
+
+static void report(const char* name, const std::map<std::string, std::string>& files, bool after) {
+  HttpServer server;
+  if (after)
+    serveAfter(server, files);
+  else
+    serveBefore(server, files);
+  Browser browser(server);
+  printf("%s\n", name);
+  for (const char* page : { "/", "/graphs.html" }) {
+    for (const char* visit : { "first", "repeat" }) {
+      Browser::Visit result = browser.load(page);
+      printf("  %-12s %-6s visit: %5zu B in %2d requests (%d not modified), %4u ms\n",
+        page, visit, result.bytes, result.requests, result.notModified, result.millis);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <data dir> <prepared data dir>\n", argv[0]);
+    return 1;
+  }
+  std::map<std::string, std::string> before = readDirectory(std::string(argv[1]) + "/ui");
+  std::map<std::string, std::string> after = readDirectory(std::string(argv[2]) + "/ui");
+  if (before.count("/ui/index.html") == 0 || after.count("/ui/index.html") == 0) {
+    fprintf(stderr, "Missing ui/index.html\n");
+    return 1;
+  }
+  printf("Link: %zu kB/s, %u ms RTT, local files only\n", BYTES_PER_MILLI, RTT_MILLIS);
+  report("before: plain files, no caching", before, false);
+  report("after: gzip, ETag and Cache-Control", after, true);
+  return 0;
+}
@@ -0,0 +1,357 @@
+/**
+ * Measures how long iterations of the main loop take while readouts are sent
+ * to Astra, with the blocking request Publisher made before and with the
+ * steps of AstraClient.
+ *
+ * A day of the main loop runs on a simulated clock. Every iteration takes
+ * 0.5 to 2 ms for the other modules, a readout is queued every minute in the
+ * real PublishQueue and the real PublishUploader sends them in batches.
+ * Calls into the network and the flash advance the clock by what they take
+ * on the device at 80 MHz:
+ *
+ *   - a round trip to Astra takes 30 to 80 ms and Astra answers in 50 to 500 ms,
+ *   - a full TLS handshake takes two round trips and 1.1 s for the key
+ *     exchange, a resumed one a round trip and 10 ms,
+ *   - TLS encrypts or decrypts 256 bytes per millisecond,
+ *   - formatting a batch takes 0.4 ms per row, erasing a sector 40 ms.
+ *
+ * The blocking request resolves the host name, connects with a new TLS session,
+ * sends the request and waits for the response in a single iteration.
+ * AstraClient waits for the DNS answer without blocking and resumes the TLS
+ * session when Astra still knows it, for an hour, so the handshake is the only
+ * long iteration.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AstraBatch.h"
+#include "AstraClient.h"
+#include "LatencyHistogram.h"
+#include "PublishQueue.h"
+#include "PublishUploader.h"
+
+
+static const uint64_t MILLI = 1000;
+static const uint64_t SECOND = 1000 * MILLI;
+static const uint64_t MINUTE = 60 * SECOND;
+static const uint64_t HOUR = 60 * MINUTE;
+static const uint64_t DAY = 24 * HOUR;
+
+static const uint64_t KEY_EXCHANGE_MICROS = 1100 * MILLI;
+static const uint64_t RESUMED_HANDSHAKE_MICROS = 10 * MILLI;
+static const uint64_t SESSION_LIFETIME_MICROS = HOUR;
+static const uint64_t TLS_BYTES_PER_MILLI = 256;
+static const uint64_t ROW_FORMAT_MICROS = 400;
+static const uint64_t ERASE_MICROS = 40 * MILLI;
+static const uint32_t LOOP_BUDGET_MICROS = 20 * MILLI;
+
+static const char* const HOST = "0b0a4a8e-3c2f-4d4e-9f0a-6b1e2c3d4e5f-europe-west1.apps.astra.datastax.com";
+static const char* const TOKEN =
+  "AstraCS:ZmFrZXRva2VuZmFrZXRva2Vu:0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+static const char* const RESPONSE =
+  "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 32\r\nConnection: close\r\n\r\n"
+  "{\"data\":{\"r0\":{\"applied\":true}}}";
+
+static std::mt19937 rng;
+static uint64_t now = 0;
+
+static uint64_t between(uint64_t min, uint64_t max) {
+  return min + rng() % (max - min + 1);
+}
+
+static uint64_t roundTrip() {
+  return between(30 * MILLI, 80 * MILLI);
+}
+
+static uint64_t tlsMicros(size_t bytes) {
+  return bytes * MILLI / TLS_BYTES_PER_MILLI;
+}
+
+/** Flash in RAM, erasing takes as long as on the device */
+class SimulatedFlash: public LogRingMedium {
+  public:
+    SimulatedFlash(uint32_t sectors):
+        sectors(sectors),
+        data(sectors * PublishQueue::SECTOR_SIZE, 0xFF) {
+    }
+
+    bool begin() override { return true; }
+    uint32_t getSectorCount() const override { return sectors; }
+
+    bool read(uint32_t offset, uint8_t* buffer, size_t size) override {
+      memcpy(buffer, data.data() + offset, size);
+      return true;
+    }
+
+    bool write(uint32_t offset, const uint8_t* buffer, size_t size) override {
+      for (size_t i = 0; i < size; i++)
+        data[offset + i] &= buffer[i];
+      now += 100;
+      return true;
+    }
+
+    bool erase(uint32_t sector) override {
+      memset(data.data() + sector * PublishQueue::SECTOR_SIZE, 0xFF, PublishQueue::SECTOR_SIZE);
+      now += ERASE_MICROS;
+      return true;
+    }
+
+  private:
+    uint32_t sectors;
+    std::vector<uint8_t> data;
+};
+
+/** TLS connection to Astra in the steps of AstraTransport */
+class SimulatedTransport: public AstraSocket {
+  public:
+    bool connect(const char* host, uint16_t port) override {
+      step = RESOLVING;
+      dnsAnswerAt = now + roundTrip();
+      expected = 0;
+      written = 0;
+      receivedPos = 0;
+      answerAt = UINT64_MAX;
+      return true;
+    }
+
+    Status poll() override {
+      switch (step) {
+        case RESOLVING:
+          if (now >= dnsAnswerAt)
+            step = RESOLVED;
+          return CONNECTING;
+        case RESOLVED:
+          // TCP handshake, then TLS
+          now += roundTrip();
+          if (sessionAt > 0 && now - sessionAt < SESSION_LIFETIME_MICROS) {
+            now += roundTrip() + RESUMED_HANDSHAKE_MICROS;
+            resumed++;
+          }
+          else {
+            now += 2 * roundTrip() + KEY_EXCHANGE_MICROS;
+            sessionAt = now;
+            full++;
+          }
+          step = OPEN;
+          return CONNECTED;
+        case OPEN:
+          return CONNECTED;
+        default:
+          return FAILED;
+      }
+    }
+
+    size_t space() override {
+      return step == OPEN ? 2920 : 0;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      now += tlsMicros(size);
+      if (expected == 0) {
+        head.append((const char*) data, size);
+        size_t headEnd = head.find("\r\n\r\n");
+        const char* lengthHeader = strstr(head.c_str(), "\r\nContent-Length: ");
+        if (headEnd != std::string::npos && lengthHeader != nullptr) {
+          expected = headEnd + 4 + strtoul(lengthHeader + 18, nullptr, 10);
+          head.clear();
+        }
+      }
+      written += size;
+      if (expected > 0 && written >= expected)
+        answerAt = now + roundTrip() + between(50 * MILLI, 500 * MILLI);
+      return size;
+    }
+
+    int read(uint8_t* buffer, size_t size) override {
+      if (now < answerAt)
+        return 0;
+      size_t length = strlen(RESPONSE);
+      if (receivedPos == length)
+        return -1;
+      size_t n = std::min(size, length - receivedPos);
+      memcpy(buffer, RESPONSE + receivedPos, n);
+      receivedPos += n;
+      now += tlsMicros(n);
+      return n;
+    }
+
+    void stop() override {
+      step = IDLE;
+    }
+
+    int full = 0;
+    int resumed = 0;
+
+  private:
+    enum Step { IDLE, RESOLVING, RESOLVED, OPEN } step = IDLE;
+    uint64_t dnsAnswerAt = 0;
+    uint64_t sessionAt = 0;
+    std::string head;
+    size_t expected = 0;
+    size_t written = 0;
+    size_t receivedPos = 0;
+    uint64_t answerAt = UINT64_MAX;
+};
+
+static void formatBatch(AstraBatch& batch, const PublishQueue::Record* records, uint8_t count) {
+  batch.begin();
+  for (uint8_t i = 0; i < count; i++) {
+    batch.beginRow("measurements");
+    batch.add("sensor_id", "81fc94c8-dc84-49bf-9d82-df629b8555c2");
+    batch.add("day", "2026-10-17");
+    batch.add("ts", "2026-10-17T12:34:56Z");
+    batch.add("temp", (int16_t) records[i].values[0] / 10.0, 1);
+    batch.add("humidity", records[i].values[1] / 10.0, 1);
+    batch.add("pm01", (int32_t) records[i].values[2]);
+    batch.add("pm02", (int32_t) records[i].values[3]);
+    batch.add("pm10", (int32_t) records[i].values[4]);
+    batch.add("latitude", 52.237049, 6);
+    batch.add("longitude", 21.017532, 6);
+    batch.endRow();
+  }
+  batch.end();
+  now += count * ROW_FORMAT_MICROS;
+}
+
+/** Sends a batch within begin(), like Publisher did before AstraClient */
+class BlockingSender: public PublishSender {
+  public:
+    bool begin(const PublishQueue::Record* records, uint8_t count) override {
+      AstraBatch batch(body, sizeof(body));
+      formatBatch(batch, records, count);
+      char headBuffer[AstraClient::MAX_HEAD];
+      TextWriter head(headBuffer, sizeof(headBuffer));
+      batch.writeHead(head, HOST, "public", TOKEN);
+      // Blocking DNS, a new TLS session on every connection
+      now += roundTrip();
+      now += 3 * roundTrip() + KEY_EXCHANGE_MICROS;
+      now += tlsMicros(head.length() + batch.length());
+      now += roundTrip() + between(50 * MILLI, 500 * MILLI);
+      now += tlsMicros(strlen(RESPONSE));
+      return true;
+    }
+
+    Status poll(uint32_t nowMillis) override {
+      return STORED;
+    }
+
+  private:
+    char body[3072];
+};
+
+/** Sends a batch with AstraClient, like Publisher */
+class SteppedSender: public PublishSender {
+  public:
+    SteppedSender(): client(transport) {}
+
+    bool begin(const PublishQueue::Record* records, uint8_t count) override {
+      AstraBatch batch(body, sizeof(body));
+      formatBatch(batch, records, count);
+      return client.begin(batch, HOST, "public", TOKEN, (uint32_t) (now / MILLI));
+    }
+
+    Status poll(uint32_t nowMillis) override {
+      switch (client.poll(nowMillis)) {
+        case AstraClient::STORED:
+          return STORED;
+        case AstraClient::FAILED:
+          return FAILED;
+        default:
+          return IN_PROGRESS;
+      }
+    }
+
+    SimulatedTransport transport;
+
+  private:
+    AstraClient client;
+    char body[3072];
+};
+
+struct Result {
+  LatencyHistogram publishing;
+  uint64_t maxMicros = 0;
+  uint32_t overBudget = 0;
+  uint32_t sent = 0;
+  uint32_t failures = 0;
+};
+
+static Result run(PublishSender& sender) {
+  rng.seed(1);
+  now = 0;
+  Result result;
+  SimulatedFlash flash(10);
+  PublishQueue queue(flash);
+  PublishUploader uploader(queue, sender);
+  queue.begin();
+  uint64_t nextReadout = MINUTE;
+  while (now < DAY) {
+    uint64_t start = now;
+    now += between(500, 2000);
+    if (now >= nextReadout) {
+      PublishQueue::Record record;
+      record.time = (uint32_t) (nextReadout / SECOND);
+      record.channels = 5;
+      record.values[0] = 215;
+      record.values[1] = 450;
+      for (uint8_t i = 2; i < 5; i++)
+        record.values[i] = rng() % 100;
+      queue.push(record);
+      nextReadout += MINUTE;
+    }
+    // Counted like WebServer counts the iterations of Publisher::isSending()
+    bool wasSending = uploader.isSending();
+    uploader.loop((uint32_t) (now / MILLI));
+    bool publishing = wasSending || uploader.isSending();
+
+    uint64_t duration = now - start;
+    if (publishing) {
+      result.publishing.record((uint32_t) std::min(duration, (uint64_t) UINT32_MAX));
+      result.maxMicros = std::max(result.maxMicros, duration);
+      if (duration > LOOP_BUDGET_MICROS)
+        result.overBudget++;
+    }
+  }
+  result.sent = uploader.getSentRecords();
+  result.failures = uploader.getFailures();
+  return result;
+}
+
+// Upper bound of a bucket of the histogram in milliseconds
+static std::string formatBound(uint32_t micros) {
+  if (micros == UINT32_MAX)
+    return "inf";
+  char text[16];
+  snprintf(text, sizeof(text), "%g", micros / 1000.0);
+  return text;
+}
+
+static void print(const char* name, const Result& result) {
+  const LatencyHistogram& h = result.publishing;
+  printf("  %-9s %6u iterations, p50 <= %4s ms, p99 <= %4s ms, max %6.1f ms, %3u over %u ms, %u readouts sent\n",
+    name, h.getCount(), formatBound(h.getPercentileMicros(0.5)).c_str(),
+    formatBound(h.getPercentileMicros(0.99)).c_str(), result.maxMicros / 1000.0,
+    result.overBudget, LOOP_BUDGET_MICROS / 1000, result.sent);
+}
+
+int main() {
+  BlockingSender blocking;
+  SteppedSender stepped;
+  printf("iterations of the main loop while publishing, over a day\n");
+  Result before = run(blocking);
+  print("blocking", before);
+  Result after = run(stepped);
+  print("steps", after);
+  printf("TLS handshakes with AstraClient: %d full, %d resumed\n", stepped.transport.full, stepped.transport.resumed);
+
+  bool ok = after.publishing.getPercentileMicros(0.99) <= LOOP_BUDGET_MICROS &&
+    after.failures == 0 && after.sent + PublishUploader::MAX_BATCH >= before.sent;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,439 @@
+/**
+ * Checks that sensor readouts queued for publishing reach the database
+ * through outages and resets, and measures what batching saves.
+ *
+ * Runs the real PublishQueue on a simulated flash of the size used by Main,
+ * drained by the real PublishUploader, which sends batches formatted with
+ * AstraBatch like Publisher, with the real AstraClient over a simulated
+ * connection to a mock of the Astra GraphQL endpoint.
+ * A readout is queued every minute for a week, during which:
+ *
+ *   - every request takes 0.5 to 3 s, the time of a TLS handshake and a round trip,
+ *   - some requests fail with status 503, some with GraphQL errors, and some
+ *     store the rows but the response never arrives, so they are sent again,
+ *   - Wi-Fi is down for 4 hours and Astra for 30 hours, longer than the queue
+ *     can hold, so the oldest readouts are dropped,
+ *   - the device resets about twice a day, some of the time in the middle
+ *     of a flash write or erase.
+ *
+ * Afterwards every queued readout must be stored, except for readouts the
+ * queue reported as dropped, which must be the oldest ones of the long outage.
+ * The queue drops a whole sector at a time, so the first records of the
+ * dropped sector may have been stored just before it was erased.
+ * Storing a readout again is harmless, as Astra overwrites the row.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AstraBatch.h"
+#include "AstraClient.h"
+#include "PublishQueue.h"
+#include "PublishUploader.h"
+
+
+static const uint32_t QUEUE_SECTORS = 10;
+static const uint64_t MINUTE = 60 * 1000;
+static const uint64_t HOUR = 60 * MINUTE;
+static const uint64_t DAY = 24 * HOUR;
+// As long as a real database host and Astra token
+static const char* const HOST = "0b0a4a8e-3c2f-4d4e-9f0a-6b1e2c3d4e5f-europe-west1.apps.astra.datastax.com";
+static const char* const TOKEN =
+  "AstraCS:ZmFrZXRva2VuZmFrZXRva2Vu:0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+static const uint32_t START_TIME = 1792195200;
+
+static std::mt19937 rng;
+static uint64_t now = 0;
+
+static bool chance(double probability) {
+  return std::uniform_real_distribution<double>(0, 1)(rng) < probability;
+}
+
+/** Simulated raw flash, which can be reset during a write or an erase */
+class SimulatedFlash: public LogRingMedium {
+  public:
+    SimulatedFlash(uint32_t sectors):
+        sectors(sectors),
+        data(sectors * PublishQueue::SECTOR_SIZE, 0xFF) {
+    }
+
+    bool begin() override { return true; }
+    uint32_t getSectorCount() const override { return sectors; }
+
+    bool read(uint32_t offset, uint8_t* buffer, size_t size) override {
+      if (offset + size > data.size())
+        return false;
+      memcpy(buffer, data.data() + offset, size);
+      return true;
+    }
+
+    bool write(uint32_t offset, const uint8_t* buffer, size_t size) override {
+      if (reset || offset + size > data.size())
+        return false;
+      size_t n = interrupt() ? rng() % size : size;
+      for (size_t i = 0; i < n; i++)
+        data[offset + i] &= buffer[i];
+      return !reset;
+    }
+
+    bool erase(uint32_t sector) override {
+      if (reset)
+        return false;
+      size_t n = interrupt() ? rng() % PublishQueue::SECTOR_SIZE : PublishQueue::SECTOR_SIZE;
+      memset(data.data() + sector * PublishQueue::SECTOR_SIZE, 0xFF, n);
+      return !reset;
+    }
+
+    // Number of writes and erases until a reset in the middle of one, 0 for none
+    uint32_t operationsUntilReset = 0;
+    bool reset = false;
+
+  private:
+    uint32_t sectors;
+    std::vector<uint8_t> data;
+
+    bool interrupt() {
+      if (operationsUntilReset == 0 || --operationsUntilReset > 0)
+        return false;
+      reset = true;
+      return true;
+    }
+};
+
+/** The GraphQL endpoint of Astra, storing rows by their timestamp */
+class MockAstra {
+  public:
+    std::map<std::string, int> stored;
+    std::map<std::string, uint64_t> storedAt;
+    bool down = false;
+    int requests = 0;
+    int failures = 0;
+    int malformed = 0;
+
+    // Handles a request and returns the response, or an empty string if it never arrives
+    std::string handle(const std::string& request, uint64_t& latency) {
+      requests++;
+      latency = 500 + rng() % 2500;
+      if (down || chance(0.05)) {
+        failures++;
+        return "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+      }
+      size_t headEnd = request.find("\r\n\r\n");
+      std::string head = request.substr(0, headEnd + 2);
+      std::string body = request.substr(headEnd + 4);
+      size_t length = 0;
+      const char* lengthHeader = strstr(head.c_str(), "\r\nContent-Length: ");
+      if (lengthHeader != nullptr)
+        length = strtoul(lengthHeader + 18, nullptr, 10);
+      if (head.compare(0, 31, "POST /api/graphql/public HTTP/1") != 0 ||
+          head.find(std::string("\r\nX-Cassandra-Token: ") + TOKEN + "\r\n") == std::string::npos ||
+          length != body.size() || body.compare(0, 19, "{\"query\":\"mutation{") != 0 ||
+          body.compare(body.size() - 3, 3, "}\"}") != 0) {
+        malformed++;
+        return "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+      }
+      if (chance(0.03)) {
+        failures++;
+        return response("{\"errors\":[{\"message\":\"Unavailable\"}]}");
+      }
+      std::string data = "{\"data\":{";
+      int row = 0;
+      for (size_t pos = body.find(":insertmeasurements("); pos != std::string::npos; pos = body.find(":insertmeasurements(", pos + 1)) {
+        size_t ts = body.find("ts:\\\"", pos);
+        std::string timestamp = body.substr(ts + 5, 20);
+        if (stored[timestamp]++ == 0)
+          storedAt[timestamp] = now + latency;
+        data += (row > 0 ? ",\"r" : "\"r") + std::to_string(row) + "\":{\"applied\":true}";
+        row++;
+      }
+      if (chance(0.02)) {
+        // Stored, but the response never arrives
+        failures++;
+        return "";
+      }
+      return response(data + "}}");
+    }
+
+  private:
+    static std::string response(const std::string& body) {
+      return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+        std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+};
+
+static std::string formatTimestamp(uint32_t time) {
+  time_t t = time;
+  struct tm utc;
+  gmtime_r(&t, &utc);
+  char text[24];
+  strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  return text;
+}
+
+/**
+ * Connection to MockAstra. Connecting takes a round trip, the request is
+ * answered once all of it arrived, after the latency of the mock, and the
+ * response arrives split at random points like TCP segments.
+ */
+class SimulatedSocket: public AstraSocket {
+  public:
+    SimulatedSocket(MockAstra& astra): astra(astra) {}
+
+    bool connect(const char* host, uint16_t port) override {
+      request.clear();
+      received.clear();
+      receivedPos = 0;
+      connectedAt = now + 50;
+      answerAt = UINT64_MAX;
+      open = true;
+      return strcmp(host, HOST) == 0 && port == 443;
+    }
+
+    Status poll() override {
+      return now >= connectedAt ? CONNECTED : CONNECTING;
+    }
+
+    size_t space() override {
+      return now >= connectedAt && answerAt == UINT64_MAX ? 1460 : 0;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      request.append((const char*) data, size);
+      size_t headEnd = request.find("\r\n\r\n");
+      const char* lengthHeader = strstr(request.c_str(), "\r\nContent-Length: ");
+      if (headEnd != std::string::npos && lengthHeader != nullptr &&
+          request.size() >= headEnd + 4 + strtoul(lengthHeader + 18, nullptr, 10)) {
+        uint64_t latency;
+        received = astra.handle(request, latency);
+        answerAt = now + latency;
+        // A lost response leaves the connection open until the client gives up
+        lost = received.empty();
+      }
+      return size;
+    }
+
+    int read(uint8_t* buffer, size_t size) override {
+      if (now < answerAt || lost)
+        return 0;
+      if (receivedPos == received.size())
+        return -1;
+      size_t n = std::min(std::min(size, (size_t) (1 + rng() % 64)), received.size() - receivedPos);
+      memcpy(buffer, received.data() + receivedPos, n);
+      receivedPos += n;
+      return n;
+    }
+
+    void stop() override {
+      open = false;
+    }
+
+    bool open = false;
+
+  private:
+    MockAstra& astra;
+    std::string request;
+    std::string received;
+    size_t receivedPos = 0;
+    uint64_t connectedAt = 0;
+    uint64_t answerAt = UINT64_MAX;
+    bool lost = false;
+};
+
+/** Sends batches like Publisher, over a connection that may be down */
+class SimulatedSender: public PublishSender {
+  public:
+    SimulatedSender(MockAstra& astra): socket(astra), client(socket) {}
+
+    bool begin(const PublishQueue::Record* records, uint8_t count) override {
+      attempts++;
+      if (wifiDown)
+        return false;
+      AstraBatch batch(body, sizeof(body));
+      batch.begin();
+      for (uint8_t i = 0; i < count; i++) {
+        std::string timestamp = formatTimestamp(records[i].time);
+        batch.beginRow("measurements");
+        batch.add("sensor_id", "81fc94c8-dc84-49bf-9d82-df629b8555c2");
+        batch.add("day", timestamp.substr(0, 10).c_str());
+        batch.add("ts", timestamp.c_str());
+        batch.add("temp", (int16_t) records[i].values[0] / 10.0, 1);
+        batch.add("humidity", records[i].values[1] / 10.0, 1);
+        batch.add("pm01", (int32_t) records[i].values[2]);
+        batch.add("pm02", (int32_t) records[i].values[3]);
+        batch.add("pm10", (int32_t) records[i].values[4]);
+        batch.add("latitude", 52.237049, 6);
+        batch.add("longitude", 21.017532, 6);
+        batch.endRow();
+      }
+      batch.end();
+      if (batch.isOverflowed() || !client.begin(batch, HOST, "public", TOKEN, (uint32_t) now)) {
+        overflows++;
+        return false;
+      }
+      largestBody = std::max(largestBody, batch.length());
+      return true;
+    }
+
+    Status poll(uint32_t nowMillis) override {
+      switch (client.poll((uint32_t) now)) {
+        case AstraClient::STORED:
+          return STORED;
+        case AstraClient::FAILED:
+          if (client.getFailedIn() != AstraClient::RECEIVING)
+            unexpectedFailures++;
+          return FAILED;
+        default:
+          return IN_PROGRESS;
+      }
+    }
+
+    bool wifiDown = false;
+    int attempts = 0;
+    int overflows = 0;
+    // Requests that failed before the whole of them was sent
+    int unexpectedFailures = 0;
+    size_t largestBody = 0;
+    SimulatedSocket socket;
+
+  private:
+    AstraClient client;
+    char body[3072];
+};
+
+int main(int argc, char** argv) {
+  const int days = argc > 1 ? atoi(argv[1]) : 7;
+  const double resetsPerDay = argc > 2 ? atof(argv[2]) : 2;
+  rng.seed(1);
+
+  const uint64_t end = days * DAY;
+  const uint64_t wifiOutageStart = DAY + 6 * HOUR, wifiOutageEnd = wifiOutageStart + 4 * HOUR;
+  const uint64_t astraOutageStart = 3 * DAY, astraOutageEnd = astraOutageStart + 30 * HOUR;
+
+  SimulatedFlash flash(QUEUE_SECTORS);
+  MockAstra astra;
+  SimulatedSender sender(astra);
+  std::vector<uint32_t> queued;
+  uint32_t dropped = 0;
+  int resets = 0, tornResets = 0;
+  int outageAttempts[2] = { 0, 0 };
+  std::exponential_distribution<double> resetInterval(resetsPerDay > 0 ? resetsPerDay / DAY : 1.0 / UINT64_MAX);
+
+  uint64_t nextReadout = MINUTE;
+  uint64_t nextReset = resetsPerDay > 0 ? resetInterval(rng) : UINT64_MAX;
+  while (now < end) {
+    // Boot
+    uint64_t bootTime = now;
+    PublishQueue queue(flash);
+    PublishUploader uploader(queue, sender);
+    queue.begin();
+    flash.reset = false;
+
+    while (now < end && !flash.reset) {
+      if (now >= nextReset) {
+        nextReset = resetsPerDay > 0 ? now + resetInterval(rng) : UINT64_MAX;
+        if (chance(0.3)) {
+          // Reset during one of the next flash operations
+          flash.operationsUntilReset = 1 + rng() % 3;
+          tornResets++;
+        }
+        else
+          break;
+      }
+      if (now >= nextReadout) {
+        PublishQueue::Record record;
+        record.time = START_TIME + nextReadout / 1000;
+        record.channels = 5;
+        record.values[0] = (uint16_t) (int16_t) (200 + rng() % 50 - 25);
+        record.values[1] = 400 + rng() % 200;
+        for (uint8_t i = 2; i < 5; i++)
+          record.values[i] = rng() % 100;
+        if (queue.push(record))
+          queued.push_back(record.time);
+        nextReadout += MINUTE;
+      }
+      sender.wifiDown = now >= wifiOutageStart && now < wifiOutageEnd;
+      astra.down = now >= astraOutageStart && now < astraOutageEnd;
+      int attempts = sender.attempts;
+      uploader.loop((uint32_t) (now - bootTime));
+      if (sender.wifiDown)
+        outageAttempts[0] += sender.attempts - attempts;
+      if (astra.down)
+        outageAttempts[1] += sender.attempts - attempts;
+      // The main loop polls a request in progress every few milliseconds
+      now += uploader.isSending() ? 10 : 1000;
+    }
+    dropped += queue.getDropped();
+    if (now < end) {
+      resets++;
+      flash.operationsUntilReset = 0;
+    }
+  }
+  // Drain what's left
+  {
+    PublishQueue queue(flash);
+    PublishUploader uploader(queue, sender);
+    queue.begin();
+    uint64_t drainEnd = now + DAY;
+    while ((queue.getPending() > 0 || uploader.isSending()) && now < drainEnd) {
+      uploader.loop((uint32_t) now);
+      now += uploader.isSending() ? 10 : 1000;
+    }
+    dropped += queue.getDropped();
+  }
+
+  // Compare the stored rows with the queued readouts
+  int lost = 0, duplicates = 0;
+  uint32_t lastLostInOutage = 0, firstStoredInOutage = UINT32_MAX;
+  bool lostOutsideOutage = false;
+  std::vector<double> delays;
+  for (uint32_t time : queued) {
+    std::string timestamp = formatTimestamp(time);
+    auto row = astra.stored.find(timestamp);
+    uint64_t readoutAt = (uint64_t) (time - START_TIME) * 1000;
+    // Readouts waiting for a batch when the outage started may be dropped too
+    bool inOutage = readoutAt + HOUR >= astraOutageStart && readoutAt < astraOutageEnd;
+    if (row == astra.stored.end()) {
+      lost++;
+      if (inOutage)
+        lastLostInOutage = std::max(lastLostInOutage, time);
+      else
+        lostOutsideOutage = true;
+      continue;
+    }
+    duplicates += row->second - 1;
+    // Readouts stored after the outage began were queued with the dropped ones
+    if (astra.storedAt[timestamp] >= astraOutageStart)
+      firstStoredInOutage = std::min(firstStoredInOutage, time);
+    delays.push_back((astra.storedAt[timestamp] - readoutAt) / 60000.0);
+  }
+  std::sort(delays.begin(), delays.end());
+  int successes = astra.requests - astra.failures - astra.malformed;
+
+  printf("%d days, %zu readouts queued, %d resets (%d during a flash write or erase)\n",
+    days, queued.size(), resets, tornResets);
+  printf("queue of %u sectors, %u entries each\n", QUEUE_SECTORS, (unsigned) PublishQueue::ENTRIES_PER_SECTOR);
+  printf("%d attempts, %d requests, %d failed, %d malformed, %.1f readouts per stored batch, largest body %zu B\n",
+    sender.attempts, astra.requests, astra.failures, astra.malformed,
+    successes > 0 ? (double) astra.stored.size() / successes : 0.0, sender.largestBody);
+  printf("4 h Wi-Fi outage: %d attempts; 30 h Astra outage: %d attempts\n", outageAttempts[0], outageAttempts[1]);
+  printf("%zu readouts stored, %d stored again, %d lost, %u dropped by the queue%s\n",
+    astra.stored.size(), duplicates, lost, dropped,
+    lostOutsideOutage ? ", SOME OUTSIDE OF THE OUTAGE" : "");
+  if (!delays.empty())
+    printf("delay until stored: median %.1f min, 90%% %.1f min, max %.0f min\n",
+      delays[delays.size() / 2], delays[delays.size() * 9 / 10], delays.back());
+
+  bool ok = astra.malformed == 0 && sender.overflows == 0 && sender.unexpectedFailures == 0 &&
+    !sender.socket.open && !lostOutsideOutage &&
+    (uint32_t) lost <= dropped &&
+    lastLostInOutage < firstStoredInOutage + PublishQueue::ENTRIES_PER_SECTOR * MINUTE / 1000;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+/**
+ * Benchmarks rendering of the index page.
+ *
+ * Compares the pre-parsed HttpTemplate with the previous approach of reading
+ * the whole page into a string and replacing every placeholder in turn,
+ * both served by HttpServer to a client reading as fast as possible. Both render data/ui/index.html (or the given file)
+ * with the same values and must produce the same page.
+ * Heap use is measured by counting the allocations of operator new.
+ */
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <new>
+#include <string>
+
+#include "HttpServer.h"
+#include "HttpTemplate.h"
+
+
+static size_t allocations = 0;
+static size_t heapUsed = 0;
+static size_t heapPeak = 0;
+
+void* operator new(size_t size) {
+  void* p = malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  allocations++;
+  heapUsed += malloc_usable_size(p);
+  if (heapUsed > heapPeak)
+    heapPeak = heapUsed;
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  if (p == nullptr)
+    return;
+  heapUsed -= malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  operator delete(p);
+}
+
+static const char* const NAMES[] = { "temperature", "humidity", "pm10", "pm2_5", "pm1", "pmready" };
+static const char* const VALUES[] = { "21.50", "45.25", "12", "8", "5", "1" };
+
+/** Template in memory, standing for a file kept open */
+class MemorySource: public HttpTemplate::Source {
+  public:
+    MemorySource(const std::string& data): data(data) {}
+
+    uint32_t size() override {
+      return data.size();
+    }
+
+    size_t read(uint32_t offset, uint8_t* buffer, size_t size) override {
+      if (offset >= data.size())
+        return 0;
+      size_t n = data.size() - offset < size ? data.size() - offset : size;
+      memcpy(buffer, data.data() + offset, n);
+      return n;
+    }
+
+  private:
+    const std::string& data;
+};
+
+class FixedValues: public HttpTemplate::Values {
+  public:
+    void format(uint8_t slot, char* buffer, size_t size) override {
+      snprintf(buffer, size, "%s", VALUES[slot]);
+    }
+};
+
+/** Socket of a client reading as fast as possible */
+class FastSocket: public HttpSocket {
+  public:
+    size_t space() override {
+      return 2920;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      if (keep)
+        received.append((const char*) data, size);
+      bytes += size;
+      return size;
+    }
+
+    void close() override {
+      closed = true;
+    }
+
+    bool keep = false;
+    bool closed = false;
+    size_t bytes = 0;
+    std::string received;
+};
+
+static std::string renderByReplacing(const std::string& page) {
+  std::string content = page;
+  // The order matters, $pm1 is a prefix of $pm10
+  const int order[] = { 0, 1, 2, 3, 4, 5 };
+  for (int slot : order) {
+    std::string placeholder = std::string("$") + NAMES[slot];
+    std::string value = VALUES[slot];
+    for (size_t pos = content.find(placeholder); pos != std::string::npos; pos = content.find(placeholder, pos + value.size()))
+      content.replace(pos, placeholder.size(), value);
+  }
+  return content;
+}
+
+/** Body of a response owning the string it sends, like HttpStringBody */
+class StringBody: public HttpBody {
+  public:
+    StringBody(std::string&& content): content(std::move(content)), body(nullptr, 0) {
+      body = HttpMemoryBody((const uint8_t*) this->content.data(), this->content.size());
+    }
+
+    size_t read(uint8_t* buffer, size_t size) override {
+      return body.read(buffer, size);
+    }
+
+  private:
+    std::string content;
+    HttpMemoryBody body;
+};
+
+static std::string decodeChunked(const std::string& response) {
+  size_t pos = response.find("\r\n\r\n") + 4;
+  std::string body;
+  while (true) {
+    size_t size = strtoul(response.c_str() + pos, nullptr, 16);
+    pos = response.find("\r\n", pos) + 2;
+    if (size == 0)
+      return body;
+    body.append(response, pos, size);
+    pos += size + 2;
+  }
+}
+
+// Serves one request and returns the number of bytes sent
+static size_t serve(HttpServer& server, const char* path, FastSocket& socket, uint32_t& now) {
+  char request[64];
+  int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: sensor\r\nConnection: close\r\n\r\n", path);
+  HttpConnection* connection = server.accept(&socket);
+  connection->receive((const uint8_t*) request, length);
+  while (!socket.closed)
+    server.loop(++now);
+  server.release(connection);
+  return socket.bytes;
+}
+
+int main(int argc, char** argv) {
+  const char* fileName = argc > 1 ? argv[1] : "../../data/ui/index.html";
+  const int requests = argc > 2 ? atoi(argv[2]) : 100000;
+  FILE* file = fopen(fileName, "rb");
+  if (file == nullptr) {
+    perror(fileName);
+    return 1;
+  }
+  std::string page;
+  char buffer[4096];
+  for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) > 0; )
+    page.append(buffer, n);
+  fclose(file);
+
+  MemorySource source(page);
+  FixedValues values;
+  HttpTemplate index;
+  if (!index.parse(source, NAMES, sizeof(NAMES) / sizeof(NAMES[0]))) {
+    fprintf(stderr, "Failed to parse %s\n", fileName);
+    return 1;
+  }
+  HttpServer* server = new HttpServer();
+  server->on("/", [&index, &values](HttpRequest& request, HttpResponse& response) {
+    response.begin(200, "text/html", HttpResponse::CHUNKED);
+    response.setBody<HttpTemplateBody>(index, values);
+  });
+  server->on("/replace", [&page](HttpRequest& request, HttpResponse& response) {
+    std::string content = renderByReplacing(page);
+    response.begin(200, "text/html", content.size());
+    response.setBody<StringBody>(std::move(content));
+  });
+  uint32_t now = 0;
+
+  // Both must render the same page
+  FastSocket check;
+  check.keep = true;
+  serve(*server, "/", check, now);
+  FastSocket replaced;
+  replaced.keep = true;
+  serve(*server, "/replace", replaced, now);
+  std::string expected = replaced.received.substr(replaced.received.find("\r\n\r\n") + 4);
+  bool same = decodeChunked(check.received) == expected;
+
+  size_t baseline = heapUsed;
+  heapPeak = heapUsed;
+  size_t before = allocations;
+  size_t bytes = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < requests; i++) {
+    FastSocket socket;
+    bytes += serve(*server, "/", socket, now);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double templateSeconds = std::chrono::duration<double>(t1 - t0).count();
+  size_t templateAllocations = allocations - before;
+  size_t templatePeak = heapPeak - baseline;
+
+  baseline = heapUsed;
+  heapPeak = heapUsed;
+  before = allocations;
+  size_t replacedBytes = 0;
+  t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < requests; i++) {
+    FastSocket socket;
+    replacedBytes += serve(*server, "/replace", socket, now);
+  }
+  t1 = std::chrono::steady_clock::now();
+  double replaceSeconds = std::chrono::duration<double>(t1 - t0).count();
+  size_t replaceAllocations = allocations - before;
+  size_t replacePeak = heapPeak - baseline;
+
+  printf("%s: %zu B, %u segments, rendered page %s\n", fileName, page.size(), index.getSegmentCount(),
+    same ? "identical" : "DIFFERENT");
+  printf("template: %8.0f requests/s, %.2f allocations/request, %6zu B peak heap, %zu B per response\n",
+    requests / templateSeconds, (double) templateAllocations / requests, templatePeak, bytes / requests);
+  printf("replace:  %8.0f requests/s, %.2f allocations/request, %6zu B peak heap, %zu B per response\n",
+    requests / replaceSeconds, (double) replaceAllocations / requests, replacePeak, replacedBytes / requests);
+  delete server;
+  bool ok = same && templateAllocations == 0;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,321 @@
+#include <set>
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "Storage.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+uint32_t hostMillis = 0;
+
+// The log sources write to the Storage filesystem, which is a RAM disk on the host
+fs::RamFs HostStorage;
+fs::FS& Storage = HostStorage;
+
+bool beginStorage() {
+  return HostStorage.begin();
+}
+
+String::String(double value, unsigned char decimals) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+  s = buffer;
+}
+
+void String::trim() {
+  size_t start = s.find_first_not_of(" \t\r\n");
+  size_t end = s.find_last_not_of(" \t\r\n");
+  s = start == std::string::npos ? "" : s.substr(start, end - start + 1);
+}
+
+String Stream::readString() {
+  std::string text;
+  int c;
+  while ((c = read()) >= 0)
+    text += (char) c;
+  return String(text);
+}
+
+String Stream::readStringUntil(char terminator) {
+  std::string text;
+  int c;
+  while ((c = read()) >= 0 && c != terminator)
+    text += (char) c;
+  return String(text);
+}
+
+void HardwareSerial::printf(const char* format, ...) {
+  if (!enabled)
+    return;
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+}
+
+namespace fs {
+
+struct FileState {
+  RamFs* fs;
+  std::string path;
+  std::shared_ptr<std::vector<uint8_t>> data;
+  size_t pos;
+  bool readable;
+  bool writable;
+  bool append;
+  bool open;
+};
+
+File::operator bool() const {
+  return state && state->open;
+}
+
+size_t File::size() const {
+  return *this ? state->data->size() : 0;
+}
+
+size_t File::position() const {
+  return *this ? state->pos : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!*this)
+    return false;
+  state->fs->stats.seeks++;
+  size_t base = mode == SeekSet ? 0 : mode == SeekCur ? state->pos : state->data->size();
+  if (base + pos > state->data->size())
+    return false;
+  state->pos = base + pos;
+  return true;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  if (!*this || !state->readable)
+    return 0;
+  state->fs->stats.reads++;
+  size_t n = std::min(size, state->data->size() - state->pos);
+  memcpy(buffer, state->data->data() + state->pos, n);
+  state->pos += n;
+  state->fs->stats.bytesRead += n;
+  return n;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::available() {
+  return *this ? state->data->size() - state->pos : 0;
+}
+
+size_t File::write(const uint8_t* data, size_t size) {
+  if (!*this || !state->writable)
+    return 0;
+  RamFs* fs = state->fs;
+  fs->stats.writes++;
+  std::vector<uint8_t>& content = *state->data;
+  if (state->append)
+    state->pos = content.size();
+  size_t end = std::max(content.size(), state->pos + size);
+  if (fs->getUsedBytes() - fs->blocks(content.size()) + fs->blocks(end) > fs->totalBytes)
+    return 0;
+  if (end > content.size())
+    content.resize(end);
+  memcpy(content.data() + state->pos, data, size);
+  state->pos += size;
+  fs->stats.bytesWritten += size;
+  return size;
+}
+
+void File::close() {
+  if (!*this)
+    return;
+  state->fs->stats.closes++;
+  state->open = false;
+}
+
+String File::name() const {
+  return state ? String(state->path) : String();
+}
+
+Dir::Dir(RamFs* fs, std::vector<std::string> names, std::vector<bool> files, std::string path):
+    fs(fs),
+    names(names),
+    files(files),
+    path(path) {
+}
+
+bool Dir::next() {
+  if (index + 1 >= (int) names.size())
+    return false;
+  index++;
+  fs->stats.dirEntries++;
+  return true;
+}
+
+String Dir::fileName() const {
+  return index >= 0 ? String(names[index]) : String();
+}
+
+size_t Dir::fileSize() const {
+  if (index < 0 || !files[index])
+    return 0;
+  const std::vector<uint8_t>* data = fs->getData(fs->listing == RamFs::FLAT ? names[index] : path + names[index]);
+  return data != nullptr ? data->size() : 0;
+}
+
+bool Dir::isFile() const {
+  return index >= 0 && files[index];
+}
+
+bool Dir::isDirectory() const {
+  return index >= 0 && !files[index];
+}
+
+File Dir::openFile(const char* mode) {
+  if (!isFile())
+    return File();
+  return fs->open(fs->listing == RamFs::FLAT ? names[index] : path + names[index], mode);
+}
+
+RamFs::RamFs(size_t totalBytes, Listing listing, size_t blockSize):
+    totalBytes(totalBytes),
+    blockSize(blockSize),
+    listing(listing),
+    mounted(true) {
+}
+
+bool RamFs::begin() {
+  mounted = true;
+  return true;
+}
+
+void RamFs::end() {
+  mounted = false;
+}
+
+bool RamFs::format() {
+  files.clear();
+  return true;
+}
+
+bool RamFs::info(FSInfo& info) {
+  info.totalBytes = totalBytes;
+  info.usedBytes = getUsedBytes();
+  info.blockSize = blockSize;
+  info.pageSize = blockSize;
+  info.maxOpenFiles = 5;
+  info.maxPathLength = 32;
+  return mounted;
+}
+
+File RamFs::open(const String& path, const char* mode) {
+  if (!mounted)
+    return File();
+  if (opensUntilFailure == 0) {
+    opensUntilFailure = -1;
+    return File();
+  }
+  if (opensUntilFailure > 0)
+    opensUntilFailure--;
+  stats.opens++;
+
+  std::string name = path.str();
+  bool read = mode[0] == 'r';
+  bool plus = mode[1] == '+';
+  auto found = files.find(name);
+  if (found == files.end()) {
+    if (read)
+      return File();
+    found = files.emplace(name, std::make_shared<std::vector<uint8_t>>()).first;
+  }
+  if (mode[0] == 'w')
+    found->second->clear();
+
+  auto state = std::make_shared<FileState>();
+  state->fs = this;
+  state->path = name;
+  state->data = found->second;
+  state->pos = 0;
+  state->readable = read || plus;
+  state->writable = !read || plus;
+  state->append = mode[0] == 'a';
+  state->open = true;
+  return File(state);
+}
+
+bool RamFs::exists(const String& path) {
+  return files.count(path.str()) > 0;
+}
+
+bool RamFs::remove(const String& path) {
+  stats.removes++;
+  return files.erase(path.str()) > 0;
+}
+
+bool RamFs::rename(const String& from, const String& to) {
+  stats.renames++;
+  auto found = files.find(from.str());
+  if (found == files.end())
+    return false;
+  files[to.str()] = found->second;
+  files.erase(found);
+  return true;
+}
+
+Dir RamFs::openDir(const String& path) {
+  std::string prefix = path.str();
+  if (listing == HIERARCHICAL && !prefix.empty() && prefix.back() != '/')
+    prefix += '/';
+  std::vector<std::string> names;
+  std::vector<bool> isFile;
+  std::set<std::string> directories;
+  for (auto& file: files) {
+    if (file.first.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    if (listing == FLAT) {
+      names.push_back(file.first);
+      isFile.push_back(true);
+      continue;
+    }
+    std::string rest = file.first.substr(prefix.size());
+    size_t slash = rest.find('/');
+    if (slash == std::string::npos) {
+      names.push_back(rest);
+      isFile.push_back(true);
+    }
+    else if (directories.insert(rest.substr(0, slash)).second) {
+      names.push_back(rest.substr(0, slash));
+      isFile.push_back(false);
+    }
+  }
+  return Dir(this, names, isFile, prefix);
+}
+
+const std::vector<uint8_t>* RamFs::getData(const std::string& path) const {
+  auto found = files.find(path);
+  return found != files.end() ? found->second.get() : nullptr;
+}
+
+std::vector<std::string> RamFs::list() const {
+  std::vector<std::string> names;
+  for (auto& file: files)
+    names.push_back(file.first);
+  return names;
+}
+
+size_t RamFs::getUsedBytes() const {
+  size_t used = 0;
+  for (auto& file: files)
+    used += blocks(file.second->size());
+  return used;
+}
+
+size_t RamFs::blocks(size_t size) const {
+  // Every file takes at least one block for its metadata
+  return (size / blockSize + 1) * blockSize;
+}
+
+}  // namespace fs
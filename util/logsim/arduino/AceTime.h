@@ -0,0 +1,160 @@
+/**
+ * The part of AceTime 1.4 used by the log sources, for time zones with
+ * a fixed offset from UTC. Epoch seconds count from 2000-01-01 00:00:00 UTC
+ * like in AceTime.
+ */
+#ifndef HOST_ACETIME_H
+#define HOST_ACETIME_H
+
+#include <stdint.h>
+
+typedef int32_t acetime_t;
+
+namespace ace_time {
+
+// Seconds between the unix epoch and the AceTime epoch
+static const int32_t SECONDS_TO_AC_EPOCH = 946684800;
+
+/** Time zone with a fixed offset from UTC */
+class TimeZone {
+  public:
+    static TimeZone forUtc() { return TimeZone(0); }
+    static TimeZone forHours(int hours) { return TimeZone(hours * 3600); }
+
+    int32_t getOffsetSeconds() const { return offsetSeconds; }
+
+  private:
+    explicit TimeZone(int32_t offsetSeconds): offsetSeconds(offsetSeconds) {}
+
+    int32_t offsetSeconds;
+};
+
+/** Calendar date and time of day */
+class LocalDateTime {
+  public:
+    static LocalDateTime forEpochSeconds(acetime_t seconds) {
+      LocalDateTime time;
+      int32_t days = floorDiv(seconds, 86400);
+      int32_t rest = seconds - days * 86400;
+      time.fromDays(days + DAYS_TO_AC_EPOCH);
+      time.h = rest / 3600;
+      time.mi = rest / 60 % 60;
+      time.s = rest % 60;
+      return time;
+    }
+
+    static LocalDateTime forUnixSeconds(int32_t seconds) {
+      return forEpochSeconds(seconds - SECONDS_TO_AC_EPOCH);
+    }
+
+    static LocalDateTime forComponents(int16_t year, uint8_t month, uint8_t day,
+                                       uint8_t hour, uint8_t minute, uint8_t second) {
+      LocalDateTime time;
+      time.y = year;
+      time.m = month;
+      time.d = day;
+      time.h = hour;
+      time.mi = minute;
+      time.s = second;
+      time.error = month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 59;
+      return time;
+    }
+
+    acetime_t toEpochSeconds() const {
+      return (toDays() - DAYS_TO_AC_EPOCH) * 86400 + h * 3600 + mi * 60 + s;
+    }
+
+    int32_t toUnixSeconds() const { return toEpochSeconds() + SECONDS_TO_AC_EPOCH; }
+
+    int16_t year() const { return y; }
+    uint8_t month() const { return m; }
+    uint8_t day() const { return d; }
+    uint8_t hour() const { return h; }
+    uint8_t minute() const { return mi; }
+    uint8_t second() const { return s; }
+    bool isError() const { return error; }
+
+  private:
+    // Days between 1970-01-01 and 2000-01-01
+    static const int32_t DAYS_TO_AC_EPOCH = 10957;
+
+    int16_t y = 2000;
+    uint8_t m = 1, d = 1, h = 0, mi = 0, s = 0;
+    bool error = false;
+
+    static int32_t floorDiv(int32_t a, int32_t b) { return a / b - (a % b < 0 ? 1 : 0); }
+
+    // Civil calendar conversions of days since 1970-01-01 (H. Hinnant)
+    int32_t toDays() const {
+      int32_t year = y - (m <= 2 ? 1 : 0);
+      int32_t era = floorDiv(year, 400);
+      int32_t yoe = year - era * 400;
+      int32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+      int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+      return era * 146097 + doe - 719468;
+    }
+
+    void fromDays(int32_t days) {
+      days += 719468;
+      int32_t era = floorDiv(days, 146097);
+      int32_t doe = days - era * 146097;
+      int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+      int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+      int32_t mp = (5 * doy + 2) / 153;
+      d = doy - (153 * mp + 2) / 5 + 1;
+      m = mp < 10 ? mp + 3 : mp - 9;
+      y = yoe + era * 400 + (m <= 2 ? 1 : 0);
+    }
+};
+
+/** Date and time in a time zone */
+class ZonedDateTime {
+  public:
+    static ZonedDateTime forEpochSeconds(acetime_t seconds, const TimeZone& tz) {
+      return ZonedDateTime(LocalDateTime::forEpochSeconds(seconds + tz.getOffsetSeconds()), tz);
+    }
+
+    static ZonedDateTime forUnixSeconds(int32_t seconds, const TimeZone& tz) {
+      return forEpochSeconds(seconds - SECONDS_TO_AC_EPOCH, tz);
+    }
+
+    static ZonedDateTime forComponents(int16_t year, uint8_t month, uint8_t day,
+                                       uint8_t hour, uint8_t minute, uint8_t second, const TimeZone& tz) {
+      return ZonedDateTime(LocalDateTime::forComponents(year, month, day, hour, minute, second), tz);
+    }
+
+    acetime_t toEpochSeconds() const { return local.toEpochSeconds() - tz.getOffsetSeconds(); }
+    int32_t toUnixSeconds() const { return toEpochSeconds() + SECONDS_TO_AC_EPOCH; }
+
+    int16_t year() const { return local.year(); }
+    uint8_t month() const { return local.month(); }
+    uint8_t day() const { return local.day(); }
+    uint8_t hour() const { return local.hour(); }
+    uint8_t minute() const { return local.minute(); }
+    uint8_t second() const { return local.second(); }
+    bool isError() const { return local.isError(); }
+
+  private:
+    ZonedDateTime(const LocalDateTime& local, const TimeZone& tz): local(local), tz(tz) {}
+
+    LocalDateTime local;
+    TimeZone tz;
+};
+
+namespace clock {
+
+/** Source of the current time */
+class Clock {
+  public:
+    // Returned by getNow() while the time is unknown
+    static const acetime_t kInvalidSeconds = INT32_MIN;
+
+    virtual ~Clock() {}
+    virtual acetime_t getNow() const = 0;
+    virtual void setNow(acetime_t) {}
+};
+
+}  // namespace clock
+}  // namespace ace_time
+
+#endif /* HOST_ACETIME_H */
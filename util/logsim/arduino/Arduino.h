@@ -0,0 +1,136 @@
+/**
+ * The part of the Arduino core for the ESP8266 used by the log sources,
+ * so they can be built and checked on the host.
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+typedef uint8_t byte;
+
+using std::min;
+using std::max;
+
+/** Arduino String on top of std::string */
+class String {
+  public:
+    String() {}
+    String(const char* text): s(text != nullptr ? text : "") {}
+    String(const std::string& text): s(text) {}
+    explicit String(char c): s(1, c) {}
+    explicit String(int value): s(std::to_string(value)) {}
+    explicit String(unsigned int value): s(std::to_string(value)) {}
+    explicit String(long value): s(std::to_string(value)) {}
+    explicit String(unsigned long value): s(std::to_string(value)) {}
+    explicit String(double value, unsigned char decimals = 2);
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.size(); }
+    char operator[](unsigned int i) const { return i < s.size() ? s[i] : 0; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+
+    String& operator+=(const String& other) { s += other.s; return *this; }
+    String& operator+=(const char* other) { s += other; return *this; }
+    String& operator+=(char c) { s += c; return *this; }
+    bool concat(const String& other) { s += other.s; return true; }
+
+    bool operator==(const String& other) const { return s == other.s; }
+    bool operator!=(const String& other) const { return s != other.s; }
+    bool operator<(const String& other) const { return s < other.s; }
+    bool operator>(const String& other) const { return s > other.s; }
+    bool operator<=(const String& other) const { return s <= other.s; }
+    bool operator>=(const String& other) const { return s >= other.s; }
+    bool equals(const String& other) const { return s == other.s; }
+
+    bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+    bool endsWith(const String& suffix) const {
+      return s.size() >= suffix.s.size() && s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const { return find(s.find(c, from)); }
+    int indexOf(const String& text, unsigned int from = 0) const { return find(s.find(text.s, from)); }
+    int lastIndexOf(char c) const { return find(s.rfind(c)); }
+    String substring(unsigned int from) const { return from < s.size() ? s.substr(from) : ""; }
+    String substring(unsigned int from, unsigned int to) const {
+      return from < to && from < s.size() ? s.substr(from, to - from) : "";
+    }
+    void trim();
+    long toInt() const { return atol(s.c_str()); }
+    void reserve(unsigned int size) { s.reserve(size); }
+
+    const std::string& str() const { return s; }
+
+  private:
+    std::string s;
+
+    static int find(size_t pos) { return pos == std::string::npos ? -1 : (int) pos; }
+};
+
+inline String operator+(const String& a, const String& b) { return String(a.str() + b.str()); }
+inline String operator+(const String& a, const char* b) { return String(a.str() + b); }
+inline String operator+(const char* a, const String& b) { return String(a + b.str()); }
+inline String operator+(const String& a, char b) { return String(a.str() + b); }
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+/** Stream of bytes, the base of File */
+class Stream {
+  public:
+    virtual ~Stream() {}
+    virtual int read() = 0;
+    virtual int available() = 0;
+    virtual size_t write(const uint8_t* data, size_t size) = 0;
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t print(const String& text) { return write((const uint8_t*) text.c_str(), text.length()); }
+    size_t print(const char* text) { return write((const uint8_t*) text, strlen(text)); }
+    String readString();
+    String readStringUntil(char terminator);
+};
+
+/** Serial port, writing to stdout only when enabled, so checks print just their results */
+class HardwareSerial {
+  public:
+    bool enabled = false;
+
+    void begin(unsigned long) {}
+    template<typename T> void print(const T& value) { if (enabled) out(String(value)); }
+    template<typename T> void println(const T& value) { if (enabled) { out(String(value)); out("\n"); } }
+    void println() { if (enabled) out("\n"); }
+    void printf(const char* format, ...);
+
+  private:
+    void out(const String& text) { fputs(text.c_str(), stdout); }
+};
+
+extern HardwareSerial Serial;
+
+/** Free heap of the device, which the host pretends to have */
+class EspClass {
+  public:
+    uint32_t freeHeap = 40000;
+
+    uint32_t getFreeHeap() const { return freeHeap; }
+    uint32_t getMaxFreeBlockSize() const { return freeHeap; }
+    uint8_t getHeapFragmentation() const { return 0; }
+};
+
+extern EspClass ESP;
+
+// Time since start of the program, which the checks advance themselves
+extern uint32_t hostMillis;
+
+inline unsigned long millis() { return hostMillis; }
+inline unsigned long micros() { return hostMillis * 1000UL; }
+inline void delay(unsigned long ms) { hostMillis += ms; }
+inline void yield() {}
+
+#endif /* HOST_ARDUINO_H */
@@ -0,0 +1,158 @@
+/**
+ * The filesystem API of the ESP8266 Arduino core, implemented by a RAM disk
+ * that counts the calls made to it. The disk lists directories like SPIFFS,
+ * with full names of all files under a prefix, or like LittleFS, with the
+ * names of the entries directly in a directory.
+ */
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+
+namespace fs {
+
+struct FSInfo {
+  size_t totalBytes;
+  size_t usedBytes;
+  size_t blockSize;
+  size_t pageSize;
+  size_t maxOpenFiles;
+  size_t maxPathLength;
+};
+
+/** Calls made to a RamFs, to compare how much work different code does */
+struct FSStats {
+  uint32_t opens = 0;
+  uint32_t closes = 0;
+  uint32_t reads = 0;
+  uint32_t writes = 0;
+  uint32_t seeks = 0;
+  uint32_t removes = 0;
+  uint32_t renames = 0;
+  uint32_t dirEntries = 0;
+  uint64_t bytesRead = 0;
+  uint64_t bytesWritten = 0;
+
+  uint32_t calls() const { return opens + closes + reads + writes + seeks + removes + renames; }
+};
+
+class RamFs;
+struct FileState;
+
+class File: public Stream {
+  public:
+    File() {}
+    File(std::shared_ptr<FileState> state): state(state) {}
+
+    explicit operator bool() const;
+    size_t size() const;
+    size_t position() const;
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t read(uint8_t* buffer, size_t size);
+    int read() override;
+    int available() override;
+    size_t write(const uint8_t* data, size_t size) override;
+    using Stream::write;
+    void flush() {}
+    void close();
+    String name() const;
+    bool isFile() const { return (bool) *this; }
+
+  private:
+    std::shared_ptr<FileState> state;
+};
+
+class Dir {
+  public:
+    Dir() {}
+    Dir(RamFs* fs, std::vector<std::string> names, std::vector<bool> files, std::string path);
+
+    bool next();
+    String fileName() const;
+    size_t fileSize() const;
+    bool isFile() const;
+    bool isDirectory() const;
+    File openFile(const char* mode);
+
+  private:
+    RamFs* fs = nullptr;
+    std::vector<std::string> names;
+    std::vector<bool> files;
+    std::string path;
+    int index = -1;
+};
+
+/** Filesystem API used by the firmware */
+class FS {
+  public:
+    virtual ~FS() {}
+    virtual bool begin() = 0;
+    virtual void end() = 0;
+    virtual bool format() = 0;
+    virtual bool info(FSInfo& info) = 0;
+    virtual File open(const String& path, const char* mode) = 0;
+    virtual bool exists(const String& path) = 0;
+    virtual bool remove(const String& path) = 0;
+    virtual bool rename(const String& from, const String& to) = 0;
+    virtual Dir openDir(const String& path) = 0;
+};
+
+/**
+ * Filesystem in RAM. Every file takes whole blocks of blockSize bytes,
+ * so the used bytes grow like on flash.
+ */
+class RamFs: public FS {
+  public:
+    enum Listing { FLAT, HIERARCHICAL };
+
+    RamFs(size_t totalBytes = 1024 * 1024, Listing listing = FLAT, size_t blockSize = 256);
+
+    bool begin() override;
+    void end() override;
+    bool format() override;
+    bool info(FSInfo& info) override;
+    File open(const String& path, const char* mode) override;
+    bool exists(const String& path) override;
+    bool remove(const String& path) override;
+    bool rename(const String& from, const String& to) override;
+    Dir openDir(const String& path) override;
+
+    void setTotalBytes(size_t totalBytes) { this->totalBytes = totalBytes; }
+    // Contents of a file, nullptr if it doesn't exist
+    const std::vector<uint8_t>* getData(const std::string& path) const;
+    std::vector<std::string> list() const;
+    size_t getUsedBytes() const;
+
+    FSStats stats;
+    // Number of further opens that succeed, the next one fails. Negative for no limit.
+    int opensUntilFailure = -1;
+
+  private:
+    friend class File;
+    friend class Dir;
+
+    size_t totalBytes;
+    size_t blockSize;
+    Listing listing;
+    bool mounted;
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+
+    size_t blocks(size_t size) const;
+};
+
+}  // namespace fs
+
+// The RAM disk behind Storage on the host
+extern fs::RamFs HostStorage;
+
+using fs::FS;
+using fs::File;
+using fs::Dir;
+using fs::FSInfo;
+
+#endif /* HOST_FS_H */
@@ -0,0 +1,94 @@
+/**
+ * Checks Log after a reboot, when the clock isn't set until NTP syncs,
+ * running the real Log sources on a RAM disk.
+ *
+ * A day of records is logged, then the device reboots. The end time of the
+ * log must be restored from the last record in flash by begin(), whether it
+ * runs before the clock is set or after, so logging continues at the same
+ * interval instead of starting over. The last day file is found in a flat
+ * listing like SPIFFS, which has the rollup files too. A last record later
+ * than the set clock is still ignored.
+ *
+ * Records written before the clock is set must be dropped, without a day
+ * file of an invalid date or a change of the end time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <FS.h>
+
+#include "Log.h"
+
+using namespace ace_time;
+
+
+struct TestSchema {
+  static constexpr LogChannel CHANNELS[] = {
+    { "temperature", LogChannelType::INT16, -1 },
+    { "pm2_5", LogChannelType::UINT16, 0 },
+  };
+};
+
+/** Clock set by the test, invalid until then like SystemClockLoop without a backup clock */
+class HostClock: public Clock {
+  public:
+    acetime_t now = kInvalidSeconds;
+    acetime_t getNow() const override { return now; }
+};
+
+static bool expect(bool condition, const char* description) {
+  printf("  %-64s %s\n", description, condition ? "ok" : "FAILED");
+  return condition;
+}
+
+int main() {
+  const int interval = 600;
+  TimeZone tz = TimeZone::forUtc();
+  acetime_t start = LocalDateTime::forComponents(2024, 3, 1, 0, 0, 0).toEpochSeconds();
+  acetime_t last = start + 86400 - interval;
+  {
+    HostClock clock;
+    Log log("/logs/env/", clock, tz);
+    for (acetime_t time = start; time <= last; time += interval) {
+      clock.now = time;
+      log.write(TypedLogRecord<TestSchema>((int16_t) 215, (uint16_t) 12));
+    }
+    log.flush();
+  }
+
+  bool ok = true;
+  {
+    HostClock clock;
+    Log log("/logs/env/", clock, tz);
+    log.begin();
+    ok &= expect(log.getEndTime() == last, "begin() before the clock is set restores the end time");
+  }
+  {
+    HostClock clock;
+    clock.now = last + 300;
+    Log log("/logs/env/", clock, tz);
+    log.begin();
+    ok &= expect(log.getEndTime() == last, "begin() after the clock is set restores the end time");
+  }
+  {
+    HostClock clock;
+    clock.now = last - 86400;
+    Log log("/logs/env/", clock, tz);
+    log.begin();
+    ok &= expect(log.getEndTime() == 0, "begin() ignores a last record later than the clock");
+  }
+  {
+    HostClock clock;
+    Log log("/logs/env/", clock, tz);
+    log.begin();
+    size_t files = HostStorage.list().size();
+    log.write(TypedLogRecord<TestSchema>((int16_t) 215, (uint16_t) 12));
+    log.flush();
+    ok &= expect(log.getPendingCount() == 0 && HostStorage.list().size() == files && log.getEndTime() == last,
+      "records written before the clock is set are dropped");
+  }
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+/**
+ * Checks how Log writes records to day files, running the real Log sources
+ * on a RAM disk.
+ *
+ * Counts the filesystem calls (opens, reads, writes, seeks, closes, ...) made
+ * for N records logged once a minute, including the rollup files, and compares
+ * them with writing every record separately, which takes at least an open,
+ * a write and a close.
+ *
+ * Then fails the write of the pending records at a day change and checks
+ * that they still end up in the file of their own day, not in the next one,
+ * once writing works again.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <FS.h>
+
+#include "Log.h"
+#include "LogScanner.h"
+
+using namespace ace_time;
+
+
+struct TestSchema {
+  static constexpr LogChannel CHANNELS[] = {
+    { "temperature", LogChannelType::INT16, -1 },
+    { "humidity", LogChannelType::INT16, -1 },
+    { "pm10", LogChannelType::UINT16, 0 },
+  };
+};
+
+/** Clock set by the test */
+class HostClock: public Clock {
+  public:
+    acetime_t now = 0;
+    acetime_t getNow() const override { return now; }
+};
+
+// Decodes all records of a file on the RAM disk
+static std::vector<LogEntry> readRecords(const String& fileName) {
+  std::vector<LogEntry> records;
+  const std::vector<uint8_t>* data = HostStorage.getData(fileName.str());
+  if (data == nullptr)
+    return records;
+  LogScanner scanner;
+  scanner.begin(data->data(), data->size(), true);
+  LogEntry entry;
+  while (scanner.next(entry))
+    records.push_back(entry);
+  return records;
+}
+
+static void writeRecord(Log& log, HostClock& clock, acetime_t time, int i) {
+  clock.now = time;
+  hostMillis = time * 1000;
+  log.write(TypedLogRecord<TestSchema>((int16_t) (200 + i % 50), (int16_t) (400 + i % 30), (uint16_t) (i % 100)));
+  log.loop();
+}
+
+// Logs records once a minute and returns the filesystem calls per record
+static bool countCalls(int records) {
+  HostStorage.format();
+  HostStorage.stats = fs::FSStats();
+  HostClock clock;
+  TimeZone tz = TimeZone::forUtc();
+  Log log("/logs/th/", clock, tz);
+  acetime_t start = LocalDateTime::forComponents(2024, 3, 1, 0, 0, 0).toEpochSeconds();
+  for (int i = 0; i < records; i++)
+    writeRecord(log, clock, start + i * 60, i);
+  log.flush();
+
+  const fs::FSStats& stats = HostStorage.stats;
+  uint32_t calls = stats.calls();
+  double perRecord = (double) calls / records;
+  printf("%d records: %u opens, %u writes, %u reads, %u seeks, %u closes, %u B written\n",
+    records, stats.opens, stats.writes, stats.reads, stats.seeks, stats.closes, (uint32_t) stats.bytesWritten);
+  printf("  %.3f filesystem calls per record, %.1f per 1000 records (3 per record written separately)\n",
+    perRecord, perRecord * 1000);
+
+  uint32_t logged = 0;
+  for (const std::string& name : HostStorage.list())
+    if (name.size() == strlen("/logs/th/") + 10)
+      logged += readRecords(String(name)).size();
+  bool ok = logged == (uint32_t) records && log.getRecordsWritten() == (uint32_t) records && perRecord < 1.0;
+  if (logged != (uint32_t) records)
+    printf("  FAILED: %u records in the day files\n", logged);
+  return ok;
+}
+
+// Fails the flush at midnight and checks which files the records go to
+static bool failAtDayChange() {
+  HostStorage.format();
+  HostClock clock;
+  TimeZone tz = TimeZone::forUtc();
+  Log log("/logs/th/", clock, tz);
+  acetime_t midnight = LocalDateTime::forComponents(2024, 3, 2, 0, 0, 0).toEpochSeconds();
+  uint32_t midnightUnix = LocalDateTime::forEpochSeconds(midnight).toUnixSeconds();
+
+  // Four records of the first day stay pending until midnight
+  int i = 0;
+  for (; i < 4; i++)
+    writeRecord(log, clock, midnight - (4 - i) * 60, i);
+  HostStorage.opensUntilFailure = 0;
+  for (; i < 12; i++)
+    writeRecord(log, clock, midnight + (i - 4) * 60, i);
+  log.flush();
+
+  std::vector<LogEntry> first = readRecords("/logs/th/2024-03-01");
+  std::vector<LogEntry> second = readRecords("/logs/th/2024-03-02");
+  int misplaced = 0;
+  for (const LogEntry& entry : first)
+    misplaced += entry.timestamp >= midnightUnix;
+  for (const LogEntry& entry : second)
+    misplaced += entry.timestamp < midnightUnix;
+  printf("Failed flush at the day change: %zu records in the first day, %zu in the second, %d misplaced, %u write errors\n",
+    first.size(), second.size(), misplaced, log.getWriteErrors());
+  return first.size() == 4 && second.size() == 8 && misplaced == 0 && log.getWriteErrors() == 1;
+}
+
+int main(int argc, char** argv) {
+  const int records = argc > 1 ? atoi(argv[1]) : 7 * 1440;
+  bool ok = countCalls(records);
+  ok = failAtDayChange() && ok;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+/**
+ * Measures reading the last 2 hours of a day file with and without the
+ * sparse time index, running the real Log sources on a RAM disk.
+ *
+ * Day files of different sizes are written by Log, with records every 10
+ * minutes up to every 10 seconds. The range is read the way WebServer and
+ * LogQuery read it: the file is opened, seeked to Log::findOffset() or read
+ * from its start, and scanned by LogScanner in chunks of LogBlock::MAX_SIZE.
+ * Both reads must find the same records of the range.
+ *
+ * Reported are the bytes and read calls of each, and the time taken on the
+ * host, which follows the bytes read as flash reads do on the device.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <FS.h>
+
+#include "Log.h"
+#include "LogScanner.h"
+#include "Storage.h"
+
+using namespace ace_time;
+
+
+struct TestSchema {
+  static constexpr LogChannel CHANNELS[] = {
+    { "temperature", LogChannelType::INT16, -1 },
+    { "humidity", LogChannelType::INT16, -1 },
+    { "pm2_5", LogChannelType::UINT16, 0 },
+  };
+};
+
+/** Clock set by the benchmark */
+class HostClock: public Clock {
+  public:
+    acetime_t now = 0;
+    acetime_t getNow() const override { return now; }
+};
+
+struct RangeRead {
+  uint32_t records;
+  uint32_t bytes;
+  uint32_t reads;
+  double micros;
+};
+
+// Reads the records of a day file not older than from, starting at the indexed offset or at 0
+static RangeRead readRange(const String& fileName, uint32_t from, bool indexed) {
+  RangeRead result = { 0, 0, 0, 0 };
+  HostStorage.stats = fs::FSStats();
+  auto t0 = std::chrono::steady_clock::now();
+  uint32_t offset = indexed ? Log::findOffset(fileName, from) : 0;
+  File file = Storage.open(fileName, "r");
+  file.seek(offset, SeekSet);
+  uint8_t chunk[LogBlock::MAX_SIZE];
+  size_t chunkSize = 0;
+  LogScanner scanner;
+  bool final = false;
+  while (!final) {
+    size_t n = file.read(chunk + chunkSize, sizeof(chunk) - chunkSize);
+    chunkSize += n;
+    final = n == 0 || file.position() >= file.size();
+    scanner.begin(chunk, chunkSize, final);
+    LogEntry entry;
+    while (scanner.next(entry))
+      result.records += entry.timestamp >= from;
+    size_t consumed = scanner.getConsumed();
+    memmove(chunk, chunk + consumed, chunkSize - consumed);
+    chunkSize -= consumed;
+  }
+  file.close();
+  auto t1 = std::chrono::steady_clock::now();
+  result.micros = std::chrono::duration<double>(t1 - t0).count() * 1e6;
+  result.bytes = HostStorage.stats.bytesRead;
+  result.reads = HostStorage.stats.reads;
+  return result;
+}
+
+// Median of repeated reads
+static RangeRead measure(const String& fileName, uint32_t from, bool indexed) {
+  std::vector<RangeRead> runs;
+  for (int i = 0; i < 201; i++)
+    runs.push_back(readRange(fileName, from, indexed));
+  std::sort(runs.begin(), runs.end(), [](const RangeRead& a, const RangeRead& b) { return a.micros < b.micros; });
+  return runs[runs.size() / 2];
+}
+
+int main() {
+  const int intervals[] = { 600, 60, 10 };
+  const uint32_t range = 2 * 3600;
+  bool ok = true;
+  printf("%9s %8s | %-30s | %-30s | %s\n", "interval", "file", "whole file", "indexed", "speedup");
+  for (int interval : intervals) {
+    HostStorage.format();
+    HostClock clock;
+    TimeZone tz = TimeZone::forUtc();
+    Log log("/logs/env/", clock, tz);
+    acetime_t start = LocalDateTime::forComponents(2024, 3, 1, 0, 0, 0).toEpochSeconds();
+    acetime_t end = start + 86400 - interval;
+    for (acetime_t time = start; time <= end; time += interval) {
+      clock.now = time;
+      int i = (time - start) / interval;
+      log.write(TypedLogRecord<TestSchema>((int16_t) (200 + i % 40), (int16_t) (450 - i % 25), (uint16_t) (i % 70)));
+    }
+    log.flush();
+
+    String fileName = "/logs/env/2024-03-01";
+    uint32_t from = LocalDateTime::forEpochSeconds(end).toUnixSeconds() - range + interval;
+    RangeRead whole = measure(fileName, from, false);
+    RangeRead indexed = measure(fileName, from, true);
+    bool same = whole.records == indexed.records && whole.records == range / interval;
+    ok = ok && same;
+    printf("%7d s %6zu B | %4u rec %6u B %3u reads %6.1f us | %4u rec %6u B %3u reads %6.1f us | %5.1fx%s\n",
+      interval, HostStorage.getData(fileName.str())->size(),
+      whole.records, whole.bytes, whole.reads, whole.micros,
+      indexed.records, indexed.bytes, indexed.reads, indexed.micros,
+      whole.micros / indexed.micros, same ? "" : " DIFFERENT RECORDS");
+  }
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
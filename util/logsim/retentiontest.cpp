@@ -0,0 +1,109 @@
+/**
+ * Checks that LogRetention never removes log files still being written,
+ * running the real Log and LogRetention sources on a RAM disk.
+ *
+ * A log is written for a few days, then a large file that isn't part of any
+ * log fills the filesystem, so the records of the second half of the last day
+ * can't be written and are still pending after midnight. Retention
+ * must remove the complete days, keep the day with pending records and the
+ * rollups of the current month, and report that it is blocked. Once the
+ * pending records are written, their day is complete and can go too.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <FS.h>
+
+#include "Log.h"
+#include "LogRetention.h"
+#include "Storage.h"
+
+using namespace ace_time;
+
+
+struct TestSchema {
+  static constexpr LogChannel CHANNELS[] = {
+    { "temperature", LogChannelType::INT16, -1 },
+    { "pm2_5", LogChannelType::UINT16, 0 },
+  };
+};
+
+/** Clock set by the test */
+class HostClock: public Clock {
+  public:
+    acetime_t now = 0;
+    acetime_t getNow() const override { return now; }
+};
+
+static void writeRecord(Log& log, HostClock& clock, acetime_t time, int i) {
+  clock.now = time;
+  log.write(TypedLogRecord<TestSchema>((int16_t) (200 + i % 40), (uint16_t) (i % 70)));
+}
+
+int main() {
+  const int interval = 600;
+  const int days = 4;
+  HostStorage.setTotalBytes(64 * 1024);
+  HostClock clock;
+  TimeZone tz = TimeZone::forUtc();
+  Log log("/logs/env/", clock, tz);
+  LogRetention retention(75);
+  retention.add(log);
+  retention.begin();
+
+  acetime_t start = LocalDateTime::forComponents(2024, 3, 1, 0, 0, 0).toEpochSeconds();
+  acetime_t full = start + (days - 1) * 86400 + 12 * 3600;
+  acetime_t midnight = start + days * 86400;
+  int i = 0;
+  for (acetime_t time = start; time < full; time += interval)
+    writeRecord(log, clock, time, i++);
+
+  // Something else takes the rest of the filesystem, so the records of the
+  // last hours of the day can't be written and are still pending at midnight
+  File file = Storage.open("/ui/firmware.bin", "w");
+  std::vector<uint8_t> filler(64 * 1024 - HostStorage.getUsedBytes());
+  file.write(filler.data(), filler.size());
+  file.close();
+  for (acetime_t time = full; time <= midnight; time += interval)
+    writeRecord(log, clock, time, i++);
+
+  for (int step = 0; step < 1000; step++) {
+    hostMillis += 1000;
+    retention.loop();
+  }
+
+  const char* expected[][2] = {
+    { "/logs/env/2024-03-01", "evicted" },
+    { "/logs/env/2024-03-02", "evicted" },
+    { "/logs/env/2024-03-03", "evicted" },
+    { "/logs/env/2024-03-03.idx", "evicted" },
+    { "/logs/env/2024-03-04", "kept" },
+    { "/logs/env/hourly/2024-03", "kept" },
+    { "/logs/env/daily/2024", "kept" },
+  };
+  bool ok = true;
+  for (auto& file : expected) {
+    bool kept = HostStorage.getData(file[0]) != nullptr;
+    bool right = kept == (strcmp(file[1], "kept") == 0);
+    printf("%-26s %-7s %s\n", file[0], kept ? "kept" : "evicted", right ? "" : "WRONG");
+    ok = ok && right;
+  }
+  printf("%u files and %u B evicted, %u B used by the log, %s\n", retention.getEvictedFiles(),
+    retention.getEvictedBytes(), retention.getUsedBytes(0), retention.isBlocked() ? "blocked" : "NOT BLOCKED");
+  ok = ok && retention.isBlocked() && log.getPendingCount() > 0;
+
+  // Once the pending records are written, their day can go too
+  log.flush();
+  for (int step = 0; step < 1000; step++) {
+    hostMillis += 1000;
+    retention.loop();
+  }
+  bool evicted = HostStorage.getData("/logs/env/2024-03-04") == nullptr;
+  printf("After writing the pending records: /logs/env/2024-03-04 %s, %s\n",
+    evicted ? "evicted" : "KEPT", retention.isBlocked() ? "blocked" : "NOT BLOCKED");
+  ok = ok && evicted && retention.isBlocked();
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
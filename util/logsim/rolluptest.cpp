@@ -0,0 +1,119 @@
+/**
+ * Checks the hourly and daily rollups of Log across resets, running the real
+ * Log sources on a RAM disk.
+ *
+ * Records are logged every 10 minutes for several days and the device is
+ * reset in the middle of every day, dropping the Log with its open rollup
+ * buckets. Every rollup file must hold at most one entry per bucket, and
+ * the entry of a day must count all records of the day except the ones
+ * logged after the last hourly save before the reset. The open day is saved
+ * too, at its last full hour.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <map>
+#include <memory>
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <FS.h>
+
+#include "Log.h"
+
+using namespace ace_time;
+
+
+struct TestSchema {
+  static constexpr LogChannel CHANNELS[] = {
+    { "present", LogChannelType::PRESENCE, 0 },
+    { "temperature", LogChannelType::INT16, -1 },
+    { "pm10", LogChannelType::UINT16, 0 },
+  };
+};
+
+/** Clock set by the test */
+class HostClock: public Clock {
+  public:
+    acetime_t now = 0;
+    acetime_t getNow() const override { return now; }
+};
+
+struct Bucket {
+  int entries = 0;
+  uint16_t count = 0;
+};
+
+// Reads the entries of a rollup file by the unix time of their bucket
+static std::map<uint32_t, Bucket> readRollup(const std::string& fileName) {
+  std::map<uint32_t, Bucket> buckets;
+  const std::vector<uint8_t>* data = HostStorage.getData(fileName);
+  if (data == nullptr)
+    return buckets;
+  size_t pos = 0;
+  while (pos < data->size()) {
+    size_t size = LogRollup::entrySize((*data)[pos]);
+    if (pos + size > data->size())
+      break;
+    uint32_t unixTime;
+    uint16_t count;
+    memcpy(&unixTime, data->data() + pos + 1, sizeof(unixTime));
+    memcpy(&count, data->data() + pos + 1 + sizeof(unixTime), sizeof(count));
+    buckets[unixTime].entries++;
+    buckets[unixTime].count = count;
+    pos += size;
+  }
+  return buckets;
+}
+
+int main(int argc, char** argv) {
+  const int days = argc > 1 ? atoi(argv[1]) : 10;
+  const int interval = 600;
+  // The reset comes 25 minutes after the last save at the full hour
+  const int resetSecond = 14 * 3600 + 25 * 60;
+
+  HostClock clock;
+  TimeZone tz = TimeZone::forUtc();
+  std::unique_ptr<Log> log(new Log("/logs/env/", clock, tz));
+  acetime_t start = LocalDateTime::forComponents(2024, 3, 1, 0, 0, 0).toEpochSeconds();
+  int resets = 0;
+  for (acetime_t time = start; time < start + days * 86400; time += interval) {
+    if ((time - start) % 86400 == resetSecond - resetSecond % interval + interval) {
+      // Whatever the Log held in RAM is lost
+      log.reset(new Log("/logs/env/", clock, tz));
+      resets++;
+    }
+    clock.now = time;
+    hostMillis = time * 1000;
+    int i = (time - start) / interval;
+    bool pm = i % 5 != 0;
+    log->write(TypedLogRecord<TestSchema>(LogPresence { (uint16_t) (pm ? 0b111 : 0b011) },
+      (int16_t) (200 + i % 40), (uint16_t) (pm ? i % 90 : 0)));
+  }
+
+  std::map<uint32_t, Bucket> daily = readRollup("/logs/env/daily/2024");
+  std::map<uint32_t, Bucket> hourly = readRollup("/logs/env/hourly/2024-03");
+  int duplicates = 0;
+  for (auto& bucket : daily)
+    duplicates += bucket.second.entries - 1;
+  for (auto& bucket : hourly)
+    duplicates += bucket.second.entries - 1;
+
+  // Records between the last save at 14:00 and the reset are lost
+  const uint16_t perDay = 86400 / interval;
+  const uint16_t lost = (resetSecond % 3600) / interval + 1;
+  // The last day is still open, saved at its last full hour
+  const uint16_t lastDay = perDay - lost - 3600 / interval;
+  int wrongCounts = 0;
+  for (auto& bucket : daily)
+    wrongCounts += bucket.second.count != (&bucket == &*daily.rbegin() ? lastDay : perDay - lost);
+  printf("%d days, %d resets: %zu daily entries, %zu hourly entries, %d duplicate buckets\n",
+    days, resets, daily.size(), hourly.size(), duplicates);
+  printf("Records per day: %u logged, %u expected in the rollup, %d days counted differently\n",
+    perDay, perDay - lost, wrongCounts);
+  // The last hour is still open
+  bool ok = duplicates == 0 && wrongCounts == 0 && (int) daily.size() == days &&
+    (int) hourly.size() == days * 24 - 1;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+/**
+ * Measures the Storage operations of the logs on the host RAM disk, with a
+ * flat listing like SPIFFS and with directories like LittleFS.
+ *
+ * A year of day files with indexes and rollups is written by the real Log
+ * sources, then more records are logged while the time of every write is
+ * recorded. Reported are the p50 and p99 of the time of a write, which
+ * includes the appends of the flushes, the time of listing the directory of
+ * the log and the throughput of reading a whole day file in chunks of
+ * LogBlock::MAX_SIZE, next to the filesystem calls behind them.
+ *
+ * The RAM disk doesn't model the flash, so the times only compare the work
+ * done above it, e.g. a flat listing also goes through the rollup files.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <Arduino.h>
+#include <AceTime.h>
+#include <FS.h>
+
+#include "Log.h"
+#include "LogBlock.h"
+#include "Storage.h"
+
+using namespace ace_time;
+
+
+struct TestSchema {
+  static constexpr LogChannel CHANNELS[] = {
+    { "temperature", LogChannelType::INT16, -1 },
+    { "humidity", LogChannelType::INT16, -1 },
+    { "pm2_5", LogChannelType::UINT16, 0 },
+  };
+};
+
+/** Clock set by the benchmark */
+class HostClock: public Clock {
+  public:
+    acetime_t now = 0;
+    acetime_t getNow() const override { return now; }
+};
+
+static double elapsedMicros(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1e6;
+}
+
+static double percentile(std::vector<double>& values, double p) {
+  std::sort(values.begin(), values.end());
+  return values[(size_t) (p * (values.size() - 1))];
+}
+
+static void writeRecord(Log& log, HostClock& clock, acetime_t time, int i) {
+  clock.now = time;
+  log.write(TypedLogRecord<TestSchema>((int16_t) (200 + i % 40), (int16_t) (450 - i % 25), (uint16_t) (i % 70)));
+}
+
+static bool run(const char* name, fs::RamFs::Listing listing) {
+  const int days = 365;
+  const int interval = 60;
+  HostStorage = fs::RamFs(8 * 1024 * 1024, listing);
+  HostClock clock;
+  TimeZone tz = TimeZone::forUtc();
+  Log log("/logs/env/", clock, tz);
+  acetime_t start = LocalDateTime::forComponents(2023, 3, 1, 0, 0, 0).toEpochSeconds();
+  acetime_t end = start + days * 86400;
+  int i = 0;
+  for (acetime_t time = start; time < end; time += 600)
+    writeRecord(log, clock, time, i++);
+
+  // Appending a day of records every minute
+  std::vector<double> writes;
+  HostStorage.stats = fs::FSStats();
+  for (acetime_t time = end; time < end + 86400; time += interval) {
+    auto t0 = std::chrono::steady_clock::now();
+    writeRecord(log, clock, time, i++);
+    writes.push_back(elapsedMicros(t0));
+  }
+  log.flush();
+  fs::FSStats appendStats = HostStorage.stats;
+
+  // Listing the log directory, as Log and LogRetention do
+  std::vector<double> listings;
+  uint32_t entries = 0;
+  for (int run = 0; run < 51; run++) {
+    HostStorage.stats = fs::FSStats();
+    auto t0 = std::chrono::steady_clock::now();
+    Dir dir = Storage.openDir("/logs/env/");
+    entries = 0;
+    while (dir.next())
+      entries += dir.isFile();
+    listings.push_back(elapsedMicros(t0));
+  }
+  fs::FSStats listStats = HostStorage.stats;
+
+  // Reading the day file of the appends
+  LocalDateTime day = LocalDateTime::forEpochSeconds(end);
+  char fileName[32];
+  snprintf(fileName, sizeof(fileName), "/logs/env/%d-%02d-%02d", day.year(), day.month(), day.day());
+  std::vector<double> reads;
+  size_t fileSize = 0;
+  for (int run = 0; run < 51; run++) {
+    HostStorage.stats = fs::FSStats();
+    auto t0 = std::chrono::steady_clock::now();
+    File file = Storage.open(fileName, "r");
+    uint8_t chunk[LogBlock::MAX_SIZE];
+    fileSize = 0;
+    size_t n;
+    while ((n = file.read(chunk, sizeof(chunk))) > 0)
+      fileSize += n;
+    file.close();
+    reads.push_back(elapsedMicros(t0));
+  }
+  fs::FSStats readStats = HostStorage.stats;
+
+  printf("%-12s append p50 %5.2f us, p99 %6.2f us, %.2f opens per record | "
+    "listing %4u entries %7.1f us, %5u visited | read %6zu B %6.1f us, %6.1f MB/s, %u reads\n",
+    name, percentile(writes, 0.5), percentile(writes, 0.99), (double) appendStats.opens / writes.size(),
+    entries, percentile(listings, 0.5), listStats.dirEntries,
+    fileSize, percentile(reads, 0.5), fileSize / percentile(reads, 0.5), readStats.reads);
+  return fileSize > 0 && entries > 0;
+}
+
+int main() {
+  bool ok = run("flat", fs::RamFs::FLAT);
+  ok = run("directories", fs::RamFs::HIERARCHICAL) && ok;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
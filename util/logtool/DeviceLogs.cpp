@@ -0,0 +1,260 @@
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "DeviceLogs.h"
+#include "LogScanner.h"
+#include "SpiffsImage.h"
+
+namespace fs = std::filesystem;
+
+
+// Layouts of the logs written before schema.json files were introduced
+static const std::map<std::string, std::vector<ChannelSpec>> DEFAULT_SCHEMAS = {
+  { "th", {
+    { "temperature", LogChannelType::INT16, -1 },
+    { "humidity", LogChannelType::INT16, -1 } } },
+  { "pm", {
+    { "pm1", LogChannelType::UINT16, 0 },
+    { "pm2_5", LogChannelType::UINT16, 0 },
+    { "pm10", LogChannelType::UINT16, 0 } } },
+};
+
+static const char* SCHEMA_FILE = "schema.json";
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+  data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+static bool isDayFileName(const std::string& name) {
+  static const char* pattern = "0000-00-00";
+  if (name.size() != strlen(pattern))
+    return false;
+  for (size_t i = 0; i < name.size(); i++) {
+    if (pattern[i] == '0' ? !isdigit((unsigned char) name[i]) : name[i] != pattern[i])
+      return false;
+  }
+  return true;
+}
+
+static std::string dateOf(int64_t unixTime) {
+  time_t time = (time_t) std::max<int64_t>(unixTime, 0);
+  struct tm utc;
+  gmtime_r(&time, &utc);
+  char date[16];
+  strftime(date, sizeof(date), "%Y-%m-%d", &utc);
+  return date;
+}
+
+// Returns the string value of a "key":"value" or the number of a "key":number pair
+static std::string jsonField(const std::string& object, const std::string& key) {
+  size_t pos = object.find("\"" + key + "\"");
+  if (pos == std::string::npos)
+    return "";
+  pos = object.find(':', pos);
+  if (pos == std::string::npos)
+    return "";
+  pos = object.find_first_not_of(" \t\r\n", pos + 1);
+  if (pos == std::string::npos)
+    return "";
+  if (object[pos] == '"') {
+    size_t end = object.find('"', pos + 1);
+    return end == std::string::npos ? "" : object.substr(pos + 1, end - pos - 1);
+  }
+  size_t end = object.find_first_of(",} \t\r\n", pos);
+  return object.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+bool DeviceLogs::parseSchema(const std::string& json, std::vector<ChannelSpec>& channels) {
+  channels.clear();
+  size_t pos = json.find('[');
+  while (pos != std::string::npos) {
+    size_t start = json.find('{', pos);
+    size_t end = json.find('}', start);
+    if (start == std::string::npos || end == std::string::npos)
+      break;
+    std::string object = json.substr(start, end - start + 1);
+    std::string type = jsonField(object, "type");
+    ChannelSpec channel;
+    channel.name = jsonField(object, "name");
+    channel.type = type == "int16" ? LogChannelType::INT16
+      : type == "presence" ? LogChannelType::PRESENCE
+      : LogChannelType::UINT16;
+    channel.scale = atoi(jsonField(object, "scale").c_str());
+    if (channel.name.empty())
+      return false;
+    channels.push_back(channel);
+    pos = end + 1;
+  }
+  return !channels.empty();
+}
+
+bool DeviceLogs::load(const std::string& path, const std::string& defaultLog) {
+  fs::path p(path);
+  name = p.stem().string();
+  std::error_code error;
+  if (fs::is_directory(p, error)) {
+    name = p.filename().empty() ? p.parent_path().filename().string() : p.filename().string();
+    for (auto& entry : fs::recursive_directory_iterator(p, error)) {
+      if (!entry.is_regular_file())
+        continue;
+      std::string fileName = entry.path().filename().string();
+      if (fileName != SCHEMA_FILE && !isDayFileName(fileName))
+        continue;
+      std::vector<uint8_t> data;
+      if (readFile(entry.path().string(), data))
+        addFile(entry.path().generic_string(), std::move(data));
+    }
+    return !files.empty();
+  }
+
+  std::vector<uint8_t> data;
+  if (!readFile(path, data))
+    return false;
+  SpiffsImage image;
+  if (image.parse(data)) {
+    for (auto& file : image.getFiles()) {
+      std::vector<uint8_t> contents = file.second;
+      addFile(file.first, std::move(contents));
+    }
+    return true;
+  }
+
+  // A single day file, possibly with a name not following the convention
+  DayFile file;
+  file.log = defaultLog.empty() ? p.parent_path().filename().string() : defaultLog;
+  file.date = isDayFileName(p.filename().string()) ? p.filename().string() : "";
+  file.data = std::move(data);
+  files.push_back(std::move(file));
+  return true;
+}
+
+void DeviceLogs::addFile(const std::string& path, std::vector<uint8_t>&& data) {
+  fs::path p(path);
+  std::string fileName = p.filename().string();
+  std::string log = p.parent_path().filename().string();
+  if (fileName == SCHEMA_FILE) {
+    std::vector<ChannelSpec> channels;
+    if (parseSchema(std::string(data.begin(), data.end()), channels))
+      schemas[log] = channels;
+  }
+  else if (isDayFileName(fileName)) {
+    DayFile file;
+    file.log = log;
+    file.date = fileName;
+    file.data = std::move(data);
+    files.push_back(std::move(file));
+  }
+}
+
+const std::string& DeviceLogs::getName() const {
+  return name;
+}
+
+size_t DeviceLogs::getFileCount() const {
+  return files.size();
+}
+
+size_t DeviceLogs::getByteCount() const {
+  size_t bytes = 0;
+  for (const DayFile& file : files)
+    bytes += file.data.size();
+  return bytes;
+}
+
+const std::vector<ChannelSpec>& DeviceLogs::getSchema(const std::string& log) const {
+  static const std::vector<ChannelSpec> empty;
+  auto schema = schemas.find(log);
+  if (schema != schemas.end())
+    return schema->second;
+  auto defaultSchema = DEFAULT_SCHEMAS.find(log);
+  return defaultSchema != DEFAULT_SCHEMAS.end() ? defaultSchema->second : empty;
+}
+
+bool DeviceLogs::accepts(const LogFilter& filter, const DayFile& file) const {
+  if (!filter.logs.empty() && filter.logs.count(file.log) == 0)
+    return false;
+  if (file.date.empty())
+    return true;
+  // Day files are named after the local date, which is at most a day off UTC
+  return file.date >= dateOf((int64_t) filter.from - 24 * 3600)
+    && (filter.to == UINT32_MAX || file.date <= dateOf((int64_t) filter.to + 24 * 3600));
+}
+
+std::vector<std::string> DeviceLogs::getChannelNames(const LogFilter& filter) const {
+  std::vector<std::string> names;
+  std::set<std::string> logs;
+  for (const DayFile& file : files) {
+    if (accepts(filter, file))
+      logs.insert(file.log);
+  }
+  for (const std::string& log : logs) {
+    const std::vector<ChannelSpec>& schema = getSchema(log);
+    for (size_t i = 0; i < LogBlock::MAX_CHANNELS; i++) {
+      std::string channel = i < schema.size() ? schema[i].name : log + ".ch" + std::to_string(i);
+      if (i < schema.size() && schema[i].type == LogChannelType::PRESENCE)
+        continue;
+      if (i >= schema.size() && !schema.empty())
+        break;
+      names.push_back(channel);
+    }
+  }
+  return names;
+}
+
+uint32_t DeviceLogs::decode(const LogFilter& filter, uint16_t device, SampleTable& table) const {
+  const std::vector<std::string>& columns = table.getColumns();
+  std::vector<float> row(columns.size());
+  uint32_t corrupt = 0;
+  for (const DayFile& file : files) {
+    if (!accepts(filter, file))
+      continue;
+
+    // Column of every channel of the log, -1 for channels not in the output
+    const std::vector<ChannelSpec>& schema = getSchema(file.log);
+    int column[LogBlock::MAX_CHANNELS];
+    // Dividing by a power of 10 keeps e.g. 198 * 10^-1 at exactly the float nearest to 19.8
+    float multiplier[LogBlock::MAX_CHANNELS];
+    float divisor[LogBlock::MAX_CHANNELS];
+    int presence = -1;
+    for (size_t i = 0; i < LogBlock::MAX_CHANNELS; i++) {
+      std::string channel = i < schema.size() ? schema[i].name : file.log + ".ch" + std::to_string(i);
+      auto found = std::find(columns.begin(), columns.end(), channel);
+      column[i] = found != columns.end() ? (int) (found - columns.begin()) : -1;
+      int scale = i < schema.size() ? schema[i].scale : 0;
+      multiplier[i] = scale > 0 ? powf(10.0f, (float) scale) : 1.0f;
+      divisor[i] = scale < 0 ? powf(10.0f, (float) -scale) : 1.0f;
+      if (i < schema.size() && schema[i].type == LogChannelType::PRESENCE)
+        presence = (int) i;
+    }
+
+    LogScanner scanner;
+    LogEntry entry;
+    scanner.begin(file.data.data(), file.data.size(), true);
+    while (scanner.next(entry)) {
+      if (entry.timestamp < filter.from || entry.timestamp >= filter.to)
+        continue;
+      uint16_t present = presence >= 0 && presence < entry.channels ? entry.values[presence] : UINT16_MAX;
+      std::fill(row.begin(), row.end(), NAN);
+      for (size_t i = 0; i < entry.channels; i++) {
+        if (column[i] < 0 || !(present & (1 << i)))
+          continue;
+        bool isSigned = i < schema.size() && schema[i].type == LogChannelType::INT16;
+        float value = isSigned ? (float) (int16_t) entry.values[i] : (float) entry.values[i];
+        row[column[i]] = value * multiplier[i] / divisor[i];
+      }
+      table.add(device, entry.timestamp, row.data());
+    }
+    corrupt += scanner.getCorruptFrames();
+  }
+  return corrupt;
+}
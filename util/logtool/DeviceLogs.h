@@ -0,0 +1,73 @@
+#ifndef DEVICELOGS_H
+#define DEVICELOGS_H
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "LogSchema.h"
+#include "SampleTable.h"
+
+/** A channel of a log as described by its schema.json */
+struct ChannelSpec {
+  std::string name;
+  LogChannelType type;
+  int scale;
+};
+
+/** Selects the records to extract */
+struct LogFilter {
+  uint32_t from = 0;            // unix time, inclusive
+  uint32_t to = UINT32_MAX;     // unix time, exclusive
+  std::set<std::string> logs;   // e.g. "pm", all logs if empty
+};
+
+/**
+ * Day files of a single device, read from a SPIFFS image, a directory
+ * (e.g. the `unpacked_fs` directory written by util/download_fs.py)
+ * or a single day file.
+ *
+ * Day files are named YYYY-MM-DD and live in the directory of their log,
+ * e.g. `/log/pm/2021-11-25`. Channels are described by `schema.json` of the log.
+ * Logs written before schema files existed get the layout of the firmware
+ * of that time, picked by the log name.
+ */
+class DeviceLogs {
+  public:
+    // Reads the logs from a path. The log of a single day file is the name
+    // of its directory unless defaultLog is given.
+    bool load(const std::string& path, const std::string& defaultLog);
+
+    const std::string& getName() const;
+    size_t getFileCount() const;
+    size_t getByteCount() const;
+
+    // Names of all channels of the logs accepted by the filter
+    std::vector<std::string> getChannelNames(const LogFilter& filter) const;
+
+    // Appends all records accepted by the filter to the table and returns
+    // the number of corrupted fragments skipped
+    uint32_t decode(const LogFilter& filter, uint16_t device, SampleTable& table) const;
+
+    static bool parseSchema(const std::string& json, std::vector<ChannelSpec>& channels);
+
+  private:
+    struct DayFile {
+      std::string log;
+      std::string date;
+      std::vector<uint8_t> data;
+    };
+
+    std::string name;
+    std::vector<DayFile> files;
+    std::map<std::string, std::vector<ChannelSpec>> schemas;
+
+    void addFile(const std::string& path, std::vector<uint8_t>&& data);
+    const std::vector<ChannelSpec>& getSchema(const std::string& log) const;
+    bool accepts(const LogFilter& filter, const DayFile& file) const;
+};
+
+#endif /* DEVICELOGS_H */
@@ -0,0 +1,192 @@
+#include <math.h>
+#include <time.h>
+
+#include <algorithm>
+#include <charconv>
+#include <numeric>
+
+#include "SampleTable.h"
+
+
+SampleTable::SampleTable(const std::vector<std::string>& columns):
+    columns(columns) {
+}
+
+void SampleTable::add(uint16_t device, uint32_t timestamp, const float* row) {
+  devices.push_back(device);
+  timestamps.push_back(timestamp);
+  values.insert(values.end(), row, row + columns.size());
+}
+
+void SampleTable::append(const SampleTable& other) {
+  devices.insert(devices.end(), other.devices.begin(), other.devices.end());
+  timestamps.insert(timestamps.end(), other.timestamps.begin(), other.timestamps.end());
+  values.insert(values.end(), other.values.begin(), other.values.end());
+}
+
+void SampleTable::permute(const std::vector<size_t>& order) {
+  const size_t width = columns.size();
+  std::vector<uint32_t> sortedTimestamps(order.size());
+  std::vector<uint16_t> sortedDevices(order.size());
+  std::vector<float> sortedValues(order.size() * width);
+  for (size_t i = 0; i < order.size(); i++) {
+    sortedTimestamps[i] = timestamps[order[i]];
+    sortedDevices[i] = devices[order[i]];
+    std::copy_n(values.begin() + order[i] * width, width, sortedValues.begin() + i * width);
+  }
+  timestamps.swap(sortedTimestamps);
+  devices.swap(sortedDevices);
+  values.swap(sortedValues);
+}
+
+void SampleTable::sort() {
+  std::vector<size_t> order(timestamps.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return timestamps[a] != timestamps[b] ? timestamps[a] < timestamps[b] : devices[a] < devices[b];
+  });
+
+  // Keep the first row of every device and timestamp, filling its gaps from the duplicates
+  const size_t width = columns.size();
+  std::vector<size_t> unique;
+  unique.reserve(order.size());
+  for (size_t i : order) {
+    if (!unique.empty() && timestamps[unique.back()] == timestamps[i] && devices[unique.back()] == devices[i]) {
+      float* target = values.data() + unique.back() * width;
+      const float* source = values.data() + i * width;
+      for (size_t c = 0; c < width; c++) {
+        if (isnan(target[c]))
+          target[c] = source[c];
+      }
+      continue;
+    }
+    unique.push_back(i);
+  }
+  permute(unique);
+}
+
+void SampleTable::resample(uint32_t seconds) {
+  if (seconds == 0)
+    return;
+  const size_t width = columns.size();
+  std::vector<double> sum(width);
+  std::vector<uint32_t> count(width);
+  std::vector<float> mean(width);
+  SampleTable result(columns);
+
+  // Rows are sorted by time, so rows of a period are contiguous for all devices at once.
+  // Each device has its own accumulators within the period.
+  size_t start = 0;
+  while (start < timestamps.size()) {
+    uint32_t period = timestamps[start] - timestamps[start] % seconds;
+    size_t end = start;
+    while (end < timestamps.size() && timestamps[end] - timestamps[end] % seconds == period)
+      end++;
+    std::vector<uint16_t> periodDevices(devices.begin() + start, devices.begin() + end);
+    std::sort(periodDevices.begin(), periodDevices.end());
+    periodDevices.erase(std::unique(periodDevices.begin(), periodDevices.end()), periodDevices.end());
+    for (uint16_t device : periodDevices) {
+      std::fill(sum.begin(), sum.end(), 0.0);
+      std::fill(count.begin(), count.end(), 0);
+      for (size_t i = start; i < end; i++) {
+        if (devices[i] != device)
+          continue;
+        const float* row = values.data() + i * width;
+        for (size_t c = 0; c < width; c++) {
+          if (!isnan(row[c])) {
+            sum[c] += row[c];
+            count[c]++;
+          }
+        }
+      }
+      for (size_t c = 0; c < width; c++)
+        mean[c] = count[c] > 0 ? (float) (sum[c] / count[c]) : NAN;
+      result.add(device, period, mean.data());
+    }
+    start = end;
+  }
+  timestamps.swap(result.timestamps);
+  devices.swap(result.devices);
+  values.swap(result.values);
+}
+
+size_t SampleTable::getRowCount() const {
+  return timestamps.size();
+}
+
+const std::vector<std::string>& SampleTable::getColumns() const {
+  return columns;
+}
+
+bool SampleTable::writeCsv(FILE* out, const std::vector<std::string>& deviceNames) const {
+  fputs("device,timestamp,time", out);
+  for (const std::string& column : columns)
+    fprintf(out, ",%s", column.c_str());
+  fputc('\n', out);
+
+  const size_t width = columns.size();
+  char line[64 + 16 * 64];
+  char date[16] = "";
+  uint32_t day = UINT32_MAX;
+  for (size_t i = 0; i < timestamps.size(); i++) {
+    // Rows are sorted by time, so the date rarely changes
+    uint32_t timestamp = timestamps[i];
+    if (timestamp / 86400 != day) {
+      day = timestamp / 86400;
+      time_t time = (time_t) day * 86400;
+      struct tm utc;
+      gmtime_r(&time, &utc);
+      strftime(date, sizeof(date), "%Y-%m-%d", &utc);
+    }
+    uint32_t second = timestamp % 86400;
+    int length = snprintf(line, sizeof(line), "%s,%u,%sT%02u:%02u:%02uZ", 
+      deviceNames[devices[i]].c_str(), timestamp, date, second / 3600, second / 60 % 60, second % 60);
+    const float* row = values.data() + i * width;
+    char* end = line + sizeof(line) - 1;
+    for (size_t c = 0; c < width; c++) {
+      char* pos = line + length;
+      if (pos + 32 > end)
+        break;
+      *pos++ = ',';
+      if (!isnan(row[c]))
+        pos = std::to_chars(pos, end, row[c]).ptr;
+      length = (int) (pos - line);
+    }
+    line[length++] = '\n';
+    if (fwrite(line, 1, length, out) != (size_t) length)
+      return false;
+  }
+  return true;
+}
+
+static void writeName(FILE* out, const std::string& name) {
+  uint8_t length = (uint8_t) std::min<size_t>(name.size(), UINT8_MAX);
+  fputc(length, out);
+  fwrite(name.data(), 1, length, out);
+}
+
+bool SampleTable::writeColumnar(FILE* out, const std::vector<std::string>& deviceNames) const {
+  const uint16_t version = 1;
+  const uint16_t deviceCount = (uint16_t) deviceNames.size();
+  const uint16_t columnCount = (uint16_t) columns.size();
+  const uint32_t rowCount = (uint32_t) timestamps.size();
+  fwrite("AMLC", 1, 4, out);
+  fwrite(&version, sizeof(version), 1, out);
+  fwrite(&deviceCount, sizeof(deviceCount), 1, out);
+  fwrite(&columnCount, sizeof(columnCount), 1, out);
+  fwrite(&rowCount, sizeof(rowCount), 1, out);
+  for (const std::string& name : deviceNames)
+    writeName(out, name);
+  for (const std::string& name : columns)
+    writeName(out, name);
+  fwrite(timestamps.data(), sizeof(uint32_t), rowCount, out);
+  fwrite(devices.data(), sizeof(uint16_t), rowCount, out);
+
+  std::vector<float> column(rowCount);
+  for (size_t c = 0; c < columns.size(); c++) {
+    for (size_t i = 0; i < rowCount; i++)
+      column[i] = values[i * columns.size() + c];
+    fwrite(column.data(), sizeof(float), rowCount, out);
+  }
+  return !ferror(out);
+}
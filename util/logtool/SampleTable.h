@@ -0,0 +1,60 @@
+#ifndef SAMPLETABLE_H
+#define SAMPLETABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Samples of many devices and channels, one row per device and timestamp
+ * and one column per channel. Channels missing from a sample are NaN.
+ */
+class SampleTable {
+  public:
+    SampleTable(const std::vector<std::string>& columns);
+
+    // Appends a row. Values must hold one number per column.
+    void add(uint16_t device, uint32_t timestamp, const float* values);
+    void append(const SampleTable& other);
+
+    // Sorts the rows by time and device, merging rows of the same device
+    // and timestamp coming from different logs
+    void sort();
+
+    // Replaces the rows with the mean of every column over consecutive
+    // periods of the given length. Must be called on a sorted table.
+    void resample(uint32_t seconds);
+
+    size_t getRowCount() const;
+    const std::vector<std::string>& getColumns() const;
+
+    bool writeCsv(FILE* out, const std::vector<std::string>& devices) const;
+
+    /**
+     * Writes the table column by column (all numbers little-endian):
+     *
+     *   0..3   "AMLC"
+     *   4..5   format version (1)
+     *   6..7   number of devices d
+     *   8..9   number of channel columns c
+     *   10..13 number of rows n
+     *   14..   d device names and c column names, each prefixed by its length byte
+     *          n u32 unix timestamps
+     *          n u16 device numbers
+     *          c times n f32 values, NaN where missing
+     */
+    bool writeColumnar(FILE* out, const std::vector<std::string>& devices) const;
+
+  private:
+    std::vector<std::string> columns;
+    std::vector<uint32_t> timestamps;
+    std::vector<uint16_t> devices;
+    std::vector<float> values;    // row by row
+
+    void permute(const std::vector<size_t>& order);
+};
+
+#endif /* SAMPLETABLE_H */
@@ -0,0 +1,70 @@
+#include <string.h>
+
+#include "SpiffsImage.h"
+
+
+static uint16_t readUint16(const uint8_t* src) {
+  return (uint16_t) (src[0] | (src[1] << 8));
+}
+
+static uint32_t readUint32(const uint8_t* src) {
+  return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+bool SpiffsImage::parse(const std::vector<uint8_t>& image) {
+  files.clear();
+  if (image.size() < 2 * BLOCK_SIZE || image.size() % BLOCK_SIZE != 0)
+    return false;
+
+  const size_t pagesPerBlock = BLOCK_SIZE / PAGE_SIZE;
+  const size_t lookupPages = (pagesPerBlock * sizeof(uint16_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+  struct Object {
+    std::string name;
+    uint32_t size = UINT32_MAX;
+    std::map<uint16_t, const uint8_t*> pages;
+  };
+  std::map<uint16_t, Object> objects;
+
+  for (size_t block = 0; block < image.size(); block += BLOCK_SIZE) {
+    for (size_t page = lookupPages; page < pagesPerBlock; page++) {
+      const uint8_t* p = image.data() + block + page * PAGE_SIZE;
+      uint16_t id = readUint16(p);
+      uint16_t span = readUint16(p + 2);
+      uint8_t flags = p[4];
+      if ((flags & FLAG_USED) || (flags & FLAG_FINAL) || !(flags & FLAG_DELETED))
+        continue;
+      if (!(flags & FLAG_INDEX)) {
+        if (span != 0)
+          continue;
+        Object& object = objects[id & ~INDEX_ID_FLAG];
+        object.size = readUint32(p + SIZE_OFFSET);
+        object.name.assign((const char*) p + NAME_OFFSET, strnlen((const char*) p + NAME_OFFSET, NAME_LENGTH));
+      }
+      else if (!(id & INDEX_ID_FLAG))
+        objects[id].pages[span] = p + DATA_HEADER_SIZE;
+    }
+  }
+
+  const size_t dataSize = PAGE_SIZE - DATA_HEADER_SIZE;
+  for (auto& entry : objects) {
+    Object& object = entry.second;
+    if (object.name.empty() || object.name[0] != '/')
+      continue;
+    std::vector<uint8_t>& contents = files[object.name];
+    for (auto& page : object.pages) {
+      size_t offset = (size_t) page.first * dataSize;
+      if (object.size != UINT32_MAX && offset >= object.size)
+        break;
+      if (contents.size() < offset + dataSize)
+        contents.resize(offset + dataSize, 0xFF);
+      memcpy(contents.data() + offset, page.second, dataSize);
+    }
+    if (object.size != UINT32_MAX && contents.size() > object.size)
+      contents.resize(object.size);
+  }
+  return !files.empty();
+}
+
+const std::map<std::string, std::vector<uint8_t>>& SpiffsImage::getFiles() const {
+  return files;
+}
@@ -0,0 +1,53 @@
+#ifndef SPIFFSIMAGE_H
+#define SPIFFSIMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Read-only access to the files of a raw SPIFFS image, such as the one
+ * downloaded from the device by `pio run -t downloadfs` (util/download_fs.py).
+ *
+ * Uses the geometry of the ESP8266 Arduino core: 256 B logical pages, 8 kB
+ * logical blocks, 32 B object names and no metadata. Each block begins with
+ * object lookup pages, followed by pages starting with this header:
+ *
+ *   0..1  object id, with the top bit set for object index pages
+ *   2..3  span index (number of the page within the object)
+ *   4     flags, each set by clearing its bit
+ *
+ * Data pages carry PAGE_SIZE - 5 bytes of file contents. The first index page
+ * of an object (span 0) holds the file size at offset 8 and its name
+ * at offset 13. Pages that are unused, not finalized or deleted are ignored,
+ * so files are recovered even from images taken while a file was being written.
+ */
+class SpiffsImage {
+  public:
+    static const size_t PAGE_SIZE = 256;
+    static const size_t BLOCK_SIZE = 8192;
+
+    // Parses an image. Returns false if it doesn't look like a SPIFFS image.
+    bool parse(const std::vector<uint8_t>& image);
+
+    // Contents of all files by their full name, e.g. "/log/pm/2021-11-25"
+    const std::map<std::string, std::vector<uint8_t>>& getFiles() const;
+
+  private:
+    static const size_t DATA_HEADER_SIZE = 5;
+    static const size_t SIZE_OFFSET = 8;
+    static const size_t NAME_OFFSET = 13;
+    static const size_t NAME_LENGTH = 32;
+    static const uint16_t INDEX_ID_FLAG = 0x8000;
+    static const uint8_t FLAG_USED = 1 << 0;
+    static const uint8_t FLAG_FINAL = 1 << 1;
+    static const uint8_t FLAG_INDEX = 1 << 2;
+    static const uint8_t FLAG_DELETED = 1 << 7;
+
+    std::map<std::string, std::vector<uint8_t>> files;
+};
+
+#endif /* SPIFFSIMAGE_H */
@@ -0,0 +1,115 @@
+/**
+ * Measures the bytes per sample of LogBlocks against uncompressed frames.
+ *
+ * Reads the records of a day file of old uncompressed frames, e.g.
+ * src/old.log.dat, and encodes them again as LogBlocks of increasing size:
+ * 6 records are written by a flush of Log, 12 when pending records are
+ * staged in RTC memory, larger blocks would need a longer write-behind or
+ * a rewrite of completed days. Every block must decode back to the records
+ * it was encoded from.
+ *
+ * Reported are the bytes per sample (a record of all channels) of the frames
+ * and the blocks, the compression ratio and the days of history fitting in
+ * 1 MB of flash at the sampling rate of the file, compared with the 4x target.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "LogBlock.h"
+#include "LogScanner.h"
+
+
+static const double TARGET_RATIO = 4.0;
+static const double FLASH_BYTES = 1024 * 1024;
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr)
+    return false;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  fclose(file);
+  return true;
+}
+
+// Encodes records in blocks of at most blockRecords, returns the total size
+// or 0 if the blocks don't decode back to the records
+static size_t encode(const std::vector<LogEntry>& records, size_t blockRecords) {
+  size_t total = 0;
+  uint8_t buffer[LogBlock::MAX_SIZE];
+  size_t i = 0;
+  while (i < records.size()) {
+    uint8_t channels = records[i].channels;
+    LogBlockEncoder encoder(buffer, sizeof(buffer), channels);
+    size_t first = i;
+    while (i < records.size() && i - first < blockRecords && records[i].channels == channels &&
+           encoder.add(records[i].timestamp, records[i].values))
+      i++;
+    size_t size = encoder.finish();
+
+    LogBlockDecoder decoder;
+    if (!decoder.begin(buffer, size) || decoder.getCount() != i - first)
+      return 0;
+    uint32_t timestamp;
+    uint16_t values[LogBlock::MAX_CHANNELS];
+    for (size_t j = first; j < i; j++) {
+      if (!decoder.next(timestamp, values) || timestamp != records[j].timestamp ||
+          memcmp(values, records[j].values, channels * sizeof(uint16_t)) != 0)
+        return 0;
+    }
+    total += size;
+  }
+  return total;
+}
+
+int main(int argc, char** argv) {
+  const char* path = argc > 1 ? argv[1] : "../../src/old.log.dat";
+  std::vector<uint8_t> data;
+  if (!readFile(path, data)) {
+    printf("Cannot read %s\n", path);
+    return 1;
+  }
+  std::vector<LogEntry> records;
+  LogScanner scanner;
+  scanner.begin(data.data(), data.size(), true);
+  LogEntry entry;
+  while (scanner.next(entry))
+    records.push_back(entry);
+  if (records.size() < 2) {
+    printf("No records in %s\n", path);
+    return 1;
+  }
+
+  double days = (records.back().timestamp - records.front().timestamp) / 86400.0;
+  double samplesPerDay = records.size() / days;
+  double frameBytes = (double) data.size() / records.size();
+  printf("%s: %zu samples of %u channels over %.1f days, %.0f samples per day\n",
+    path, records.size(), records[0].channels, days, samplesPerDay);
+  printf("%-22s %6zu B, %5.2f B/sample, %5.1f days in 1 MB\n",
+    "uncompressed frames", data.size(), frameBytes, FLASH_BYTES / (frameBytes * samplesPerDay));
+
+  bool ok = true;
+  const size_t blockSizes[] = { 6, 12, 48, LogBlock::MAX_RECORDS };
+  for (size_t blockRecords : blockSizes) {
+    size_t size = encode(records, blockRecords);
+    ok = ok && size > 0;
+    if (size == 0) {
+      printf("blocks of %3zu records: DECODED DIFFERENTLY\n", blockRecords);
+      continue;
+    }
+    double bytes = (double) size / records.size();
+    double ratio = frameBytes / bytes;
+    char name[32];
+    snprintf(name, sizeof(name), "blocks of %zu records", blockRecords);
+    printf("%-22s %6zu B, %5.2f B/sample, %5.1f days in 1 MB, %.1fx (%s the %.0fx target)\n",
+      name, size, bytes, FLASH_BYTES / (bytes * samplesPerDay), ratio,
+      ratio >= TARGET_RATIO ? "meets" : "misses", TARGET_RATIO);
+  }
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+/**
+ * Benchmarks exporting a month of the combined env log as CSV and NDJSON.
+ *
+ * Day files are generated the way Log writes them, as blocks of up to
+ * 12 records, with the PM channels missing from some records. They are read 
+ * back the way LogQuery reads them for /export.csv and /export.ndjson: 
+ * one chunk of LogBlock::MAX_SIZE bytes at most per read of the response body,
+ * scanned by LogScanner and formatted by LogExport into a response buffer.
+ *
+ * The exported text must match a reference formatting of all decoded records.
+ * Reported are the throughput, the time of a read (for which the main loop 
+ * would be held up) and the heap used by the export, which must be none:
+ * the memory of a query is fixed and allocated once, when it starts.
+ */
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "LogBlock.h"
+#include "LogExport.h"
+#include "LogScanner.h"
+
+
+static size_t allocations = 0;
+static size_t heapUsed = 0;
+static size_t heapPeak = 0;
+
+void* operator new(size_t size) {
+  void* p = malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  allocations++;
+  heapUsed += malloc_usable_size(p);
+  if (heapUsed > heapPeak)
+    heapPeak = heapUsed;
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  if (p == nullptr)
+    return;
+  heapUsed -= malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  operator delete(p);
+}
+
+static const uint8_t CHANNELS = 6;
+static const uint16_t PRESENT_TH = 0b000110;
+static const uint16_t PRESENT_PM = 0b111000;
+static const uint8_t RECORDS_PER_BLOCK = 12;
+// Size of a response buffer left for a chunk of a chunked body
+static const size_t RESPONSE_BUFFER = 512 - 8;
+
+static const LogRows::Channel EXPORTED[] = {
+  { "temperature", 1, LogChannelType::INT16, -1 },
+  { "humidity", 2, LogChannelType::INT16, -1 },
+  { "pm1", 3, LogChannelType::UINT16, 0 },
+  { "pm2_5", 4, LogChannelType::UINT16, 0 },
+  { "pm10", 5, LogChannelType::UINT16, 0 },
+};
+static const uint8_t EXPORTED_COUNT = sizeof(EXPORTED) / sizeof(EXPORTED[0]);
+
+typedef std::vector<uint8_t> DayFile;
+
+static std::vector<DayFile> generateMonth(uint32_t start, uint32_t interval, uint32_t days) {
+  std::mt19937 random(1);
+  std::vector<DayFile> files;
+  int16_t temperature = 215, humidity = 450;
+  uint16_t pm = 10;
+  for (uint32_t day = 0; day < days; day++) {
+    DayFile file;
+    uint32_t dayStart = start + day * 86400;
+    uint32_t time = dayStart;
+    while (time < dayStart + 86400) {
+      uint8_t block[LogBlock::MAX_SIZE];
+      LogBlockEncoder encoder(block, sizeof(block), CHANNELS);
+      for (uint8_t i = 0; i < RECORDS_PER_BLOCK && time < dayStart + 86400; i++, time += interval) {
+        temperature += (int16_t) (random() % 5) - 2;
+        humidity += (int16_t) (random() % 7) - 3;
+        pm = (uint16_t) (pm + random() % 5 > 2 ? pm + random() % 5 - 2 : 0);
+        uint16_t values[CHANNELS] = { 
+          (uint16_t) (PRESENT_TH | (random() % 10 > 0 ? PRESENT_PM : 0)), 
+          (uint16_t) temperature, (uint16_t) humidity, pm, (uint16_t) (pm + 2), (uint16_t) (pm + 5) };
+        encoder.add(time, values);
+      }
+      size_t size = encoder.finish();
+      file.insert(file.end(), block, block + size);
+    }
+    files.push_back(file);
+  }
+  return files;
+}
+
+/** Export of day files read in chunks, like a LogQuery */
+class Export {
+  public:
+    Export(const std::vector<DayFile>& files, LogExport::Format format, uint32_t from, uint32_t to):
+        files(files) {
+      rows.begin(format, from, to, EXPORTED, EXPORTED_COUNT, 0);
+    }
+
+    // Like LogQuery::read(), reads at most one chunk of a file
+    size_t read(char* text, size_t size) {
+      size_t filled = 0;
+      bool chunkRead = false;
+      if (!headerDone) {
+        filled += rows.formatHeader(text, size);
+        headerDone = true;
+      }
+      while (!done && filled + rows.getMaxRowSize() < size) {
+        if (rows.hasRow()) {
+          filled += rows.formatRow(text + filled, size - filled);
+          continue;
+        }
+        if (hasEntry) {
+          if (rows.add(entry))
+            hasEntry = false;
+          continue;
+        }
+        if (scanning) {
+          if (scanner.next(entry)) {
+            hasEntry = true;
+            continue;
+          }
+          size_t consumed = scanner.getConsumed();
+          memmove(chunk, chunk + consumed, chunkSize - consumed);
+          chunkSize -= consumed;
+          scanning = false;
+        }
+        if (chunkRead)
+          break;
+        if (!readChunk())
+          done = true;
+        chunkRead = true;
+      }
+      return filled;
+    }
+
+    bool isDone() const {
+      return done && !rows.hasRow();
+    }
+
+  private:
+    const std::vector<DayFile>& files;
+    LogExport rows;
+    LogScanner scanner;
+    LogEntry entry;
+    size_t file = 0;
+    size_t position = 0;
+    bool headerDone = false;
+    bool hasEntry = false;
+    bool scanning = false;
+    bool done = false;
+    size_t chunkSize = 0;
+    uint8_t chunk[LogBlock::MAX_SIZE];
+
+    bool readChunk() {
+      if (file < files.size() && position == files[file].size()) {
+        file++;
+        position = 0;
+        chunkSize = 0;
+      }
+      if (file == files.size())
+        return false;
+      const DayFile& data = files[file];
+      size_t n = data.size() - position < sizeof(chunk) - chunkSize ? data.size() - position : sizeof(chunk) - chunkSize;
+      memcpy(chunk + chunkSize, data.data() + position, n);
+      position += n;
+      chunkSize += n;
+      scanner.begin(chunk, chunkSize, position == data.size());
+      scanning = true;
+      return true;
+    }
+};
+
+static std::string formatReference(const std::vector<DayFile>& files, bool json, uint32_t from, uint32_t to) {
+  std::string text = json ? "" : "time,temperature,humidity,pm1,pm2_5,pm10\n";
+  char line[256];
+  for (const DayFile& file : files) {
+    LogScanner scanner;
+    scanner.begin(file.data(), file.size(), true);
+    LogEntry entry;
+    while (scanner.next(entry)) {
+      if (entry.timestamp < from || entry.timestamp >= to)
+        continue;
+      bool pm = entry.values[0] & PRESENT_PM;
+      int n = snprintf(line, sizeof(line), json ? "{\"time\":%u,\"temperature\":%.1f,\"humidity\":%.1f" : "%u,%.1f,%.1f", 
+        entry.timestamp, (int16_t) entry.values[1] / 10.0, (int16_t) entry.values[2] / 10.0);
+      for (uint8_t i = 3; i < CHANNELS; i++) {
+        if (json)
+          n += snprintf(line + n, sizeof(line) - n, ",\"%s\":", EXPORTED[i - 1].name);
+        else
+          n += snprintf(line + n, sizeof(line) - n, ",");
+        if (pm)
+          n += snprintf(line + n, sizeof(line) - n, "%u", entry.values[i]);
+        else if (json)
+          n += snprintf(line + n, sizeof(line) - n, "null");
+      }
+      snprintf(line + n, sizeof(line) - n, json ? "}\n" : "\n");
+      text += line;
+    }
+  }
+  return text;
+}
+
+int main(int argc, char** argv) {
+  const uint32_t interval = argc > 1 ? atoi(argv[1]) : 60;
+  const uint32_t days = argc > 2 ? atoi(argv[2]) : 31;
+  const uint32_t start = 1704067200;  // 2024-01-01
+  std::vector<DayFile> files = generateMonth(start, interval, days);
+  size_t logSize = 0;
+  for (const DayFile& file : files)
+    logSize += file.size();
+  // The whole month except for the first and the last hour
+  const uint32_t from = start + 3600, to = start + days * 86400 - 3600;
+  printf("%u days of records every %u s, %zu B of log\n", days, interval, logSize);
+
+  bool ok = true;
+  const char* names[] = { "CSV", "NDJSON" };
+  for (int f = 0; f < 2; f++) {
+    bool json = f == 1;
+    std::string expected = formatReference(files, json, from, to);
+    Export exporter(files, json ? LogExport::Format::NDJSON : LogExport::Format::CSV, from, to);
+    std::string exported;
+    exported.reserve(expected.size());
+    std::vector<double> readTimes;
+    readTimes.reserve(expected.size() / 64);
+    size_t before = allocations;
+    size_t baseline = heapUsed;
+    heapPeak = heapUsed;
+    auto t0 = std::chrono::steady_clock::now();
+    char buffer[RESPONSE_BUFFER];
+    while (!exporter.isDone()) {
+      auto r0 = std::chrono::steady_clock::now();
+      size_t n = exporter.read(buffer, sizeof(buffer));
+      auto r1 = std::chrono::steady_clock::now();
+      readTimes.push_back(std::chrono::duration<double>(r1 - r0).count());
+      exported.append(buffer, n);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    size_t exportAllocations = allocations - before;
+    size_t exportPeak = heapPeak - baseline;
+    std::sort(readTimes.begin(), readTimes.end());
+    double typicalRead = readTimes[readTimes.size() / 2];
+    double slowRead = readTimes[readTimes.size() * 999 / 1000];
+    double seconds = std::chrono::duration<double>(t1 - t0).count();
+    bool same = exported == expected;
+    size_t lines = 0;
+    for (char c : exported)
+      lines += c == '\n';
+    printf("%-6s %6zu lines, %7zu B in %5zu reads of %4.1f us (99.9%% under %4.1f us), %5.1f MB/s, "
+      "%zu allocations, %zu B peak heap (+%zu B query state), %s\n",
+      names[f], lines, exported.size(), readTimes.size(), typicalRead * 1e6, slowRead * 1e6, 
+      exported.size() / seconds / 1e6,
+      exportAllocations, exportPeak, sizeof(Export), same ? "matches" : "DIFFERENT");
+    ok = ok && same && exportAllocations == 0;
+  }
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+/**
+ * Extracts the measurement logs of one or more devices into a single
+ * time-sorted table, written as CSV or as a compact columnar binary file.
+ *
+ * Every input is one device: a SPIFFS image downloaded from the device,
+ * a directory with day files (e.g. an unpacked image) or a single day file.
+ * Run without arguments for the list of options.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DeviceLogs.h"
+#include "SampleTable.h"
+
+
+struct Options {
+  std::vector<std::string> inputs;
+  std::string output;
+  std::string format = "csv";
+  std::string defaultLog;
+  std::vector<std::string> channels;
+  LogFilter filter;
+  uint32_t resample = 0;
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+  bool verbose = false;
+};
+
+static void usage() {
+  fputs(
+    "Usage: logtool [options] <image | directory | day file>...\n"
+    "\n"
+    "Decodes the logs of every input (one input per device) and writes all\n"
+    "records as a single table sorted by time.\n"
+    "\n"
+    "  -o, --output FILE        write to FILE instead of the standard output\n"
+    "  -f, --format FORMAT      csv (default) or columnar\n"
+    "      --from TIME          skip records older than TIME\n"
+    "      --to TIME            skip records from TIME on\n"
+    "      --log NAMES          comma-separated logs to read, e.g. env,pm\n"
+    "      --channels NAMES     comma-separated channels to write, e.g. pm2_5,temperature\n"
+    "      --resample SECONDS   write the mean of every channel over periods of SECONDS\n"
+    "      --default-log NAME   log of day files given directly, e.g. th for old.log.dat\n"
+    "  -j, --jobs N             number of decoding threads\n"
+    "  -v, --verbose            print statistics to the standard error\n"
+    "\n"
+    "TIME is YYYY-MM-DD[THH:MM[:SS]] in UTC or a number of unix seconds.\n",
+    stderr);
+}
+
+static std::vector<std::string> split(const std::string& list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ','))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+static bool parseTime(const char* text, uint32_t& unixTime) {
+  char* end;
+  unsigned long seconds = strtoul(text, &end, 10);
+  if (*end == '\0' && end != text) {
+    unixTime = (uint32_t) seconds;
+    return true;
+  }
+  struct tm utc = {};
+  if (sscanf(text, "%d-%d-%dT%d:%d:%d", &utc.tm_year, &utc.tm_mon, &utc.tm_mday,
+             &utc.tm_hour, &utc.tm_min, &utc.tm_sec) < 3)
+    return false;
+  utc.tm_year -= 1900;
+  utc.tm_mon -= 1;
+  unixTime = (uint32_t) timegm(&utc);
+  return true;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    const char* value = hasValue ? argv[i + 1] : "";
+    if (arg == "-h" || arg == "--help")
+      return false;
+    else if (arg == "-v" || arg == "--verbose")
+      options.verbose = true;
+    else if (arg[0] != '-' || arg == "-")
+      options.inputs.push_back(arg);
+    else if (!hasValue) {
+      fprintf(stderr, "Missing value of %s\n", arg.c_str());
+      return false;
+    }
+    else {
+      i++;
+      if (arg == "-o" || arg == "--output")
+        options.output = value;
+      else if (arg == "-f" || arg == "--format")
+        options.format = value;
+      else if (arg == "--log")
+        for (const std::string& log : split(value))
+          options.filter.logs.insert(log);
+      else if (arg == "--channels")
+        options.channels = split(value);
+      else if (arg == "--default-log")
+        options.defaultLog = value;
+      else if (arg == "--resample")
+        options.resample = (uint32_t) strtoul(value, nullptr, 10);
+      else if (arg == "-j" || arg == "--jobs")
+        options.jobs = std::max(1, atoi(value));
+      else if ((arg == "--from" && parseTime(value, options.filter.from)) ||
+               (arg == "--to" && parseTime(value, options.filter.to)))
+        continue;
+      else {
+        fprintf(stderr, "Invalid option %s %s\n", arg.c_str(), value);
+        return false;
+      }
+    }
+  }
+  if (options.format != "csv" && options.format != "columnar") {
+    fprintf(stderr, "Unknown format %s\n", options.format.c_str());
+    return false;
+  }
+  return !options.inputs.empty();
+}
+
+// Runs task(i) for i in 0..count-1 on the given number of threads
+template<typename Task>
+static void parallelFor(size_t count, unsigned jobs, Task task) {
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (unsigned j = 0; j < std::min<size_t>(jobs, count); j++) {
+    threads.emplace_back([&]() {
+      for (size_t i = next++; i < count; i = next++)
+        task(i);
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    usage();
+    return 2;
+  }
+  auto startTime = std::chrono::steady_clock::now();
+
+  std::vector<DeviceLogs> devices(options.inputs.size());
+  std::vector<char> loaded(options.inputs.size());
+  parallelFor(devices.size(), options.jobs, [&](size_t i) {
+    loaded[i] = devices[i].load(options.inputs[i], options.defaultLog);
+  });
+  std::vector<std::string> deviceNames;
+  std::set<std::string> uniqueNames;
+  for (size_t i = 0; i < devices.size(); i++) {
+    if (!loaded[i]) {
+      fprintf(stderr, "Failed to read logs from %s\n", options.inputs[i].c_str());
+      return 1;
+    }
+    std::string name = devices[i].getName();
+    if (!uniqueNames.insert(name).second)
+      name = options.inputs[i];
+    deviceNames.push_back(name);
+  }
+
+  std::vector<std::string> columns = options.channels;
+  if (columns.empty()) {
+    for (const DeviceLogs& device : devices) {
+      for (const std::string& channel : device.getChannelNames(options.filter))
+        if (std::find(columns.begin(), columns.end(), channel) == columns.end())
+          columns.push_back(channel);
+    }
+  }
+
+  std::vector<SampleTable> tables(devices.size(), SampleTable(columns));
+  std::vector<uint32_t> corrupt(devices.size());
+  parallelFor(devices.size(), options.jobs, [&](size_t i) {
+    corrupt[i] = devices[i].decode(options.filter, (uint16_t) i, tables[i]);
+  });
+  SampleTable table(columns);
+  for (SampleTable& deviceTable : tables) {
+    table.append(deviceTable);
+    deviceTable = SampleTable(columns);
+  }
+  table.sort();
+  size_t recordCount = table.getRowCount();
+  table.resample(options.resample);
+
+  FILE* out = options.output.empty() ? stdout : fopen(options.output.c_str(), "wb");
+  if (out == nullptr) {
+    perror(options.output.c_str());
+    return 1;
+  }
+  static char buffer[1 << 20];
+  setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+  bool written = options.format == "csv"
+    ? table.writeCsv(out, deviceNames)
+    : table.writeColumnar(out, deviceNames);
+  if (fclose(out) != 0 || !written) {
+    fprintf(stderr, "Failed to write the output\n");
+    return 1;
+  }
+
+  if (options.verbose) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    size_t files = 0, bytes = 0;
+    for (size_t i = 0; i < devices.size(); i++) {
+      files += devices[i].getFileCount();
+      bytes += devices[i].getByteCount();
+      if (corrupt[i] > 0)
+        fprintf(stderr, "%s: skipped %u corrupted fragments\n", deviceNames[i].c_str(), corrupt[i]);
+    }
+    fprintf(stderr, "%zu devices, %zu day files, %zu bytes, %zu records, %zu rows written in %.3f s\n",
+      devices.size(), files, bytes, recordCount, table.getRowCount(), seconds);
+  }
+  return 0;
+}
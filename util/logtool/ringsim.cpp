@@ -0,0 +1,246 @@
+/**
+ * Estimates flash wear of the log storage backends by appending the same
+ * simulated stream of combined log records to:
+ *
+ *   - per-day files on SPIFFS, each with a sparse .idx file (the default backend),
+ *   - a LogRing kept in a pre-allocated SPIFFS file,
+ *   - a LogRing in raw flash sectors.
+ *
+ * The raw ring uses the real LogRing code on a simulated flash that counts
+ * programmed bytes and erased sectors. The SPIFFS backends are estimated with
+ * a model of how SPIFFS updates pages (256 B pages, 8 kB blocks):
+ *
+ *   - appended data fills the free space of the last page of the file in place,
+ *     and every new page costs a 5 B page header and a 2 B lookup entry,
+ *   - overwritten data pages are copied to new pages and the old ones deleted,
+ *   - every size or page change rewrites the object index page of the file,
+ *   - a deleted page costs 3 B of flags and lookup updates, and every 31
+ *     deleted pages cost an erase of one 8 kB block during garbage collection.
+ *
+ * Write amplification is reported as programmed and erased bytes of flash
+ * per byte of encoded log data.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "LogBlock.h"
+#include "LogRing.h"
+
+
+struct Wear {
+  uint64_t programmed = 0;
+  uint64_t erased = 0;
+};
+
+/** Simulated raw flash */
+class SimulatedFlash: public LogRingMedium {
+  public:
+    SimulatedFlash(uint32_t sectors):
+        sectors(sectors),
+        data(sectors * LogRing::SECTOR_SIZE, 0xFF) {
+    }
+
+    bool begin() override { return true; }
+    uint32_t getSectorCount() const override { return sectors; }
+
+    bool read(uint32_t offset, uint8_t* buffer, size_t size) override {
+      if (offset + size > data.size())
+        return false;
+      memcpy(buffer, data.data() + offset, size);
+      return true;
+    }
+
+    bool write(uint32_t offset, const uint8_t* buffer, size_t size) override {
+      if (offset + size > data.size())
+        return false;
+      for (size_t i = 0; i < size; i++)
+        data[offset + i] &= buffer[i];
+      wear.programmed += size;
+      return true;
+    }
+
+    bool erase(uint32_t sector) override {
+      memset(data.data() + sector * LogRing::SECTOR_SIZE, 0xFF, LogRing::SECTOR_SIZE);
+      wear.erased += LogRing::SECTOR_SIZE;
+      return true;
+    }
+
+    Wear wear;
+
+  private:
+    uint32_t sectors;
+    std::vector<uint8_t> data;
+};
+
+/** Estimates flash wear of SPIFFS file operations, see the model above */
+class SpiffsModel {
+  public:
+    static const size_t PAGE_SIZE = 256;
+    static const size_t PAGE_DATA = PAGE_SIZE - 5;
+    static const size_t LOOKUP_ENTRY = 2;
+    static const size_t DELETE_COST = 3;
+    static const size_t BLOCK_SIZE = 8192;
+    static const size_t PAGES_PER_GC = BLOCK_SIZE / PAGE_SIZE - 1;
+
+    void create() {
+      program(PAGE_SIZE + LOOKUP_ENTRY);
+    }
+
+    void append(size_t fileSize, size_t size) {
+      size_t free = fileSize % PAGE_DATA == 0 ? 0 : PAGE_DATA - fileSize % PAGE_DATA;
+      size_t inPlace = size < free ? size : free;
+      size_t newPages = (size - inPlace + PAGE_DATA - 1) / PAGE_DATA;
+      program(size + newPages * (PAGE_SIZE - PAGE_DATA + LOOKUP_ENTRY));
+      rewriteIndex();
+    }
+
+    void overwrite(size_t offset, size_t size) {
+      size_t pages = (offset + size - 1) / PAGE_DATA - offset / PAGE_DATA + 1;
+      program(pages * (PAGE_SIZE + LOOKUP_ENTRY));
+      deletePages(pages);
+      rewriteIndex();
+    }
+
+    void remove(size_t fileSize) {
+      deletePages((fileSize + PAGE_DATA - 1) / PAGE_DATA + 1);
+    }
+
+    Wear wear;
+
+  private:
+    size_t deleted = 0;
+
+    void program(size_t bytes) {
+      wear.programmed += bytes;
+    }
+
+    void rewriteIndex() {
+      program(PAGE_SIZE + LOOKUP_ENTRY);
+      deletePages(1);
+    }
+
+    void deletePages(size_t pages) {
+      program(pages * DELETE_COST);
+      deleted += pages;
+      wear.erased += deleted / PAGES_PER_GC * BLOCK_SIZE;
+      deleted %= PAGES_PER_GC;
+    }
+};
+
+/** LogRing medium storing the ring in a SPIFFS file, for the model */
+class SpiffsRingFile: public LogRingMedium {
+  public:
+    SpiffsRingFile(uint32_t sectors): flash(sectors) {}
+
+    bool begin() override { return true; }
+    uint32_t getSectorCount() const override { return flash.getSectorCount(); }
+    bool read(uint32_t offset, uint8_t* buffer, size_t size) override {
+      return flash.read(offset, buffer, size);
+    }
+    bool write(uint32_t offset, const uint8_t* buffer, size_t size) override {
+      model.overwrite(offset, size);
+      return flash.write(offset, buffer, size);
+    }
+    bool erase(uint32_t sector) override {
+      model.overwrite(sector * LogRing::SECTOR_SIZE, LogRing::SECTOR_SIZE);
+      return flash.erase(sector);
+    }
+
+    SpiffsModel model;
+
+  private:
+    SimulatedFlash flash;
+};
+
+static void report(const char* name, const Wear& wear, uint64_t payload) {
+  printf("%-26s %12llu %12llu %10.2f %10.2f\n", name,
+    (unsigned long long) wear.programmed, (unsigned long long) wear.erased,
+    (double) wear.programmed / payload, (double) wear.erased / payload);
+}
+
+int main(int argc, char** argv) {
+  const int days = argc > 1 ? atoi(argv[1]) : 365;
+  const uint32_t sectors = argc > 2 ? atoi(argv[2]) : 64;
+  const int retainedDays = argc > 3 ? atoi(argv[3]) : 60;
+  const int recordsPerFlush = 6;
+  const int recordsPerIndex = 12;
+  const int recordsPerDay = 24 * 6;
+  const uint8_t channels = 6;
+
+  SimulatedFlash flash(sectors);
+  LogRing flashRing(flash);
+  SpiffsRingFile ringFile(sectors);
+  LogRing fileRing(ringFile);
+  flashRing.begin();
+  fileRing.begin();
+  SpiffsModel dayFiles;
+  std::vector<size_t> daySizes;
+
+  std::mt19937 random(1);
+  uint16_t values[channels] = { 0x3F, 200, 400, 10, 15, 20 };
+  uint32_t time = 1609459200;
+  uint64_t payload = 0;
+  uint8_t buffer[LogBlock::MAX_SIZE];
+
+  for (int day = 0; day < days; day++) {
+    size_t daySize = 0;
+    size_t dayIndexSize = 0;
+    int unindexed = 0;
+    dayFiles.create();
+    for (int record = 0; record < recordsPerDay; record += recordsPerFlush) {
+      LogBlockEncoder encoder(buffer, sizeof(buffer), channels);
+      uint32_t firstTime = time;
+      for (int i = 0; i < recordsPerFlush; i++) {
+        values[1] += random() % 5 - 2;
+        values[2] += random() % 5 - 2;
+        values[3] = 10 + random() % 20;
+        values[4] = values[3] + random() % 10;
+        values[5] = values[4] + random() % 10;
+        encoder.add(time, values);
+        time += 600;
+      }
+      size_t size = encoder.finish();
+      payload += size;
+
+      if (!flashRing.append(buffer, size, firstTime) || !fileRing.append(buffer, size, firstTime)) {
+        fprintf(stderr, "Failed to append to the ring\n");
+        return 1;
+      }
+
+      // Log::flush appends the blocks and every INDEX_INTERVAL records an index entry
+      dayFiles.append(daySize, size);
+      if (daySize > 0 && unindexed >= recordsPerIndex) {
+        if (dayIndexSize == 0)
+          dayFiles.create();
+        dayFiles.append(dayIndexSize, 8);
+        dayIndexSize += 8;
+        unindexed = 0;
+      }
+      unindexed += recordsPerFlush;
+      daySize += size;
+    }
+    daySizes.push_back(daySize + dayIndexSize);
+    if ((int) daySizes.size() > retainedDays) {
+      dayFiles.remove(daySizes.front());
+      daySizes.erase(daySizes.begin());
+    }
+  }
+
+  printf("%d days, %llu bytes of log blocks, ring of %u sectors, day files kept for %d days\n\n",
+    days, (unsigned long long) payload, sectors, retainedDays);
+  printf("%-26s %12s %12s %10s %10s\n", "backend", "programmed", "erased", "prog/data", "erase/data");
+  report("day files on SPIFFS", dayFiles.wear, payload);
+  report("ring in a SPIFFS file", ringFile.model.wear, payload);
+  report("ring in raw flash", flash.wear, payload);
+
+  // Sanity check: the raw ring must hold the most recent records
+  uint32_t last = flashRing.getSectorCount() - 1;
+  printf("\nRaw ring holds %u sectors, the oldest starting at %u, the newest at %u\n",
+    flashRing.getSectorCount(), flashRing.getSectorTime(0), flashRing.getSectorTime(last));
+  return 0;
+}
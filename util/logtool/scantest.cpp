@@ -0,0 +1,129 @@
+/**
+ * Checks LogScanner on the log files it must read.
+ *
+ * Decodes a day file of uncompressed frames written by old firmware, e.g.
+ * src/old.log.dat, whole and in small chunks, and checks that every frame
+ * is decoded and none is reported as corrupt. Those frames have no checksum
+ * and keep channel values in their last two bytes.
+ *
+ * Then checks that compressed blocks are still verified by their checksum:
+ * a block with a flipped bit, a torn block and garbage between blocks must
+ * be skipped and counted as corrupt, without losing the blocks around them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "LogBlock.h"
+#include "LogScanner.h"
+
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr)
+    return false;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  fclose(file);
+  return true;
+}
+
+// Scans data in chunks of the given size, like the firmware reads files
+static std::vector<LogEntry> scan(const std::vector<uint8_t>& data, size_t chunkSize, uint32_t& corrupt) {
+  std::vector<LogEntry> records;
+  std::vector<uint8_t> chunk;
+  LogScanner scanner;
+  size_t pos = 0;
+  while (true) {
+    size_t n = chunkSize - chunk.size() < data.size() - pos ? chunkSize - chunk.size() : data.size() - pos;
+    chunk.insert(chunk.end(), data.begin() + pos, data.begin() + pos + n);
+    pos += n;
+    bool final = pos == data.size();
+    scanner.begin(chunk.data(), chunk.size(), final);
+    LogEntry entry;
+    while (scanner.next(entry))
+      records.push_back(entry);
+    chunk.erase(chunk.begin(), chunk.begin() + scanner.getConsumed());
+    if (final)
+      break;
+  }
+  corrupt = scanner.getCorruptFrames();
+  return records;
+}
+
+static bool checkOldFrames(const char* path) {
+  std::vector<uint8_t> data;
+  if (!readFile(path, data)) {
+    printf("Cannot read %s\n", path);
+    return false;
+  }
+  // Count the frames by their length bytes
+  size_t frames = 0;
+  for (size_t pos = 0; pos < data.size(); pos += data[pos] + 1)
+    frames++;
+
+  bool ok = true;
+  const size_t chunkSizes[] = { data.size(), LogBlock::MAX_SIZE, 64 };
+  for (size_t chunkSize : chunkSizes) {
+    uint32_t corrupt;
+    std::vector<LogEntry> records = scan(data, chunkSize, corrupt);
+    bool ordered = true;
+    for (size_t i = 1; i < records.size(); i++)
+      ordered = ordered && records[i].timestamp > records[i - 1].timestamp;
+    printf("%s in chunks of %zu B: %zu frames, %zu records, %u corrupt, %s\n",
+      path, chunkSize, frames, records.size(), corrupt, ordered ? "in order" : "OUT OF ORDER");
+    ok = ok && records.size() == frames && corrupt == 0 && ordered;
+  }
+  return ok;
+}
+
+static size_t appendBlock(std::vector<uint8_t>& data, uint32_t start, int count) {
+  uint8_t buffer[LogBlock::MAX_SIZE];
+  LogBlockEncoder encoder(buffer, sizeof(buffer), 3);
+  for (int i = 0; i < count; i++) {
+    uint16_t values[3] = { (uint16_t) (200 + i % 7), (uint16_t) (400 - i % 5), (uint16_t) (i % 3) };
+    encoder.add(start + i * 600, values);
+  }
+  size_t size = encoder.finish();
+  data.insert(data.end(), buffer, buffer + size);
+  return size;
+}
+
+static bool checkBlocks() {
+  const uint32_t start = 1700000000;
+  std::vector<uint8_t> data;
+  appendBlock(data, start, 6);
+  size_t flipped = data.size();
+  appendBlock(data, start + 6 * 600, 6);
+  data[flipped + LogBlock::HEADER_SIZE + 1] ^= 0x10;
+  appendBlock(data, start + 12 * 600, 6);
+  const uint8_t garbage[] = { 0x0c, 0x00, 0x00, 0x00, 0x00, LogBlock::MARKER, 0xff, 0x12 };
+  data.insert(data.end(), garbage, garbage + sizeof(garbage));
+  appendBlock(data, start + 18 * 600, 6);
+  size_t torn = data.size();
+  appendBlock(data, start + 24 * 600, 6);
+  data.resize(torn + 5);
+
+  bool ok = true;
+  const size_t chunkSizes[] = { data.size(), 64 };
+  for (size_t chunkSize : chunkSizes) {
+    uint32_t corrupt;
+    std::vector<LogEntry> records = scan(data, chunkSize, corrupt);
+    printf("Blocks in chunks of %zu B: %zu records, %u corrupt\n", chunkSize, records.size(), corrupt);
+    ok = ok && records.size() == 18 && corrupt == 3 && records[0].timestamp == start && 
+      records[6].timestamp == start + 12 * 600 && records[12].timestamp == start + 18 * 600;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  const char* oldLog = argc > 1 ? argv[1] : "../../src/old.log.dat";
+  bool ok = checkOldFrames(oldLog);
+  ok = checkBlocks() && ok;
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
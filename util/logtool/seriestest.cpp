@@ -0,0 +1,127 @@
+/**
+ * Checks the downsampling of LogSeries against bucketing by brute force.
+ *
+ * A year of records every 10 minutes is generated with a presence channel,
+ * a signed temperature and a PM channel missing from some of the records.
+ * The records are fed to LogSeries in order, formatting rows whenever it
+ * asks for it, like LogQuery does for /api/series. The rows must match the
+ * min, max and mean computed from all records of every bucket at once, with
+ * nulls for a channel without values and no row for a bucket without records.
+ * The range starts and ends in the middle of buckets and the data has a gap
+ * of two days.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "LogSeries.h"
+
+
+static const uint8_t PRESENCE = 0;
+static const uint8_t TEMPERATURE = 1;
+static const uint8_t PM = 2;
+
+static std::vector<LogEntry> generate(uint32_t start, int days, uint32_t interval) {
+  std::vector<LogEntry> records;
+  uint32_t gap = start + days / 2 * 86400;
+  for (uint32_t time = start; time < start + days * 86400; time += interval) {
+    if (time >= gap && time < gap + 2 * 86400)
+      continue;
+    uint32_t i = (time - start) / interval;
+    LogEntry entry;
+    entry.timestamp = time;
+    entry.channels = 3;
+    // PM is missing from every 7th record and for a whole day every month
+    bool pm = i % 7 != 0 && (time - start) / 86400 % 30 != 3;
+    entry.values[PRESENCE] = pm ? 0b111 : 0b011;
+    entry.values[TEMPERATURE] = (uint16_t) (int16_t) ((int) (i * 37 % 500) - 150);
+    entry.values[PM] = pm ? (uint16_t) (i * 13 % 900) : 0;
+    records.push_back(entry);
+  }
+  return records;
+}
+
+// Formats the rows of the records in [from, to) with LogSeries, without header and footer
+static std::string downsample(const std::vector<LogEntry>& records, uint32_t from, uint32_t to, uint32_t step) {
+  LogSeries::Channel channels[] = {
+    { "temperature", TEMPERATURE, LogChannelType::INT16, -1 },
+    { "pm2_5", PM, LogChannelType::UINT16, 0 },
+  };
+  LogSeries series;
+  series.begin(from, to, step, channels, 2, PRESENCE);
+  std::string rows;
+  char buffer[LogRows::MAX_ROW + 1];
+  for (const LogEntry& entry : records) {
+    while (!series.add(entry))
+      rows.append(buffer, series.formatRow(buffer, sizeof(buffer)));
+  }
+  while (series.hasRow())
+    rows.append(buffer, series.formatRow(buffer, sizeof(buffer)));
+  series.finish();
+  while (series.hasRow())
+    rows.append(buffer, series.formatRow(buffer, sizeof(buffer)));
+  return rows;
+}
+
+// Formats the rows the same way from all values of every bucket
+static std::string bruteForce(const std::vector<LogEntry>& records, uint32_t from, uint32_t to, uint32_t step) {
+  std::map<uint32_t, std::vector<std::vector<long>>> buckets;
+  for (const LogEntry& entry : records) {
+    if (entry.timestamp < from || entry.timestamp >= to)
+      continue;
+    std::vector<std::vector<long>>& values = buckets[from + (entry.timestamp - from) / step * step];
+    values.resize(2);
+    if (entry.values[PRESENCE] & (1 << TEMPERATURE))
+      values[0].push_back((int16_t) entry.values[TEMPERATURE]);
+    if (entry.values[PRESENCE] & (1 << PM))
+      values[1].push_back(entry.values[PM]);
+  }
+  std::string rows;
+  char text[64];
+  for (auto& bucket : buckets) {
+    snprintf(text, sizeof(text), "%s\n[%u", rows.empty() ? "" : ",", bucket.first);
+    rows += text;
+    for (std::vector<long>& values : bucket.second) {
+      if (values.empty()) {
+        rows += ",null,null,null";
+        continue;
+      }
+      long long sum = 0;
+      for (long value : values)
+        sum += value;
+      long long half = values.size() / 2;
+      long mean = (long) ((sum >= 0 ? sum + half : sum - half) / (long long) values.size());
+      snprintf(text, sizeof(text), ",%ld,%ld,%ld",
+        *std::min_element(values.begin(), values.end()), *std::max_element(values.begin(), values.end()), mean);
+      rows += text;
+    }
+    rows += "]";
+  }
+  return rows;
+}
+
+int main() {
+  const uint32_t start = 1672531200;
+  std::vector<LogEntry> records = generate(start, 365, 600);
+  const uint32_t from = records[100].timestamp + 17;
+  const uint32_t to = records[records.size() - 100].timestamp;
+  const uint32_t steps[] = { 600, 3600, 6 * 3600, 7 * 86400 };
+
+  bool ok = true;
+  for (uint32_t step : steps) {
+    std::string rows = downsample(records, from, to, step);
+    std::string expected = bruteForce(records, from, to, step);
+    size_t count = std::count(expected.begin(), expected.end(), '[');
+    bool same = rows == expected;
+    printf("%zu records in buckets of %6u s: %5zu rows, %s\n", records.size(), step, count,
+      same ? "same as brute force" : "DIFFERENT FROM BRUTE FORCE");
+    ok = ok && same && count > 0;
+  }
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
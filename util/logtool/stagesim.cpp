@@ -0,0 +1,182 @@
+/**
+ * Checks that log records staged in RTC memory survive resets.
+ *
+ * Runs the real LogStaging code on a simulated RTC memory, driven the same
+ * way Log drives it: every record is kept in RAM and staged, and all pending
+ * records are flushed to a simulated log file when the staging area is full.
+ * The device is reset at random points, either between two memory writes or
+ * in the middle of one (a torn write), and recovers the staged records at boot.
+ *
+ * Afterwards every staged record must be in the log file exactly once, except
+ * for records staged right before a torn write. Records flushed right before
+ * a reset, but not yet released from staging, are written again after the
+ * reset and are reported as duplicates.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "LogStaging.h"
+
+
+/** Simulated RTC memory, which can be reset after a number of written words */
+class SimulatedRtcMemory: public RtcMemory {
+  public:
+    SimulatedRtcMemory(size_t size): data(size / 4) {}
+
+    bool read(uint32_t offset, uint32_t* buffer, size_t size) override {
+      if (offset + size > data.size() * 4)
+        return false;
+      memcpy(buffer, data.data() + offset / 4, size);
+      return true;
+    }
+
+    bool write(uint32_t offset, const uint32_t* buffer, size_t size) override {
+      if (reset || offset + size > data.size() * 4)
+        return false;
+      for (size_t i = 0; i < size / 4; i++) {
+        if (budget == 0) {
+          reset = true;
+          torn = i > 0;
+          return false;
+        }
+        budget--;
+        data[offset / 4 + i] = buffer[i];
+      }
+      return true;
+    }
+
+    void fill(std::mt19937& random) {
+      for (uint32_t& word : data)
+        word = random();
+    }
+
+    uint64_t budget = UINT64_MAX;
+    bool reset = false;
+    bool torn = false;
+
+  private:
+    std::vector<uint32_t> data;
+};
+
+/** The part of Log using LogStaging */
+class SimulatedLog {
+  public:
+    SimulatedLog(LogStaging& staging, std::vector<uint32_t>& file, uint8_t ringCapacity):
+        staging(staging),
+        file(file),
+        flushCount(staging.getCapacity() < ringCapacity ? staging.getCapacity() : ringCapacity) {
+    }
+
+    uint8_t begin() {
+      LogStaging::Record records[LogStaging::MAX_SLOTS];
+      uint8_t count = staging.recover(records, flushCount);
+      for (uint8_t i = 0; i < count; i++)
+        enqueue(records[i]);
+      return count;
+    }
+
+    bool write(const LogStaging::Record& record) {
+      enqueue(record);
+      bool staged = staging.stage(record);
+      if (pending.size() >= flushCount)
+        flush();
+      return staged;
+    }
+
+    void flush() {
+      for (const LogStaging::Record& record : pending)
+        file.push_back(record.time);
+      staging.release(pending.size());
+      pending.clear();
+    }
+
+  private:
+    LogStaging& staging;
+    std::vector<uint32_t>& file;
+    const uint8_t flushCount;
+    std::deque<LogStaging::Record> pending;
+
+    void enqueue(const LogStaging::Record& record) {
+      if (pending.size() == flushCount) {
+        pending.pop_front();
+        staging.release(1);
+      }
+      pending.push_back(record);
+    }
+};
+
+int main(int argc, char** argv) {
+  const int records = argc > 1 ? atoi(argv[1]) : 1000000;
+  const size_t size = argc > 2 ? atoi(argv[2]) : 384;
+  const int meanWordsBetweenResets = argc > 3 ? atoi(argv[3]) : 500;
+  const uint8_t ringCapacity = 12;
+  const uint8_t channels = 6;
+
+  std::mt19937 random(1);
+  SimulatedRtcMemory memory(size);
+  memory.fill(random);
+  std::vector<uint32_t> file;
+  std::map<uint32_t, bool> staged;
+  int resets = 0, tornWrites = 0, recovered = 0;
+
+  int next = 0;
+  while (next < records) {
+    memory.budget = random() % (2 * meanWordsBetweenResets);
+    LogStaging staging(memory, 0, size);
+    SimulatedLog log(staging, file, ringCapacity);
+    recovered += log.begin();
+
+    while (next < records && !memory.reset) {
+      LogStaging::Record record;
+      record.time = 1000 + next * 600;
+      record.channels = channels;
+      for (uint8_t i = 0; i < channels; i++)
+        record.values[i] = random();
+      if (log.write(record))
+        staged[record.time] = true;
+      next++;
+    }
+    if (!memory.reset) {
+      log.flush();
+      break;
+    }
+    resets++;
+    tornWrites += memory.torn;
+    memory.reset = false;
+    memory.torn = false;
+  }
+
+  // Compare the file with the staged records
+  std::map<uint32_t, int> written;
+  bool ordered = true;
+  uint32_t last = 0;
+  for (uint32_t time : file) {
+    if (written[time]++ > 0)
+      continue;
+    ordered = ordered && time > last;
+    last = time;
+  }
+  int lost = 0, duplicates = 0;
+  for (const auto& entry : staged)
+    if (written.count(entry.first) == 0)
+      lost++;
+  for (const auto& entry : written)
+    duplicates += entry.second - 1;
+
+  printf("%d records of %d channels, %zu B of RTC memory (%u slots)\n",
+    records, channels, size, LogStaging(memory, 0, size).getCapacity());
+  printf("%d resets, %d during a write, %d records recovered\n", resets, tornWrites, recovered);
+  printf("%zu records staged, %d lost, %d written twice, %s\n",
+    staged.size(), lost, duplicates, ordered ? "in order" : "OUT OF ORDER");
+
+  // A torn write may lose up to a full staging area, a clean reset nothing
+  bool ok = ordered && lost <= tornWrites * LogStaging(memory, 0, size).getCapacity();
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}